@@ -273,6 +273,10 @@ struct BuildSettings
     size_t       maxStateSize       = 0;
     int          optimisationLevel  = -1;
     int32_t      sessionID          = 0;
+    uint32_t     maxRenderThreads   = 0;
+    uint32_t     processorBatchSize = 1;
+    uint32_t     inlineSizeBudget   = 0;
+    bool         useFastMaths       = false;
     std::string  mainProcessor;
     SourceFiles  overrideStandardLibrary;
 
@@ -74,6 +74,21 @@ struct Parameter  : public RefCountedBase
 
     /** Returns the names of all the annotations on the SOUL stream. */
     virtual Span<const char*> getPropertyNames() const = 0;
+
+    /** Schedules a change to this parameter's value at a particular frame, for sample-accurate
+        automation. The frame index uses the same timeline as the frameIndex values that
+        PatchPlayer::handleOutgoingEvents() provides, i.e. the number of frames that the player
+        has rendered since it was created.
+        If the parameter is a stream, its value ramps linearly from the previous point to reach
+        the new value at this frame, otherwise it jumps to the new value at this frame. A point
+        whose frame has already been rendered is applied at the start of the next block.
+        The value is clamped and quantised in the same way as for setValue().
+        Points for each parameter must be added in time order. This doesn't lock or allocate,
+        so it can be called from the audio thread or from a host thread, but only one thread
+        at a time may add automation points to a player's parameters. Returns false if the
+        player's automation queue is full.
+    */
+    virtual bool addAutomationPoint (uint64_t frameIndex, float newValue) = 0;
 };
 
 //==============================================================================
@@ -208,6 +223,13 @@ public:
         unspecified time in the future (probably the start of the next block that
         gets processed). The available handles for input event endpoinst are obtained
         with a call to getInputEventEndpoints().
+        This may be called from any number of threads at once. The first 16 threads to
+        send events each get their own queue, so they don't block each other or the audio
+        thread, but any further threads share a queue which is protected by a spin lock.
+        Events sent from the same thread are delivered in the order they were sent, and an
+        event that's sent while a block is being rendered is delivered at the start of the
+        next block. Returns false if the handle isn't valid, or if the event couldn't be
+        queued because the sending thread's queue is full.
     */
     virtual bool sendInputEvent (EndpointHandle inputEndpointHandle,
                                  const choc::value::ValueView& event) = 0;
@@ -0,0 +1,2190 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul::bytecode
+{
+
+using interpreter::CompiledProcessor;
+using interpreter::alignSlotSize;
+
+//==============================================================================
+/**
+    The position-independent form of a compiled function.
+
+    Every word of code which refers to something outside the function is listed as a
+    relocation, so that an image can be stored in a LinkerCache and relocated by another
+    performer which links the same program.
+*/
+struct FunctionImage
+{
+    enum class RelocationType  : uint32_t
+    {
+        opCode,             // the word is an OpCode
+        constant,           // the word is an offset into the function's constant data
+        external,           // the word is the index of an external variable
+        function,           // the word is the ID of the function being called
+        unsizedArraySizes,  // the word is replaced by the address of the UnsizedArraySizes
+
+        numTypes
+    };
+
+    struct Relocation
+    {
+        uint32_t position;
+        RelocationType type;
+    };
+
+    std::string name;
+    std::vector<interpreter::EntryPoint::Parameter> parameters;
+    uint32_t frameSize = 0, returnValueOffset = 0, returnValueSize = 0;
+    std::vector<Word> code;
+    std::vector<Relocation> relocations;
+    std::vector<uint8_t> constantData;
+    std::vector<uint32_t> constantHandleOffsets;   // the constants which hold ConstantTable handles
+};
+
+//==============================================================================
+/**
+    Compiles the HEART functions of a program into bytecode.
+
+    Each function gets an ID from its position in the program, and its image is compiled
+    on demand, or taken from the LinkerCache if the same program has been linked before.
+    When the graph is complete, all the images are relocated into runnable Functions.
+*/
+class Compiler  : public interpreter::ProcessorCompiler
+{
+public:
+    Compiler (Program& p, const BuildSettings& s,
+              const std::unordered_map<const heart::Variable*, const Value*>& externals,
+              UnsizedArraySizes& sizes, LinkerCache* linkerCache)
+        : program (p), settings (s), externalValues (externals), unsizedArraySizes (sizes), cache (linkerCache)
+    {
+        uint32_t numFunctions = 0;
+
+        for (auto& m : program.getModules())
+            for (auto& f : m->functions.get())
+                functionIDs[f.getPointer()] = numFunctions++;
+
+        firstStateInitialiserID = numFunctions;
+        images.resize (numFunctions + program.getModules().size());
+        functions.resize (images.size());
+        externalVariables = program.getExternalVariables();
+
+        if (cache != nullptr)
+        {
+            cacheKey = "soulbytecode" + std::to_string (formatVersion)
+                         + "s" + std::to_string (static_cast<uint32_t> (settings.sessionID))
+                         + (settings.useFastMaths ? "f" : "")
+                         + "h" + program.getHash();
+
+            loadFromCache();
+        }
+    }
+
+    CompiledProcessor& getProcessor (Module& module) override
+    {
+        for (auto& p : processors)
+            if (std::addressof (p->module) == std::addressof (module))
+                return *p;
+
+        processors.push_back (std::make_unique<CompiledProcessor> (module));
+        auto& p = *processors.back();
+        p.createLayout (settings);
+
+        auto& moduleFunctions = module.functions;
+
+        p.stateInitialiser = std::addressof (getStateInitialiser (p));
+
+        for (auto& f : moduleFunctions.get())
+        {
+            if (f->functionType.isSystemInit())  p.systemInitFunction = std::addressof (getFunction (f));
+            if (f->functionType.isUserInit())    p.userInitFunction   = std::addressof (getFunction (f));
+        }
+
+        for (auto& input : module.inputs)
+        {
+            p.eventHandlers.emplace_back();
+
+            if (input->isEventEndpoint())
+            {
+                for (auto& type : input->dataTypes)
+                {
+                    CompiledProcessor::EventHandler handler;
+
+                    if (auto f = moduleFunctions.find (heart::getEventFunctionName (input->name.toString(), type)))
+                    {
+                        handler.function = std::addressof (getFunction (*f));
+                        handler.hasIndexParameter = f->parameters.size() > 1;
+                    }
+
+                    p.eventHandlers.back().push_back (handler);
+                }
+            }
+        }
+
+        if (auto run = moduleFunctions.findRunFunction())
+            p.setRunFunction (getFunction (*run));
+
+        if (auto f = moduleFunctions.find (heart::getVectorisedRunFunctionName()))
+            p.setVectorisedRunFunction (getFunction (*f), StreamLoopVectoriser::getFramesPerCall (*f));
+
+        return p;
+    }
+
+    bool canDispatchGroupedInstances() const override     { return true; }
+
+    size_t getRequiredStackSize() const override
+    {
+        size_t total = 64;
+
+        for (auto& f : functions)
+            if (f != nullptr)
+                total += f->frameSize;
+
+        return total;
+    }
+
+    void finishedCompiling() override
+    {
+        // Functions which were loaded from the cache haven't had their callees requested yet
+        for (uint32_t id = 0; id < functions.size(); ++id)
+            if (functions[id] != nullptr)
+                createCallees (id);
+
+        for (uint32_t id = 0; id < functions.size(); ++id)
+            if (functions[id] != nullptr)
+                relocate (*images[id], *functions[id]);
+
+        if (cache != nullptr && hasCompiledNewImages)
+            saveToCache();
+    }
+
+private:
+    //==============================================================================
+    static constexpr uint32_t formatVersion = 2;
+    static constexpr uint32_t cacheMagic = 0x53424331; // "SBC1"
+
+    Program& program;
+    const BuildSettings& settings;
+    const std::unordered_map<const heart::Variable*, const Value*>& externalValues;
+    UnsizedArraySizes& unsizedArraySizes;
+    LinkerCache* cache;
+    std::string cacheKey;
+
+    std::unordered_map<const heart::Function*, uint32_t> functionIDs;
+    uint32_t firstStateInitialiserID = 0;
+    std::vector<pool_ref<heart::Variable>> externalVariables;
+    std::vector<std::unique_ptr<FunctionImage>> images;     // indexed by function ID
+    std::vector<std::unique_ptr<Function>> functions;       // indexed by function ID
+    std::vector<std::unique_ptr<CompiledProcessor>> processors;
+    bool hasCompiledNewImages = false;
+
+    //==============================================================================
+    Function& getFunction (uint32_t id)
+    {
+        auto& fn = functions[id];
+
+        if (fn == nullptr)
+        {
+            auto& image = *images[id];
+            fn = std::make_unique<Function>();
+            fn->name = image.name;
+            fn->parameters = image.parameters;
+            fn->frameSize = image.frameSize;
+            fn->returnValueOffset = image.returnValueOffset;
+            fn->returnValueSize = image.returnValueSize;
+        }
+
+        return *fn;
+    }
+
+    const Function& getFunction (heart::Function& f)
+    {
+        auto id = getFunctionID (f);
+        getImage (f, id);
+        return getFunction (id);
+    }
+
+    uint32_t getFunctionID (const heart::Function& f) const
+    {
+        auto found = functionIDs.find (std::addressof (f));
+        SOUL_ASSERT (found != functionIDs.end());
+        return found->second;
+    }
+
+    const FunctionImage& getImage (heart::Function& f, uint32_t id)
+    {
+        if (images[id] == nullptr)
+        {
+            auto& module = program.getModuleContainingFunction (f);
+
+            if (f.hasNoBody)
+                f.location.throwError (Errors::functionHasNoImplementation());
+
+            auto image = std::make_unique<FunctionImage>();
+            image->name = program.getFunctionNameWithQualificationIfNeeded (module, f);
+
+            FunctionBuilder builder (*this, *image, module.isProcessor() ? std::addressof (getProcessor (module)) : nullptr);
+            builder.build (f);
+
+            images[id] = std::move (image);
+            hasCompiledNewImages = true;
+        }
+
+        return *images[id];
+    }
+
+    const Function& getStateInitialiser (CompiledProcessor& p)
+    {
+        auto& modules = program.getModules();
+        uint32_t id = firstStateInitialiserID;
+
+        for (auto& m : modules)
+        {
+            if (std::addressof (m.get()) == std::addressof (p.module))
+                break;
+
+            ++id;
+        }
+
+        if (images[id] == nullptr)
+        {
+            auto image = std::make_unique<FunctionImage>();
+            image->name = p.module.fullName + "::_stateInitialiser";
+
+            FunctionBuilder builder (*this, *image, std::addressof (p));
+            builder.buildStateInitialiser();
+
+            images[id] = std::move (image);
+            hasCompiledNewImages = true;
+        }
+
+        return getFunction (id);
+    }
+
+    void createCallees (uint32_t id)
+    {
+        auto& image = *images[id];
+
+        for (auto& r : image.relocations)
+        {
+            if (r.type == FunctionImage::RelocationType::function)
+            {
+                auto calleeID = static_cast<uint32_t> (image.code[r.position]);
+
+                if (functions[calleeID] == nullptr)
+                {
+                    getFunction (calleeID);
+                    createCallees (calleeID);
+                }
+            }
+        }
+    }
+
+    void relocate (const FunctionImage& image, Function& fn)
+    {
+        using RelocationType = FunctionImage::RelocationType;
+
+        fn.code = image.code;
+        fn.constantData = image.constantData;
+
+        for (auto offset : image.constantHandleOffsets)
+        {
+            auto data = fn.constantData.data() + offset;
+            void* target = nullptr;
+
+            if (auto handle = readValue<ConstantTable::Handle> (data))
+            {
+                auto source = program.getConstantTable().getValueForHandle (handle);
+                SOUL_ASSERT (source != nullptr);
+                target = source->getPackedData();
+            }
+
+            writeValue<void*> (data, target);
+        }
+
+        for (auto& r : image.relocations)
+        {
+            auto& word = fn.code[r.position];
+
+            switch (r.type)
+            {
+                case RelocationType::opCode:             word = Function::getOpCodeWord (static_cast<OpCode> (word)); break;
+                case RelocationType::constant:           word = toWord (fn.constantData.data() + word); break;
+                case RelocationType::external:           word = toWord (getExternalValue (externalVariables[word]).getPackedData()); break;
+                case RelocationType::function:           word = toWord (functions[word].get()); break;
+                case RelocationType::unsizedArraySizes:  word = toWord (std::addressof (unsizedArraySizes)); break;
+                case RelocationType::numTypes:
+                default:                                 SOUL_ASSERT_FALSE; break;
+            }
+        }
+
+        // The batch code is the same apart from its handlers, so the offsets of its
+        // statements match, and an instance can leave a batch and carry on by itself
+        if (settings.processorBatchSize > 1)
+        {
+            fn.batchCode = fn.code;
+
+            for (auto& r : image.relocations)
+                if (r.type == RelocationType::opCode)
+                    fn.batchCode[r.position] = Function::getBatchOpCodeWord (static_cast<OpCode> (image.code[r.position]));
+        }
+    }
+
+    static Word toWord (const void* address) noexcept
+    {
+        return static_cast<Word> (reinterpret_cast<uintptr_t> (address));
+    }
+
+    const Value& getExternalValue (heart::Variable& v) const
+    {
+        auto found = externalValues.find (std::addressof (v));
+
+        if (found == externalValues.end())
+            v.location.throwError (Errors::unresolvedExternal (v.name.toString()));
+
+        return *found->second;
+    }
+
+    uint32_t getExternalIndex (heart::Variable& v) const
+    {
+        getExternalValue (v);
+
+        for (uint32_t i = 0; i < externalVariables.size(); ++i)
+            if (externalVariables[i].getPointer() == std::addressof (v))
+                return i;
+
+        throwInternalCompilerError ("Unknown external variable", v.name.toString().c_str(), 0);
+    }
+
+    //==============================================================================
+    struct CacheWriter
+    {
+        std::vector<uint8_t> data;
+
+        template <typename Type>
+        void write (Type v)
+        {
+            static_assert (std::is_trivially_copyable<Type>::value);
+            auto start = data.size();
+            data.resize (start + sizeof (Type));
+            writeValue<Type> (data.data() + start, v);
+        }
+
+        template <typename Type>
+        void write (const std::vector<Type>& items)
+        {
+            write (static_cast<uint32_t> (items.size()));
+
+            for (auto& i : items)
+                write (i);
+        }
+
+        void write (const std::string& s)
+        {
+            write (static_cast<uint32_t> (s.length()));
+            data.insert (data.end(), s.begin(), s.end());
+        }
+    };
+
+    struct CacheReader
+    {
+        const uint8_t* data;
+        size_t size, position = 0;
+
+        template <typename Type>
+        bool read (Type& v)
+        {
+            static_assert (std::is_trivially_copyable<Type>::value);
+
+            if (position + sizeof (Type) > size)
+                return false;
+
+            v = readValue<Type> (data + position);
+            position += sizeof (Type);
+            return true;
+        }
+
+        template <typename Type>
+        bool read (std::vector<Type>& items)
+        {
+            uint32_t num;
+
+            if (! read (num) || num > size - position)
+                return false;
+
+            items.resize (num);
+
+            for (auto& i : items)
+                if (! read (i))
+                    return false;
+
+            return true;
+        }
+
+        bool read (std::string& s)
+        {
+            uint32_t length;
+
+            if (! read (length) || length > size - position)
+                return false;
+
+            s = std::string (reinterpret_cast<const char*> (data + position), length);
+            position += length;
+            return true;
+        }
+    };
+
+    void saveToCache()
+    {
+        CacheWriter writer;
+        writer.write (cacheMagic);
+        writer.write (formatVersion);
+        writer.write (static_cast<uint32_t> (sizeof (void*)));
+        writer.write (static_cast<uint32_t> (images.size()));
+
+        for (auto& image : images)
+        {
+            writer.write (static_cast<uint8_t> (image != nullptr ? 1 : 0));
+
+            if (image != nullptr)
+            {
+                writer.write (image->name);
+                writer.write (image->parameters);
+                writer.write (image->frameSize);
+                writer.write (image->returnValueOffset);
+                writer.write (image->returnValueSize);
+                writer.write (image->code);
+                writer.write (image->relocations);
+                writer.write (image->constantData);
+                writer.write (image->constantHandleOffsets);
+            }
+        }
+
+        cache->storeItem (cacheKey.c_str(), writer.data.data(), writer.data.size());
+    }
+
+    void loadFromCache()
+    {
+        auto size = cache->readItem (cacheKey.c_str(), nullptr, 0);
+
+        if (size == 0)
+            return;
+
+        std::vector<uint8_t> data (static_cast<size_t> (size));
+
+        if (cache->readItem (cacheKey.c_str(), data.data(), size) != size || ! readImages (data))
+            for (auto& image : images)
+                image.reset();
+    }
+
+    bool readImages (const std::vector<uint8_t>& data)
+    {
+        CacheReader reader { data.data(), data.size() };
+        uint32_t magic, version, pointerSize, numImages;
+
+        if (! (reader.read (magic) && magic == cacheMagic
+                && reader.read (version) && version == formatVersion
+                && reader.read (pointerSize) && pointerSize == sizeof (void*)
+                && reader.read (numImages) && numImages == images.size()))
+            return false;
+
+        for (auto& image : images)
+        {
+            uint8_t isPresent;
+
+            if (! reader.read (isPresent))
+                return false;
+
+            if (isPresent == 0)
+                continue;
+
+            image = std::make_unique<FunctionImage>();
+
+            if (! (reader.read (image->name)
+                    && reader.read (image->parameters)
+                    && reader.read (image->frameSize)
+                    && reader.read (image->returnValueOffset)
+                    && reader.read (image->returnValueSize)
+                    && reader.read (image->code)
+                    && reader.read (image->relocations)
+                    && reader.read (image->constantData)
+                    && reader.read (image->constantHandleOffsets)
+                    && isValid (*image)))
+                return false;
+        }
+
+        return reader.position == data.size();
+    }
+
+    bool isValid (const FunctionImage& image) const
+    {
+        using RelocationType = FunctionImage::RelocationType;
+
+        for (auto& r : image.relocations)
+        {
+            if (r.position >= image.code.size())
+                return false;
+
+            auto word = image.code[r.position];
+
+            switch (r.type)
+            {
+                case RelocationType::opCode:             if (word >= static_cast<Word> (OpCode::numOpCodes)) return false; break;
+                case RelocationType::constant:           if (word > image.constantData.size()) return false; break;
+                case RelocationType::external:           if (word >= externalVariables.size()) return false; break;
+                case RelocationType::function:           if (word >= images.size()) return false; break;
+                case RelocationType::unsizedArraySizes:  break;
+                case RelocationType::numTypes:
+                default:                                 return false;
+            }
+        }
+
+        for (auto offset : image.constantHandleOffsets)
+            if (offset + sizeof (ConstantTable::Handle) > image.constantData.size())
+                return false;
+
+        return true;
+    }
+
+    //==============================================================================
+    /** Where the value of an expression can be found when it's needed. */
+    struct Location
+    {
+        enum class Kind
+        {
+            frame,      // at a fixed offset in the frame, i.e. already in a register
+            state,      // at a fixed offset in the processor state
+            indirect,   // at an offset from the pointer held in a register
+            immediate,  // a primitive constant, whose bits are held in the value
+            constant,   // in the function's constant data
+            external    // in the value of an external variable
+        };
+
+        Kind kind = Kind::frame;
+        Word offset = 0;      // the frame, state or byte offset
+        uint32_t reg = 0;     // for indirect locations, the register holding the pointer
+        uint32_t index = 0;   // the constant data offset or external variable index
+        Word value = 0;       // the bits of an immediate value
+
+        static Location inFrame (uint32_t offset)                     { return { Kind::frame, offset, 0, 0, 0 }; }
+        static Location inState (uint32_t offset)                     { return { Kind::state, offset, 0, 0, 0 }; }
+        static Location indirect (uint32_t reg, Word offset)          { return { Kind::indirect, offset, reg, 0, 0 }; }
+        static Location immediate (Word value)                        { return { Kind::immediate, 0, 0, 0, value }; }
+        static Location inConstants (uint32_t offset)                 { return { Kind::constant, 0, 0, offset, 0 }; }
+        static Location inExternal (uint32_t index)                   { return { Kind::external, 0, 0, index, 0 }; }
+
+        bool isFrame() const        { return kind == Kind::frame; }
+        bool isImmediate() const    { return kind == Kind::immediate; }
+    };
+
+    //==============================================================================
+    struct FunctionBuilder
+    {
+        FunctionBuilder (Compiler& c, FunctionImage& i, CompiledProcessor* p)
+            : compiler (c), image (i), processor (p) {}
+
+        Compiler& compiler;
+        FunctionImage& image;
+        CompiledProcessor* processor;
+        uint32_t frameSize = 0;
+        std::unordered_map<const heart::Variable*, Location> variables;
+
+        struct Temp
+        {
+            uint32_t offset, size;
+        };
+
+        std::vector<Temp> freeTemps, tempsInUse;
+
+        std::vector<uint32_t> labels;  // the code position of each label, or ~0 if not yet placed
+        std::vector<std::pair<uint32_t, uint32_t>> labelReferences;   // code position, label
+        static constexpr uint32_t unplacedLabel = ~0u;
+
+        //==============================================================================
+        void build (heart::Function& f)
+        {
+            for (auto& param : f.parameters)
+            {
+                auto isReference = param->type.isReference();
+                auto size = isReference ? sizeof (void*) : param->type.getPackedSizeInBytes();
+                auto offset = allocateFrameSlot (size);
+                image.parameters.push_back ({ offset, static_cast<uint32_t> (size), isReference });
+                variables[param.getPointer()] = isReference ? Location::indirect (offset, 0) : Location::inFrame (offset);
+            }
+
+            if (! f.returnType.isVoid())
+            {
+                image.returnValueSize = static_cast<uint32_t> (f.returnType.getPackedSizeInBytes());
+                image.returnValueOffset = allocateFrameSlot (image.returnValueSize);
+            }
+
+            std::unordered_map<const heart::Block*, uint32_t> blockLabels;
+
+            for (auto& b : f.blocks)
+            {
+                blockLabels[b.getPointer()] = createLabel();
+
+                for (auto& param : b->parameters)
+                    variables[param.getPointer()] = Location::inFrame (allocateFrameSlot (param->type.getPackedSizeInBytes()));
+            }
+
+            for (size_t i = 0; i < f.blocks.size(); ++i)
+            {
+                auto& b = f.blocks[i];
+                placeLabel (blockLabels[b.getPointer()]);
+
+                for (auto s : b->statements)
+                {
+                    compileStatement (*s);
+                    releaseTemps();
+                }
+
+                auto nextBlock = i + 1 < f.blocks.size() ? blockLabels[f.blocks[i + 1].getPointer()] : unplacedLabel;
+                compileTerminator (*b->terminator, f, blockLabels, nextBlock);
+                releaseTemps();
+            }
+
+            finish();
+        }
+
+        void buildStateInitialiser()
+        {
+            SOUL_ASSERT (processor != nullptr);
+
+            for (auto& v : processor->module.stateVariables.get())
+            {
+                if (v->initialValue != nullptr && ! v->isExternal())
+                {
+                    auto dest = getVariable (v);
+                    copy (dest, compileExpression (*v->initialValue, v->type, nullptr), v->type.getPackedSizeInBytes());
+                    releaseTemps();
+                }
+            }
+
+            emit (OpCode::ret);
+            finish();
+        }
+
+        void finish()
+        {
+            for (auto& ref : labelReferences)
+            {
+                SOUL_ASSERT (labels[ref.second] != unplacedLabel);
+                image.code[ref.first] = labels[ref.second];
+            }
+
+            image.frameSize = frameSize;
+        }
+
+        //==============================================================================
+        uint32_t allocateFrameSlot (size_t size)
+        {
+            auto start = frameSize;
+            frameSize += alignSlotSize (std::max (size, (size_t) 1));
+            return start;
+        }
+
+        /** Temporary values only live until the end of the statement which creates them, so
+            their slots are recycled by the following statements.
+        */
+        uint32_t allocateTemp (size_t size)
+        {
+            auto alignedSize = alignSlotSize (std::max (size, (size_t) 1));
+
+            for (auto i = freeTemps.begin(); i != freeTemps.end(); ++i)
+            {
+                if (i->size == alignedSize)
+                {
+                    auto t = *i;
+                    freeTemps.erase (i);
+                    tempsInUse.push_back (t);
+                    return t.offset;
+                }
+            }
+
+            tempsInUse.push_back ({ allocateFrameSlot (size), alignedSize });
+            return tempsInUse.back().offset;
+        }
+
+        void releaseTemps()
+        {
+            freeTemps.insert (freeTemps.end(), tempsInUse.begin(), tempsInUse.end());
+            tempsInUse.clear();
+        }
+
+        /** Picks the register for the result of an operation. If the value is going to be
+            assigned straight to a variable, the operation can write to it directly instead
+            of needing a move afterwards.
+        */
+        uint32_t allocateResult (size_t size, uint32_t numElements, const Location* target)
+        {
+            if (target != nullptr && target->isFrame() && numElements == 1)
+                return static_cast<uint32_t> (target->offset);
+
+            return allocateTemp (size);
+        }
+
+        //==============================================================================
+        uint32_t createLabel()
+        {
+            labels.push_back (unplacedLabel);
+            return static_cast<uint32_t> (labels.size() - 1);
+        }
+
+        void placeLabel (uint32_t label)
+        {
+            labels[label] = static_cast<uint32_t> (image.code.size());
+        }
+
+        void addRelocation (FunctionImage::RelocationType type)
+        {
+            image.relocations.push_back ({ static_cast<uint32_t> (image.code.size() - 1), type });
+        }
+
+        void emitOpCode (OpCode op)
+        {
+            image.code.push_back (static_cast<Word> (op));
+            addRelocation (FunctionImage::RelocationType::opCode);
+        }
+
+        template <typename... Operands>
+        void emit (OpCode op, Operands... operands)
+        {
+            emitOpCode (op);
+            (image.code.push_back (static_cast<Word> (operands)), ...);
+        }
+
+        void emitLabelReference (uint32_t label)
+        {
+            labelReferences.push_back ({ static_cast<uint32_t> (image.code.size()), label });
+            image.code.push_back (0);
+        }
+
+        void emitJump (uint32_t label)
+        {
+            emitOpCode (OpCode::jump);
+            emitLabelReference (label);
+        }
+
+        //==============================================================================
+        static OpCode selectSizedOp (size_t size, OpCode op1, OpCode op4, OpCode op8, OpCode opN)
+        {
+            if (size == 1)  return op1;
+            if (size == 4)  return op4;
+            if (size == 8)  return op8;
+            return opN;
+        }
+
+        /** Converts constant and external locations into indirect ones. */
+        Location resolve (const Location& l)
+        {
+            if (l.kind == Location::Kind::constant)
+            {
+                auto reg = allocateTemp (sizeof (void*));
+                emit (OpCode::address, reg, l.index);
+                addRelocation (FunctionImage::RelocationType::constant);
+                return Location::indirect (reg, l.offset);
+            }
+
+            if (l.kind == Location::Kind::external)
+            {
+                auto reg = allocateTemp (sizeof (void*));
+                emit (OpCode::address, reg, l.index);
+                addRelocation (FunctionImage::RelocationType::external);
+                return Location::indirect (reg, l.offset);
+            }
+
+            return l;
+        }
+
+        /** Returns a register which holds the value at the given location, loading it if needed. */
+        uint32_t toRegister (const Location& l, size_t size)
+        {
+            if (l.isFrame())
+                return static_cast<uint32_t> (l.offset);
+
+            auto reg = allocateTemp (size);
+            copy (Location::inFrame (reg), l, size);
+            return reg;
+        }
+
+        /** Returns a register which holds a pointer to the value at the given location. */
+        uint32_t addressOf (const Location& location, size_t size)
+        {
+            auto l = resolve (location);
+
+            if (l.kind == Location::Kind::indirect && l.offset == 0)
+                return l.reg;
+
+            if (l.isImmediate())
+                return addressOf (Location::inFrame (toRegister (l, size)), size);
+
+            auto reg = allocateTemp (sizeof (void*));
+
+            if (l.kind == Location::Kind::frame)       emit (OpCode::addressOfFrame, reg, l.offset);
+            else if (l.kind == Location::Kind::state)  emit (OpCode::addressOfState, reg, l.offset);
+            else                                       emit (OpCode::addOffset, reg, l.reg, l.offset);
+
+            return reg;
+        }
+
+        Location withOffset (const Location& l, size_t delta)
+        {
+            if (delta == 0)
+                return l;
+
+            SOUL_ASSERT (! l.isImmediate());
+            auto result = l;
+            result.offset += delta;
+            return result;
+        }
+
+        void copy (const Location& destination, const Location& source, size_t size)
+        {
+            if (size == 0)
+                return;
+
+            auto src = resolve (source);
+            auto dest = resolve (destination);
+
+            if (dest.isFrame())
+            {
+                switch (src.kind)
+                {
+                    case Location::Kind::frame:
+                        if (src.offset != dest.offset)
+                        {
+                            if (size == 1 || size == 4 || size == 8)
+                                emit (selectSizedOp (size, OpCode::mov1, OpCode::mov4, OpCode::mov8, OpCode::movN), dest.offset, src.offset);
+                            else
+                                emit (OpCode::movN, dest.offset, src.offset, size);
+                        }
+
+                        return;
+
+                    case Location::Kind::state:
+                        if (size == 1 || size == 4 || size == 8)
+                            emit (selectSizedOp (size, OpCode::loadState1, OpCode::loadState4, OpCode::loadState8, OpCode::loadStateN), dest.offset, src.offset);
+                        else
+                            emit (OpCode::loadStateN, dest.offset, src.offset, size);
+
+                        return;
+
+                    case Location::Kind::indirect:
+                        if (size == 1 || size == 4 || size == 8)
+                            emit (selectSizedOp (size, OpCode::load1, OpCode::load4, OpCode::load8, OpCode::loadN), dest.offset, src.reg, src.offset);
+                        else
+                            emit (OpCode::loadN, dest.offset, src.reg, src.offset, size);
+
+                        return;
+
+                    case Location::Kind::immediate:
+                        SOUL_ASSERT (size == 1 || size == 4 || size == 8);
+                        emit (selectSizedOp (size, OpCode::imm1, OpCode::imm4, OpCode::imm8, OpCode::imm8), dest.offset, src.value);
+                        return;
+
+                    case Location::Kind::constant:
+                    case Location::Kind::external:
+                    default:
+                        SOUL_ASSERT_FALSE;
+                        return;
+                }
+            }
+
+            auto reg = toRegister (src, size);
+
+            if (dest.kind == Location::Kind::state)
+            {
+                if (size == 1 || size == 4 || size == 8)
+                    emit (selectSizedOp (size, OpCode::storeState1, OpCode::storeState4, OpCode::storeState8, OpCode::storeStateN), dest.offset, reg);
+                else
+                    emit (OpCode::storeStateN, dest.offset, reg, size);
+
+                return;
+            }
+
+            SOUL_ASSERT (dest.kind == Location::Kind::indirect);
+
+            if (size == 1 || size == 4 || size == 8)
+                emit (selectSizedOp (size, OpCode::store1, OpCode::store4, OpCode::store8, OpCode::storeN), dest.reg, dest.offset, reg);
+            else
+                emit (OpCode::storeN, dest.reg, dest.offset, reg, size);
+        }
+
+        //==============================================================================
+        void compileTerminator (heart::Terminator& t, heart::Function& f,
+                                std::unordered_map<const heart::Block*, uint32_t>& blockLabels, uint32_t nextBlock)
+        {
+            if (auto br = cast<heart::Branch> (t))
+            {
+                auto target = blockLabels[br->target.getPointer()];
+                copyBlockArguments (br->target, br->targetArgs);
+
+                if (target != nextBlock)
+                    emitJump (target);
+
+                return;
+            }
+
+            if (auto bi = cast<heart::BranchIf> (t))
+            {
+                auto hasArgs = ! (bi->targetArgs[0].empty() && bi->targetArgs[1].empty());
+                uint32_t targets[2] = { blockLabels[bi->targets[0].getPointer()],
+                                        blockLabels[bi->targets[1].getPointer()] };
+
+                if (hasArgs)
+                {
+                    targets[0] = createLabel();
+                    targets[1] = createLabel();
+                }
+
+                compileConditionalBranch (bi->condition, targets[0], targets[1]);
+                releaseTemps();
+
+                if (hasArgs)
+                {
+                    for (int i = 0; i < 2; ++i)
+                    {
+                        placeLabel (targets[i]);
+                        copyBlockArguments (bi->targets[i], bi->targetArgs[i]);
+                        emitJump (blockLabels[bi->targets[i].getPointer()]);
+                        releaseTemps();
+                    }
+                }
+
+                return;
+            }
+
+            if (auto rv = cast<heart::ReturnValue> (t))
+            {
+                auto dest = Location::inFrame (image.returnValueOffset);
+                copy (dest, compileExpression (rv->returnValue, f.returnType, std::addressof (dest)), image.returnValueSize);
+            }
+
+            emit (OpCode::ret);
+        }
+
+        void compileConditionalBranch (heart::Expression& condition, uint32_t trueLabel, uint32_t falseLabel)
+        {
+            if (auto b = cast<heart::BinaryOperator> (condition))
+            {
+                auto operandType = BinaryOp::getTypes (b->operation, b->lhs->getType().removeReferenceIfPresent(),
+                                                       b->rhs->getType().removeReferenceIfPresent()).operandType;
+
+                if (operandType.isInteger32() && operandType.isPrimitive())
+                {
+                    auto op = b->operation;
+
+                    if (getCompareAndBranchOpCode (op, false))
+                    {
+                        auto lhs = compileExpression (b->lhs, operandType, nullptr);
+                        auto rhs = compileExpression (b->rhs, operandType, nullptr);
+
+                        if (lhs.isImmediate() && ! rhs.isImmediate())
+                        {
+                            std::swap (lhs, rhs);
+                            op = getReversedComparison (op);
+                        }
+
+                        auto lhsReg = toRegister (lhs, sizeof (int32_t));
+
+                        if (rhs.isImmediate())
+                            emit (*getCompareAndBranchOpCode (op, true), lhsReg, rhs.value);
+                        else
+                            emit (*getCompareAndBranchOpCode (op, false), lhsReg, toRegister (rhs, sizeof (int32_t)));
+
+                        emitLabelReference (trueLabel);
+                        emitLabelReference (falseLabel);
+                        return;
+                    }
+                }
+            }
+
+            auto reg = toRegister (compileExpression (condition, PrimitiveType::bool_, nullptr), 1);
+            emit (OpCode::branch, reg);
+            emitLabelReference (trueLabel);
+            emitLabelReference (falseLabel);
+        }
+
+        static std::optional<OpCode> getCompareAndBranchOpCode (BinaryOp::Op op, bool hasImmediateOperand)
+        {
+            switch (op)
+            {
+                case BinaryOp::Op::lessThan:            return hasImmediateOperand ? OpCode::branchLTImm_i32 : OpCode::branchLT_i32;
+                case BinaryOp::Op::lessThanOrEqual:     return hasImmediateOperand ? OpCode::branchLEImm_i32 : OpCode::branchLE_i32;
+                case BinaryOp::Op::greaterThan:         return hasImmediateOperand ? OpCode::branchGTImm_i32 : OpCode::branchGT_i32;
+                case BinaryOp::Op::greaterThanOrEqual:  return hasImmediateOperand ? OpCode::branchGEImm_i32 : OpCode::branchGE_i32;
+                case BinaryOp::Op::equals:              return hasImmediateOperand ? OpCode::branchEQImm_i32 : OpCode::branchEQ_i32;
+                case BinaryOp::Op::notEquals:           return hasImmediateOperand ? OpCode::branchNEImm_i32 : OpCode::branchNE_i32;
+                default:                                return {};
+            }
+        }
+
+        /** Returns the comparison which gives the same result when its operands are swapped. */
+        static BinaryOp::Op getReversedComparison (BinaryOp::Op op)
+        {
+            switch (op)
+            {
+                case BinaryOp::Op::lessThan:            return BinaryOp::Op::greaterThan;
+                case BinaryOp::Op::lessThanOrEqual:     return BinaryOp::Op::greaterThanOrEqual;
+                case BinaryOp::Op::greaterThan:         return BinaryOp::Op::lessThan;
+                case BinaryOp::Op::greaterThanOrEqual:  return BinaryOp::Op::lessThanOrEqual;
+                default:                                return op;
+            }
+        }
+
+        void copyBlockArguments (heart::Block& target, ArrayView<pool_ref<heart::Expression>> args)
+        {
+            SOUL_ASSERT (args.size() == target.parameters.size());
+
+            struct Argument
+            {
+                Location source, param;
+                size_t size;
+            };
+
+            std::vector<Argument> arguments;
+
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                auto& param = target.parameters[i];
+                arguments.push_back ({ compileExpression (args[i], param->type, nullptr), variables[param.getPointer()],
+                                       param->type.getPackedSizeInBytes() });
+            }
+
+            // An argument may read one of the parameters that's about to be overwritten, so
+            // any which could do that are copied to a scratch register first
+            auto mayReadParameters = [&] (const Location& l)
+            {
+                if (l.kind == Location::Kind::indirect)
+                    return true;
+
+                if (l.kind != Location::Kind::frame)
+                    return false;
+
+                for (auto& a : arguments)
+                    if (l.offset < a.param.offset + a.size && a.param.offset < l.offset + a.size)
+                        return true;
+
+                return false;
+            };
+
+            if (arguments.size() > 1)
+                for (auto& a : arguments)
+                    if (mayReadParameters (a.source))
+                        a.source = copyToScratch (a.source, a.size);
+
+            for (auto& a : arguments)
+                copy (a.param, a.source, a.size);
+        }
+
+        Location copyToScratch (const Location& source, size_t size)
+        {
+            auto scratch = Location::inFrame (allocateTemp (size));
+            copy (scratch, source, size);
+            return scratch;
+        }
+
+        //==============================================================================
+        void compileStatement (heart::Statement& s)
+        {
+            if (is_type<heart::AdvanceClock> (s))
+                return emit (OpCode::advance);
+
+            if (auto a = cast<heart::AssignFromValue> (s))
+            {
+                auto& targetType = a->target->getType();
+                return compileAssignment (*a->target, [&] (const Location* hint) { return compileExpression (a->source, targetType, hint); });
+            }
+
+            if (auto fc = cast<heart::FunctionCall> (s))
+            {
+                auto& target = fc->getFunction();
+
+                if (fc->target == nullptr)
+                {
+                    compileCallExpression (target, fc->arguments, nullptr);
+                    return;
+                }
+
+                auto targetType = fc->target->getType().removeReferenceIfPresent();
+
+                return compileAssignment (*fc->target, [&] (const Location* hint)
+                {
+                    if (! targetType.isIdentical (target.returnType.removeReferenceIfPresent()))
+                        return createCast (compileCallExpression (target, fc->arguments, nullptr), target.returnType, targetType, hint);
+
+                    return compileCallExpression (target, fc->arguments, hint);
+                });
+            }
+
+            if (auto r = cast<heart::ReadStream> (s))
+            {
+                auto& input = r->source.get();
+                auto& targetType = r->target->getType();
+                auto slotType = r->element != nullptr ? input.getFrameOrValueType().getElementType()
+                                                      : input.getFrameOrValueType();
+
+                return compileAssignment (*r->target, [&] (const Location* hint)
+                {
+                    return createCast (getInputSlot (input, r->element), slotType, targetType, hint);
+                });
+            }
+
+            if (auto w = cast<heart::WriteStream> (s))
+                return compileWrite (*w);
+
+            s.location.throwError (Errors::notYetImplemented ("statement type"));
+        }
+
+        /** As in the interpreter, the source is evaluated before the destination. */
+        template <typename CompileSource>
+        void compileAssignment (heart::Expression& target, CompileSource&& compileSource)
+        {
+            auto size = target.getType().removeReferenceIfPresent().getPackedSizeInBytes();
+
+            if (auto v = cast<heart::Variable> (target))
+            {
+                auto dest = getVariable (*v);
+
+                if (dest.isFrame())
+                {
+                    copy (dest, compileSource (std::addressof (dest)), size);
+                    return;
+                }
+            }
+
+            auto source = compileSource (nullptr);
+            copy (compileExpression (target), source, size);
+        }
+
+        Location getInputSlot (heart::InputDeclaration& input, pool_ptr<heart::Expression> element)
+        {
+            SOUL_ASSERT (processor != nullptr);
+            auto index = getEndpointIndex (processor->module.inputs, input);
+            auto slot = Location::inState (processor->inputOffsets[index]);
+
+            if (element == nullptr)
+                return slot;
+
+            return createElementAccess (slot, input.getFrameOrValueType(), *element, false);
+        }
+
+        template <typename DeclType>
+        static size_t getEndpointIndex (const std::vector<pool_ref<DeclType>>& list, const heart::IODeclaration& endpoint)
+        {
+            for (size_t i = 0; i < list.size(); ++i)
+                if (list[i].getPointer() == std::addressof (endpoint))
+                    return i;
+
+            SOUL_ASSERT_FALSE;
+            return 0;
+        }
+
+        void compileWrite (heart::WriteStream& w)
+        {
+            SOUL_ASSERT (processor != nullptr);
+            auto& output = w.target.get();
+            auto outputIndex = getEndpointIndex (processor->module.outputs, output);
+            auto& valueType = w.value->getType();
+
+            if (output.isEventEndpoint())
+            {
+                uint32_t typeIndex = 0;
+
+                for (uint32_t i = 0; i < output.dataTypes.size(); ++i)
+                {
+                    if (output.dataTypes[i].isEqual (valueType, Type::ignoreReferences | Type::ignoreConst))
+                    {
+                        typeIndex = i;
+                        break;
+                    }
+
+                    if (TypeRules::canSilentlyCastTo (output.dataTypes[i], valueType))
+                        typeIndex = i;
+                }
+
+                auto& eventType = output.dataTypes[typeIndex];
+                auto value = addressOf (compileExpression (w.value, eventType, nullptr), eventType.getPackedSizeInBytes());
+                auto arraySize = output.arraySize.value_or (1);
+
+                if (w.element != nullptr)
+                {
+                    if (w.element->getType().isInteger64())
+                        return emit (OpCode::writeEvent64, outputIndex, typeIndex, value,
+                                     toRegister (compileExpression (*w.element), sizeof (int64_t)), arraySize);
+
+                    return emit (OpCode::writeEvent32, outputIndex, typeIndex, value,
+                                 toRegister (compileExpression (*w.element, PrimitiveType::int32, nullptr), sizeof (int32_t)), arraySize);
+                }
+
+                return emit (OpCode::writeEvent32, outputIndex, typeIndex, value, noRegister, arraySize);
+            }
+
+            auto dest = Location::inState (processor->outputOffsets[outputIndex]);
+            auto slotType = output.getFrameOrValueType();
+
+            if (w.element != nullptr)
+            {
+                dest = createElementAccess (dest, slotType, *w.element, false);
+                slotType = slotType.getElementType();
+            }
+
+            auto value = compileExpression (w.value, slotType, nullptr);
+            auto size = slotType.getPackedSizeInBytes();
+
+            if (output.isValueEndpoint())
+                return copy (dest, value, size);
+
+            auto prim = slotType.getPrimitiveType();
+            auto scalarType = getScalarType (prim);
+
+            if (prim.isBool() || ! scalarType.has_value())
+                w.location.throwError (Errors::unsupportedType());
+
+            auto elementSize = prim.getPackedSizeInBytes();
+            auto numElements = size / elementSize;
+            auto valueReg = toRegister (value, size);
+
+            for (size_t i = 0; i < numElements; ++i)
+            {
+                if (dest.kind == Location::Kind::state)
+                    emit (selectTypedOp (*scalarType, OpCode::accstate_f32, OpCode::accstate_f64, OpCode::accstate_i32, OpCode::accstate_i64),
+                          dest.offset + i * elementSize, valueReg + i * elementSize);
+                else
+                    emit (selectTypedOp (*scalarType, OpCode::acc_f32, OpCode::acc_f64, OpCode::acc_i32, OpCode::acc_i64),
+                          dest.reg, dest.offset + i * elementSize, valueReg + i * elementSize);
+            }
+        }
+
+        //==============================================================================
+        Location getVariable (heart::Variable& v)
+        {
+            auto found = variables.find (std::addressof (v));
+
+            if (found != variables.end())
+                return found->second;
+
+            Location l;
+
+            if (v.isExternal())
+            {
+                l = Location::inExternal (compiler.getExternalIndex (v));
+            }
+            else if (v.isState())
+            {
+                if (processor == nullptr)
+                    throwInternalCompilerError ("Unknown state variable", v.name.toString().c_str(), 0);
+
+                auto offset = processor->stateVariableOffsets.find (std::addressof (v));
+
+                if (offset == processor->stateVariableOffsets.end())
+                    throwInternalCompilerError ("Unknown state variable", v.name.toString().c_str(), 0);
+
+                l = Location::inState (offset->second);
+            }
+            else
+            {
+                SOUL_ASSERT (v.isFunctionLocal());
+                l = Location::inFrame (allocateFrameSlot (v.type.getPackedSizeInBytes()));
+            }
+
+            variables[std::addressof (v)] = l;
+            return l;
+        }
+
+        Location compileExpression (heart::Expression& e, const Type& targetType, const Location* hint)
+        {
+            auto sourceType = e.getType();
+
+            if (isIdentityCast (sourceType, targetType))
+                return compileExpression (e, hint);
+
+            return createCast (compileExpression (e), sourceType, targetType, hint);
+        }
+
+        Location compileExpression (heart::Expression& e, const Location* hint = nullptr)
+        {
+            if (auto v = cast<heart::Variable> (e))
+                return getVariable (*v);
+
+            if (auto c = cast<heart::Constant> (e))
+                return createConstant (c->value);
+
+            if (auto a = cast<heart::ArrayElement> (e))
+            {
+                auto parent = compileExpression (a->parent);
+                auto parentType = a->parent->getType().removeReferenceIfPresent();
+
+                if (a->isDynamic())
+                    return createElementAccess (parent, parentType, *a->dynamicIndex, a->isRangeTrusted);
+
+                auto offset = a->fixedStartIndex * getElementSize (parentType);
+
+                if (parentType.isUnsizedArray())
+                    return Location::indirect (toRegister (parent, sizeof (void*)), offset);
+
+                return withOffset (parent, offset);
+            }
+
+            if (auto s = cast<heart::StructElement> (e))
+            {
+                auto parent = compileExpression (s->parent);
+                auto& structure = s->getStruct();
+                auto index = s->getMemberIndex();
+                size_t offset = 0;
+
+                for (size_t i = 0; i < index; ++i)
+                    offset += structure.getMemberType (i).getPackedSizeInBytes();
+
+                return withOffset (parent, offset);
+            }
+
+            if (auto c = cast<heart::TypeCast> (e))
+                return compileExpression (c->source, c->destType, hint);
+
+            if (auto u = cast<heart::UnaryOperator> (e))
+                return compileUnaryOp (*u, hint);
+
+            if (auto b = cast<heart::BinaryOperator> (e))
+                return compileBinaryOp (*b, hint);
+
+            if (auto fc = cast<heart::PureFunctionCall> (e))
+                return compileCallExpression (fc->function, fc->arguments, hint);
+
+            if (auto p = cast<heart::ProcessorProperty> (e))
+                return compileProcessorProperty (*p);
+
+            e.location.throwError (Errors::notYetImplemented ("expression type"));
+        }
+
+        static size_t getElementSize (const Type& arrayOrVector)
+        {
+            if (arrayOrVector.isPrimitive() || arrayOrVector.isBoundedInt())
+                return arrayOrVector.getPackedSizeInBytes();
+
+            return arrayOrVector.getElementType().getPackedSizeInBytes();
+        }
+
+        Location createElementAccess (const Location& parent, const Type& parentType, heart::Expression& index, bool isRangeTrusted)
+        {
+            auto elementSize = getElementSize (parentType);
+            auto isUnsized = parentType.isUnsizedArray();
+            size_t size = (isUnsized || isRangeTrusted) ? 0 : parentType.getArrayOrVectorSize();
+            auto base = isUnsized ? toRegister (parent, sizeof (void*)) : addressOf (parent, parentType.getPackedSizeInBytes());
+            auto result = allocateTemp (sizeof (void*));
+
+            if (index.getType().isInteger64())
+                emit (OpCode::index64, result, base, toRegister (compileExpression (index), sizeof (int64_t)), elementSize, size);
+            else
+                emit (OpCode::index32, result, base, toRegister (compileExpression (index, PrimitiveType::int32, nullptr), sizeof (int32_t)), elementSize, size);
+
+            return Location::indirect (result, 0);
+        }
+
+        Location compileProcessorProperty (heart::ProcessorProperty& p)
+        {
+            using Property = heart::ProcessorProperty::Property;
+
+            if (processor == nullptr)
+                p.location.throwError (Errors::processorPropertyUsedOutsideDecl());
+
+            switch (p.property)
+            {
+                case Property::frequency:  return Location::inState (processor->frequencyOffset);
+                case Property::period:     return Location::inState (processor->periodOffset);
+                case Property::id:         return Location::inState (processor->idOffset);
+                case Property::session:    return createConstant (Value::createInt32 (compiler.settings.sessionID));
+                case Property::latency:    return createConstant (Value::createInt32 (processor->module.latency));
+                case Property::none:
+                default:                   p.location.throwError (Errors::unknownProperty());
+            }
+        }
+
+        //==============================================================================
+        /** Small primitives become immediate operands, and anything else is added to the
+            function's constant data, along with the positions of any constant table handles
+            that it contains, which get replaced by pointers when the code is relocated.
+        */
+        Location createConstant (const Value& v)
+        {
+            auto& type = v.getType();
+            auto size = type.getPackedSizeInBytes();
+            auto data = static_cast<const uint8_t*> (v.getPackedData());
+
+            if ((type.isPrimitive() || type.isBoundedInt()) && ! type.isUnsizedArray())
+            {
+                if (size == 1)  return Location::immediate (readValue<uint8_t> (data));
+                if (size == 4)  return Location::immediate (readValue<uint32_t> (data));
+                if (size == 8)  return Location::immediate (readValue<uint64_t> (data));
+            }
+
+            auto& constants = image.constantData;
+            auto offset = static_cast<uint32_t> (constants.size());
+            constants.insert (constants.end(), data, data + size);
+            constants.resize (offset + alignSlotSize (size));
+            findConstantHandles (type, offset);
+            return Location::inConstants (offset);
+        }
+
+        void findConstantHandles (const Type& type, size_t offset)
+        {
+            if (type.isUnsizedArray())
+            {
+                image.constantHandleOffsets.push_back (static_cast<uint32_t> (offset));
+            }
+            else if (type.isFixedSizeArray())
+            {
+                auto elementType = type.getArrayElementType();
+                auto elementSize = elementType.getPackedSizeInBytes();
+
+                if (containsUnsizedArray (elementType))
+                    for (size_t i = 0; i < type.getArraySize(); ++i)
+                        findConstantHandles (elementType, offset + i * elementSize);
+            }
+            else if (type.isStruct())
+            {
+                auto& s = type.getStructRef();
+
+                for (size_t i = 0; i < s.getNumMembers(); ++i)
+                {
+                    findConstantHandles (s.getMemberType (i), offset);
+                    offset += s.getMemberType (i).getPackedSizeInBytes();
+                }
+            }
+        }
+
+        static bool containsUnsizedArray (const Type& type)
+        {
+            if (type.isUnsizedArray())
+                return true;
+
+            if (type.isFixedSizeArray())
+                return containsUnsizedArray (type.getArrayElementType());
+
+            if (type.isStruct())
+            {
+                auto& s = type.getStructRef();
+
+                for (size_t i = 0; i < s.getNumMembers(); ++i)
+                    if (containsUnsizedArray (s.getMemberType (i)))
+                        return true;
+            }
+
+            return false;
+        }
+
+        //==============================================================================
+        Location compileCallExpression (heart::Function& target, ArrayView<pool_ref<heart::Expression>> args, const Location* hint)
+        {
+            if (auto native = compileIntrinsic (target, args, hint))
+                return *native;
+
+            auto calleeID = compiler.getFunctionID (target);
+            auto& callee = compiler.getImage (target, calleeID);
+            SOUL_ASSERT (args.size() == callee.parameters.size());
+
+            // All the arguments must be evaluated before any are copied into the new frame,
+            // because their evaluation may itself need to call functions
+            std::vector<Word> argumentOperands;
+
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                auto& param = callee.parameters[i];
+
+                if (param.isReference)
+                    argumentOperands.push_back (addressOf (compileExpression (args[i]), param.size));
+                else
+                    argumentOperands.push_back (toRegister (compileExpression (args[i], target.parameters[i]->type, nullptr), param.size));
+
+                argumentOperands.push_back (param.offset);
+                argumentOperands.push_back (param.isReference ? sizeof (void*) : param.size);
+            }
+
+            auto resultSize = callee.returnValueSize;
+            auto result = resultSize != 0 ? allocateResult (resultSize, 1, hint) : 0;
+
+            emit (OpCode::call, calleeID);
+            addRelocation (FunctionImage::RelocationType::function);
+            image.code.push_back (resultSize != 0 ? result : noRegister);
+            image.code.push_back (resultSize);
+            image.code.push_back (args.size());
+            image.code.insert (image.code.end(), argumentOperands.begin(), argumentOperands.end());
+
+            return Location::inFrame (result);
+        }
+
+        std::optional<Location> compileIntrinsic (heart::Function& f, ArrayView<pool_ref<heart::Expression>> args, const Location* hint)
+        {
+            if (f.intrinsicType == IntrinsicType::none)
+                return {};
+
+            auto& returnType = f.returnType;
+
+            if (f.intrinsicType == IntrinsicType::get_array_size)
+            {
+                auto arrayType = args.front()->getType().removeReferenceIfPresent();
+                auto resultType = Type (PrimitiveType::int32);
+
+                if (arrayType.isUnsizedArray())
+                {
+                    auto source = toRegister (compileExpression (args.front()), sizeof (void*));
+                    auto isCast = ! resultType.isIdentical (returnType.removeReferenceIfPresent().removeConstIfPresent());
+                    auto result = allocateResult (sizeof (int32_t), 1, isCast ? nullptr : hint);
+                    emit (OpCode::unsizedArraySize, result, source, 0);
+                    addRelocation (FunctionImage::RelocationType::unsizedArraySizes);
+                    return createCast (Location::inFrame (result), resultType, returnType, hint);
+                }
+
+                return createConstant (Value::createInt32 (arrayType.getArrayOrVectorSize()).castToTypeExpectingSuccess (returnType));
+            }
+
+            if (f.intrinsicType == IntrinsicType::sum || f.intrinsicType == IntrinsicType::product)
+            {
+                auto argType = args.front()->getType().removeReferenceIfPresent();
+
+                if (! (argType.isFixedSizeArray() || argType.isVector()) || ! returnType.isPrimitive()
+                      || ! argType.getElementType().isEqual (returnType, Type::ignoreConst))
+                    return {};
+
+                auto scalarType = getScalarType (returnType.getPrimitiveType());
+
+                if (! scalarType.has_value() || *scalarType == ScalarType::b)
+                    return {};
+
+                auto source = addressOf (compileExpression (args.front()), argType.getPackedSizeInBytes());
+                auto result = allocateResult (returnType.getPackedSizeInBytes(), 1, hint);
+
+                if (f.intrinsicType == IntrinsicType::product)
+                    emit (selectTypedOp (*scalarType, OpCode::product_f32, OpCode::product_f64, OpCode::product_i32, OpCode::product_i64),
+                          result, source, argType.getArrayOrVectorSize());
+                else
+                    emit (selectTypedOp (*scalarType, OpCode::sum_f32, OpCode::sum_f64, OpCode::sum_i32, OpCode::sum_i64),
+                          result, source, argType.getArrayOrVectorSize());
+
+                return Location::inFrame (result);
+            }
+
+            // The remaining intrinsics operate element-wise on primitives or vectors which all share the same type
+            if (args.empty() || args.size() != f.parameters.size())
+                return {};
+
+            auto argType = f.parameters.front()->type.removeReferenceIfPresent().removeConstIfPresent();
+
+            if (! argType.isPrimitiveOrVector() || argType.isBoundedInt())
+                return {};
+
+            for (auto& p : f.parameters)
+                if (! p->type.removeReferenceIfPresent().isEqual (argType, Type::ignoreConst))
+                    return {};
+
+            auto num = static_cast<uint32_t> (argType.isVector() ? argType.getVectorSize() : 1);
+            auto prim = argType.getPrimitiveType();
+            auto scalarType = getScalarType (prim);
+
+            if (! scalarType.has_value() || *scalarType == ScalarType::b)
+                return {};
+
+            auto isFloat = *scalarType == ScalarType::f32 || *scalarType == ScalarType::f64;
+            auto elementSize = prim.getPackedSizeInBytes();
+
+            auto compileArgs = [&]
+            {
+                std::vector<uint32_t> regs;
+
+                for (auto& a : args)
+                    regs.push_back (toRegister (compileExpression (a, argType, nullptr), argType.getPackedSizeInBytes()));
+
+                return regs;
+            };
+
+            if (f.intrinsicType == IntrinsicType::roundToInt)
+            {
+                if (! (isFloat && argType.isPrimitive() && returnType.isPrimitiveInteger()))
+                    return {};
+
+                auto arg = compileArgs().front();
+                auto result = allocateResult (8, 1, hint);
+                auto is64 = returnType.isInteger64();
+
+                if (*scalarType == ScalarType::f32)
+                    emit (is64 ? OpCode::roundToInt64_f32 : OpCode::roundToInt32_f32, result, arg);
+                else
+                    emit (is64 ? OpCode::roundToInt64_f64 : OpCode::roundToInt32_f64, result, arg);
+
+                return Location::inFrame (result);
+            }
+
+            if (f.intrinsicType == IntrinsicType::isnan || f.intrinsicType == IntrinsicType::isinf)
+            {
+                if (! (isFloat && returnType.isBool() && returnType.getVectorSize() == argType.getVectorSize()))
+                    return {};
+
+                auto isNaN = f.intrinsicType == IntrinsicType::isnan;
+                auto op = *scalarType == ScalarType::f32 ? (isNaN ? OpCode::isnan_f32 : OpCode::isinf_f32)
+                                                         : (isNaN ? OpCode::isnan_f64 : OpCode::isinf_f64);
+
+                return emitElementwise (op, compileArgs(), elementSize, 1, num, hint);
+            }
+
+            if (! returnType.isEqual (argType, Type::ignoreConst))
+                return {};
+
+            if (compiler.settings.useFastMaths)
+            {
+                if (auto fastOp = getFastIntrinsicOpCode (f.intrinsicType, *scalarType, args.size()))
+                {
+                    auto regs = compileArgs();
+                    auto result = allocateResult (argType.getPackedSizeInBytes(), num, hint);
+
+                    if (regs.size() == 1)
+                        emit (*fastOp, result, regs[0], num);
+                    else
+                        emit (*fastOp, result, regs[0], regs[1], num);
+
+                    return Location::inFrame (result);
+                }
+            }
+
+            auto op = getElementwiseIntrinsicOpCode (f.intrinsicType, *scalarType, args.size());
+
+            if (! op.has_value())
+                return {};
+
+            return emitElementwise (*op, compileArgs(), elementSize, elementSize, num, hint);
+        }
+
+        static std::optional<OpCode> getElementwiseIntrinsicOpCode (IntrinsicType type, ScalarType scalarType, size_t numArgs)
+        {
+            #define SOUL_TYPED_OP(name)        selectTypedOp (scalarType, OpCode::name##_f32, OpCode::name##_f64, OpCode::name##_i32, OpCode::name##_i64)
+            #define SOUL_INTRINSIC(name, args) case IntrinsicType::name:  if (numArgs != args) return {}; return SOUL_TYPED_OP (name);
+
+            switch (type)
+            {
+                SOUL_INTRINSIC (abs, 1)
+                SOUL_INTRINSIC (min, 2)
+                SOUL_INTRINSIC (max, 2)
+                SOUL_INTRINSIC (clamp, 3)
+                SOUL_INTRINSIC (wrap, 2)
+                default: break;
+            }
+
+            #undef SOUL_INTRINSIC
+            #undef SOUL_TYPED_OP
+
+            if (scalarType != ScalarType::f32 && scalarType != ScalarType::f64)
+                return {};
+
+            auto is32 = scalarType == ScalarType::f32;
+            #define SOUL_INTRINSIC(name, args) case IntrinsicType::name:  if (numArgs != args) return {}; return is32 ? OpCode::name##_f32 : OpCode::name##_f64;
+
+            switch (type)
+            {
+                SOUL_INTRINSIC (fmod, 2)
+                SOUL_INTRINSIC (remainder, 2)
+                SOUL_INTRINSIC (floor, 1)
+                SOUL_INTRINSIC (ceil, 1)
+                SOUL_INTRINSIC (addModulo2Pi, 2)
+                SOUL_INTRINSIC (sqrt, 1)
+                SOUL_INTRINSIC (pow, 2)
+                SOUL_INTRINSIC (exp, 1)
+                SOUL_INTRINSIC (log, 1)
+                SOUL_INTRINSIC (log10, 1)
+                SOUL_INTRINSIC (sin, 1)
+                SOUL_INTRINSIC (cos, 1)
+                SOUL_INTRINSIC (tan, 1)
+                SOUL_INTRINSIC (sinh, 1)
+                SOUL_INTRINSIC (cosh, 1)
+                SOUL_INTRINSIC (tanh, 1)
+                SOUL_INTRINSIC (asinh, 1)
+                SOUL_INTRINSIC (acosh, 1)
+                SOUL_INTRINSIC (atanh, 1)
+                SOUL_INTRINSIC (asin, 1)
+                SOUL_INTRINSIC (acos, 1)
+                SOUL_INTRINSIC (atan, 1)
+                SOUL_INTRINSIC (atan2, 2)
+                default: break;
+            }
+
+            #undef SOUL_INTRINSIC
+            return {};
+        }
+
+        static std::optional<OpCode> getFastIntrinsicOpCode (IntrinsicType type, ScalarType scalarType, size_t numArgs)
+        {
+            if (scalarType != ScalarType::f32 && scalarType != ScalarType::f64)
+                return {};
+
+            auto is32 = scalarType == ScalarType::f32;
+            #define SOUL_INTRINSIC(name, op, args) case IntrinsicType::name:  if (numArgs != args) return {}; return is32 ? OpCode::op##_f32 : OpCode::op##_f64;
+
+            switch (type)
+            {
+                SOUL_INTRINSIC (pow,   fastPow, 2)
+                SOUL_INTRINSIC (exp,   fastExp, 1)
+                SOUL_INTRINSIC (log,   fastLog, 1)
+                SOUL_INTRINSIC (log10, fastLog10, 1)
+                SOUL_INTRINSIC (sin,   fastSin, 1)
+                SOUL_INTRINSIC (cos,   fastCos, 1)
+                SOUL_INTRINSIC (tan,   fastTan, 1)
+                SOUL_INTRINSIC (sinh,  fastSinh, 1)
+                SOUL_INTRINSIC (cosh,  fastCosh, 1)
+                SOUL_INTRINSIC (tanh,  fastTanh, 1)
+                default: break;
+            }
+
+            #undef SOUL_INTRINSIC
+            return {};
+        }
+
+        //==============================================================================
+        static std::optional<ScalarType> getScalarType (PrimitiveType p)
+        {
+            if (p.isFloat32())    return ScalarType::f32;
+            if (p.isFloat64())    return ScalarType::f64;
+            if (p.isInteger32())  return ScalarType::i32;
+            if (p.isInteger64())  return ScalarType::i64;
+            if (p.isBool())       return ScalarType::b;
+            return {};
+        }
+
+        static OpCode selectTypedOp (ScalarType type, OpCode f32, OpCode f64, OpCode i32, OpCode i64)
+        {
+            switch (type)
+            {
+                case ScalarType::f32:  return f32;
+                case ScalarType::f64:  return f64;
+                case ScalarType::i32:  return i32;
+                case ScalarType::i64:  return i64;
+                case ScalarType::b:
+                default:               SOUL_ASSERT_FALSE; return f32;
+            }
+        }
+
+        /** Vector operations are unrolled into one instruction per element. */
+        Location emitElementwise (OpCode op, const std::vector<uint32_t>& args, size_t operandSize, size_t resultSize,
+                                  uint32_t num, const Location* hint)
+        {
+            auto result = allocateResult (resultSize * num, num, hint);
+
+            for (uint32_t i = 0; i < num; ++i)
+            {
+                emitOpCode (op);
+                image.code.push_back (result + i * resultSize);
+
+                for (auto a : args)
+                    image.code.push_back (a + i * operandSize);
+            }
+
+            return Location::inFrame (result);
+        }
+
+        Location compileUnaryOp (heart::UnaryOperator& u, const Location* hint)
+        {
+            auto type = u.getType().removeReferenceIfPresent();
+            auto source = compileExpression (u.source, type, nullptr);
+            auto num = static_cast<uint32_t> (type.isVector() ? type.getVectorSize() : 1);
+            auto prim = type.getPrimitiveType();
+            auto scalarType = getScalarType (prim);
+            auto elementSize = prim.getPackedSizeInBytes();
+            std::optional<OpCode> op;
+
+            if (scalarType.has_value())
+            {
+                switch (u.operation)
+                {
+                    case UnaryOp::Op::negate:
+                        if (*scalarType != ScalarType::b)
+                            op = selectTypedOp (*scalarType, OpCode::neg_f32, OpCode::neg_f64, OpCode::neg_i32, OpCode::neg_i64);
+
+                        break;
+
+                    case UnaryOp::Op::bitwiseNot:
+                        if (*scalarType == ScalarType::i32)  op = OpCode::not_i32;
+                        if (*scalarType == ScalarType::i64)  op = OpCode::not_i64;
+                        break;
+
+                    case UnaryOp::Op::logicalNot:
+                        if (*scalarType == ScalarType::b)    op = OpCode::not_b;
+                        break;
+
+                    case UnaryOp::Op::unknown:
+                    default:
+                        break;
+                }
+            }
+
+            if (! op.has_value())
+                u.location.throwError (Errors::unsupportedType());
+
+            return emitElementwise (*op, { toRegister (source, type.getPackedSizeInBytes()) }, elementSize, elementSize, num, hint);
+        }
+
+        Location compileBinaryOp (heart::BinaryOperator& b, const Location* hint)
+        {
+            auto lhsType = b.lhs->getType().removeReferenceIfPresent();
+            auto rhsType = b.rhs->getType().removeReferenceIfPresent();
+            auto types = BinaryOp::getTypes (b.operation, lhsType, rhsType);
+
+            if (! types.operandType.isValid())
+                b.location.throwError (Errors::unsupportedType());
+
+            auto operandType = types.operandType;
+            auto resultType = types.resultType;
+            auto resultHint = resultType.isBoundedInt() ? nullptr : hint;
+
+            if (auto superInstruction = compileFusedBinaryOp (b, operandType, resultHint))
+                return createBoundedResult (*superInstruction, resultType, hint);
+
+            auto lhs = compileExpression (b.lhs, operandType, nullptr);
+            auto rhs = compileExpression (b.rhs, operandType, nullptr);
+
+            if (operandType.isStringLiteral())
+                operandType = PrimitiveType::int32;
+
+            auto num = static_cast<uint32_t> (operandType.isVector() ? operandType.getVectorSize() : 1);
+            auto prim = operandType.getPrimitiveType();
+            auto scalarType = getScalarType (prim);
+            std::optional<OpCode> op;
+
+            if (scalarType.has_value())
+                op = getBinaryOpCode (b.operation, *scalarType);
+
+            if (! op.has_value())
+                b.location.throwError (Errors::unsupportedType());
+
+            auto operandSize = prim.getPackedSizeInBytes();
+            auto isComparison = BinaryOp::isComparisonOperator (b.operation) || BinaryOp::isEqualityOperator (b.operation);
+            auto args = { toRegister (lhs, operandType.getPackedSizeInBytes()),
+                          toRegister (rhs, operandType.getPackedSizeInBytes()) };
+
+            auto result = emitElementwise (*op, args, operandSize, isComparison ? 1 : operandSize, num, resultHint);
+            return createBoundedResult (result, resultType, hint);
+        }
+
+        Location createBoundedResult (const Location& result, const Type& resultType, const Location* hint)
+        {
+            if (resultType.isBoundedInt())
+                return createBoundedIntCast (result, PrimitiveType::int32, resultType, hint);
+
+            return result;
+        }
+
+        /** Spots the common patterns which have their own superinstructions: a multiply
+            feeding an add, and float or int32 arithmetic with a constant operand.
+        */
+        std::optional<Location> compileFusedBinaryOp (heart::BinaryOperator& b, const Type& operandType, const Location* hint)
+        {
+            if (! operandType.isPrimitive())
+                return {};
+
+            auto isFloat32 = operandType.isFloat32();
+            auto isFloat64 = operandType.isFloat64();
+            auto isInt32 = operandType.isInteger32() && ! operandType.isBoundedInt();
+            auto op = b.operation;
+
+            if (! (isFloat32 || isFloat64 || isInt32))
+                return {};
+
+            auto size = operandType.getPackedSizeInBytes();
+
+            auto isMultiplyOfType = [&] (heart::Expression& e) -> heart::BinaryOperator*
+            {
+                if (auto m = cast<heart::BinaryOperator> (e))
+                    if (m->operation == BinaryOp::Op::multiply
+                         && BinaryOp::getTypes (m->operation, m->lhs->getType().removeReferenceIfPresent(),
+                                                m->rhs->getType().removeReferenceIfPresent()).operandType.isIdentical (operandType))
+                        return m.get();
+
+                return nullptr;
+            };
+
+            if (op == BinaryOp::Op::add && (isFloat32 || isFloat64))
+            {
+                auto multiply = isMultiplyOfType (b.rhs);
+                auto* addend = b.lhs.getPointer();
+
+                if (multiply == nullptr)
+                {
+                    multiply = isMultiplyOfType (b.lhs);
+                    addend = b.rhs.getPointer();
+                }
+
+                if (multiply != nullptr)
+                {
+                    auto m1 = toRegister (compileExpression (multiply->lhs, operandType, nullptr), size);
+                    auto m2 = toRegister (compileExpression (multiply->rhs, operandType, nullptr), size);
+                    auto a = toRegister (compileExpression (*addend, operandType, nullptr), size);
+                    auto result = allocateResult (size, 1, hint);
+                    emit (isFloat32 ? OpCode::mulAdd_f32 : OpCode::mulAdd_f64, result, m1, m2, a);
+                    return Location::inFrame (result);
+                }
+            }
+
+            if (op != BinaryOp::Op::add && op != BinaryOp::Op::subtract && ! (op == BinaryOp::Op::multiply && ! isInt32))
+                return {};
+
+            auto* variable = b.lhs.getPointer();
+            auto* constant = b.rhs.getPointer();
+            auto isCommutative = op != BinaryOp::Op::subtract;
+
+            if (! isConstant (*constant))
+            {
+                if (! (isCommutative && isConstant (*variable)))
+                    return {};
+
+                std::swap (variable, constant);
+            }
+
+            auto value = cast<heart::Constant> (*constant)->value.castToTypeExpectingSuccess (operandType);
+            auto source = toRegister (compileExpression (*variable, operandType, nullptr), size);
+            auto result = allocateResult (size, 1, hint);
+
+            if (isInt32)
+            {
+                auto n = value.getAsInt32();
+
+                if (op == BinaryOp::Op::subtract)
+                    n = Ops::negate (n);
+
+                emit (OpCode::addImm_i32, result, source, static_cast<uint32_t> (n));
+                return Location::inFrame (result);
+            }
+
+            if (op == BinaryOp::Op::subtract)
+                value = value.negated();
+
+            if (isFloat32)
+                emit (op == BinaryOp::Op::multiply ? OpCode::mulImm_f32 : OpCode::addImm_f32, result, source, Function::toWord (value.getAsFloat()));
+            else
+                emit (op == BinaryOp::Op::multiply ? OpCode::mulImm_f64 : OpCode::addImm_f64, result, source, Function::toWord (value.getAsDouble()));
+
+            return Location::inFrame (result);
+        }
+
+        static bool isConstant (heart::Expression& e)
+        {
+            return is_type<heart::Constant> (e);
+        }
+
+        static std::optional<OpCode> getBinaryOpCode (BinaryOp::Op op, ScalarType type)
+        {
+            #define SOUL_TYPED_OP(name)  selectTypedOp (type, OpCode::name##_f32, OpCode::name##_f64, OpCode::name##_i32, OpCode::name##_i64)
+
+            if (type == ScalarType::b)
+            {
+                switch (op)
+                {
+                    case BinaryOp::Op::equals:      return OpCode::eq_b;
+                    case BinaryOp::Op::notEquals:   return OpCode::ne_b;
+                    case BinaryOp::Op::logicalAnd:  return OpCode::and_b;
+                    case BinaryOp::Op::logicalOr:   return OpCode::or_b;
+                    default:                        return {};
+                }
+            }
+
+            switch (op)
+            {
+                case BinaryOp::Op::add:                 return SOUL_TYPED_OP (add);
+                case BinaryOp::Op::subtract:            return SOUL_TYPED_OP (sub);
+                case BinaryOp::Op::multiply:            return SOUL_TYPED_OP (mul);
+                case BinaryOp::Op::divide:              return SOUL_TYPED_OP (div);
+                case BinaryOp::Op::modulo:              return SOUL_TYPED_OP (mod);
+                case BinaryOp::Op::equals:              return SOUL_TYPED_OP (eq);
+                case BinaryOp::Op::notEquals:           return SOUL_TYPED_OP (ne);
+                case BinaryOp::Op::lessThan:            return SOUL_TYPED_OP (lt);
+                case BinaryOp::Op::lessThanOrEqual:     return SOUL_TYPED_OP (le);
+                case BinaryOp::Op::greaterThan:         return SOUL_TYPED_OP (gt);
+                case BinaryOp::Op::greaterThanOrEqual:  return SOUL_TYPED_OP (ge);
+                default: break;
+            }
+
+            #undef SOUL_TYPED_OP
+
+            if (type != ScalarType::i32 && type != ScalarType::i64)
+                return {};
+
+            auto is32 = type == ScalarType::i32;
+
+            switch (op)
+            {
+                case BinaryOp::Op::bitwiseOr:           return is32 ? OpCode::or_i32   : OpCode::or_i64;
+                case BinaryOp::Op::bitwiseAnd:          return is32 ? OpCode::and_i32  : OpCode::and_i64;
+                case BinaryOp::Op::bitwiseXor:          return is32 ? OpCode::xor_i32  : OpCode::xor_i64;
+                case BinaryOp::Op::leftShift:           return is32 ? OpCode::shl_i32  : OpCode::shl_i64;
+                case BinaryOp::Op::rightShift:          return is32 ? OpCode::shr_i32  : OpCode::shr_i64;
+                case BinaryOp::Op::rightShiftUnsigned:  return is32 ? OpCode::shru_i32 : OpCode::shru_i64;
+                default:                                return {};
+            }
+        }
+
+        //==============================================================================
+        static bool isIdentityCast (const Type& sourceType, const Type& destType)
+        {
+            return sourceType.removeReferenceIfPresent().removeConstIfPresent()
+                     .isIdentical (destType.removeReferenceIfPresent().removeConstIfPresent());
+        }
+
+        Location createCast (const Location& source, const Type& sourceType, const Type& destType, const Location* hint)
+        {
+            auto src = sourceType.removeReferenceIfPresent().removeConstIfPresent();
+            auto dst = destType.removeReferenceIfPresent().removeConstIfPresent();
+
+            if (src.isIdentical (dst))
+                return source;
+
+            if (dst.isBoundedInt())
+                return createBoundedIntCast (source, src, dst, hint);
+
+            if (src.isBoundedInt())
+                return createCast (source, PrimitiveType::int32, dst, hint);
+
+            if (dst.isPrimitiveOrVector() && src.isPrimitiveOrVector())
+            {
+                auto srcNum = static_cast<uint32_t> (src.isVector() ? src.getVectorSize() : 1);
+                auto dstNum = static_cast<uint32_t> (dst.isVector() ? dst.getVectorSize() : 1);
+
+                if (srcNum != dstNum && srcNum != 1)
+                    throwCastError (src, dst);
+
+                if (srcNum == dstNum && src.getPrimitiveType() == dst.getPrimitiveType())
+                    return source;
+
+                return createConversion (source, src.getPrimitiveType(), dst.getPrimitiveType(), dstNum, srcNum == dstNum, hint);
+            }
+
+            if (dst.isFixedSizeArray() && src.isFixedSizeArray() && dst.getArraySize() == src.getArraySize())
+            {
+                auto srcElement = src.getArrayElementType();
+                auto dstElement = dst.getArrayElementType();
+
+                if (srcElement.hasIdenticalLayout (dstElement))
+                    return source;
+
+                if (srcElement.isPrimitiveOrVector() && dstElement.isPrimitiveOrVector()
+                     && srcElement.getVectorSize() == dstElement.getVectorSize())
+                    return createConversion (source, srcElement.getPrimitiveType(), dstElement.getPrimitiveType(),
+                                             static_cast<uint32_t> (dst.getArraySize() * dstElement.getVectorSize()), true, nullptr);
+            }
+
+            if (dst.isUnsizedArray() && src.isFixedSizeArray()
+                 && src.getArrayElementType().hasIdenticalLayout (dst.getArrayElementType()))
+            {
+                auto data = addressOf (source, src.getPackedSizeInBytes());
+                auto result = allocateResult (sizeof (void*), 1, hint);
+                emit (OpCode::toUnsizedArray, result, data, src.getArraySize(), 0);
+                addRelocation (FunctionImage::RelocationType::unsizedArraySizes);
+                return Location::inFrame (result);
+            }
+
+            if (src.hasIdenticalLayout (dst))
+                return source;
+
+            throwCastError (src, dst);
+        }
+
+        [[noreturn]] static void throwCastError (const Type& src, const Type& dst)
+        {
+            CodeLocation().throwError (Errors::notYetImplemented ("cast from " + src.getDescription() + " to " + dst.getDescription()));
+        }
+
+        static OpCode getConversionOpCode (ScalarType src, ScalarType dst)
+        {
+            #define SOUL_CONVERSIONS_FROM(t)  { OpCode::cvt_##t##_f32, OpCode::cvt_##t##_f64, OpCode::cvt_##t##_i32, OpCode::cvt_##t##_i64, OpCode::cvt_##t##_b }
+
+            static constexpr OpCode conversions[5][5] =
+            {
+                SOUL_CONVERSIONS_FROM (f32),
+                SOUL_CONVERSIONS_FROM (f64),
+                SOUL_CONVERSIONS_FROM (i32),
+                SOUL_CONVERSIONS_FROM (i64),
+                SOUL_CONVERSIONS_FROM (b)
+            };
+
+            #undef SOUL_CONVERSIONS_FROM
+            return conversions[static_cast<uint32_t> (src)][static_cast<uint32_t> (dst)];
+        }
+
+        /** Converts a number of elements, or if isElementwise is false, broadcasts a single
+            source element into them all.
+        */
+        Location createConversion (const Location& source, PrimitiveType src, PrimitiveType dst, uint32_t num, bool isElementwise, const Location* hint)
+        {
+            if (src == dst && isElementwise)
+                return source;
+
+            auto srcType = getScalarType (src);
+            auto dstType = getScalarType (dst);
+
+            if (! (srcType.has_value() && dstType.has_value()))
+                throwCastError (src, dst);
+
+            auto srcSize = src.getPackedSizeInBytes();
+            auto dstSize = dst.getPackedSizeInBytes();
+            auto sourceReg = toRegister (source, isElementwise ? srcSize * num : srcSize);
+
+            // Long arrays are converted by a single looping instruction rather than unrolled
+            if (num > maxUnrolledElements)
+            {
+                auto result = allocateTemp (dstSize * num);
+                emit (OpCode::convertArray, result, sourceReg, num, isElementwise ? srcSize : 0,
+                      static_cast<uint32_t> (*srcType), static_cast<uint32_t> (*dstType));
+                return Location::inFrame (result);
+            }
+
+            auto op = getConversionOpCode (*srcType, *dstType);
+            auto result = allocateResult (dstSize * num, num, hint);
+
+            for (uint32_t i = 0; i < num; ++i)
+                emit (op, result + i * dstSize, sourceReg + (isElementwise ? i * srcSize : 0));
+
+            return Location::inFrame (result);
+        }
+
+        static constexpr uint32_t maxUnrolledElements = 16;
+
+        Location createBoundedIntCast (const Location& source, const Type& sourceType, const Type& destType, const Location* hint)
+        {
+            if (sourceType.isFloatingPoint())
+                return createBoundedIntCast (createCast (source, sourceType, PrimitiveType::int64, nullptr), PrimitiveType::int64, destType, hint);
+
+            if (! (sourceType.isInteger32() || sourceType.isInteger64()))
+                throwCastError (sourceType, destType);
+
+            auto num = static_cast<uint32_t> (destType.isArrayOrVector() ? destType.getArrayOrVectorSize() : 1);
+            auto limit = static_cast<Word> (destType.getBoundedIntLimit());
+            auto is64 = sourceType.isInteger64();
+            auto sourceSize = is64 ? sizeof (int64_t) : sizeof (int32_t);
+            auto sourceReg = toRegister (source, sourceSize * num);
+            auto result = allocateResult (sizeof (int32_t) * num, num, hint);
+
+            auto op = destType.isWrapped() ? (is64 ? OpCode::wrapBounded64  : OpCode::wrapBounded32)
+                                           : (is64 ? OpCode::clampBounded64 : OpCode::clampBounded32);
+
+            for (uint32_t i = 0; i < num; ++i)
+                emit (op, result + i * sizeof (int32_t), sourceReg + i * sourceSize, limit);
+
+            return Location::inFrame (result);
+        }
+    };
+};
+
+} // namespace soul::bytecode
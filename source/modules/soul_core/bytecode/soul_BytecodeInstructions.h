@@ -0,0 +1,787 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+// Compilers which support the "labels as values" extension get a direct-threaded dispatch
+// loop, where each opcode is replaced by the address of its handler. Others use a switch.
+#ifndef SOUL_BYTECODE_USE_COMPUTED_GOTO
+ #if defined (__GNUC__) || defined (__clang__)
+  #define SOUL_BYTECODE_USE_COMPUTED_GOTO 1
+ #else
+  #define SOUL_BYTECODE_USE_COMPUTED_GOTO 0
+ #endif
+#endif
+
+namespace soul::bytecode
+{
+
+using interpreter::ExecutionContext;
+using interpreter::ResumePoint;
+using interpreter::Ops;
+using interpreter::IntrinsicFunctions;
+using interpreter::UnsizedArraySizes;
+using interpreter::readValue;
+using interpreter::writeValue;
+
+/** Each instruction is an opcode word followed by its operand words. Most operands are
+    "registers", which are byte offsets into the current stack frame.
+*/
+using Word = uint64_t;
+
+/** An operand value which means that an optional register isn't used. */
+static constexpr Word noRegister = ~static_cast<Word> (0);
+
+//==============================================================================
+#define SOUL_BYTECODE_NUMERIC_OPCODES(X, t) \
+    X (add_##t)  X (sub_##t)  X (mul_##t)  X (div_##t)  X (mod_##t)  X (neg_##t) \
+    X (lt_##t)   X (le_##t)   X (gt_##t)   X (ge_##t)   X (eq_##t)   X (ne_##t) \
+    X (sum_##t)  X (product_##t)  X (acc_##t)  X (accstate_##t) \
+    X (abs_##t)  X (min_##t)  X (max_##t)  X (clamp_##t)  X (wrap_##t)
+
+#define SOUL_BYTECODE_INTEGER_OPCODES(X, t) \
+    X (and_##t)  X (or_##t)  X (xor_##t)  X (shl_##t)  X (shr_##t)  X (shru_##t)  X (not_##t)
+
+#define SOUL_BYTECODE_FLOAT_OPCODES(X, t) \
+    X (fmod_##t)   X (remainder_##t)  X (floor_##t)  X (ceil_##t)  X (sqrt_##t)  X (pow_##t) \
+    X (exp_##t)    X (log_##t)   X (log10_##t) X (sin_##t)   X (cos_##t)   X (tan_##t) \
+    X (sinh_##t)   X (cosh_##t)  X (tanh_##t)  X (asinh_##t) X (acosh_##t) X (atanh_##t) \
+    X (asin_##t)   X (acos_##t)  X (atan_##t)  X (atan2_##t) X (addModulo2Pi_##t) \
+    X (isnan_##t)  X (isinf_##t) X (roundToInt32_##t)  X (roundToInt64_##t) \
+    X (addImm_##t) X (mulImm_##t) X (mulAdd_##t) \
+    X (fastPow_##t)  X (fastExp_##t)  X (fastLog_##t)  X (fastLog10_##t)  X (fastSin_##t) \
+    X (fastCos_##t)  X (fastTan_##t)  X (fastSinh_##t) X (fastCosh_##t)   X (fastTanh_##t)
+
+#define SOUL_BYTECODE_CONVERSION_OPCODES(X, t) \
+    X (cvt_##t##_f32)  X (cvt_##t##_f64)  X (cvt_##t##_i32)  X (cvt_##t##_i64)  X (cvt_##t##_b)
+
+#define SOUL_BYTECODE_OPCODES(X) \
+    X (mov1)  X (mov4)  X (mov8)  X (movN) \
+    X (imm1)  X (imm4)  X (imm8) \
+    X (load1)  X (load4)  X (load8)  X (loadN) \
+    X (store1) X (store4) X (store8) X (storeN) \
+    X (loadState1)   X (loadState4)   X (loadState8)   X (loadStateN) \
+    X (storeState1)  X (storeState4)  X (storeState8)  X (storeStateN) \
+    X (addressOfFrame)  X (addressOfState)  X (address)  X (addOffset)  X (index32)  X (index64) \
+    SOUL_BYTECODE_NUMERIC_OPCODES (X, f32) \
+    SOUL_BYTECODE_NUMERIC_OPCODES (X, f64) \
+    SOUL_BYTECODE_NUMERIC_OPCODES (X, i32) \
+    SOUL_BYTECODE_NUMERIC_OPCODES (X, i64) \
+    SOUL_BYTECODE_INTEGER_OPCODES (X, i32) \
+    SOUL_BYTECODE_INTEGER_OPCODES (X, i64) \
+    SOUL_BYTECODE_FLOAT_OPCODES (X, f32) \
+    SOUL_BYTECODE_FLOAT_OPCODES (X, f64) \
+    SOUL_BYTECODE_CONVERSION_OPCODES (X, f32) \
+    SOUL_BYTECODE_CONVERSION_OPCODES (X, f64) \
+    SOUL_BYTECODE_CONVERSION_OPCODES (X, i32) \
+    SOUL_BYTECODE_CONVERSION_OPCODES (X, i64) \
+    SOUL_BYTECODE_CONVERSION_OPCODES (X, b) \
+    X (convertArray) \
+    X (and_b)  X (or_b)  X (not_b)  X (eq_b)  X (ne_b) \
+    X (wrapBounded32)  X (clampBounded32)  X (wrapBounded64)  X (clampBounded64) \
+    X (addImm_i32) \
+    X (branchLT_i32)  X (branchLE_i32)  X (branchGT_i32)  X (branchGE_i32)  X (branchEQ_i32)  X (branchNE_i32) \
+    X (branchLTImm_i32)  X (branchLEImm_i32)  X (branchGTImm_i32)  X (branchGEImm_i32)  X (branchEQImm_i32)  X (branchNEImm_i32) \
+    X (toUnsizedArray)  X (unsizedArraySize) \
+    X (writeEvent32)  X (writeEvent64) \
+    X (jump)  X (branch)  X (call)  X (advance)  X (ret)
+
+/** The primitive types which the typed opcodes and conversions operate on. */
+enum class ScalarType  : uint32_t
+{
+    f32, f64, i32, i64, b
+};
+
+enum class OpCode  : uint32_t
+{
+   #define SOUL_BYTECODE_ENUM_ITEM(name)  name,
+    SOUL_BYTECODE_OPCODES (SOUL_BYTECODE_ENUM_ITEM)
+   #undef SOUL_BYTECODE_ENUM_ITEM
+    numOpCodes
+};
+
+//==============================================================================
+/**
+    A function which has been compiled to bytecode and relocated, ready to run.
+
+    The code contains absolute addresses and (when threaded) handler addresses, so it
+    can only be used in the process that created it. See FunctionImage for the
+    position-independent form that gets cached.
+
+    A function may also have a copy of its code for running batches of instances in
+    lockstep, where each instruction is dispatched once and then performed for every
+    instance, so the cost of decoding it is shared between them. The batch carries on
+    in lockstep until its instances take different branches, at which point each one
+    finishes the call by itself. Calls reconverge when they return.
+*/
+struct Function final  : public interpreter::EntryPoint
+{
+    std::vector<Word> code, batchCode;
+    std::vector<uint8_t> constantData;
+
+    bool execute (ExecutionContext& context, ResumePoint& resumePoint) const noexcept override
+    {
+        return run<false> (this, std::addressof (context), std::addressof (resumePoint), nullptr, 1);
+    }
+
+    void executeBatch (ExecutionContext* contexts, ResumePoint* resumePoints, bool* results, uint32_t numInstances) const noexcept override
+    {
+        if (batchCode.empty())
+            return EntryPoint::executeBatch (contexts, resumePoints, results, numInstances);
+
+        // Each run of consecutive instances which are at the same resume point goes together
+        for (uint32_t start = 0; start < numInstances;)
+        {
+            auto end = start + 1;
+
+            while (end < numInstances && end - start < maxBatchSize
+                    && resumePoints[end].statement == resumePoints[start].statement)
+                ++end;
+
+            if (end - start == 1)
+                results[start] = execute (contexts[start], resumePoints[start]);
+            else
+                run<true> (this, contexts + start, resumePoints + start, results + start, end - start);
+
+            start = end;
+        }
+    }
+
+    /** Returns the value that an opcode must be replaced with before its code can be run.
+        For threaded code this is the address of its handler, otherwise it's left alone.
+    */
+    static Word getOpCodeWord (OpCode op) noexcept
+    {
+       #if SOUL_BYTECODE_USE_COMPUTED_GOTO
+        static const void* const* handlers = getHandlerTable<false>();
+        return static_cast<Word> (reinterpret_cast<uintptr_t> (handlers[static_cast<uint32_t> (op)]));
+       #else
+        return static_cast<Word> (op);
+       #endif
+    }
+
+    /** Like getOpCodeWord(), but for the batchCode. */
+    static Word getBatchOpCodeWord (OpCode op) noexcept
+    {
+       #if SOUL_BYTECODE_USE_COMPUTED_GOTO
+        static const void* const* handlers = getHandlerTable<true>();
+        return static_cast<Word> (reinterpret_cast<uintptr_t> (handlers[static_cast<uint32_t> (op)]));
+       #else
+        return static_cast<Word> (op);
+       #endif
+    }
+
+    /** Immediate operands hold the bits of a 32 or 64-bit value in the low bits of a word. */
+    template <typename Type>
+    static Word toWord (Type value) noexcept
+    {
+        if constexpr (sizeof (Type) == 8)
+            return readValue<uint64_t> (std::addressof (value));
+        else if constexpr (sizeof (Type) == 4)
+            return readValue<uint32_t> (std::addressof (value));
+        else
+            return static_cast<Word> (readValue<uint8_t> (std::addressof (value)));
+    }
+
+    template <typename Type>
+    static Type fromWord (Word w) noexcept
+    {
+        static_assert (sizeof (Type) == 4 || sizeof (Type) == 8);
+
+        if constexpr (sizeof (Type) == 8)
+        {
+            return readValue<Type> (std::addressof (w));
+        }
+        else
+        {
+            auto bits = static_cast<uint32_t> (w);
+            return readValue<Type> (std::addressof (bits));
+        }
+    }
+
+private:
+    template <typename SourceType>
+    static void convertArrayFrom (uint8_t* dest, const uint8_t* source, Word num, Word stride, ScalarType destType) noexcept
+    {
+        for (Word i = 0; i < num; ++i)
+        {
+            auto v = readValue<SourceType> (source + i * stride);
+
+            switch (destType)
+            {
+                case ScalarType::f32:  writeValue<float>   (dest + i * sizeof (float),   static_cast<float> (v));   break;
+                case ScalarType::f64:  writeValue<double>  (dest + i * sizeof (double),  static_cast<double> (v));  break;
+                case ScalarType::i32:  writeValue<int32_t> (dest + i * sizeof (int32_t), static_cast<int32_t> (v)); break;
+                case ScalarType::i64:  writeValue<int64_t> (dest + i * sizeof (int64_t), static_cast<int64_t> (v)); break;
+                case ScalarType::b:    writeValue<uint8_t> (dest + i, v != 0 ? 1 : 0); break;
+                default:               break;
+            }
+        }
+    }
+
+    static void convertArray (uint8_t* dest, const uint8_t* source, Word num, Word stride, ScalarType sourceType, ScalarType destType) noexcept
+    {
+        switch (sourceType)
+        {
+            case ScalarType::f32:  convertArrayFrom<float>   (dest, source, num, stride, destType); break;
+            case ScalarType::f64:  convertArrayFrom<double>  (dest, source, num, stride, destType); break;
+            case ScalarType::i32:  convertArrayFrom<int32_t> (dest, source, num, stride, destType); break;
+            case ScalarType::i64:  convertArrayFrom<int64_t> (dest, source, num, stride, destType); break;
+            case ScalarType::b:    convertArrayFrom<uint8_t> (dest, source, num, stride, destType); break;
+            default:               break;
+        }
+    }
+
+   #if SOUL_BYTECODE_USE_COMPUTED_GOTO
+    template <bool isBatch>
+    static const void* const* getHandlerTable() noexcept
+    {
+        const void* const* table = nullptr;
+        run<isBatch> (nullptr, nullptr, nullptr, nullptr, 0, std::addressof (table));
+        return table;
+    }
+   #endif
+
+    /** Called when the instances in a batch have branched to different places. */
+    static void finishBatchSeparately (const Function& fn, ExecutionContext* contexts, ResumePoint* resumePoints,
+                                       bool* results, uint32_t numInstances, const Word* targets) noexcept
+    {
+        for (uint32_t i = 0; i < numInstances; ++i)
+        {
+            resumePoints[i].statement = static_cast<uint32_t> (targets[i]);
+            results[i] = run<false> (std::addressof (fn), contexts + i, resumePoints + i, nullptr, 1);
+        }
+    }
+
+    /** Runs the function's code for one instance, or its batchCode for a batch of them (which
+        must all be at the same resume point). For a single instance this returns true if it
+        stopped at an advance(), and for a batch the results array is set instead.
+    */
+    template <bool isBatch>
+    static bool run (const Function* fn, ExecutionContext* contexts, ResumePoint* resumePoints, bool* results,
+                     uint32_t numInstances, const void* const** handlerTable = nullptr) noexcept
+    {
+       #if SOUL_BYTECODE_USE_COMPUTED_GOTO
+        static const void* const handlers[] =
+        {
+           #define SOUL_BYTECODE_HANDLER_ADDRESS(name)  &&handler_##name,
+            SOUL_BYTECODE_OPCODES (SOUL_BYTECODE_HANDLER_ADDRESS)
+           #undef SOUL_BYTECODE_HANDLER_ADDRESS
+        };
+
+        if (handlerTable != nullptr)
+        {
+            *handlerTable = handlers;
+            return false;
+        }
+
+        #define SOUL_VM_OP(name)     handler_##name:
+        #define SOUL_VM_DISPATCH     goto *reinterpret_cast<const void*> (static_cast<uintptr_t> (*pc));
+       #else
+        (void) handlerTable;
+        #define SOUL_VM_OP(name)     case OpCode::name:
+        #define SOUL_VM_DISPATCH     continue;
+       #endif
+
+        #define SOUL_VM_NEXT(numOperands)   { pc += (numOperands) + 1; SOUL_VM_DISPATCH }
+
+        // Performs a statement for the current instance, or for each one in a batch
+        #define SOUL_VM_FOR_EACH(...) \
+            if constexpr (isBatch) \
+            { \
+                for (uint32_t i = 0; i < numInstances; ++i) \
+                { \
+                    context = contexts + i; \
+                    state = context->state; \
+                    frame = context->frame; \
+                    { __VA_ARGS__; } \
+                } \
+            } \
+            else \
+            { \
+                __VA_ARGS__; \
+            }
+
+        // Jumps to a target, unless the instances in a batch disagree about where to go
+        #define SOUL_VM_BRANCH(...) \
+            { \
+                if constexpr (isBatch) \
+                { \
+                    Word targets[maxBatchSize]; \
+                    bool allTheSame = true; \
+                    \
+                    for (uint32_t i = 0; i < numInstances; ++i) \
+                    { \
+                        context = contexts + i; \
+                        state = context->state; \
+                        frame = context->frame; \
+                        targets[i] = (__VA_ARGS__); \
+                        allTheSame = allTheSame && targets[i] == targets[0]; \
+                    } \
+                    \
+                    if (! allTheSame) \
+                    { \
+                        finishBatchSeparately (*fn, contexts, resumePoints, results, numInstances, targets); \
+                        return false; \
+                    } \
+                    \
+                    pc = code + targets[0]; \
+                } \
+                else \
+                { \
+                    pc = code + (__VA_ARGS__); \
+                } \
+                \
+                SOUL_VM_DISPATCH \
+            }
+
+        #define SOUL_VM_REG(n)              (frame + pc[n])
+        #define SOUL_VM_READ(T, n)          readValue<T> (SOUL_VM_REG (n))
+        #define SOUL_VM_WRITE(T, n, value)  writeValue<T> (SOUL_VM_REG (n), value)
+        #define SOUL_VM_POINTER(n)          readValue<uint8_t*> (SOUL_VM_REG (n))
+
+        #define SOUL_VM_UNARY(name, T, R, op) \
+            SOUL_VM_OP (name)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (R, 1, op (SOUL_VM_READ (T, 2)))) SOUL_VM_NEXT (2) }
+
+        #define SOUL_VM_BINARY(name, T, R, op) \
+            SOUL_VM_OP (name)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (R, 1, op (SOUL_VM_READ (T, 2), SOUL_VM_READ (T, 3)))) SOUL_VM_NEXT (3) }
+
+        // The fast maths ops process a whole vector in one instruction, so that the native
+        // compiler can use SIMD for the loop. Single values take the scalar variant.
+        #define SOUL_VM_FAST_UNARY(name, T, fn) \
+            SOUL_VM_OP (name) \
+            { \
+                SOUL_VM_FOR_EACH ( \
+                    auto dest = SOUL_VM_REG (1); \
+                    auto source = SOUL_VM_REG (2); \
+                    if (pc[3] == 1) \
+                        writeValue<T> (dest, FastIntrinsics::fn<T> (readValue<T> (source))); \
+                    else \
+                        for (Word e = 0; e < pc[3]; ++e) \
+                            writeValue<T> (dest + e * sizeof (T), VectorisableFastIntrinsics::fn<T> (readValue<T> (source + e * sizeof (T))))) \
+                SOUL_VM_NEXT (3) \
+            }
+
+        #define SOUL_VM_FAST_BINARY(name, T, fn) \
+            SOUL_VM_OP (name) \
+            { \
+                SOUL_VM_FOR_EACH ( \
+                    auto dest = SOUL_VM_REG (1); \
+                    auto source1 = SOUL_VM_REG (2); \
+                    auto source2 = SOUL_VM_REG (3); \
+                    if (pc[4] == 1) \
+                        writeValue<T> (dest, FastIntrinsics::fn<T> (readValue<T> (source1), readValue<T> (source2))); \
+                    else \
+                        for (Word e = 0; e < pc[4]; ++e) \
+                            writeValue<T> (dest + e * sizeof (T), VectorisableFastIntrinsics::fn<T> (readValue<T> (source1 + e * sizeof (T)), \
+                                                                                                     readValue<T> (source2 + e * sizeof (T))))) \
+                SOUL_VM_NEXT (4) \
+            }
+
+        #define SOUL_VM_TERNARY(name, T, op) \
+            SOUL_VM_OP (name)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (T, 1, op (SOUL_VM_READ (T, 2), SOUL_VM_READ (T, 3), SOUL_VM_READ (T, 4)))) SOUL_VM_NEXT (4) }
+
+        #define SOUL_VM_NUMERIC_HANDLERS(t, T) \
+            SOUL_VM_BINARY (add_##t, T, T, Ops::add<T>) \
+            SOUL_VM_BINARY (sub_##t, T, T, Ops::subtract<T>) \
+            SOUL_VM_BINARY (mul_##t, T, T, Ops::multiply<T>) \
+            SOUL_VM_BINARY (div_##t, T, T, Ops::divide<T>) \
+            SOUL_VM_BINARY (mod_##t, T, T, Ops::modulo<T>) \
+            SOUL_VM_UNARY  (neg_##t, T, T, Ops::negate<T>) \
+            SOUL_VM_BINARY (lt_##t,  T, uint8_t, Ops::lessThan<T>) \
+            SOUL_VM_BINARY (le_##t,  T, uint8_t, Ops::lessThanOrEqual<T>) \
+            SOUL_VM_BINARY (gt_##t,  T, uint8_t, Ops::greaterThan<T>) \
+            SOUL_VM_BINARY (ge_##t,  T, uint8_t, Ops::greaterThanOrEqual<T>) \
+            SOUL_VM_BINARY (eq_##t,  T, uint8_t, Ops::equals<T>) \
+            SOUL_VM_BINARY (ne_##t,  T, uint8_t, Ops::notEquals<T>) \
+            SOUL_VM_UNARY  (abs_##t, T, T, IntrinsicFunctions::abs<T>) \
+            SOUL_VM_BINARY (min_##t, T, T, IntrinsicFunctions::min<T>) \
+            SOUL_VM_BINARY (max_##t, T, T, IntrinsicFunctions::max<T>) \
+            SOUL_VM_TERNARY (clamp_##t, T, Ops::clamp<T>) \
+            SOUL_VM_BINARY (wrap_##t, T, T, Ops::wrap<T>) \
+            \
+            SOUL_VM_OP (sum_##t) \
+            { \
+                SOUL_VM_FOR_EACH ( \
+                    auto source = SOUL_VM_POINTER (2); \
+                    auto total = static_cast<T> (0); \
+                    for (Word e = 0; e < pc[3]; ++e) \
+                        total = Ops::add (total, readValue<T> (source + e * sizeof (T))); \
+                    SOUL_VM_WRITE (T, 1, total)) \
+                SOUL_VM_NEXT (3) \
+            } \
+            \
+            SOUL_VM_OP (product_##t) \
+            { \
+                SOUL_VM_FOR_EACH ( \
+                    auto source = SOUL_VM_POINTER (2); \
+                    auto total = static_cast<T> (1); \
+                    for (Word e = 0; e < pc[3]; ++e) \
+                        total = Ops::multiply (total, readValue<T> (source + e * sizeof (T))); \
+                    SOUL_VM_WRITE (T, 1, total)) \
+                SOUL_VM_NEXT (3) \
+            } \
+            \
+            SOUL_VM_OP (acc_##t) \
+            { \
+                SOUL_VM_FOR_EACH ( \
+                    auto dest = SOUL_VM_POINTER (1) + pc[2]; \
+                    writeValue<T> (dest, Ops::add (readValue<T> (dest), SOUL_VM_READ (T, 3)))) \
+                SOUL_VM_NEXT (3) \
+            } \
+            \
+            SOUL_VM_OP (accstate_##t) \
+            { \
+                SOUL_VM_FOR_EACH ( \
+                    auto dest = state + pc[1]; \
+                    writeValue<T> (dest, Ops::add (readValue<T> (dest), SOUL_VM_READ (T, 2)))) \
+                SOUL_VM_NEXT (2) \
+            }
+
+        #define SOUL_VM_INTEGER_HANDLERS(t, T) \
+            SOUL_VM_BINARY (and_##t,  T, T, Ops::bitwiseAnd<T>) \
+            SOUL_VM_BINARY (or_##t,   T, T, Ops::bitwiseOr<T>) \
+            SOUL_VM_BINARY (xor_##t,  T, T, Ops::bitwiseXor<T>) \
+            SOUL_VM_BINARY (shl_##t,  T, T, Ops::leftShift<T>) \
+            SOUL_VM_BINARY (shr_##t,  T, T, Ops::rightShift<T>) \
+            SOUL_VM_BINARY (shru_##t, T, T, Ops::rightShiftUnsigned<T>) \
+            SOUL_VM_UNARY  (not_##t,  T, T, Ops::bitwiseNot<T>)
+
+        #define SOUL_VM_FLOAT_HANDLERS(t, T) \
+            SOUL_VM_BINARY (fmod_##t,      T, T, IntrinsicFunctions::fmod<T>) \
+            SOUL_VM_BINARY (remainder_##t, T, T, IntrinsicFunctions::remainder<T>) \
+            SOUL_VM_UNARY  (floor_##t,     T, T, IntrinsicFunctions::floor<T>) \
+            SOUL_VM_UNARY  (ceil_##t,      T, T, IntrinsicFunctions::ceil<T>) \
+            SOUL_VM_UNARY  (sqrt_##t,      T, T, IntrinsicFunctions::sqrt<T>) \
+            SOUL_VM_BINARY (pow_##t,       T, T, IntrinsicFunctions::pow<T>) \
+            SOUL_VM_UNARY  (exp_##t,       T, T, IntrinsicFunctions::exp<T>) \
+            SOUL_VM_UNARY  (log_##t,       T, T, IntrinsicFunctions::log<T>) \
+            SOUL_VM_UNARY  (log10_##t,     T, T, IntrinsicFunctions::log10<T>) \
+            SOUL_VM_UNARY  (sin_##t,       T, T, IntrinsicFunctions::sin<T>) \
+            SOUL_VM_UNARY  (cos_##t,       T, T, IntrinsicFunctions::cos<T>) \
+            SOUL_VM_UNARY  (tan_##t,       T, T, IntrinsicFunctions::tan<T>) \
+            SOUL_VM_UNARY  (sinh_##t,      T, T, IntrinsicFunctions::sinh<T>) \
+            SOUL_VM_UNARY  (cosh_##t,      T, T, IntrinsicFunctions::cosh<T>) \
+            SOUL_VM_UNARY  (tanh_##t,      T, T, IntrinsicFunctions::tanh<T>) \
+            SOUL_VM_UNARY  (asinh_##t,     T, T, IntrinsicFunctions::asinh<T>) \
+            SOUL_VM_UNARY  (acosh_##t,     T, T, IntrinsicFunctions::acosh<T>) \
+            SOUL_VM_UNARY  (atanh_##t,     T, T, IntrinsicFunctions::atanh<T>) \
+            SOUL_VM_UNARY  (asin_##t,      T, T, IntrinsicFunctions::asin<T>) \
+            SOUL_VM_UNARY  (acos_##t,      T, T, IntrinsicFunctions::acos<T>) \
+            SOUL_VM_UNARY  (atan_##t,      T, T, IntrinsicFunctions::atan<T>) \
+            SOUL_VM_BINARY (atan2_##t,     T, T, IntrinsicFunctions::atan2<T>) \
+            SOUL_VM_BINARY (addModulo2Pi_##t, T, T, IntrinsicFunctions::addModulo2Pi<T>) \
+            SOUL_VM_UNARY  (isnan_##t,     T, uint8_t, IntrinsicFunctions::isnan<T>) \
+            SOUL_VM_UNARY  (isinf_##t,     T, uint8_t, IntrinsicFunctions::isinf<T>) \
+            SOUL_VM_OP (roundToInt32_##t)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int32_t, 1, static_cast<int32_t> (IntrinsicFunctions::roundToInt (SOUL_VM_READ (T, 2))))) SOUL_VM_NEXT (2) } \
+            SOUL_VM_OP (roundToInt64_##t)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int64_t, 1, static_cast<int64_t> (IntrinsicFunctions::roundToInt (SOUL_VM_READ (T, 2))))) SOUL_VM_NEXT (2) } \
+            SOUL_VM_OP (addImm_##t)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (T, 1, SOUL_VM_READ (T, 2) + fromWord<T> (pc[3]))) SOUL_VM_NEXT (3) } \
+            SOUL_VM_OP (mulImm_##t)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (T, 1, SOUL_VM_READ (T, 2) * fromWord<T> (pc[3]))) SOUL_VM_NEXT (3) } \
+            SOUL_VM_OP (mulAdd_##t)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (T, 1, SOUL_VM_READ (T, 2) * SOUL_VM_READ (T, 3) + SOUL_VM_READ (T, 4))) SOUL_VM_NEXT (4) } \
+            SOUL_VM_FAST_BINARY (fastPow_##t,   T, pow) \
+            SOUL_VM_FAST_UNARY  (fastExp_##t,   T, exp) \
+            SOUL_VM_FAST_UNARY  (fastLog_##t,   T, log) \
+            SOUL_VM_FAST_UNARY  (fastLog10_##t, T, log10) \
+            SOUL_VM_FAST_UNARY  (fastSin_##t,   T, sin) \
+            SOUL_VM_FAST_UNARY  (fastCos_##t,   T, cos) \
+            SOUL_VM_FAST_UNARY  (fastTan_##t,   T, tan) \
+            SOUL_VM_FAST_UNARY  (fastSinh_##t,  T, sinh) \
+            SOUL_VM_FAST_UNARY  (fastCosh_##t,  T, cosh) \
+            SOUL_VM_FAST_UNARY  (fastTanh_##t,  T, tanh)
+
+        #define SOUL_VM_CONVERSION(name, S, D) \
+            SOUL_VM_OP (name)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (D, 1, static_cast<D> (SOUL_VM_READ (S, 2)))) SOUL_VM_NEXT (2) }
+
+        #define SOUL_VM_CONVERSION_HANDLERS(t, T) \
+            SOUL_VM_CONVERSION (cvt_##t##_f32, T, float) \
+            SOUL_VM_CONVERSION (cvt_##t##_f64, T, double) \
+            SOUL_VM_CONVERSION (cvt_##t##_i32, T, int32_t) \
+            SOUL_VM_CONVERSION (cvt_##t##_i64, T, int64_t) \
+            SOUL_VM_OP (cvt_##t##_b)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t, 1, SOUL_VM_READ (T, 2) != 0 ? 1 : 0)) SOUL_VM_NEXT (2) }
+
+        #define SOUL_VM_COMPARE_AND_BRANCH(name, op) \
+            SOUL_VM_OP (name##_i32)     SOUL_VM_BRANCH (SOUL_VM_READ (int32_t, 1) op SOUL_VM_READ (int32_t, 2) ? pc[3] : pc[4]) \
+            SOUL_VM_OP (name##Imm_i32)  SOUL_VM_BRANCH (SOUL_VM_READ (int32_t, 1) op static_cast<int32_t> (pc[2]) ? pc[3] : pc[4])
+
+        auto code = isBatch ? fn->batchCode.data() : fn->code.data();
+        auto context = contexts;
+        auto state = context->state;
+        auto frame = context->frame;
+        auto pc = code + resumePoints->statement;
+
+       #if SOUL_BYTECODE_USE_COMPUTED_GOTO
+        SOUL_VM_DISPATCH
+       #else
+        for (;;)
+        {
+            switch (static_cast<OpCode> (*pc))
+            {
+       #endif
+
+        SOUL_VM_OP (mov1)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t,  1, SOUL_VM_READ (uint8_t,  2))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (mov4)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint32_t, 1, SOUL_VM_READ (uint32_t, 2))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (mov8)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint64_t, 1, SOUL_VM_READ (uint64_t, 2))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (movN)   { SOUL_VM_FOR_EACH (std::memmove (SOUL_VM_REG (1), SOUL_VM_REG (2), static_cast<size_t> (pc[3]))) SOUL_VM_NEXT (3) }
+
+        SOUL_VM_OP (imm1)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t,  1, static_cast<uint8_t>  (pc[2]))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (imm4)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint32_t, 1, static_cast<uint32_t> (pc[2]))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (imm8)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint64_t, 1, pc[2])) SOUL_VM_NEXT (2) }
+
+        // load/store: register, pointer register, offset from the pointer
+        SOUL_VM_OP (load1)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t,  1, readValue<uint8_t>  (SOUL_VM_POINTER (2) + pc[3]))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (load4)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint32_t, 1, readValue<uint32_t> (SOUL_VM_POINTER (2) + pc[3]))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (load8)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint64_t, 1, readValue<uint64_t> (SOUL_VM_POINTER (2) + pc[3]))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (loadN)  { SOUL_VM_FOR_EACH (std::memmove (SOUL_VM_REG (1), SOUL_VM_POINTER (2) + pc[3], static_cast<size_t> (pc[4]))) SOUL_VM_NEXT (4) }
+
+        SOUL_VM_OP (store1) { SOUL_VM_FOR_EACH (writeValue<uint8_t>  (SOUL_VM_POINTER (1) + pc[2], SOUL_VM_READ (uint8_t,  3))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (store4) { SOUL_VM_FOR_EACH (writeValue<uint32_t> (SOUL_VM_POINTER (1) + pc[2], SOUL_VM_READ (uint32_t, 3))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (store8) { SOUL_VM_FOR_EACH (writeValue<uint64_t> (SOUL_VM_POINTER (1) + pc[2], SOUL_VM_READ (uint64_t, 3))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (storeN) { SOUL_VM_FOR_EACH (std::memmove (SOUL_VM_POINTER (1) + pc[2], SOUL_VM_REG (3), static_cast<size_t> (pc[4]))) SOUL_VM_NEXT (4) }
+
+        SOUL_VM_OP (loadState1)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t,  1, readValue<uint8_t>  (state + pc[2]))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (loadState4)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint32_t, 1, readValue<uint32_t> (state + pc[2]))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (loadState8)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint64_t, 1, readValue<uint64_t> (state + pc[2]))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (loadStateN)  { SOUL_VM_FOR_EACH (std::memmove (SOUL_VM_REG (1), state + pc[2], static_cast<size_t> (pc[3]))) SOUL_VM_NEXT (3) }
+
+        SOUL_VM_OP (storeState1) { SOUL_VM_FOR_EACH (writeValue<uint8_t>  (state + pc[1], SOUL_VM_READ (uint8_t,  2))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (storeState4) { SOUL_VM_FOR_EACH (writeValue<uint32_t> (state + pc[1], SOUL_VM_READ (uint32_t, 2))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (storeState8) { SOUL_VM_FOR_EACH (writeValue<uint64_t> (state + pc[1], SOUL_VM_READ (uint64_t, 2))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (storeStateN) { SOUL_VM_FOR_EACH (std::memmove (state + pc[1], SOUL_VM_REG (2), static_cast<size_t> (pc[3]))) SOUL_VM_NEXT (3) }
+
+        SOUL_VM_OP (addressOfFrame)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t*, 1, frame + pc[2])) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (addressOfState)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t*, 1, state + pc[2])) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (address)         { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t*, 1, reinterpret_cast<uint8_t*> (static_cast<uintptr_t> (pc[2])))) SOUL_VM_NEXT (2) }
+        SOUL_VM_OP (addOffset)       { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (uint8_t*, 1, SOUL_VM_POINTER (2) + pc[3])) SOUL_VM_NEXT (3) }
+
+        // index: register, pointer register, index register, element size, array size (or 0 if the index is trusted)
+        SOUL_VM_OP (index32)
+        {
+            SOUL_VM_FOR_EACH (
+                auto index = SOUL_VM_READ (int32_t, 3);
+                auto size = static_cast<int32_t> (pc[5]);
+
+                if (size != 0 && (index < 0 || index >= size))
+                    index = Ops::wrap (index, size);
+
+                SOUL_VM_WRITE (uint8_t*, 1, SOUL_VM_POINTER (2) + static_cast<size_t> (index) * pc[4]))
+
+            SOUL_VM_NEXT (5)
+        }
+
+        SOUL_VM_OP (index64)
+        {
+            SOUL_VM_FOR_EACH (
+                auto index = SOUL_VM_READ (int64_t, 3);
+                auto size = static_cast<int64_t> (pc[5]);
+
+                if (size != 0 && (index < 0 || index >= size))
+                    index = Ops::wrap (index, size);
+
+                SOUL_VM_WRITE (uint8_t*, 1, SOUL_VM_POINTER (2) + static_cast<size_t> (index) * pc[4]))
+
+            SOUL_VM_NEXT (5)
+        }
+
+        SOUL_VM_NUMERIC_HANDLERS (f32, float)
+        SOUL_VM_NUMERIC_HANDLERS (f64, double)
+        SOUL_VM_NUMERIC_HANDLERS (i32, int32_t)
+        SOUL_VM_NUMERIC_HANDLERS (i64, int64_t)
+        SOUL_VM_INTEGER_HANDLERS (i32, int32_t)
+        SOUL_VM_INTEGER_HANDLERS (i64, int64_t)
+        SOUL_VM_FLOAT_HANDLERS (f32, float)
+        SOUL_VM_FLOAT_HANDLERS (f64, double)
+        SOUL_VM_CONVERSION_HANDLERS (f32, float)
+        SOUL_VM_CONVERSION_HANDLERS (f64, double)
+        SOUL_VM_CONVERSION_HANDLERS (i32, int32_t)
+        SOUL_VM_CONVERSION_HANDLERS (i64, int64_t)
+        SOUL_VM_CONVERSION_HANDLERS (b, uint8_t)
+
+        // convertArray: register, source register, count, source stride, source type, dest type
+        SOUL_VM_OP (convertArray)
+        {
+            SOUL_VM_FOR_EACH (convertArray (SOUL_VM_REG (1), SOUL_VM_REG (2), pc[3], pc[4], static_cast<ScalarType> (pc[5]), static_cast<ScalarType> (pc[6])))
+            SOUL_VM_NEXT (6)
+        }
+
+        SOUL_VM_BINARY (and_b, uint8_t, uint8_t, Ops::logicalAnd<uint8_t>)
+        SOUL_VM_BINARY (or_b,  uint8_t, uint8_t, Ops::logicalOr<uint8_t>)
+        SOUL_VM_UNARY  (not_b, uint8_t, uint8_t, Ops::logicalNot<uint8_t>)
+        SOUL_VM_BINARY (eq_b,  uint8_t, uint8_t, Ops::equals<uint8_t>)
+        SOUL_VM_BINARY (ne_b,  uint8_t, uint8_t, Ops::notEquals<uint8_t>)
+
+        // bounded ints: register, source register, limit
+        SOUL_VM_OP (wrapBounded32)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int32_t, 1, static_cast<int32_t> (Ops::wrap<int64_t> (SOUL_VM_READ (int32_t, 2), static_cast<int64_t> (pc[3]))))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (clampBounded32)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int32_t, 1, static_cast<int32_t> (Ops::clamp<int64_t> (SOUL_VM_READ (int32_t, 2), 0, static_cast<int64_t> (pc[3]) - 1)))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (wrapBounded64)   { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int32_t, 1, static_cast<int32_t> (Ops::wrap<int64_t> (SOUL_VM_READ (int64_t, 2), static_cast<int64_t> (pc[3]))))) SOUL_VM_NEXT (3) }
+        SOUL_VM_OP (clampBounded64)  { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int32_t, 1, static_cast<int32_t> (Ops::clamp<int64_t> (SOUL_VM_READ (int64_t, 2), 0, static_cast<int64_t> (pc[3]) - 1)))) SOUL_VM_NEXT (3) }
+
+        SOUL_VM_OP (addImm_i32)      { SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int32_t, 1, Ops::add (SOUL_VM_READ (int32_t, 2), static_cast<int32_t> (pc[3])))) SOUL_VM_NEXT (3) }
+
+        SOUL_VM_COMPARE_AND_BRANCH (branchLT, <)
+        SOUL_VM_COMPARE_AND_BRANCH (branchLE, <=)
+        SOUL_VM_COMPARE_AND_BRANCH (branchGT, >)
+        SOUL_VM_COMPARE_AND_BRANCH (branchGE, >=)
+        SOUL_VM_COMPARE_AND_BRANCH (branchEQ, ==)
+        SOUL_VM_COMPARE_AND_BRANCH (branchNE, !=)
+
+        // toUnsizedArray: register, pointer register, array size, UnsizedArraySizes
+        SOUL_VM_OP (toUnsizedArray)
+        {
+            SOUL_VM_FOR_EACH (
+                auto data = SOUL_VM_POINTER (2);
+                reinterpret_cast<UnsizedArraySizes*> (static_cast<uintptr_t> (pc[4]))->recordCast (data, static_cast<int32_t> (pc[3]));
+                SOUL_VM_WRITE (uint8_t*, 1, data))
+
+            SOUL_VM_NEXT (4)
+        }
+
+        SOUL_VM_OP (unsizedArraySize)
+        {
+            SOUL_VM_FOR_EACH (SOUL_VM_WRITE (int32_t, 1, reinterpret_cast<const UnsizedArraySizes*> (static_cast<uintptr_t> (pc[3]))->find (SOUL_VM_POINTER (2))))
+            SOUL_VM_NEXT (3)
+        }
+
+        // writeEvent: output index, type index, pointer register for the value, element register (or noRegister), array size
+        SOUL_VM_OP (writeEvent32)
+        {
+            SOUL_VM_FOR_EACH (
+                auto element = pc[4] == noRegister ? 0u : static_cast<uint32_t> (Ops::wrap (SOUL_VM_READ (int32_t, 4), static_cast<int32_t> (pc[5])));
+                context->eventOutputs->writeEvent (static_cast<uint32_t> (pc[1]), element, static_cast<uint32_t> (pc[2]), SOUL_VM_POINTER (3)))
+
+            SOUL_VM_NEXT (5)
+        }
+
+        SOUL_VM_OP (writeEvent64)
+        {
+            SOUL_VM_FOR_EACH (
+                auto element = static_cast<uint32_t> (Ops::wrap (SOUL_VM_READ (int64_t, 4), static_cast<int64_t> (pc[5])));
+                context->eventOutputs->writeEvent (static_cast<uint32_t> (pc[1]), element, static_cast<uint32_t> (pc[2]), SOUL_VM_POINTER (3)))
+
+            SOUL_VM_NEXT (5)
+        }
+
+        SOUL_VM_OP (jump)    { pc = code + pc[1]; SOUL_VM_DISPATCH }
+        SOUL_VM_OP (branch)  SOUL_VM_BRANCH (SOUL_VM_READ (uint8_t, 1) != 0 ? pc[2] : pc[3])
+
+        // call: function, result register (or noRegister), result size, number of arguments,
+        // then for each argument: source register, parameter offset, size
+        SOUL_VM_OP (call)
+        {
+            auto& callee = *reinterpret_cast<const Function*> (static_cast<uintptr_t> (pc[1]));
+            auto numArgs = pc[4];
+            auto args = pc + 5;
+
+            if constexpr (isBatch)
+            {
+                ExecutionContext calleeContexts[maxBatchSize];
+                ResumePoint starts[maxBatchSize];
+                bool calleeResults[maxBatchSize];
+
+                for (uint32_t i = 0; i < numInstances; ++i)
+                {
+                    auto& c = contexts[i];
+                    auto newFrame = c.stackTop;
+
+                    for (Word j = 0; j < numArgs; ++j)
+                        std::memcpy (newFrame + args[3 * j + 1], c.frame + args[3 * j], static_cast<size_t> (args[3 * j + 2]));
+
+                    calleeContexts[i] = { c.state, newFrame, newFrame + callee.frameSize, c.eventOutputs };
+                }
+
+                callee.executeBatch (calleeContexts, starts, calleeResults, numInstances);
+
+                if (pc[2] != noRegister)
+                    for (uint32_t i = 0; i < numInstances; ++i)
+                        std::memcpy (contexts[i].frame + pc[2], contexts[i].stackTop + callee.returnValueOffset, static_cast<size_t> (pc[3]));
+            }
+            else
+            {
+                auto newFrame = context->stackTop;
+
+                for (Word j = 0; j < numArgs; ++j)
+                    std::memcpy (newFrame + args[3 * j + 1], frame + args[3 * j], static_cast<size_t> (args[3 * j + 2]));
+
+                ExecutionContext calleeContext { state, newFrame, newFrame + callee.frameSize, context->eventOutputs };
+                ResumePoint start;
+                run<false> (std::addressof (callee), std::addressof (calleeContext), std::addressof (start), nullptr, 1);
+
+                if (pc[2] != noRegister)
+                    std::memcpy (frame + pc[2], newFrame + callee.returnValueOffset, static_cast<size_t> (pc[3]));
+            }
+
+            pc = args + 3 * numArgs;
+            SOUL_VM_DISPATCH
+        }
+
+        SOUL_VM_OP (advance)
+        {
+            auto next = static_cast<uint32_t> (pc + 1 - code);
+
+            for (uint32_t i = 0; i < numInstances; ++i)
+            {
+                resumePoints[i].statement = next;
+
+                if constexpr (isBatch)
+                    results[i] = true;
+            }
+
+            return true;
+        }
+
+        SOUL_VM_OP (ret)
+        {
+            if constexpr (isBatch)
+                for (uint32_t i = 0; i < numInstances; ++i)
+                    results[i] = false;
+
+            return false;
+        }
+
+       #if ! SOUL_BYTECODE_USE_COMPUTED_GOTO
+                case OpCode::numOpCodes:
+                default:
+                    SOUL_ASSERT_FALSE;
+                    return false;
+            }
+        }
+       #endif
+
+        #undef SOUL_VM_OP
+        #undef SOUL_VM_DISPATCH
+        #undef SOUL_VM_NEXT
+        #undef SOUL_VM_FOR_EACH
+        #undef SOUL_VM_BRANCH
+        #undef SOUL_VM_REG
+        #undef SOUL_VM_READ
+        #undef SOUL_VM_WRITE
+        #undef SOUL_VM_POINTER
+        #undef SOUL_VM_UNARY
+        #undef SOUL_VM_BINARY
+        #undef SOUL_VM_TERNARY
+        #undef SOUL_VM_FAST_UNARY
+        #undef SOUL_VM_FAST_BINARY
+        #undef SOUL_VM_NUMERIC_HANDLERS
+        #undef SOUL_VM_INTEGER_HANDLERS
+        #undef SOUL_VM_FLOAT_HANDLERS
+        #undef SOUL_VM_CONVERSION
+        #undef SOUL_VM_CONVERSION_HANDLERS
+        #undef SOUL_VM_COMPARE_AND_BRANCH
+    }
+};
+
+} // namespace soul::bytecode
@@ -0,0 +1,56 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#if ! SOUL_INSIDE_CORE_CPP
+ #error "Don't add this cpp file to your build, it gets included indirectly by soul_core.cpp"
+#endif
+
+namespace soul::bytecode
+{
+
+//==============================================================================
+/**
+    Creates performers which use the same graph runtime as the interpreter, but compile
+    each function into register bytecode, which is run by a threaded dispatch loop.
+*/
+struct BytecodePerformerFactory  : public PerformerFactory
+{
+    std::unique_ptr<Performer> createPerformer() override
+    {
+        return std::make_unique<interpreter::InterpreterPerformer> ([] (Program& program, const BuildSettings& settings,
+                                                                         const std::unordered_map<const heart::Variable*, const Value*>& externals,
+                                                                         UnsizedArraySizes& sizes, LinkerCache* cache)
+        {
+            return std::make_unique<Compiler> (program, settings, externals, sizes, cache);
+        });
+    }
+};
+
+} // namespace soul::bytecode
+
+namespace soul
+{
+
+std::unique_ptr<PerformerFactory> createBytecodePerformerFactory()
+{
+    return std::make_unique<bytecode::BytecodePerformerFactory>();
+}
+
+} // namespace soul
@@ -0,0 +1,3682 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#if ! SOUL_INSIDE_CORE_CPP
+ #error "Don't add this cpp file to your build, it gets included indirectly by soul_core.cpp"
+#endif
+
+namespace soul::cplusplus
+{
+
+//==============================================================================
+/** The types and helper functions which every generated class uses. This is emitted at
+    the top of each generated file, guarded so that several generated headers can be
+    included together. It's split into a few literals, because some compilers limit
+    how long a single literal can be.
+*/
+static const char* const runtimeCode[] =
+{
+R"SOUL_RUNTIME(#ifndef SOUL_GENERATED_CPP_RUNTIME_V1
+#define SOUL_GENERATED_CPP_RUNTIME_V1
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+namespace soul_generated
+{
+
+/** The types and helper functions used by classes which were generated from SOUL programs.
+    Each generated class inherits from this, so that its code can use them unqualified.
+*/
+struct Runtime
+{
+    template <typename T, int N> struct Vector  { T e[N]; };
+    template <typename T, int N> struct Array   { T e[N]; };
+    template <typename T> struct Slice          { T* data; int32_t size; };
+
+    template <typename T>        struct IsVector                { static constexpr bool value = false; };
+    template <typename T, int N> struct IsVector<Vector<T, N>>  { static constexpr bool value = true; };
+
+    // The flat run of primitives that a numeric type is made of
+    template <typename T>        struct Elements                { using Primitive = T; static constexpr int count = 1; };
+    template <typename T, int N> struct Elements<Vector<T, N>>  { using Primitive = T; static constexpr int count = N; };
+    template <typename T, int N> struct Elements<Array<T, N>>   { using Primitive = typename Elements<T>::Primitive; static constexpr int count = N * Elements<T>::count; };
+
+    template <typename T>        struct BoolResult                { using Type = bool; };
+    template <typename T, int N> struct BoolResult<Vector<T, N>>  { using Type = Vector<bool, N>; };
+
+    template <typename T> static constexpr bool isInteger = std::is_integral<T>::value && ! std::is_same<T, bool>::value;
+
+    template <typename T> static typename Elements<T>::Primitive* elementsOf (T& v) noexcept
+    {
+        return reinterpret_cast<typename Elements<T>::Primitive*> (std::addressof (v));
+    }
+
+    template <typename T> static const typename Elements<T>::Primitive* elementsOf (const T& v) noexcept
+    {
+        return reinterpret_cast<const typename Elements<T>::Primitive*> (std::addressof (v));
+    }
+
+    template <typename Result, typename T, typename Fn>
+    static Result mapElements (const T& a, Fn&& fn) noexcept
+    {
+        Result r;
+
+        for (int i = 0; i < Elements<T>::count; ++i)
+            r.e[i] = fn (a.e[i]);
+
+        return r;
+    }
+
+    template <typename Result, typename T, typename Fn>
+    static Result mapElements (const T& a, const T& b, Fn&& fn) noexcept
+    {
+        Result r;
+
+        for (int i = 0; i < Elements<T>::count; ++i)
+            r.e[i] = fn (a.e[i], b.e[i]);
+
+        return r;
+    }
+
+    template <typename Result, typename T, typename Fn>
+    static Result mapElements (const T& a, const T& b, const T& c, Fn&& fn) noexcept
+    {
+        Result r;
+
+        for (int i = 0; i < Elements<T>::count; ++i)
+            r.e[i] = fn (a.e[i], b.e[i], c.e[i]);
+
+        return r;
+    }
+
+    //==============================================================================
+    template <typename Dest, typename Source>
+    static Dest convertPrimitive (Source s) noexcept
+    {
+        if constexpr (std::is_same<Dest, bool>::value)
+            return s != 0;
+        else
+            return static_cast<Dest> (s);
+    }
+
+    template <typename T> static double toDouble (T v) noexcept
+    {
+        if constexpr (std::is_same<T, bool>::value)
+            return v ? 1.0 : 0.0;
+        else
+            return static_cast<double> (v);
+    }
+
+    template <typename T> static T fromDouble (double v) noexcept
+    {
+        if constexpr (std::is_same<T, bool>::value)
+            return v != 0;
+        else
+            return static_cast<T> (v);
+    }
+
+    /** Converts between primitives, or between vectors and arrays with the same number of
+        elements. A scalar source gets copied into every element of the result.
+    */
+    template <typename Dest, typename Source>
+    static Dest convert (const Source& source) noexcept
+    {
+        if constexpr (std::is_same<Dest, Source>::value)
+        {
+            return source;
+        }
+        else
+        {
+            Dest result;
+            auto d = elementsOf (result);
+            auto s = elementsOf (source);
+
+            for (int i = 0; i < Elements<Dest>::count; ++i)
+                d[i] = convertPrimitive<typename Elements<Dest>::Primitive> (s[Elements<Source>::count == 1 ? 0 : i]);
+
+            return result;
+        }
+    }
+
+    /** Converts to a wrapped or clamped integer type, whose values must lie between 0 and limit - 1. */
+    template <bool isWrapped, typename Dest, typename Source>
+    static Dest convertBounded (const Source& source, int64_t limit) noexcept
+    {
+        Dest result;
+        auto d = elementsOf (result);
+        auto s = elementsOf (source);
+
+        for (int i = 0; i < Elements<Dest>::count; ++i)
+        {
+            auto v = static_cast<int64_t> (s[Elements<Source>::count == 1 ? 0 : i]);
+
+            if constexpr (isWrapped)
+                v = Ops::wrap<int64_t> (v, limit);
+            else
+                v = Ops::clamp<int64_t> (v, 0, limit - 1);
+
+            d[i] = static_cast<int32_t> (v);
+        }
+
+        return result;
+    }
+
+    /** Converts each element via a double, which is how connections between endpoints of different types behave. */
+    template <typename Dest, typename Source>
+    static void convertElements (Dest& dest, const Source& source) noexcept
+    {
+        auto d = elementsOf (dest);
+        auto s = elementsOf (source);
+
+        for (int i = 0; i < Elements<Dest>::count; ++i)
+            d[i] = fromDouble<typename Elements<Dest>::Primitive> (toDouble (s[Elements<Source>::count == 1 ? 0 : i]));
+    }
+
+    /** Reinterprets a value as a different type which has the same layout. */
+    template <typename Dest, typename Source>
+    static Dest bitCast (const Source& source) noexcept
+    {
+        static_assert (sizeof (Dest) == sizeof (Source), "bitCast needs types of the same size");
+        Dest result;
+        std::memcpy (std::addressof (result), std::addressof (source), sizeof (Dest));
+        return result;
+    }
+
+    template <typename Dest, typename Source>
+    static void copyRaw (Dest& dest, const Source& source) noexcept
+    {
+        static_assert (sizeof (Dest) == sizeof (Source), "copyRaw needs types of the same size");
+        std::memcpy (std::addressof (dest), std::addressof (source), sizeof (Dest));
+    }
+
+    template <typename Element, typename T, int N>
+    static Slice<Element> makeSlice (const Array<T, N>& source) noexcept
+    {
+        return { reinterpret_cast<Element*> (const_cast<T*> (source.e)), N };
+    }
+
+    /** Returns a sub-range of an array or vector as a reference to a smaller array or vector. */
+    template <typename Result, typename T> static Result& subArray (T* start) noexcept                { return *reinterpret_cast<Result*> (start); }
+    template <typename Result, typename T> static const Result& subArray (const T* start) noexcept    { return *reinterpret_cast<const Result*> (start); }
+
+    template <typename IndexType>
+    static IndexType wrapIndex (IndexType index, IndexType size) noexcept
+    {
+        if (index < 0 || index >= size)
+        {
+            index %= size;
+
+            if (index < 0)
+                index += size;
+        }
+
+        return index;
+    }
+
+    static int64_t floorDivide (int64_t n, int64_t d) noexcept
+    {
+        auto q = n / d;
+        return (n % d != 0 && n < 0) ? q - 1 : q;
+    }
+
+    template <typename T> static T& asMutable (const T& v) noexcept             { return const_cast<T&> (v); }
+    template <typename T> static const void* addressOf (const T& v) noexcept    { return std::addressof (v); }
+
+    template <typename T> static void accumulate (T& dest, const T& value) noexcept
+    {
+        auto d = elementsOf (dest);
+        auto s = elementsOf (value);
+
+        for (int i = 0; i < Elements<T>::count; ++i)
+            d[i] = Ops::add (d[i], s[i]);
+    }
+)SOUL_RUNTIME",
+
+R"SOUL_RUNTIME(
+    //==============================================================================
+    #define SOUL_GENERATED_ELEMENTWISE_1(name, Result) \
+        if constexpr (IsVector<T>::value) return mapElements<Result> (a, [] (auto x) { return name (x); }); else
+    #define SOUL_GENERATED_ELEMENTWISE_2(name, Result) \
+        if constexpr (IsVector<T>::value) return mapElements<Result> (a, b, [] (auto x, auto y) { return name (x, y); }); else
+    #define SOUL_GENERATED_ELEMENTWISE_3(name, Result) \
+        if constexpr (IsVector<T>::value) return mapElements<Result> (a, b, c, [] (auto x, auto y, auto z) { return name (x, y, z); }); else
+
+    /** The operators, with integer overflow wrapping round and division by zero giving zero. */
+    struct Ops
+    {
+        template <typename T> using Unsigned = typename std::make_unsigned<T>::type;
+        template <typename T> using Bool = typename BoolResult<T>::Type;
+
+        template <typename T> static T add (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (add, T)
+            if constexpr (isInteger<T>) return static_cast<T> (static_cast<Unsigned<T>> (a) + static_cast<Unsigned<T>> (b));
+            else return a + b;
+        }
+
+        template <typename T> static T subtract (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (subtract, T)
+            if constexpr (isInteger<T>) return static_cast<T> (static_cast<Unsigned<T>> (a) - static_cast<Unsigned<T>> (b));
+            else return a - b;
+        }
+
+        template <typename T> static T multiply (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (multiply, T)
+            if constexpr (isInteger<T>) return static_cast<T> (static_cast<Unsigned<T>> (a) * static_cast<Unsigned<T>> (b));
+            else return a * b;
+        }
+
+        template <typename T> static T divide (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (divide, T)
+            {
+                if constexpr (isInteger<T>)
+                {
+                    if (b == 0)   return 0;
+                    if (b == -1)  return subtract (T (0), a);
+                }
+
+                return a / b;
+            }
+        }
+
+        template <typename T> static T modulo (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (modulo, T)
+            if constexpr (isInteger<T>) return (b == 0 || b == -1) ? 0 : a % b;
+            else return b != 0 ? static_cast<T> (std::fmod (a, b)) : 0;
+        }
+
+        template <typename T> static T bitwiseOr (T a, T b) noexcept    { SOUL_GENERATED_ELEMENTWISE_2 (bitwiseOr, T)  return a | b; }
+        template <typename T> static T bitwiseAnd (T a, T b) noexcept   { SOUL_GENERATED_ELEMENTWISE_2 (bitwiseAnd, T) return a & b; }
+        template <typename T> static T bitwiseXor (T a, T b) noexcept   { SOUL_GENERATED_ELEMENTWISE_2 (bitwiseXor, T) return a ^ b; }
+
+        template <typename T> static T leftShift (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (leftShift, T)
+            return (b >= 0 && b < static_cast<T> (sizeof (T) * 8)) ? static_cast<T> (static_cast<Unsigned<T>> (a) << b) : 0;
+        }
+
+        template <typename T> static T rightShift (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (rightShift, T)
+            return (b >= 0 && b < static_cast<T> (sizeof (T) * 8)) ? static_cast<T> (a >> b) : (a < 0 ? -1 : 0);
+        }
+
+        template <typename T> static T rightShiftUnsigned (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (rightShiftUnsigned, T)
+            return (b >= 0 && b < static_cast<T> (sizeof (T) * 8)) ? static_cast<T> (static_cast<Unsigned<T>> (a) >> b) : 0;
+        }
+
+        template <typename T> static Bool<T> logicalOr (T a, T b) noexcept            { SOUL_GENERATED_ELEMENTWISE_2 (logicalOr, Bool<T>)          return a || b; }
+        template <typename T> static Bool<T> logicalAnd (T a, T b) noexcept           { SOUL_GENERATED_ELEMENTWISE_2 (logicalAnd, Bool<T>)         return a && b; }
+        template <typename T> static Bool<T> equals (T a, T b) noexcept               { SOUL_GENERATED_ELEMENTWISE_2 (equals, Bool<T>)             return a == b; }
+        template <typename T> static Bool<T> notEquals (T a, T b) noexcept            { SOUL_GENERATED_ELEMENTWISE_2 (notEquals, Bool<T>)          return a != b; }
+        template <typename T> static Bool<T> lessThan (T a, T b) noexcept             { SOUL_GENERATED_ELEMENTWISE_2 (lessThan, Bool<T>)           return a < b; }
+        template <typename T> static Bool<T> lessThanOrEqual (T a, T b) noexcept      { SOUL_GENERATED_ELEMENTWISE_2 (lessThanOrEqual, Bool<T>)    return a <= b; }
+        template <typename T> static Bool<T> greaterThan (T a, T b) noexcept          { SOUL_GENERATED_ELEMENTWISE_2 (greaterThan, Bool<T>)        return a > b; }
+        template <typename T> static Bool<T> greaterThanOrEqual (T a, T b) noexcept   { SOUL_GENERATED_ELEMENTWISE_2 (greaterThanOrEqual, Bool<T>) return a >= b; }
+
+        template <typename T> static T negate (T a) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_1 (negate, T)
+            if constexpr (isInteger<T>) return subtract (T (0), a);
+            else return -a;
+        }
+
+        template <typename T> static T bitwiseNot (T a) noexcept            { SOUL_GENERATED_ELEMENTWISE_1 (bitwiseNot, T)       return static_cast<T> (~a); }
+        template <typename T> static Bool<T> logicalNot (T a) noexcept      { SOUL_GENERATED_ELEMENTWISE_1 (logicalNot, Bool<T>) return ! a; }
+
+        template <typename T> static T wrap (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (wrap, T)
+            {
+                if (b == 0)
+                    return 0;
+
+                if constexpr (isInteger<T>)
+                    a = modulo (a, b);
+                else
+                    a = static_cast<T> (std::fmod (a, b));
+
+                return a < 0 ? a + b : a;
+            }
+        }
+
+        template <typename T> static T clamp (T a, T b, T c) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_3 (clamp, T)
+            return a < b ? b : (a > c ? c : a);
+        }
+    };
+
+    //==============================================================================
+    #define SOUL_GENERATED_UNARY_MATHS(name) \
+        template <typename T> static T name (T a) noexcept  { SOUL_GENERATED_ELEMENTWISE_1 (name, T) return static_cast<T> (std::name (a)); }
+
+    /** The intrinsic library functions which have a native implementation. */
+    struct Intrinsics
+    {
+        template <typename T> static T abs (T a) noexcept           { SOUL_GENERATED_ELEMENTWISE_1 (abs, T) return a < 0 ? Ops::negate (a) : a; }
+        template <typename T> static T min (T a, T b) noexcept      { SOUL_GENERATED_ELEMENTWISE_2 (min, T) return a < b ? a : b; }
+        template <typename T> static T max (T a, T b) noexcept      { SOUL_GENERATED_ELEMENTWISE_2 (max, T) return a > b ? a : b; }
+        template <typename T> static T fmod (T a, T b) noexcept     { SOUL_GENERATED_ELEMENTWISE_2 (fmod, T) return b != 0 ? static_cast<T> (std::fmod (a, b)) : 0; }
+        template <typename T> static T remainder (T a, T b) noexcept{ SOUL_GENERATED_ELEMENTWISE_2 (remainder, T) return b != 0 ? static_cast<T> (std::remainder (a, b)) : 0; }
+        template <typename T> static T pow (T a, T b) noexcept      { SOUL_GENERATED_ELEMENTWISE_2 (pow, T) return static_cast<T> (std::pow (a, b)); }
+        template <typename T> static T atan2 (T a, T b) noexcept    { SOUL_GENERATED_ELEMENTWISE_2 (atan2, T) return static_cast<T> (std::atan2 (a, b)); }
+
+        SOUL_GENERATED_UNARY_MATHS (floor)
+        SOUL_GENERATED_UNARY_MATHS (ceil)
+        SOUL_GENERATED_UNARY_MATHS (sqrt)
+        SOUL_GENERATED_UNARY_MATHS (exp)
+        SOUL_GENERATED_UNARY_MATHS (log)
+        SOUL_GENERATED_UNARY_MATHS (log10)
+        SOUL_GENERATED_UNARY_MATHS (sin)
+        SOUL_GENERATED_UNARY_MATHS (cos)
+        SOUL_GENERATED_UNARY_MATHS (tan)
+        SOUL_GENERATED_UNARY_MATHS (sinh)
+        SOUL_GENERATED_UNARY_MATHS (cosh)
+        SOUL_GENERATED_UNARY_MATHS (tanh)
+        SOUL_GENERATED_UNARY_MATHS (asinh)
+        SOUL_GENERATED_UNARY_MATHS (acosh)
+        SOUL_GENERATED_UNARY_MATHS (atanh)
+        SOUL_GENERATED_UNARY_MATHS (asin)
+        SOUL_GENERATED_UNARY_MATHS (acos)
+        SOUL_GENERATED_UNARY_MATHS (atan)
+
+        template <typename T> static typename BoolResult<T>::Type isnan (T a) noexcept   { SOUL_GENERATED_ELEMENTWISE_1 (isnan, typename BoolResult<T>::Type) return std::isnan (a); }
+        template <typename T> static typename BoolResult<T>::Type isinf (T a) noexcept   { SOUL_GENERATED_ELEMENTWISE_1 (isinf, typename BoolResult<T>::Type) return std::isinf (a); }
+
+        template <typename T> static T addModulo2Pi (T a, T b) noexcept
+        {
+            SOUL_GENERATED_ELEMENTWISE_2 (addModulo2Pi, T)
+            {
+                constexpr auto twoPi = static_cast<T> (3.141592653589793238 * 2.0);
+                a += b;
+                return a >= twoPi ? remainder (a, twoPi) : a;
+            }
+        }
+
+        template <typename Result, typename T> static Result roundToInt (T a) noexcept
+        {
+            return static_cast<Result> (a + (a < 0 ? static_cast<T> (-0.5) : static_cast<T> (0.5)));
+        }
+
+        template <typename Result, typename T> static Result sum (const T& a) noexcept
+        {
+            auto total = static_cast<Result> (0);
+
+            for (int i = 0; i < Elements<T>::count; ++i)
+                total = Ops::add (total, elementsOf (a)[i]);
+
+            return total;
+        }
+
+        template <typename Result, typename T> static Result product (const T& a) noexcept
+        {
+            auto total = static_cast<Result> (1);
+
+            for (int i = 0; i < Elements<T>::count; ++i)
+                total = Ops::multiply (total, elementsOf (a)[i]);
+
+            return total;
+        }
+    };
+
+    #undef SOUL_GENERATED_UNARY_MATHS
+    #undef SOUL_GENERATED_ELEMENTWISE_1
+    #undef SOUL_GENERATED_ELEMENTWISE_2
+    #undef SOUL_GENERATED_ELEMENTWISE_3
+)SOUL_RUNTIME",
+
+R"SOUL_RUNTIME(
+    //==============================================================================
+    enum class StreamRead
+    {
+        single,       // read the source frame at the current position
+        interpolate,  // interpolate between the two most recent frames of a slower source
+        average       // average all the frames of a faster source that fall within a frame
+    };
+
+    /** Reads a source stream at the given position and adds it to a destination frame. */
+    template <StreamRead mode, typename Dest, typename Source, typename GetFrame>
+    static void addStream (Dest& dest, int64_t position, int64_t sourceTicks, int64_t destTicks, GetFrame&& getFrame) noexcept
+    {
+        constexpr int numSourceElements = Elements<Source>::count;
+        double total[numSourceElements] = {};
+        auto frame = floorDivide (position, sourceTicks);
+
+        auto read = [&] (int64_t f, double proportion)
+        {
+            auto s = elementsOf (static_cast<const Source&> (getFrame (f)));
+
+            for (int i = 0; i < numSourceElements; ++i)
+                total[i] += proportion * toDouble (s[i]);
+        };
+
+        if constexpr (mode == StreamRead::single)
+        {
+            read (frame, 1.0);
+        }
+        else if constexpr (mode == StreamRead::interpolate)
+        {
+            auto proportion = static_cast<double> (position - frame * sourceTicks) / static_cast<double> (sourceTicks);
+            read (frame - 1, 1.0 - proportion);
+            read (frame, proportion);
+        }
+        else
+        {
+            auto first = floorDivide (position - destTicks, sourceTicks) + 1;
+            auto proportion = 1.0 / static_cast<double> (frame - first + 1);
+
+            for (auto f = first; f <= frame; ++f)
+                read (f, proportion);
+        }
+
+        auto d = elementsOf (dest);
+
+        for (int i = 0; i < Elements<Dest>::count; ++i)
+            d[i] = fromDouble<typename Elements<Dest>::Primitive> (toDouble (d[i]) + total[numSourceElements == 1 ? 0 : i]);
+    }
+
+    template <typename Frame>
+    static void setRamp (double* increments, const Frame& current, const Frame& target, uint32_t numFrames) noexcept
+    {
+        auto c = elementsOf (current);
+        auto t = elementsOf (target);
+
+        for (int i = 0; i < Elements<Frame>::count; ++i)
+            increments[i] = (toDouble (t[i]) - toDouble (c[i])) / numFrames;
+    }
+
+    template <typename Frame>
+    static void applyRamp (Frame& frame, const double* increments) noexcept
+    {
+        auto f = elementsOf (frame);
+
+        for (int i = 0; i < Elements<Frame>::count; ++i)
+            f[i] = fromDouble<typename Elements<Frame>::Primitive> (toDouble (f[i]) + increments[i]);
+    }
+
+    //==============================================================================
+    /** A ring-buffer holding the most recent frames written to a stream output. */
+    template <typename Frame, uint32_t numFrames>
+    struct StreamBuffer
+    {
+        static_assert ((numFrames & (numFrames - 1)) == 0, "The size must be a power of 2");
+
+        Frame& get (int64_t frame) noexcept               { return frames[static_cast<uint64_t> (frame) & (numFrames - 1)]; }
+        const Frame& get (int64_t frame) const noexcept   { return frames[static_cast<uint64_t> (frame) & (numFrames - 1)]; }
+
+        Frame frames[numFrames];
+    };
+
+    template <typename... EventTypes>
+    static constexpr uint32_t getEventSlotSize() noexcept
+    {
+        uint32_t size = 1;
+        ((size = sizeof (EventTypes) > size ? static_cast<uint32_t> (sizeof (EventTypes)) : size), ...);
+        return (size + 7u) & ~7u;
+    }
+
+    /** A fixed-capacity, time-ordered queue of events waiting to be delivered to a node. */
+    template <uint32_t capacity, uint32_t slotSize>
+    struct EventQueue
+    {
+        struct Item
+        {
+            uint64_t tick;
+            uint32_t input, element, typeIndex, dataSlot;
+        };
+
+        void clear() noexcept
+        {
+            numItems = 0;
+            head = 0;
+            numFreeSlots = capacity;
+
+            for (uint32_t i = 0; i < capacity; ++i)
+                freeSlots[i] = capacity - 1 - i;
+        }
+
+        bool push (uint64_t tick, uint32_t input, uint32_t element, uint32_t typeIndex, const void* eventData, uint32_t size) noexcept
+        {
+            if (numItems == capacity && head != 0)
+            {
+                std::memmove (items, items + head, (numItems - head) * sizeof (Item));
+                numItems -= head;
+                head = 0;
+            }
+
+            if (numFreeSlots == 0 || numItems == capacity || size > slotSize)
+                return false;
+
+            auto slot = freeSlots[--numFreeSlots];
+            std::memcpy (data + slot * slotSize, eventData, size);
+
+            auto pos = numItems;
+
+            while (pos > head && items[pos - 1].tick > tick)
+                --pos;
+
+            std::memmove (items + pos + 1, items + pos, (numItems - pos) * sizeof (Item));
+            items[pos] = { tick, input, element, typeIndex, slot };
+            ++numItems;
+            return true;
+        }
+
+        const Item* getNext (uint64_t maxTick) const noexcept
+        {
+            return (head < numItems && items[head].tick <= maxTick) ? items + head : nullptr;
+        }
+
+        const uint8_t* getData (const Item& item) const noexcept    { return data + item.dataSlot * slotSize; }
+
+        void popNext() noexcept
+        {
+            freeSlots[numFreeSlots++] = items[head].dataSlot;
+
+            if (++head == numItems)
+            {
+                numItems = 0;
+                head = 0;
+            }
+        }
+
+        Item items[capacity];
+        uint32_t freeSlots[capacity];
+        uint32_t numItems, head, numFreeSlots;
+        alignas (8) uint8_t data[capacity * slotSize];
+    };
+
+    /** The events which a top-level output has produced during the last block. */
+    template <uint32_t capacity, uint32_t slotSize>
+    struct OutputEventList
+    {
+        struct Item
+        {
+            uint32_t frame, typeIndex;
+        };
+
+        bool add (uint32_t frame, uint32_t typeIndex, const void* eventData) noexcept
+        {
+            if (numItems == capacity)
+                return false;
+
+            std::memcpy (data + numItems * slotSize, eventData, slotSize);
+            items[numItems++] = { frame, typeIndex };
+            return true;
+        }
+
+        const uint8_t* getData (uint32_t index) const noexcept    { return data + index * slotSize; }
+
+        Item items[capacity];
+        uint32_t numItems;
+        alignas (8) uint8_t data[capacity * slotSize];
+    };
+};
+
+} // namespace soul_generated
+
+#endif // SOUL_GENERATED_CPP_RUNTIME_V1
+)SOUL_RUNTIME"
+};
+
+//==============================================================================
+/**
+    Converts a linked program into a C++ class.
+
+    Each processor becomes a nested struct, whose HEART functions turn into member functions
+    with their blocks as labels and gotos. The graph is flattened in the same way that the
+    interpreter does it, and each of its nodes becomes a member with a render function, so
+    the generated code produces exactly the same output as the interpreter, but with all
+    the connections, rates and types resolved when the code is generated.
+*/
+class CPlusPlusGenerator
+{
+public:
+    CPlusPlusGenerator (const Program& p, const BuildSettings& s, const CPlusPlusGeneratorOptions& o)
+        : program (p.clone()), settings (s), options (o)
+    {
+        for (auto name : reservedNames)
+            usedNames.insert (name);
+    }
+
+    std::string generate()
+    {
+        if (settings.maxBlockSize == 0 || settings.maxBlockSize > 16384)
+            CodeLocation().throwError (Errors::unsupportedBlockSize());
+
+        // The generated runtime only has the precise maths functions, so the constants that
+        // were folded with the fast approximations wouldn't match what the code computes
+        if (settings.useFastMaths)
+            CodeLocation().throwError (Errors::fastMathsNotSupportedInCPlusPlus());
+
+        className = createName (options.className.empty() ? std::string ("SOULPatch") : options.className);
+        resolveExternals();
+        graph.build (program);
+        createNodes();
+
+        for (auto& c : graph.connections)
+            addConnection (c);
+
+        while (! pendingFunctions.empty())
+        {
+            auto f = pendingFunctions.back();
+            pendingFunctions.pop_back();
+            writePendingFunction (*f);
+        }
+
+        return createOutput();
+    }
+
+private:
+    //==============================================================================
+    static constexpr choc::text::CodePrinter::NewLine newLine = {};
+    static constexpr choc::text::CodePrinter::BlankLine blankLine = {};
+    static constexpr choc::text::CodePrinter::SectionBreak sectionBreak = {};
+
+    static constexpr uint32_t eventQueueCapacity = 1024;
+
+    static constexpr const char* reservedNames[] =
+    {
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+        "char", "char16_t", "char32_t", "class", "compl", "concept", "const", "constexpr", "const_cast", "continue",
+        "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export",
+        "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace",
+        "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public",
+        "register", "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static", "static_assert",
+        "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef",
+        "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while",
+        "xor", "xor_eq", "std", "soul_generated", "int32_t", "int64_t", "uint8_t", "uint32_t", "uint64_t",
+        "Runtime", "Vector", "Array", "Slice", "IsVector", "Elements", "BoolResult", "isInteger", "elementsOf",
+        "mapElements", "convertPrimitive", "toDouble", "fromDouble", "convert", "convertBounded", "convertElements",
+        "bitCast", "copyRaw", "makeSlice", "subArray", "wrapIndex", "floorDivide", "asMutable", "addressOf",
+        "accumulate", "Ops", "Intrinsics", "StreamRead", "addStream", "setRamp", "applyRamp", "StreamBuffer",
+        "getEventSlotSize", "EventQueue", "OutputEventList", "name", "maxBlockSize", "latency", "numInputEndpoints",
+        "numOutputEndpoints", "EndpointKind", "AnnotationProperty", "EndpointInfo", "StringLiteral",
+        "numStringLiterals", "getInputEndpoints", "getOutputEndpoints", "getStringLiterals", "initialise", "reset",
+        "prepare", "advance", "setInputStreamFrames", "setSparseInputStreamTarget", "setInputValue", "addInputEvent",
+        "getOutputStreamFrames", "getOutputValue", "iterateOutputEvents", "getXRuns", "writeEvent", "sampleRate",
+        "sessionID", "currentTick", "blockStartFrame", "currentNodeTick", "numFramesToRender", "lastBlockSize",
+        "xruns", "packingBuffer", "owner", "nodeIndex", "frequency", "period", "id", "resumePoint", "run",
+        "initialiseState", "processor", "slot", "nextFrame", "hasFinished", "events", "topLevelFrames",
+        "rampIncrement", "rampFramesRemaining", "hasTopLevelFrames", "outputEvents", "frame", "tick", "endTick",
+        "element", "typeIndex", "data", "value", "target", "source", "dest", "n", "e", "f", "i", "j", "item",
+        "node", "render", "blockFrame", "chunkEnd", "converted", "destElement", "eventData", "event", "frames",
+        "callback", "setTopLevelFrames", "setTopLevelTarget", "clearNode", "initialiseProcessor", "PropertyType",
+        "SerialisedType", "getNumOutputFrames"
+    };
+
+    Program program;
+    const BuildSettings& settings;
+    const CPlusPlusGeneratorOptions& options;
+    interpreter::FlattenedGraph graph;
+
+    std::string className;
+    std::unordered_set<std::string> usedNames;
+    std::unordered_map<const heart::Variable*, Value> externalValues;
+
+    //==============================================================================
+    struct Expr
+    {
+        std::string code;
+        bool isLValue = false, isConst = false;
+    };
+
+    struct StructInfo
+    {
+        std::string name;
+        std::vector<std::string> memberNames;
+    };
+
+    struct ProcessorInfo;
+
+    struct FunctionInfo
+    {
+        std::string name;
+        heart::Function* function = nullptr;
+        ProcessorInfo* processor = nullptr;
+    };
+
+    struct EventHandlerInfo
+    {
+        std::string name, valueTypeName;
+        bool hasIndexParameter = false, indexIs64Bit = false;
+    };
+
+    struct ProcessorInfo
+    {
+        ProcessorInfo (Module& m) : module (m) {}
+
+        Module& module;
+        std::string structName, stateInitialiser, systemInit, userInit;
+        bool hasRunFunction = false;
+        std::unordered_map<const heart::Variable*, std::string> stateVariableNames;
+        std::vector<std::string> inputNames, outputNames; // empty for event endpoints
+        std::vector<std::string> memberDeclarations;
+        std::vector<std::vector<EventHandlerInfo>> eventHandlers; // indexed by input, then by type
+        choc::text::CodePrinter functions;
+    };
+
+    struct StreamSource
+    {
+        uint32_t sourceNode, sourceOutput;
+        interpreter::ElementRange sourceRange, destRange;
+        std::optional<uint32_t> sourceElement, destElement;
+        std::string sourceTypeName, destTypeName;
+        uint64_t ticksPerFrame, delayTicks;
+        InterpolationType interpolation;
+        bool canCopyDirectly;
+    };
+
+    struct ValueSource
+    {
+        uint32_t sourceNode, sourceOutput;
+        std::optional<uint32_t> sourceElement, destElement;
+        bool canCopyDirectly;
+    };
+
+    struct InputSources
+    {
+        std::vector<StreamSource> streams;
+        std::vector<ValueSource> values;
+    };
+
+    struct TypeMapping
+    {
+        int32_t destType = -1;
+        bool needsConversion = false;
+        std::string sourceTypeName, destTypeName;
+    };
+
+    struct EventRoute
+    {
+        uint32_t destNode, destInput;
+        int32_t sourceElement, destElement; // -1 means "any" and "the same as the source"
+        uint64_t delayTicks;
+        std::vector<TypeMapping> typeMap;
+    };
+
+    struct NodeInfo
+    {
+        const interpreter::FlattenedGraph::Node* node = nullptr;
+        ProcessorInfo* processor = nullptr; // null for a junction
+        uint32_t index = 0;
+        std::string structName, memberName;
+        std::vector<pool_ref<heart::IODeclaration>> inputs, outputs;
+        std::vector<interpreter::ElementRange> inputFrameRanges, outputFrameRanges;
+        uint64_t ticksPerFrame = 1;
+        double sampleRateFactor = 1.0;
+
+        std::vector<InputSources> inputSources;
+        std::vector<std::vector<EventRoute>> eventRoutes;
+        std::vector<uint64_t> outputBufferSizes; // zero for outputs which don't need a buffer
+        std::vector<std::string> queuedEventTypes;
+        bool hasEventQueue = false;
+
+        bool isJunction() const         { return processor == nullptr; }
+        bool isTopLevelInput() const    { return node->isTopLevel && node->isInput; }
+        bool isTopLevelOutput() const   { return node->isTopLevel && ! node->isInput; }
+
+        std::string getInputSlot (size_t i) const
+        {
+            return memberName + (isJunction() ? ".slot" : ".processor." + processor->inputNames[i]);
+        }
+
+        std::string getOutputSlot (size_t i) const
+        {
+            return memberName + (isJunction() ? ".slot" : ".processor." + processor->outputNames[i]);
+        }
+    };
+
+    std::vector<std::unique_ptr<ProcessorInfo>> processors;
+    std::vector<NodeInfo> nodes;
+    int topLevelExponent = 0;
+    uint64_t ticksPerTopLevelFrame = 1, maxChunkTicks = 1;
+
+    std::unordered_map<const Structure*, StructInfo> structs;
+    std::unordered_map<std::string, std::string> constantNames;
+    std::unordered_map<const heart::Function*, FunctionInfo> functions;
+    std::vector<heart::Function*> pendingFunctions;
+    std::unordered_map<std::string, std::string> packFunctions, unpackFunctions;
+    size_t packingBufferSize = 8;
+
+    choc::text::CodePrinter structDeclarations, constantDeclarations, namespaceFunctions, packingFunctions;
+
+    //==============================================================================
+    struct Parameter
+    {
+        std::string type, name;
+    };
+
+    static bool containsIdentifier (const std::string& code, const std::string& name)
+    {
+        auto isIdentifierChar = [] (char c) { return isDigit (c) || c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
+
+        for (auto pos = code.find (name); pos != std::string::npos; pos = code.find (name, pos + 1))
+        {
+            auto end = pos + name.length();
+
+            if ((pos == 0 || ! isIdentifierChar (code[pos - 1])) && (end == code.length() || ! isIdentifierChar (code[end])))
+                return true;
+        }
+
+        return false;
+    }
+
+    /** Leaves out the names of any parameters which the body doesn't use, so that the
+        generated code doesn't cause warnings when it's built with them all enabled.
+    */
+    static std::string getParameterList (const std::vector<Parameter>& params, const std::string& body)
+    {
+        return joinStrings (params, ", ", [&] (const Parameter& p)
+        {
+            return containsIdentifier (body, p.name) ? p.type + " " + p.name : p.type;
+        });
+    }
+
+    static std::string makeSafeName (const std::string& suggestion)
+    {
+        auto name = makeSafeIdentifierName (choc::text::replace (suggestion, "::", "_"));
+
+        // Names with leading underscores or double underscores are reserved in C++
+        while (! name.empty() && name[0] == '_')
+            name = name.substr (1);
+
+        while (contains (name, "__"))
+            name = choc::text::replace (name, "__", "_");
+
+        if (name.empty() || isDigit (name[0]))
+            name = "v" + name;
+
+        return name;
+    }
+
+    std::string createName (const std::string& suggestion)
+    {
+        auto name = addSuffixToMakeUnique (makeSafeName (suggestion), [this] (const std::string& n) { return usedNames.find (n) != usedNames.end(); });
+        usedNames.insert (name);
+        return name;
+    }
+
+    static bool isReservedName (const std::string& name)
+    {
+        for (auto r : reservedNames)
+            if (name == r)
+                return true;
+
+        return false;
+    }
+
+    static std::string parenthesiseIfNeeded (const std::string& code)
+    {
+        for (auto c : code)
+            if (! (isSafeIdentifierChar (c) || c == '.' || c == ':'))
+                return "(" + code + ")";
+
+        return code;
+    }
+
+    void resolveExternals()
+    {
+        for (auto& v : program.getExternalVariables())
+        {
+            auto name = program.getExternalVariableName (v);
+            auto found = options.externalValues.find (name);
+
+            if (found == options.externalValues.end())
+                v->location.throwError (Errors::unresolvedExternal (name));
+
+            auto value = Value::fromExternalValue (v->type, found->second, program.getConstantTable(), program.getStringDictionary());
+
+            if (! value.getType().isIdentical (v->type))
+                v->location.throwError (Errors::cannotConvertExternalType (name, v->type.getDescription()));
+
+            externalValues.emplace (v.getPointer(), std::move (value));
+        }
+    }
+
+    //==============================================================================
+    std::string getTypeName (const Type& t)
+    {
+        auto type = t.removeReferenceIfPresent().removeConstIfPresent();
+
+        if (type.isBoundedInt() || type.isStringLiteral())
+            return "int32_t";
+
+        if (type.isPrimitive())
+        {
+            if (type.isBool())       return "bool";
+            if (type.isInteger32())  return "int32_t";
+            if (type.isInteger64())  return "int64_t";
+            if (type.isFloat32())    return "float";
+            if (type.isFloat64())    return "double";
+        }
+
+        if (type.isVector())
+            return "Vector<" + getTypeName (type.getElementType()) + ", " + std::to_string (type.getVectorSize()) + ">";
+
+        if (type.isUnsizedArray())
+            return "Slice<" + getTypeName (type.getArrayElementType()) + ">";
+
+        if (type.isFixedSizeArray())
+            return "Array<" + getTypeName (type.getArrayElementType()) + ", " + std::to_string (type.getArraySize()) + ">";
+
+        if (type.isStruct())
+            return getStruct (type.getStructRef()).name;
+
+        CodeLocation().throwError (Errors::notYetImplemented ("Generating C++ for the type " + type.getDescription()));
+    }
+
+    /** Declares a struct the first time it's needed, after the types of its members. */
+    const StructInfo& getStruct (const Structure& s)
+    {
+        auto found = structs.find (std::addressof (s));
+
+        if (found != structs.end())
+            return found->second;
+
+        std::vector<std::string> memberTypes;
+
+        for (size_t i = 0; i < s.getNumMembers(); ++i)
+            memberTypes.push_back (getTypeName (s.getMemberType (i)));
+
+        StructInfo info;
+        info.name = createName (s.getName());
+
+        for (size_t i = 0; i < s.getNumMembers(); ++i)
+        {
+            auto name = makeSafeName (s.getMemberName (i));
+
+            if (isReservedName (name))
+                name += "_";
+
+            info.memberNames.push_back (addSuffixToMakeUnique (name, [&] (const std::string& n) { return contains (info.memberNames, n); }));
+        }
+
+        structDeclarations << "struct " << info.name << newLine;
+
+        {
+            auto indent = structDeclarations.createIndentWithBraces();
+
+            for (size_t i = 0; i < memberTypes.size(); ++i)
+                structDeclarations << memberTypes[i] << " " << info.memberNames[i] << ";" << newLine;
+        }
+
+        structDeclarations << ";" << blankLine;
+        return structs.emplace (std::addressof (s), std::move (info)).first->second;
+    }
+
+    static bool isNumericType (const Type& type)
+    {
+        return (type.isPrimitiveOrVector() || (type.isFixedSizeArray() && type.getArrayElementType().isPrimitiveOrVector()))
+                 && ! type.isBoundedInt();
+    }
+
+    /** True if the type's packed layout differs from the C++ one, because it contains a struct. */
+    static bool needsPacking (const Type& type)
+    {
+        if (type.isStruct())
+            return true;
+
+        if (type.isFixedSizeArray())
+            return needsPacking (type.getArrayElementType());
+
+        return false;
+    }
+
+    //==============================================================================
+    static std::string getInt32Literal (int32_t value)
+    {
+        if (value == std::numeric_limits<int32_t>::min())
+            return "(-2147483647 - 1)";
+
+        return std::to_string (value);
+    }
+
+    static std::string getInt64Literal (int64_t value)
+    {
+        if (value == std::numeric_limits<int64_t>::min())
+            return "int64_t (-9223372036854775807 - 1)";
+
+        return "int64_t (" + std::to_string (value) + ")";
+    }
+
+    static std::string getFloatLiteral (double value, bool is32Bit)
+    {
+        std::string type (is32Bit ? "float" : "double");
+
+        if (std::isnan (value))  return "std::numeric_limits<" + type + ">::quiet_NaN()";
+        if (std::isinf (value))  return (value < 0 ? "-std::numeric_limits<" : "std::numeric_limits<") + type + ">::infinity()";
+
+        char buffer[64];
+        std::snprintf (buffer, sizeof (buffer), is32Bit ? "%.9g" : "%.17g", value);
+        std::string result (buffer);
+
+        if (result.find_first_of (".e") == std::string::npos)
+            result += ".0";
+
+        return is32Bit ? result + "f" : result;
+    }
+
+    /** Prints a value as a C++ brace-initialiser for the type that getTypeName() gives it. */
+    struct InitialiserPrinter  : public ValuePrinter
+    {
+        InitialiserPrinter (CPlusPlusGenerator& g) : generator (g) {}
+
+        CPlusPlusGenerator& generator;
+        std::string result;
+
+        void print (std::string_view s) override                  { result += s; }
+        void printInt32 (int32_t v) override                      { print (getInt32Literal (v)); }
+        void printInt64 (int64_t v) override                      { print (getInt64Literal (v)); }
+        void printFloat32 (float v) override                      { print (getFloatLiteral (v, true)); }
+        void printFloat64 (double v) override                     { print (getFloatLiteral (v, false)); }
+        void printBool (bool b) override                          { print (b ? "true" : "false"); }
+        void printZeroInitialiser (const Type&) override          { print ("{}"); }
+        void beginStructMembers (const Type&) override            { print ("{ "); }
+        void printStructMemberSeparator() override                { print (", "); }
+        void endStructMembers() override                          { print (" }"); }
+        void beginArrayMembers (const Type&) override             { print ("{ { "); }
+        void printArrayMemberSeparator() override                 { print (", "); }
+        void endArrayMembers() override                           { print (" } }"); }
+        void beginVectorMembers (const Type& t) override          { beginArrayMembers (t); }
+        void printVectorMemberSeparator() override                { printArrayMemberSeparator(); }
+        void endVectorMembers() override                          { endArrayMembers(); }
+        void printStringLiteral (StringDictionary::Handle h) override   { print (std::to_string (h.handle)); }
+
+        void printUnsizedArrayContent (const Type& arrayType, const void* pointer) override
+        {
+            auto handle = static_cast<ConstantTable::Handle> (reinterpret_cast<std::intptr_t> (pointer));
+            auto content = generator.program.getConstantTable().getValueForHandle (handle);
+
+            if (content == nullptr || ! content->getType().isFixedSizeArray())
+                return print ("{}");
+
+            auto elementType = generator.getTypeName (arrayType.getArrayElementType());
+            auto source = generator.getConstant (*content);
+
+            print ("{ const_cast<" + elementType + "*> (" + source.code + ".e), "
+                     + std::to_string (content->getType().getArraySize()) + " }");
+        }
+    };
+
+    std::string getInitialiser (const Value& value)
+    {
+        InitialiserPrinter printer (*this);
+        value.print (printer);
+        return printer.result;
+    }
+
+    /** Primitive constants become literals, and aggregates become static members of the class. */
+    Expr getConstant (const Value& value)
+    {
+        auto& type = value.getType();
+        auto typeName = getTypeName (type);
+
+        if (type.isPrimitive() || type.isBoundedInt() || type.isStringLiteral())
+            return { getInitialiser (value) };
+
+        if (value.isZero() && ! type.isUnsizedArray())
+            return { typeName + " {}" };
+
+        auto initialiser = getInitialiser (value);
+        auto& name = constantNames[typeName + " " + initialiser];
+
+        if (name.empty())
+        {
+            name = createName ("constant");
+            constantDeclarations << "static inline const " << typeName << " " << name << " = " << initialiser << ";" << newLine;
+        }
+
+        return { name, true, true };
+    }
+
+    static const char* getUnaryOpName (UnaryOp::Op o)
+    {
+        #define SOUL_GET_UNARY_OP_NAME(name, op)  if (o == UnaryOp::Op::name) return #name;
+        SOUL_UNARY_OPS (SOUL_GET_UNARY_OP_NAME)
+        #undef SOUL_GET_UNARY_OP_NAME
+        return "";
+    }
+
+    static const char* getBinaryOpName (BinaryOp::Op o)
+    {
+        #define SOUL_GET_BINARY_OP_NAME(name, op)  if (o == BinaryOp::Op::name) return #name;
+        SOUL_BINARY_OPS (SOUL_GET_BINARY_OP_NAME)
+        #undef SOUL_GET_BINARY_OP_NAME
+        return "";
+    }
+
+    static bool isBinaryOpSupported (BinaryOp::Op op, PrimitiveType type)
+    {
+        if (BinaryOp::isEqualityOperator (op))
+            return type.isFloat32() || type.isFloat64() || type.isInteger32() || type.isInteger64() || type.isBool();
+
+        if (type.isBool())
+            return BinaryOp::isLogicalOperator (op);
+
+        if (! (type.isFloat32() || type.isFloat64() || type.isInteger32() || type.isInteger64()))
+            return false;
+
+        if (BinaryOp::isArithmeticOperator (op) || BinaryOp::isComparisonOperator (op))
+            return true;
+
+        return type.isInteger() && BinaryOp::isBitwiseOperator (op);
+    }
+
+    //==============================================================================
+    /** Converts a HEART function into a C++ function, mirroring the way that the interpreter's
+        FunctionCompiler treats each expression and statement, so that the results match.
+    */
+    struct FunctionWriter
+    {
+        FunctionWriter (CPlusPlusGenerator& g, ProcessorInfo* p, bool isRun)
+            : generator (g), processor (p), isRunFunction (isRun) {}
+
+        CPlusPlusGenerator& generator;
+        ProcessorInfo* processor;
+        const bool isRunFunction;
+
+        std::unordered_map<const heart::Variable*, std::string> localNames;
+        std::vector<std::string> localDeclarations, pendingStatements;
+        std::vector<std::pair<const heart::Variable*, std::string>> declaredLocals;
+        std::unordered_map<const heart::Block*, std::string> blockLabels;
+        std::unordered_set<std::string> labelsUsed, jumpTargets;
+        std::vector<std::string> resumeLabels;
+        const heart::Block* nextBlock = nullptr;
+
+        //==============================================================================
+        std::string write (heart::Function& f, const std::string& functionName, bool isStatic)
+        {
+            std::vector<Parameter> params;
+
+            for (auto& p : f.parameters)
+            {
+                auto name = generator.createName (p->name.isValid() ? p->name.toString() : "param");
+                localNames[p.getPointer()] = name;
+                auto typeName = generator.getTypeName (p->type);
+
+                if (p->type.isReference())
+                    params.push_back ({ (p->type.isConst() ? "const " : "") + typeName + "&", name });
+                else
+                    params.push_back ({ typeName, name });
+            }
+
+            for (auto& b : f.blocks)
+            {
+                for (auto& p : b->parameters)
+                    declareLocal (p);
+
+                blockLabels[b.getPointer()] = createLabel (b->name.toString());
+            }
+
+            std::vector<std::string> blockCode;
+
+            for (size_t i = 0; i < f.blocks.size(); ++i)
+            {
+                choc::text::CodePrinter out;
+                nextBlock = i + 1 < f.blocks.size() ? f.blocks[i + 1].getPointer() : nullptr;
+
+                for (auto s : f.blocks[i]->statements)
+                    writeStatement (out, *s);
+
+                writeTerminator (out, *f.blocks[i]->terminator, f);
+                blockCode.push_back (out.toString());
+            }
+
+            choc::text::CodePrinter out;
+
+            if (isRunFunction)
+                out << "bool " << functionName << "() noexcept" << newLine;
+            else
+                out << (isStatic ? "static " : "") << (f.returnType.isVoid() ? std::string ("void") : generator.getTypeName (f.returnType))
+                    << " " << functionName << " (" << getParameterList (params, joinStrings (blockCode, {})) << ") noexcept" << newLine;
+
+            {
+                auto indent = out.createIndentWithBraces();
+
+                for (auto& d : localDeclarations)
+                    out << d << newLine;
+
+                if (! isRunFunction)
+                    writeUnusedLocalCasts (out, f);
+
+                if (! resumeLabels.empty())
+                {
+                    out << blankLine << "switch (resumePoint)" << newLine;
+
+                    {
+                        auto switchIndent = out.createIndentWithBraces();
+
+                        for (size_t i = 0; i < resumeLabels.size(); ++i)
+                            out << "case " << (i + 1) << ": goto " << resumeLabels[i] << ";" << newLine;
+
+                        out << "default: break;" << newLine;
+                    }
+
+                    out << newLine;
+                }
+
+                for (size_t i = 0; i < blockCode.size(); ++i)
+                {
+                    auto& label = blockLabels[f.blocks[i].getPointer()];
+
+                    if (jumpTargets.find (label) != jumpTargets.end())
+                        out << blankLine << label << ":" << newLine;
+                    else if (i == 0 && ! localDeclarations.empty())
+                        out << blankLine;
+
+                    out << blockCode[i];
+                }
+            }
+
+            out << newLine;
+            return out.toString();
+        }
+
+        /** Writes a function which runs the initialisers of the processor's state variables. */
+        std::string writeStateInitialiser (Module& module)
+        {
+            choc::text::CodePrinter body;
+
+            for (auto& v : module.stateVariables.get())
+            {
+                if (v->initialValue != nullptr && ! v->isExternal())
+                {
+                    auto value = compileExpression (*v->initialValue, v->type);
+                    flushPendingStatements (body);
+                    body << getVariable (v).code << " = " << value.code << ";" << newLine;
+                }
+            }
+
+            choc::text::CodePrinter out;
+            out << "void initialiseState() noexcept" << newLine;
+
+            {
+                auto indent = out.createIndentWithBraces();
+
+                for (auto& d : localDeclarations)
+                    out << d << newLine;
+
+                out << body.toString();
+            }
+
+            out << newLine;
+            return out.toString();
+        }
+
+    private:
+        //==============================================================================
+        std::string createLabel (const std::string& suggestion)
+        {
+            auto name = addSuffixToMakeUnique (makeSafeName (suggestion),
+                                               [this] (const std::string& n) { return labelsUsed.find (n) != labelsUsed.end(); });
+            labelsUsed.insert (name);
+            return name;
+        }
+
+        std::string declareLocal (heart::Variable& v)
+        {
+            auto name = generator.createName (v.name.isValid() ? v.name.toString() : "temp");
+            localNames[std::addressof (v)] = name;
+            auto typeName = generator.getTypeName (v.type);
+
+            // The run() function can be suspended, so its locals are kept in the processor's state
+            if (isRunFunction)
+                processor->memberDeclarations.push_back (typeName + " " + name + ";");
+            else
+                localDeclarations.push_back (typeName + " " + name + " {};");
+
+            declaredLocals.push_back ({ std::addressof (v), name });
+            return name;
+        }
+
+        // Locals which are only ever written to (e.g. a copy of a parameter that the inliner
+        // left behind) still need declaring, so they get a (void) cast to stop the C++
+        // compiler warning that they're set but not used
+        void writeUnusedLocalCasts (choc::text::CodePrinter& out, heart::Function& f)
+        {
+            std::unordered_set<const heart::Variable*> localsRead;
+
+            f.visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType mode)
+            {
+                if (mode != AccessType::write)
+                    if (auto v = cast<heart::Variable> (e))
+                        localsRead.insert (v.get());
+            });
+
+            for (auto& local : declaredLocals)
+                if (localsRead.find (local.first) == localsRead.end())
+                    out << "(void) " << local.second << ";" << newLine;
+        }
+
+        std::string createTemporary (const Type& type, const std::string& value)
+        {
+            auto name = generator.createName ("temp");
+            auto typeName = generator.getTypeName (type);
+
+            if (isRunFunction)
+                processor->memberDeclarations.push_back (typeName + " " + name + ";");
+            else
+                localDeclarations.push_back (typeName + " " + name + " {};");
+
+            pendingStatements.push_back (name + " = " + value + ";");
+            return name;
+        }
+
+        void flushPendingStatements (choc::text::CodePrinter& out)
+        {
+            for (auto& s : pendingStatements)
+                out << s << newLine;
+
+            pendingStatements.clear();
+        }
+
+        //==============================================================================
+        Expr getVariable (heart::Variable& v)
+        {
+            auto found = localNames.find (std::addressof (v));
+
+            if (found != localNames.end())
+                return { found->second, true, v.type.isConst() };
+
+            if (v.isExternal())
+            {
+                auto external = generator.externalValues.find (std::addressof (v));
+
+                if (external == generator.externalValues.end())
+                    v.location.throwError (Errors::unresolvedExternal (v.name.toString()));
+
+                return generator.getConstant (external->second);
+            }
+
+            if (v.isState())
+            {
+                if (processor != nullptr)
+                {
+                    auto name = processor->stateVariableNames.find (std::addressof (v));
+
+                    if (name != processor->stateVariableNames.end())
+                        return { name->second, true, false };
+                }
+
+                throwInternalCompilerError ("Unknown state variable", v.name.toString().c_str(), 0);
+            }
+
+            SOUL_ASSERT (v.isFunctionLocal());
+            return { declareLocal (v), true, false };
+        }
+
+        Expr compileExpression (heart::Expression& e, const Type& targetType)
+        {
+            return createCast (compileExpression (e), e.getType(), targetType);
+        }
+
+        Expr compileExpression (heart::Expression& e)
+        {
+            if (auto v = cast<heart::Variable> (e))
+                return getVariable (*v);
+
+            if (auto c = cast<heart::Constant> (e))
+                return generator.getConstant (c->value);
+
+            if (auto a = cast<heart::ArrayElement> (e))
+                return compileArrayElement (*a);
+
+            if (auto s = cast<heart::StructElement> (e))
+            {
+                auto parent = compileExpression (s->parent);
+                auto& memberName = generator.getStruct (s->getStruct()).memberNames[s->getMemberIndex()];
+                return { parenthesiseIfNeeded (parent.code) + "." + memberName, parent.isLValue, parent.isConst };
+            }
+
+            if (auto c = cast<heart::TypeCast> (e))
+                return compileExpression (c->source, c->destType);
+
+            if (auto u = cast<heart::UnaryOperator> (e))
+                return compileUnaryOp (*u);
+
+            if (auto b = cast<heart::BinaryOperator> (e))
+                return compileBinaryOp (*b);
+
+            if (auto fc = cast<heart::PureFunctionCall> (e))
+                return compileCall (fc->function, fc->arguments);
+
+            if (auto p = cast<heart::ProcessorProperty> (e))
+                return compileProcessorProperty (*p);
+
+            e.location.throwError (Errors::notYetImplemented ("expression type"));
+        }
+
+        Expr compileArrayElement (heart::ArrayElement& a)
+        {
+            auto parentType = a.parent->getType().removeReferenceIfPresent();
+            auto parent = compileExpression (a.parent);
+
+            if (parentType.isPrimitive() || parentType.isBoundedInt())
+                return parent;
+
+            if (a.isDynamic())
+                return createElementAccess (parent, parentType, *a.dynamicIndex, a.isRangeTrusted);
+
+            auto start = std::to_string (a.fixedStartIndex);
+            auto p = parenthesiseIfNeeded (parent.code);
+
+            if (parentType.isUnsizedArray())
+            {
+                if (a.isSlice())
+                    return { "Slice<" + generator.getTypeName (parentType.getArrayElementType()) + "> { " + p + ".data + " + start
+                               + ", " + p + ".size - " + start + " }" };
+
+                return { p + ".data[" + start + "]", true, parent.isConst };
+            }
+
+            if (a.isSlice())
+            {
+                auto sliceType = generator.getTypeName (a.getType());
+
+                if (! parent.isLValue)
+                    p = createTemporary (parentType, parent.code);
+
+                return { "subArray<" + sliceType + "> (" + p + ".e + " + start + ")", true, parent.isConst };
+            }
+
+            return { p + ".e[" + start + "]", parent.isLValue, parent.isConst };
+        }
+
+        Expr createElementAccess (const Expr& parent, const Type& parentType, heart::Expression& index, bool isRangeTrusted)
+        {
+            auto isUnsized = parentType.isUnsizedArray();
+            auto is64Bit = index.getType().isInteger64();
+            auto i = is64Bit ? compileExpression (index).code
+                             : compileExpression (index, PrimitiveType::int32).code;
+
+            if (! (isUnsized || isRangeTrusted))
+                i = std::string (is64Bit ? "wrapIndex<int64_t> (" : "wrapIndex<int32_t> (") + i + ", "
+                      + std::to_string (parentType.getArrayOrVectorSize()) + ")";
+
+            auto p = parenthesiseIfNeeded (parent.code);
+
+            if (isUnsized)
+                return { p + ".data[" + i + "]", true, parent.isConst };
+
+            return { p + ".e[" + i + "]", parent.isLValue, parent.isConst };
+        }
+
+        Expr compileProcessorProperty (heart::ProcessorProperty& p)
+        {
+            using Property = heart::ProcessorProperty::Property;
+
+            if (processor == nullptr)
+                p.location.throwError (Errors::processorPropertyUsedOutsideDecl());
+
+            switch (p.property)
+            {
+                case Property::frequency:  return { "frequency" };
+                case Property::period:     return { "period" };
+                case Property::id:         return { "id" };
+                case Property::session:    return { "owner->sessionID" };
+                case Property::latency:    return { getInt32Literal (static_cast<int32_t> (processor->module.latency)) };
+                case Property::none:
+                default:                   p.location.throwError (Errors::unknownProperty());
+            }
+        }
+
+        //==============================================================================
+        Expr compileUnaryOp (heart::UnaryOperator& u)
+        {
+            auto type = u.getType().removeReferenceIfPresent();
+            auto source = compileExpression (u.source, type);
+            auto prim = type.getPrimitiveType();
+            bool isSupported = false;
+
+            switch (u.operation)
+            {
+                case UnaryOp::Op::negate:       isSupported = prim.isFloat32() || prim.isFloat64() || prim.isInteger32() || prim.isInteger64(); break;
+                case UnaryOp::Op::bitwiseNot:   isSupported = prim.isInteger32() || prim.isInteger64(); break;
+                case UnaryOp::Op::logicalNot:   isSupported = prim.isBool(); break;
+                case UnaryOp::Op::unknown:
+                default:                        break;
+            }
+
+            if (! isSupported)
+                u.location.throwError (Errors::unsupportedType());
+
+            return { std::string ("Ops::") + getUnaryOpName (u.operation) + "<" + generator.getTypeName (type) + "> (" + source.code + ")" };
+        }
+
+        Expr compileBinaryOp (heart::BinaryOperator& b)
+        {
+            auto lhsType = b.lhs->getType().removeReferenceIfPresent();
+            auto rhsType = b.rhs->getType().removeReferenceIfPresent();
+            auto types = BinaryOp::getTypes (b.operation, lhsType, rhsType);
+
+            if (! types.operandType.isValid())
+                b.location.throwError (Errors::unsupportedType());
+
+            auto operandType = types.operandType;
+            auto lhs = compileExpression (b.lhs, operandType);
+            auto rhs = compileExpression (b.rhs, operandType);
+
+            if (operandType.isStringLiteral())
+                operandType = PrimitiveType::int32;
+
+            if (! isBinaryOpSupported (b.operation, operandType.getPrimitiveType()))
+                b.location.throwError (Errors::unsupportedType());
+
+            auto result = std::string ("Ops::") + getBinaryOpName (b.operation) + "<" + generator.getTypeName (operandType)
+                            + "> (" + lhs.code + ", " + rhs.code + ")";
+
+            if (types.resultType.isBoundedInt())
+                return createBoundedIntCast ({ result }, PrimitiveType::int32, types.resultType);
+
+            return { result };
+        }
+
+        //==============================================================================
+        Expr compileCall (heart::Function& target, ArrayView<pool_ref<heart::Expression>> args)
+        {
+            if (auto native = compileIntrinsic (target, args))
+                return *native;
+
+            auto& info = generator.getFunction (target);
+
+            if (info.processor != nullptr && info.processor != processor)
+                target.location.throwError (Errors::notYetImplemented ("Calling a function which belongs to another processor"));
+
+            return { info.name + " (" + getCallArguments (target, args) + ")" };
+        }
+
+        std::string getCallArguments (heart::Function& target, ArrayView<pool_ref<heart::Expression>> args)
+        {
+            SOUL_ASSERT (args.size() == target.parameters.size());
+            std::string result;
+
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                auto& paramType = target.parameters[i]->type;
+                std::string arg;
+
+                if (paramType.isReference())
+                {
+                    // Like the interpreter, references are passed without any conversion
+                    auto value = compileExpression (args[i]);
+                    auto paramTypeName = generator.getTypeName (paramType);
+
+                    if (generator.getTypeName (args[i]->getType()) != paramTypeName)
+                        arg = "reinterpret_cast<" + std::string (paramType.isConst() ? "const " : "") + paramTypeName + "&> (asMutable (" + value.code + "))";
+                    else if (paramType.isConst() || (value.isLValue && ! value.isConst))
+                        arg = value.code;
+                    else
+                        arg = "asMutable (" + value.code + ")";
+                }
+                else
+                {
+                    arg = compileExpression (args[i], paramType).code;
+                }
+
+                result += (i == 0 ? "" : ", ") + arg;
+            }
+
+            return result;
+        }
+
+        std::optional<Expr> compileIntrinsic (heart::Function& f, ArrayView<pool_ref<heart::Expression>> args)
+        {
+            if (f.intrinsicType == IntrinsicType::none)
+                return {};
+
+            auto& returnType = f.returnType;
+
+            if (f.intrinsicType == IntrinsicType::get_array_size)
+            {
+                auto arrayType = args.front()->getType().removeReferenceIfPresent();
+
+                if (arrayType.isUnsizedArray())
+                    return createCast ({ parenthesiseIfNeeded (compileExpression (args.front()).code) + ".size" },
+                                       PrimitiveType::int32, returnType);
+
+                return generator.getConstant (Value::createInt32 (arrayType.getArrayOrVectorSize())
+                                                .castToTypeExpectingSuccess (returnType));
+            }
+
+            if (f.intrinsicType == IntrinsicType::sum || f.intrinsicType == IntrinsicType::product)
+            {
+                auto argType = args.front()->getType().removeReferenceIfPresent();
+
+                if (! (argType.isFixedSizeArray() || argType.isVector()) || ! returnType.isPrimitive()
+                      || ! argType.getElementType().isEqual (returnType, Type::ignoreConst))
+                    return {};
+
+                if (! (returnType.isFloat32() || returnType.isFloat64() || returnType.isInteger32() || returnType.isInteger64()))
+                    return {};
+
+                return Expr { std::string (f.intrinsicType == IntrinsicType::sum ? "Intrinsics::sum<" : "Intrinsics::product<")
+                                + generator.getTypeName (returnType) + "> (" + compileExpression (args.front()).code + ")" };
+            }
+
+            // The remaining intrinsics operate element-wise on primitives or vectors which all share the same type
+            if (args.empty() || args.size() != f.parameters.size())
+                return {};
+
+            auto argType = f.parameters.front()->type.removeReferenceIfPresent().removeConstIfPresent();
+
+            if (! argType.isPrimitiveOrVector() || argType.isBoundedInt())
+                return {};
+
+            for (auto& p : f.parameters)
+                if (! p->type.removeReferenceIfPresent().isEqual (argType, Type::ignoreConst))
+                    return {};
+
+            auto prim = argType.getPrimitiveType();
+            auto typeName = generator.getTypeName (argType);
+
+            auto call = [&] (const std::string& function) -> Expr
+            {
+                auto result = function + " (";
+
+                for (size_t i = 0; i < args.size(); ++i)
+                    result += (i == 0 ? "" : ", ") + compileExpression (args[i], argType).code;
+
+                return { result + ")" };
+            };
+
+            if (f.intrinsicType == IntrinsicType::roundToInt)
+            {
+                if (! (argType.isPrimitive() && returnType.isPrimitiveInteger()))
+                    return {};
+
+                if ((prim.isFloat32() || prim.isFloat64()) && (returnType.isInteger32() || returnType.isInteger64()))
+                    return call ("Intrinsics::roundToInt<" + generator.getTypeName (returnType) + ">");
+
+                return {};
+            }
+
+            if (f.intrinsicType == IntrinsicType::isnan || f.intrinsicType == IntrinsicType::isinf)
+            {
+                if (! (returnType.isBool() && returnType.getVectorSize() == argType.getVectorSize()))
+                    return {};
+
+                if (prim.isFloat32() || prim.isFloat64())
+                    return call (std::string ("Intrinsics::") + getIntrinsicName (f.intrinsicType) + "<" + typeName + ">");
+
+                return {};
+            }
+
+            if (! returnType.isEqual (argType, Type::ignoreConst))
+                return {};
+
+            if (! (prim.isFloat32() || prim.isFloat64() || prim.isInteger32() || prim.isInteger64()))
+                return {};
+
+            auto numArgs = args.size();
+
+            switch (f.intrinsicType)
+            {
+                case IntrinsicType::abs:    if (numArgs == 1) return call ("Intrinsics::abs<" + typeName + ">");  return {};
+                case IntrinsicType::min:    if (numArgs == 2) return call ("Intrinsics::min<" + typeName + ">");  return {};
+                case IntrinsicType::max:    if (numArgs == 2) return call ("Intrinsics::max<" + typeName + ">");  return {};
+                case IntrinsicType::clamp:  if (numArgs == 3) return call ("Ops::clamp<" + typeName + ">");       return {};
+                case IntrinsicType::wrap:   if (numArgs == 2) return call ("Ops::wrap<" + typeName + ">");        return {};
+                default: break;
+            }
+
+            if (! (prim.isFloat32() || prim.isFloat64()))
+                return {};
+
+            size_t expectedArgs = 0;
+
+            switch (f.intrinsicType)
+            {
+                case IntrinsicType::floor:   case IntrinsicType::ceil:   case IntrinsicType::sqrt:   case IntrinsicType::exp:
+                case IntrinsicType::log:     case IntrinsicType::log10:  case IntrinsicType::sin:    case IntrinsicType::cos:
+                case IntrinsicType::tan:     case IntrinsicType::sinh:   case IntrinsicType::cosh:   case IntrinsicType::tanh:
+                case IntrinsicType::asinh:   case IntrinsicType::acosh:  case IntrinsicType::atanh:  case IntrinsicType::asin:
+                case IntrinsicType::acos:    case IntrinsicType::atan:
+                    expectedArgs = 1;
+                    break;
+
+                case IntrinsicType::fmod:    case IntrinsicType::remainder:  case IntrinsicType::addModulo2Pi:
+                case IntrinsicType::pow:     case IntrinsicType::atan2:
+                    expectedArgs = 2;
+                    break;
+
+                default:
+                    return {};
+            }
+
+            if (numArgs != expectedArgs)
+                return {};
+
+            return call (std::string ("Intrinsics::") + getIntrinsicName (f.intrinsicType) + "<" + typeName + ">");
+        }
+
+        //==============================================================================
+        Expr createCast (const Expr& source, const Type& sourceType, const Type& destType)
+        {
+            auto src = sourceType.removeReferenceIfPresent().removeConstIfPresent();
+            auto dst = destType.removeReferenceIfPresent().removeConstIfPresent();
+
+            if (src.isIdentical (dst))
+                return source;
+
+            if (dst.isBoundedInt())
+                return createBoundedIntCast (source, src, dst);
+
+            if (src.isBoundedInt())
+                return createCast (source, PrimitiveType::int32, dst);
+
+            auto srcName = generator.getTypeName (src);
+            auto dstName = generator.getTypeName (dst);
+
+            // Where the interpreter would use the source data unchanged, the C++ types may
+            // still have different names, so the bits are copied into the destination type
+            auto reuseSource = [&] () -> Expr
+            {
+                if (srcName == dstName)
+                    return source;
+
+                return { "bitCast<" + dstName + "> (" + source.code + ")" };
+            };
+
+            if (dst.isPrimitiveOrVector() && src.isPrimitiveOrVector())
+            {
+                auto srcNum = src.getVectorSize();
+                auto dstNum = dst.getVectorSize();
+
+                if (srcNum != dstNum && srcNum != 1)
+                    throwCastError (src, dst);
+
+                if (srcNum == dstNum && src.getPrimitiveType() == dst.getPrimitiveType())
+                    return reuseSource();
+
+                return { "convert<" + dstName + "> (" + source.code + ")" };
+            }
+
+            if (dst.isFixedSizeArray() && src.isFixedSizeArray() && dst.getArraySize() == src.getArraySize())
+            {
+                auto srcElement = src.getArrayElementType();
+                auto dstElement = dst.getArrayElementType();
+
+                if (srcElement.hasIdenticalLayout (dstElement))
+                    return reuseSource();
+
+                if (srcElement.isPrimitiveOrVector() && dstElement.isPrimitiveOrVector()
+                     && srcElement.getVectorSize() == dstElement.getVectorSize())
+                    return { "convert<" + dstName + "> (" + source.code + ")" };
+            }
+
+            if (dst.isUnsizedArray() && src.isFixedSizeArray()
+                 && src.getArrayElementType().hasIdenticalLayout (dst.getArrayElementType()))
+            {
+                auto array = source.isLValue ? source.code : createTemporary (src, source.code);
+                return { "makeSlice<" + generator.getTypeName (dst.getArrayElementType()) + "> (" + array + ")" };
+            }
+
+            if (src.hasIdenticalLayout (dst))
+                return reuseSource();
+
+            throwCastError (src, dst);
+        }
+
+        [[noreturn]] static void throwCastError (const Type& src, const Type& dst)
+        {
+            CodeLocation().throwError (Errors::notYetImplemented ("cast from " + src.getDescription() + " to " + dst.getDescription()));
+        }
+
+        Expr createBoundedIntCast (const Expr& source, const Type& sourceType, const Type& destType)
+        {
+            auto function = std::string (destType.isWrapped() ? "convertBounded<true, int32_t> (" : "convertBounded<false, int32_t> (");
+            auto limit = std::to_string (destType.getBoundedIntLimit());
+
+            if (sourceType.isInteger64() || sourceType.isInteger32())
+                return { function + source.code + ", " + limit + ")" };
+
+            if (sourceType.isFloatingPoint())
+                return createBoundedIntCast (createCast (source, sourceType, PrimitiveType::int64), PrimitiveType::int64, destType);
+
+            throwCastError (sourceType, destType);
+        }
+
+        //==============================================================================
+        void writeStatement (choc::text::CodePrinter& out, heart::Statement& s)
+        {
+            if (is_type<heart::AdvanceClock> (s))
+            {
+                if (isRunFunction)
+                {
+                    resumeLabels.push_back (createLabel ("resume" + std::to_string (resumeLabels.size() + 1)));
+                    out << "resumePoint = " << resumeLabels.size() << ";" << newLine
+                        << "return true;" << newLine
+                        << resumeLabels.back() << ":;" << newLine;
+                }
+
+                return;
+            }
+
+            if (auto a = cast<heart::AssignFromValue> (s))
+            {
+                auto& targetType = a->target->getType();
+                auto target = compileExpression (*a->target);
+                auto value = compileExpression (a->source, targetType);
+                return writeAssignment (out, target, value);
+            }
+
+            if (auto fc = cast<heart::FunctionCall> (s))
+            {
+                auto& target = fc->getFunction();
+                auto call = compileCall (target, fc->arguments);
+
+                if (fc->target == nullptr)
+                {
+                    flushPendingStatements (out);
+                    out << call.code << ";" << newLine;
+                    return;
+                }
+
+                auto targetType = fc->target->getType().removeReferenceIfPresent();
+
+                if (! targetType.isIdentical (target.returnType.removeReferenceIfPresent()))
+                    call = createCast (call, target.returnType, targetType);
+
+                return writeAssignment (out, compileExpression (*fc->target), call);
+            }
+
+            if (auto r = cast<heart::ReadStream> (s))
+            {
+                SOUL_ASSERT (processor != nullptr);
+                auto& input = r->source.get();
+                auto index = getEndpointIndex (processor->module.inputs, input);
+                auto frameType = input.getFrameOrValueType();
+                Expr slot { processor->inputNames[index], true, false };
+
+                if (r->element != nullptr)
+                {
+                    slot = createElementAccess (slot, frameType, *r->element, false);
+                    frameType = frameType.getElementType();
+                }
+
+                auto& targetType = r->target->getType();
+                auto target = compileExpression (*r->target);
+                return writeAssignment (out, target, createCast (slot, frameType, targetType));
+            }
+
+            if (auto w = cast<heart::WriteStream> (s))
+                return writeStreamWrite (out, *w);
+
+            s.location.throwError (Errors::notYetImplemented ("statement type"));
+        }
+
+        void writeAssignment (choc::text::CodePrinter& out, const Expr& target, const Expr& value)
+        {
+            flushPendingStatements (out);
+            out << target.code << " = " << value.code << ";" << newLine;
+        }
+
+        template <typename DeclType>
+        static size_t getEndpointIndex (const std::vector<pool_ref<DeclType>>& list, const heart::IODeclaration& endpoint)
+        {
+            for (size_t i = 0; i < list.size(); ++i)
+                if (list[i].getPointer() == std::addressof (endpoint))
+                    return i;
+
+            SOUL_ASSERT_FALSE;
+            return 0;
+        }
+
+        void writeStreamWrite (choc::text::CodePrinter& out, heart::WriteStream& w)
+        {
+            SOUL_ASSERT (processor != nullptr);
+            auto& output = w.target.get();
+            auto outputIndex = getEndpointIndex (processor->module.outputs, output);
+            auto& valueType = w.value->getType();
+
+            if (output.isEventEndpoint())
+            {
+                uint32_t typeIndex = 0;
+
+                for (uint32_t i = 0; i < output.dataTypes.size(); ++i)
+                {
+                    if (output.dataTypes[i].isEqual (valueType, Type::ignoreReferences | Type::ignoreConst))
+                    {
+                        typeIndex = i;
+                        break;
+                    }
+
+                    if (TypeRules::canSilentlyCastTo (output.dataTypes[i], valueType))
+                        typeIndex = i;
+                }
+
+                auto value = compileExpression (w.value, output.dataTypes[typeIndex]);
+                std::string element ("0u");
+
+                if (w.element != nullptr)
+                {
+                    auto arraySize = std::to_string (output.arraySize.value_or (1));
+
+                    if (w.element->getType().isInteger64())
+                        element = "static_cast<uint32_t> (Ops::wrap<int64_t> (" + compileExpression (*w.element).code + ", " + arraySize + "))";
+                    else
+                        element = "static_cast<uint32_t> (Ops::wrap<int32_t> (" + compileExpression (*w.element, PrimitiveType::int32).code
+                                    + ", " + arraySize + "))";
+                }
+
+                flushPendingStatements (out);
+                out << "owner->writeEvent (nodeIndex, " << outputIndex << ", " << element << ", " << typeIndex
+                    << ", addressOf (" << value.code << "));" << newLine;
+                return;
+            }
+
+            Expr slot { processor->outputNames[outputIndex], true, false };
+            auto slotType = output.getFrameOrValueType();
+
+            if (w.element != nullptr)
+            {
+                slot = createElementAccess (slot, slotType, *w.element, false);
+                slotType = slotType.getElementType();
+            }
+
+            auto value = compileExpression (w.value, slotType);
+
+            if (output.isValueEndpoint())
+                return writeAssignment (out, slot, value);
+
+            auto prim = slotType.getPrimitiveType();
+
+            if (! (prim.isFloat32() || prim.isFloat64() || prim.isInteger32() || prim.isInteger64()))
+                w.location.throwError (Errors::unsupportedType());
+
+            flushPendingStatements (out);
+            out << "accumulate<" << generator.getTypeName (slotType) << "> (" << slot.code << ", " << value.code << ");" << newLine;
+        }
+
+        //==============================================================================
+        void writeBranch (choc::text::CodePrinter& out, heart::Block& target, ArrayView<pool_ref<heart::Expression>> args, bool canFallThrough)
+        {
+            SOUL_ASSERT (args.size() == target.parameters.size());
+
+            if (args.size() == 1)
+            {
+                auto& param = target.parameters.front().get();
+                writeAssignment (out, getVariable (param), compileExpression (args.front(), param.type));
+            }
+            else if (! args.empty())
+            {
+                // All the arguments must be evaluated before any of the parameters change
+                std::vector<std::string> temporaries, values;
+
+                for (size_t i = 0; i < args.size(); ++i)
+                {
+                    auto& param = target.parameters[i].get();
+                    values.push_back (compileExpression (args[i], param.type).code);
+                    temporaries.push_back (generator.createName ("arg"));
+                }
+
+                flushPendingStatements (out);
+
+                {
+                    auto indent = out.createIndentWithBraces();
+
+                    for (size_t i = 0; i < args.size(); ++i)
+                        out << generator.getTypeName (target.parameters[i]->type) << " " << temporaries[i] << " = " << values[i] << ";" << newLine;
+
+                    for (size_t i = 0; i < args.size(); ++i)
+                        out << getVariable (target.parameters[i]).code << " = " << temporaries[i] << ";" << newLine;
+                }
+
+                out << newLine;
+            }
+
+            if (! (canFallThrough && std::addressof (target) == nextBlock))
+            {
+                auto& label = blockLabels[std::addressof (target)];
+                jumpTargets.insert (label);
+                out << "goto " << label << ";" << newLine;
+            }
+        }
+
+        void writeTerminator (choc::text::CodePrinter& out, heart::Terminator& t, heart::Function& f)
+        {
+            if (auto br = cast<heart::Branch> (t))
+                return writeBranch (out, br->target, br->targetArgs, true);
+
+            if (auto bi = cast<heart::BranchIf> (t))
+            {
+                auto condition = compileExpression (bi->condition, PrimitiveType::bool_);
+                flushPendingStatements (out);
+                out << "if (" << condition.code << ")" << newLine;
+
+                {
+                    auto indent = out.createIndentWithBraces();
+                    writeBranch (out, bi->targets[0], bi->targetArgs[0], false);
+                }
+
+                out << newLine;
+                return writeBranch (out, bi->targets[1], bi->targetArgs[1], true);
+            }
+
+            if (auto rv = cast<heart::ReturnValue> (t))
+            {
+                auto value = compileExpression (rv->returnValue, f.returnType);
+                flushPendingStatements (out);
+                out << "return " << value.code << ";" << newLine;
+                return;
+            }
+
+            out << (isRunFunction ? "return false;" : "return;") << newLine;
+        }
+    };
+
+    //==============================================================================
+    FunctionInfo& getFunction (heart::Function& f)
+    {
+        auto found = functions.find (std::addressof (f));
+
+        if (found != functions.end())
+            return found->second;
+
+        if (f.hasNoBody)
+            f.location.throwError (Errors::functionHasNoImplementation());
+
+        auto& module = program.getModuleContainingFunction (f);
+        auto processor = module.isProcessor() ? std::addressof (getProcessor (module)) : nullptr;
+
+        // Creating the processor may already have added this function
+        found = functions.find (std::addressof (f));
+
+        if (found != functions.end())
+            return found->second;
+
+        FunctionInfo info;
+        info.function = std::addressof (f);
+        info.processor = processor;
+        info.name = (processor != nullptr && f.functionType.isRun()) ? std::string ("run")
+                        : createName (program.getFunctionNameWithQualificationIfNeeded (module, f));
+
+        pendingFunctions.push_back (std::addressof (f));
+        return functions.emplace (std::addressof (f), std::move (info)).first->second;
+    }
+
+    void writePendingFunction (heart::Function& f)
+    {
+        auto& info = functions[std::addressof (f)];
+        auto isRun = info.processor != nullptr && f.functionType.isRun();
+        FunctionWriter writer (*this, info.processor, isRun);
+        auto code = writer.write (f, info.name, info.processor == nullptr);
+
+        if (info.processor != nullptr)
+            info.processor->functions << code << blankLine;
+        else
+            namespaceFunctions << code << blankLine;
+    }
+
+    ProcessorInfo& getProcessor (Module& module)
+    {
+        for (auto& p : processors)
+            if (std::addressof (p->module) == std::addressof (module))
+                return *p;
+
+        processors.push_back (std::make_unique<ProcessorInfo> (module));
+        auto& p = *processors.back();
+        p.structName = createName (module.fullName);
+
+        // This mirrors the interpreter's layout, so that both have the same limit on the state size
+        size_t stateSize = 3 * interpreter::alignSlotSize (sizeof (double)) + interpreter::alignSlotSize (sizeof (interpreter::ResumePoint));
+
+        for (auto& v : module.stateVariables.get())
+        {
+            if (! v->isExternal())
+            {
+                auto name = createName (v->name.toString());
+                p.stateVariableNames[v.getPointer()] = name;
+                p.memberDeclarations.push_back (getTypeName (v->type) + " " + name + ";");
+                stateSize += interpreter::alignSlotSize (v->type.getPackedSizeInBytes());
+            }
+        }
+
+        auto addEndpoints = [&] (auto& endpoints, std::vector<std::string>& names, const char* prefix)
+        {
+            for (auto& e : endpoints)
+            {
+                if (e->isEventEndpoint())
+                {
+                    names.emplace_back();
+                    continue;
+                }
+
+                auto type = e->getFrameOrValueType();
+                names.push_back (createName (prefix + e->name.toString()));
+                p.memberDeclarations.push_back (getTypeName (type) + " " + names.back() + ";");
+                stateSize += interpreter::alignSlotSize (type.getPackedSizeInBytes());
+            }
+        };
+
+        addEndpoints (module.inputs, p.inputNames, "in_");
+        addEndpoints (module.outputs, p.outputNames, "out_");
+
+        if (stateSize > settings.maxStateSize && settings.maxStateSize != 0)
+            CodeLocation().throwError (Errors::programStateTooLarge (getReadableDescriptionOfByteSize (stateSize),
+                                                                     getReadableDescriptionOfByteSize (settings.maxStateSize)));
+
+        auto& moduleFunctions = module.functions;
+
+        for (auto& f : moduleFunctions.get())
+        {
+            if (f->functionType.isSystemInit())  p.systemInit = getFunction (f).name;
+            if (f->functionType.isUserInit())    p.userInit   = getFunction (f).name;
+        }
+
+        for (auto& input : module.inputs)
+        {
+            p.eventHandlers.emplace_back();
+
+            if (input->isEventEndpoint())
+            {
+                for (auto& type : input->dataTypes)
+                {
+                    EventHandlerInfo handler;
+
+                    if (auto f = moduleFunctions.find (heart::getEventFunctionName (input->name.toString(), type)))
+                    {
+                        handler.name = getFunction (*f).name;
+                        handler.valueTypeName = getTypeName (f->parameters.back()->type);
+                        handler.hasIndexParameter = f->parameters.size() > 1;
+                        handler.indexIs64Bit = handler.hasIndexParameter && f->parameters.front()->type.isInteger64();
+                    }
+
+                    p.eventHandlers.back().push_back (handler);
+                }
+            }
+        }
+
+        if (auto run = moduleFunctions.findRunFunction())
+        {
+            getFunction (*run);
+            p.hasRunFunction = true;
+        }
+
+        FunctionWriter writer (*this, std::addressof (p), false);
+        p.stateInitialiser = writer.writeStateInitialiser (module);
+        return p;
+    }
+
+    //==============================================================================
+    void createNodes()
+    {
+        auto maxExponent = graph.getMaxClockExponent();
+
+        if (! graph.topLevelInputs.empty())
+            topLevelExponent = graph.nodes[graph.topLevelInputs.front()].clockExponent;
+        else if (! graph.topLevelOutputs.empty())
+            topLevelExponent = graph.nodes[graph.topLevelOutputs.front()].clockExponent;
+
+        ticksPerTopLevelFrame = uint64_t (1) << (maxExponent - topLevelExponent);
+
+        for (uint32_t i = 0; i < graph.nodes.size(); ++i)
+        {
+            auto& node = graph.nodes[i];
+            NodeInfo n;
+            n.node = std::addressof (node);
+            n.index = i;
+            n.ticksPerFrame = uint64_t (1) << (maxExponent - node.clockExponent);
+            n.sampleRateFactor = std::pow (2.0, node.clockExponent - topLevelExponent);
+            n.structName = createName ("Node_" + node.path);
+            n.memberName = createName (node.path);
+
+            if (node.isJunction())
+            {
+                n.inputs.push_back (*node.endpoint);
+                n.outputs.push_back (*node.endpoint);
+            }
+            else
+            {
+                n.processor = std::addressof (getProcessor (*node.processor));
+
+                for (auto& input : node.processor->inputs)    n.inputs.push_back (input);
+                for (auto& output : node.processor->outputs)  n.outputs.push_back (output);
+            }
+
+            for (auto& input : n.inputs)
+                n.inputFrameRanges.push_back (input->isEventEndpoint() ? interpreter::ElementRange()
+                                                                       : interpreter::ElementRange (input->getFrameOrValueType(), {}));
+
+            for (auto& output : n.outputs)
+                n.outputFrameRanges.push_back (output->isEventEndpoint() ? interpreter::ElementRange()
+                                                                         : interpreter::ElementRange (output->getFrameOrValueType(), {}));
+
+            for (auto& input : n.inputs)
+            {
+                if (input->isEventEndpoint())
+                {
+                    n.hasEventQueue = n.processor != nullptr || n.isTopLevelOutput();
+
+                    for (auto& type : input->dataTypes)
+                        n.queuedEventTypes.push_back (getTypeName (type));
+                }
+            }
+
+            n.inputSources.resize (n.inputs.size());
+            n.eventRoutes.resize (n.outputs.size());
+            n.outputBufferSizes.resize (n.outputs.size());
+            nodes.push_back (std::move (n));
+        }
+
+        maxChunkTicks = ticksPerTopLevelFrame * settings.maxBlockSize;
+        uint64_t maxDelayTicks = 0, maxTicksPerFrame = 1;
+
+        for (auto& c : graph.connections)
+        {
+            if (c.delayLength > 0)
+            {
+                auto delayTicks = static_cast<uint64_t> (c.delayLength) * nodes[c.source.node].ticksPerFrame;
+                maxChunkTicks = std::min (maxChunkTicks, delayTicks);
+                maxDelayTicks = std::max (maxDelayTicks, delayTicks);
+            }
+        }
+
+        for (auto& n : nodes)
+            maxTicksPerFrame = std::max (maxTicksPerFrame, n.ticksPerFrame);
+
+        // Only the stream outputs which something reads from need a buffer
+        for (auto& c : graph.connections)
+        {
+            auto& source = nodes[c.source.node];
+            auto outputIndex = findEndpointIndex (source.outputs, *c.source.endpoint);
+
+            if (source.outputs[outputIndex]->isStreamEndpoint())
+            {
+                auto minFrames = (maxChunkTicks + maxDelayTicks + 2 * maxTicksPerFrame) / source.ticksPerFrame + 4;
+                uint64_t numFrames = 1;
+
+                while (numFrames < minFrames)
+                    numFrames *= 2;
+
+                source.outputBufferSizes[outputIndex] = numFrames;
+            }
+        }
+    }
+
+    static uint32_t findEndpointIndex (const std::vector<pool_ref<heart::IODeclaration>>& list, const heart::IODeclaration& endpoint)
+    {
+        for (size_t i = 0; i < list.size(); ++i)
+            if (list[i].getPointer() == std::addressof (endpoint))
+                return static_cast<uint32_t> (i);
+
+        SOUL_ASSERT_FALSE;
+        return 0;
+    }
+
+    static Type getElementType (const Type& frameType, std::optional<uint32_t> element)
+    {
+        return element ? frameType.getElementType() : frameType;
+    }
+
+    void addConnection (const interpreter::FlattenedGraph::Connection& c)
+    {
+        auto& source = nodes[c.source.node];
+        auto& dest = nodes[c.dest.node];
+        auto sourceOutput = findEndpointIndex (source.outputs, *c.source.endpoint);
+        auto destInput = findEndpointIndex (dest.inputs, *c.dest.endpoint);
+        auto& sourceEndpoint = source.outputs[sourceOutput].get();
+        auto& destEndpoint = dest.inputs[destInput].get();
+        auto delayTicks = static_cast<uint64_t> (c.delayLength) * source.ticksPerFrame;
+
+        if (sourceEndpoint.isEventEndpoint())
+        {
+            EventRoute route;
+            route.destNode = c.dest.node;
+            route.destInput = destInput;
+            route.sourceElement = c.source.element ? static_cast<int32_t> (*c.source.element) : -1;
+            route.destElement = c.dest.element ? static_cast<int32_t> (*c.dest.element)
+                                               : (destEndpoint.arraySize.has_value() ? -1 : 0);
+            route.delayTicks = delayTicks;
+
+            for (auto& sourceType : sourceEndpoint.dataTypes)
+            {
+                TypeMapping mapping;
+
+                for (uint32_t i = 0; i < destEndpoint.dataTypes.size(); ++i)
+                {
+                    if (destEndpoint.dataTypes[i].isEqual (sourceType, Type::ignoreConst | Type::ignoreReferences))
+                    {
+                        mapping.destType = static_cast<int32_t> (i);
+                        mapping.needsConversion = false;
+                        break;
+                    }
+
+                    if (mapping.destType < 0 && sourceType.isPrimitive() && destEndpoint.dataTypes[i].isPrimitive()
+                         && TypeRules::canSilentlyCastTo (destEndpoint.dataTypes[i], sourceType))
+                    {
+                        mapping.destType = static_cast<int32_t> (i);
+                        mapping.needsConversion = true;
+                        mapping.sourceTypeName = getTypeName (sourceType);
+                        mapping.destTypeName = getTypeName (destEndpoint.dataTypes[i]);
+                    }
+                }
+
+                route.typeMap.push_back (mapping);
+            }
+
+            source.eventRoutes[sourceOutput].push_back (std::move (route));
+            return;
+        }
+
+        auto sourceType = sourceEndpoint.getFrameOrValueType();
+        auto destType = destEndpoint.getFrameOrValueType();
+        auto sourceRange = interpreter::ElementRange (sourceType, c.source.element);
+        auto destRange   = interpreter::ElementRange (destType, c.dest.element);
+
+        if (sourceEndpoint.isStreamEndpoint())
+        {
+            if (! sourceRange.canConvertTo (destRange))
+                c.location.throwError (Errors::notYetImplemented ("Stream connection between "
+                                                                     + sourceType.getDescription() + " and " + destType.getDescription()));
+
+            dest.inputSources[destInput].streams.push_back ({ c.source.node, sourceOutput, sourceRange, destRange,
+                                                              c.source.element, c.dest.element,
+                                                              getTypeName (getElementType (sourceType, c.source.element)),
+                                                              getTypeName (getElementType (destType, c.dest.element)),
+                                                              source.ticksPerFrame, delayTicks, c.interpolation,
+                                                              sourceRange.canCopyDirectlyTo (destRange)
+                                                                && source.ticksPerFrame == dest.ticksPerFrame });
+            return;
+        }
+
+        auto canCopy = sourceRange.size == destRange.size && sourceType.hasIdenticalLayout (destType);
+
+        if (! (canCopy || sourceRange.canConvertTo (destRange)))
+            c.location.throwError (Errors::notYetImplemented ("Value connection between "
+                                                                 + sourceType.getDescription() + " and " + destType.getDescription()));
+
+        dest.inputSources[destInput].values.push_back ({ c.source.node, sourceOutput, c.source.element, c.dest.element, canCopy });
+    }
+
+    //==============================================================================
+    static std::string getElement (const std::string& parent, std::optional<uint32_t> element)
+    {
+        return element ? parent + ".e[" + std::to_string (*element) + "]" : parent;
+    }
+
+    static std::string getBufferName (uint32_t outputIndex)
+    {
+        return "buffer" + std::to_string (outputIndex);
+    }
+
+    static std::string getBufferFrame (const NodeInfo& n, uint32_t outputIndex, const std::string& frame)
+    {
+        return n.memberName + "." + getBufferName (outputIndex) + ".get (" + frame + ")";
+    }
+
+    static void writeCopy (choc::text::CodePrinter& out, const std::string& dest, const std::string& destType,
+                           const std::string& source, const std::string& sourceType)
+    {
+        if (destType == sourceType)
+            out << dest << " = " << source << ";" << newLine;
+        else
+            out << "copyRaw (" << dest << ", " << source << ");" << newLine;
+    }
+
+    /** Writes the code which fills an input slot from the things connected to it, like GraphRuntime::readInputs(). */
+    void writeReadInputs (choc::text::CodePrinter& out, const NodeInfo& n, size_t inputIndex, const std::string& slot)
+    {
+        auto& sources = n.inputSources[inputIndex];
+        auto& destFrame = n.inputFrameRanges[inputIndex];
+
+        if (! sources.streams.empty())
+        {
+            auto& first = sources.streams.front();
+
+            if (sources.streams.size() == 1 && first.canCopyDirectly)
+            {
+                if (first.destRange.size != destFrame.size)
+                    out << slot << " = {};" << newLine;
+
+                // With the same rates, the delay is always a whole number of frames
+                auto delayFrames = first.delayTicks / first.ticksPerFrame;
+                auto sourceFrame = getBufferFrame (nodes[first.sourceNode], first.sourceOutput,
+                                                   "static_cast<int64_t> (frame)" + (delayFrames != 0 ? " - " + std::to_string (delayFrames) : std::string()));
+
+                writeCopy (out, getElement (slot, first.destElement), first.destTypeName,
+                           getElement (sourceFrame, first.sourceElement), first.sourceTypeName);
+                return;
+            }
+
+            out << slot << " = {};" << newLine;
+
+            for (auto& s : sources.streams)
+            {
+                auto latch = s.interpolation == InterpolationType::none || s.interpolation == InterpolationType::latch;
+                auto mode = (s.ticksPerFrame == n.ticksPerFrame || latch || s.sourceRange.primitiveType.isInteger())
+                              ? "single" : (s.ticksPerFrame > n.ticksPerFrame ? "interpolate" : "average");
+
+                out << "addStream<StreamRead::" << mode << ", " << s.destTypeName << ", " << s.sourceTypeName << "> ("
+                    << getElement (slot, s.destElement) << ", static_cast<int64_t> (tick)"
+                    << (s.delayTicks != 0 ? " - " + std::to_string (s.delayTicks) : std::string())
+                    << ", " << s.ticksPerFrame << ", " << n.ticksPerFrame << ", [this] (int64_t f) -> const " << s.sourceTypeName
+                    << "& { return " << getElement (getBufferFrame (nodes[s.sourceNode], s.sourceOutput, "f"), s.sourceElement) << "; });" << newLine;
+            }
+        }
+
+        for (auto& v : sources.values)
+        {
+            auto& source = nodes[v.sourceNode];
+            auto sourceType = source.outputs[v.sourceOutput]->getFrameOrValueType();
+            auto destType = n.inputs[inputIndex]->getFrameOrValueType();
+            auto sourceSlot = getElement (source.getOutputSlot (v.sourceOutput), v.sourceElement);
+            auto destSlot = getElement (slot, v.destElement);
+
+            if (v.canCopyDirectly)
+                writeCopy (out, destSlot, getTypeName (getElementType (destType, v.destElement)),
+                           sourceSlot, getTypeName (getElementType (sourceType, v.sourceElement)));
+            else
+                out << "convertElements (" << destSlot << ", " << sourceSlot << ");" << newLine;
+        }
+    }
+
+    void writeProcessorFrame (choc::text::CodePrinter& out, const NodeInfo& n)
+    {
+        auto& p = *n.processor;
+
+        if (n.hasEventQueue)
+        {
+            out << "while (auto e = node.events.getNext (tick))" << newLine;
+
+            {
+                auto indent = out.createIndentWithBraces();
+                out << "auto eventData = node.events.getData (*e);" << blankLine;
+
+                for (size_t i = 0; i < p.eventHandlers.size(); ++i)
+                {
+                    for (size_t t = 0; t < p.eventHandlers[i].size(); ++t)
+                    {
+                        auto& handler = p.eventHandlers[i][t];
+
+                        if (handler.name.empty())
+                            continue;
+
+                        out << "if (e->input == " << i << " && e->typeIndex == " << t << ")" << newLine
+                            << "    node.processor." << handler.name << " ("
+                            << (handler.hasIndexParameter ? (handler.indexIs64Bit ? "static_cast<int64_t> (e->element), "
+                                                                                   : "static_cast<int32_t> (e->element), ") : "")
+                            << "asMutable (*reinterpret_cast<const " << handler.valueTypeName << "*> (eventData)));" << blankLine;
+                    }
+                }
+
+                out << "node.events.popNext();" << newLine;
+            }
+
+            out << blankLine;
+        }
+
+        for (size_t i = 0; i < n.inputs.size(); ++i)
+            if (! n.inputs[i]->isEventEndpoint())
+                writeReadInputs (out, n, i, "node.processor." + p.inputNames[i]);
+
+        for (size_t i = 0; i < n.outputs.size(); ++i)
+            if (n.outputs[i]->isStreamEndpoint())
+                out << "node.processor." << p.outputNames[i] << " = {};" << newLine;
+
+        if (p.hasRunFunction)
+            out << blankLine
+                << "if (! node.hasFinished && ! node.processor.run())" << newLine
+                << "    node.hasFinished = true;" << blankLine;
+
+        for (uint32_t i = 0; i < n.outputs.size(); ++i)
+            if (n.outputBufferSizes[i] != 0)
+                out << "node." << getBufferName (i) << ".get (static_cast<int64_t> (frame)) = node.processor." << p.outputNames[i] << ";" << newLine;
+    }
+
+    void writeJunctionFrame (choc::text::CodePrinter& out, const NodeInfo& n)
+    {
+        auto& endpoint = n.inputs.front().get();
+
+        if (endpoint.isEventEndpoint())
+        {
+            // Only top-level outputs have anything queued, because other junctions forward events as they arrive
+            if (n.isTopLevelOutput())
+            {
+                out << "auto blockFrame = static_cast<uint32_t> (frame - blockStartFrame);" << blankLine
+                    << "while (auto e = node.events.getNext (tick))" << newLine;
+
+                {
+                    auto indent = out.createIndentWithBraces();
+                    out << "if (! node.outputEvents.add (blockFrame, e->typeIndex, node.events.getData (*e)))" << newLine
+                        << "    ++xruns;" << blankLine
+                        << "node.events.popNext();" << newLine;
+                }
+
+                out << newLine;
+            }
+
+            return;
+        }
+
+        if (endpoint.isStreamEndpoint() && (n.isTopLevelInput() || n.isTopLevelOutput()))
+            out << "auto blockFrame = static_cast<uint32_t> (frame - blockStartFrame);" << blankLine;
+
+        if (n.isTopLevelInput())
+        {
+            if (endpoint.isStreamEndpoint())
+            {
+                out << "if (node.hasTopLevelFrames)" << newLine
+                    << "    node.slot = node.topLevelFrames[blockFrame];" << newLine
+                    << "else if (node.rampFramesRemaining > 0)" << newLine;
+
+                {
+                    auto indent = out.createIndentWithBraces();
+                    out << "applyRamp (node.slot, node.rampIncrement);" << newLine
+                        << "--node.rampFramesRemaining;" << newLine;
+                }
+
+                out << blankLine;
+            }
+        }
+        else
+        {
+            writeReadInputs (out, n, 0, "node.slot");
+        }
+
+        if (n.outputBufferSizes.front() != 0)
+            out << "node." << getBufferName (0) << ".get (static_cast<int64_t> (frame)) = node.slot;" << newLine;
+
+        if (n.isTopLevelOutput() && endpoint.isStreamEndpoint())
+            out << "node.topLevelFrames[blockFrame] = node.slot;" << newLine;
+    }
+
+    /** Returns the function which renders a node up to a given tick, or nothing if the node has no work to do. */
+    std::string writeRenderFunction (const NodeInfo& n, const std::string& functionName)
+    {
+        choc::text::CodePrinter frame;
+
+        if (n.processor != nullptr)
+            writeProcessorFrame (frame, n);
+        else
+            writeJunctionFrame (frame, n);
+
+        auto frameCode = frame.toString();
+
+        if (frameCode.empty())
+            return {};
+
+        auto ticksPerFrame = std::to_string (n.ticksPerFrame) + "u";
+
+        choc::text::CodePrinter out;
+        out << "void " << functionName << " (uint64_t endTick) noexcept" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << "auto& node = " << n.memberName << ";" << blankLine
+                << "while (" << (n.ticksPerFrame == 1 ? std::string ("node.nextFrame") : "node.nextFrame * " + ticksPerFrame) << " < endTick)" << newLine;
+
+            {
+                auto loopIndent = out.createIndentWithBraces();
+                out << "auto frame = node.nextFrame++;" << newLine
+                    << "auto tick = frame" << (n.ticksPerFrame == 1 ? std::string() : " * " + ticksPerFrame) << ";" << newLine
+                    << "currentNodeTick = tick;" << blankLine
+                    << frameCode;
+            }
+
+            out << newLine;
+        }
+
+        out << newLine;
+        return out.toString();
+    }
+
+    /** Returns the function which sends an event from a node's output to everything connected to it. */
+    std::string writeDispatchFunction (const NodeInfo& n, uint32_t outputIndex, const std::string& functionName,
+                                       const std::unordered_map<uint64_t, std::string>& dispatchFunctionNames)
+    {
+        choc::text::CodePrinter out;
+
+        {
+            bool isFirst = true;
+
+            for (auto& route : n.eventRoutes[outputIndex])
+            {
+                auto& dest = nodes[route.destNode];
+                auto& destEndpoint = dest.inputs[route.destInput].get();
+                auto destTick = route.delayTicks != 0 ? "tick + " + std::to_string (route.delayTicks) + "u" : std::string ("tick");
+                auto destElement = route.destElement < 0 ? std::string ("element") : std::to_string (route.destElement) + "u";
+                auto forwardsToJunction = dest.isJunction() && ! dest.node->isTopLevel;
+
+                choc::text::CodePrinter cases;
+
+                for (uint32_t t = 0; t < route.typeMap.size(); ++t)
+                {
+                    auto& mapping = route.typeMap[t];
+
+                    if (mapping.destType < 0)
+                        continue;
+
+                    auto destType = static_cast<uint32_t> (mapping.destType);
+                    auto destTypeName = getTypeName (destEndpoint.dataTypes[destType]);
+                    std::string data ("eventData");
+
+                    if (forwardsToJunction)
+                    {
+                        auto found = dispatchFunctionNames.find ((static_cast<uint64_t> (route.destNode) << 32));
+
+                        if (found == dispatchFunctionNames.end())
+                            continue;
+                    }
+
+                    cases << "case " << t << ":" << newLine;
+
+                    {
+                        auto caseIndent = cases.createIndentWithBraces();
+
+                        if (mapping.needsConversion)
+                        {
+                            cases << destTypeName << " converted;" << newLine
+                                  << "convertElements (converted, *static_cast<const " << mapping.sourceTypeName << "*> (eventData));" << newLine;
+                            data = "std::addressof (converted)";
+                        }
+
+                        if (forwardsToJunction)
+                            cases << dispatchFunctionNames.at (static_cast<uint64_t> (route.destNode) << 32)
+                                  << " (" << destElement << ", " << destType << ", " << data << ", " << destTick << ");" << newLine;
+                        else
+                            cases << "if (! " << dest.memberName << ".events.push (" << destTick << ", " << route.destInput << ", "
+                                  << destElement << ", " << destType << ", " << data << ", sizeof (" << destTypeName << ")))" << newLine
+                                  << "    ++xruns;" << newLine;
+
+                        cases << blankLine << "break;" << newLine;
+                    }
+
+                    cases << newLine;
+                }
+
+                auto caseCode = cases.toString();
+
+                if (caseCode.empty())
+                    continue;
+
+                if (! isFirst)
+                    out << blankLine;
+
+                isFirst = false;
+
+                auto switchCode = getSwitch ("typeIndex", caseCode, "break");
+
+                if (route.sourceElement >= 0)
+                {
+                    out << "if (element == " << route.sourceElement << "u)" << newLine;
+
+                    {
+                        auto routeIndent = out.createIndentWithBraces();
+                        out << switchCode;
+                    }
+
+                    out << newLine;
+                }
+                else
+                {
+                    out << switchCode;
+                }
+            }
+        }
+
+        choc::text::CodePrinter function;
+        writeFunction (function, "void " + functionName,
+                       { { "uint32_t", "element" }, { "uint32_t", "typeIndex" }, { "const void*", "eventData" }, { "uint64_t", "tick" } },
+                       " noexcept", out.toString());
+        return function.toString();
+    }
+
+    /** Writes a function whose body has already been generated. */
+    static void writeFunction (choc::text::CodePrinter& out, const std::string& declaration, const std::vector<Parameter>& params,
+                               const std::string& qualifiers, const std::string& body)
+    {
+        out << declaration << " (" << getParameterList (params, body) << ")" << qualifiers << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << body;
+        }
+
+        out << newLine;
+    }
+
+    void writeNodeStruct (choc::text::CodePrinter& out, const NodeInfo& n)
+    {
+        out << "struct " << n.structName << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+
+            if (n.processor != nullptr)
+                out << n.processor->structName << " processor;" << newLine;
+            else if (! n.inputs.front()->isEventEndpoint())
+                out << getTypeName (n.inputs.front()->getFrameOrValueType()) << " slot;" << newLine;
+
+            out << "uint64_t nextFrame;" << newLine;
+
+            if (n.processor != nullptr)
+                out << "bool hasFinished;" << newLine;
+
+            if (n.hasEventQueue)
+            {
+                std::string types;
+
+                for (auto& t : n.queuedEventTypes)
+                    types += (types.empty() ? "" : ", ") + t;
+
+                out << "static constexpr uint32_t eventSlotSize = getEventSlotSize<" << types << ">();" << newLine
+                    << "EventQueue<" << eventQueueCapacity << ", eventSlotSize> events;" << newLine;
+            }
+
+            for (uint32_t i = 0; i < n.outputs.size(); ++i)
+                if (n.outputBufferSizes[i] != 0)
+                    out << "StreamBuffer<" << getTypeName (n.outputs[i]->getFrameOrValueType()) << ", " << n.outputBufferSizes[i] << "> "
+                        << getBufferName (i) << ";" << newLine;
+
+            if (n.node->isTopLevel)
+            {
+                auto& endpoint = n.inputs.front().get();
+
+                if (endpoint.isStreamEndpoint())
+                    out << getTypeName (endpoint.getFrameOrValueType()) << " topLevelFrames[" << settings.maxBlockSize << "];" << newLine;
+
+                if (n.isTopLevelInput() && endpoint.isStreamEndpoint())
+                    out << "double rampIncrement[" << n.outputFrameRanges.front().numElements << "];" << newLine
+                        << "uint32_t rampFramesRemaining;" << newLine
+                        << "bool hasTopLevelFrames;" << newLine;
+
+                if (n.isTopLevelOutput() && endpoint.isEventEndpoint())
+                    out << "OutputEventList<" << eventQueueCapacity << ", eventSlotSize> outputEvents;" << newLine;
+            }
+        }
+
+        out << ";" << blankLine;
+    }
+
+    void writeProcessorStruct (choc::text::CodePrinter& out, ProcessorInfo& p)
+    {
+        out << "struct " << p.structName << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+
+            out << className << "* owner;" << newLine
+                << "uint32_t nodeIndex;" << newLine
+                << "double frequency, period;" << newLine
+                << "int32_t id;" << newLine
+                << "uint32_t resumePoint;" << newLine;
+
+            for (auto& m : p.memberDeclarations)
+                out << m << newLine;
+
+            out << blankLine << p.stateInitialiser << blankLine << p.functions.toString();
+        }
+
+        out << ";" << blankLine;
+    }
+
+    //==============================================================================
+    /** Values whose packed layout differs from their C++ one get copied by a pair of functions like these. */
+    std::string getPackFunction (const Type& type)
+    {
+        auto typeName = getTypeName (type);
+        auto found = packFunctions.find (typeName);
+
+        if (found != packFunctions.end())
+            return found->second;
+
+        auto packName = createName ("pack_" + typeName);
+        auto unpackName = createName ("unpack_" + typeName);
+        packFunctions[typeName] = packName;
+        unpackFunctions[typeName] = unpackName;
+
+        choc::text::CodePrinter pack, unpack;
+
+        auto writeElement = [&] (const Type& elementType, const std::string& member, const std::string& offset)
+        {
+            if (needsPacking (elementType))
+            {
+                auto elementPack = getPackFunction (elementType);
+                pack << elementPack << " (dest + " << offset << ", source" << member << ");" << newLine;
+                unpack << unpackFunctions[getTypeName (elementType)] << " (dest" << member << ", source + " << offset << ");" << newLine;
+            }
+            else
+            {
+                auto size = std::to_string (elementType.getPackedSizeInBytes());
+                pack << "std::memcpy (dest + " << offset << ", std::addressof (source" << member << "), " << size << ");" << newLine;
+                unpack << "std::memcpy (std::addressof (dest" << member << "), source + " << offset << ", " << size << ");" << newLine;
+            }
+        };
+
+        if (type.isStruct())
+        {
+            auto& s = type.getStructRef();
+            auto& info = getStruct (s);
+            size_t offset = 0;
+
+            for (size_t i = 0; i < s.getNumMembers(); ++i)
+            {
+                writeElement (s.getMemberType (i), "." + info.memberNames[i], std::to_string (offset));
+                offset += s.getMemberType (i).getPackedSizeInBytes();
+            }
+        }
+        else
+        {
+            SOUL_ASSERT (type.isFixedSizeArray());
+            auto elementType = type.getArrayElementType();
+            auto loop = "for (int i = 0; i < " + std::to_string (type.getArraySize()) + "; ++i)";
+            pack << loop << newLine;
+            unpack << loop << newLine;
+
+            auto packIndent = pack.createIndent (4);
+            auto unpackIndent = unpack.createIndent (4);
+            writeElement (elementType, ".e[i]", "i * " + std::to_string (elementType.getPackedSizeInBytes()));
+        }
+
+        packingFunctions << "static void " << packName << " (uint8_t* dest, const " << typeName << "& source) noexcept" << newLine;
+
+        {
+            auto indent = packingFunctions.createIndentWithBraces();
+            packingFunctions << pack.toString();
+        }
+
+        packingFunctions << blankLine
+                         << "static void " << unpackName << " (" << typeName << "& dest, const uint8_t* source) noexcept" << newLine;
+
+        {
+            auto indent = packingFunctions.createIndentWithBraces();
+            packingFunctions << unpack.toString();
+        }
+
+        packingFunctions << blankLine;
+        return packName;
+    }
+
+    /** Returns a statement which copies a C++ value into the packing buffer, and makes sure it's big enough. */
+    std::string packIntoBuffer (const Type& type, const std::string& value)
+    {
+        packingBufferSize = std::max (packingBufferSize, type.getPackedSizeInBytes());
+        return getPackFunction (type) + " (packingBuffer, " + value + ");";
+    }
+
+    std::string unpackFromData (const Type& type, const std::string& dest, const std::string& data)
+    {
+        if (needsPacking (type))
+        {
+            getPackFunction (type);
+            return unpackFunctions[getTypeName (type)] + " (" + dest + ", static_cast<const uint8_t*> (" + data + "));";
+        }
+
+        return "std::memcpy (std::addressof (" + dest + "), " + data + ", sizeof (" + dest + "));";
+    }
+
+    //==============================================================================
+    struct StringWriter
+    {
+        std::string data;
+        void write (const void* source, size_t size)   { data.append (static_cast<const char*> (source), size); }
+    };
+
+    static std::string getSerialisedTypeInitialiser (const Type& type)
+    {
+        StringWriter writer;
+        type.getExternalType().serialise (writer);
+        return "{ " + toCppStringLiteral (writer.data, 0, false, false, true) + ", " + std::to_string (writer.data.size()) + " }";
+    }
+
+    static std::string getAnnotationPropertyInitialiser (const Annotation& annotation, const std::string& name)
+    {
+        auto value = annotation.getValue (name);
+        auto& type = value.getType();
+        auto quotedName = toCppStringLiteral (name, 0, false, false, true);
+
+        if (type.isBool())
+            return "{ " + quotedName + ", PropertyType::boolean, " + (value.getAsDouble() != 0 ? "1.0" : "0.0") + ", nullptr }";
+
+        if (type.isPrimitiveInteger())
+            return "{ " + quotedName + ", PropertyType::integer, " + getFloatLiteral (value.getAsDouble(), false) + ", nullptr }";
+
+        if (type.isPrimitive() && type.isFloatingPoint())
+            return "{ " + quotedName + ", PropertyType::floatingPoint, " + getFloatLiteral (value.getAsDouble(), false) + ", nullptr }";
+
+        if (type.isStringLiteral())
+            return "{ " + quotedName + ", PropertyType::string, 0.0, "
+                     + toCppStringLiteral (std::string (annotation.getDictionary().getStringForHandle (value.getStringLiteral())), 0, false, false, true)
+                     + " }";
+
+        // Other kinds of value can't be represented in the table, so they're left out
+        return {};
+    }
+
+    /** Writes the static tables which describe a list of endpoints, returning the name of the table. */
+    template <typename EndpointList>
+    std::string writeEndpointTable (choc::text::CodePrinter& out, const EndpointList& endpoints,
+                                    const std::vector<EndpointDetails>& details, const std::string& tableName)
+    {
+        if (endpoints.empty())
+            return "nullptr";
+
+        std::vector<std::string> entries;
+
+        for (size_t i = 0; i < endpoints.size(); ++i)
+        {
+            auto& e = endpoints[i].get();
+            auto typesName = createName (tableName + "_types" + std::to_string (i));
+            auto annotationName = std::string ("nullptr");
+            std::vector<std::string> properties;
+
+            out << "static constexpr SerialisedType " << typesName << "[] =" << newLine;
+
+            {
+                auto indent = out.createIndentWithBraces();
+
+                for (auto& t : e.dataTypes)
+                    out << getSerialisedTypeInitialiser (t) << "," << newLine;
+            }
+
+            out << ";" << blankLine;
+
+            for (auto& name : e.annotation.getNames())
+            {
+                auto property = getAnnotationPropertyInitialiser (e.annotation, name);
+
+                if (! property.empty())
+                    properties.push_back (property);
+            }
+
+            if (! properties.empty())
+            {
+                annotationName = createName (tableName + "_annotation" + std::to_string (i));
+                out << "static constexpr AnnotationProperty " << annotationName << "[] =" << newLine;
+
+                {
+                    auto indent = out.createIndentWithBraces();
+
+                    for (auto& p : properties)
+                        out << p << "," << newLine;
+                }
+
+                out << ";" << blankLine;
+            }
+
+            auto kind = e.isStreamEndpoint() ? "stream" : (e.isValueEndpoint() ? "value" : "event");
+
+            entries.push_back ("{ " + toCppStringLiteral (details[i].endpointID.toString(), 0, false, false, true) + ", "
+                                 + toCppStringLiteral (e.name.toString(), 0, false, false, true) + ", EndpointKind::" + kind + ", "
+                                 + typesName + ", " + std::to_string (e.dataTypes.size()) + ", "
+                                 + annotationName + ", " + std::to_string (properties.size()) + " }");
+        }
+
+        auto name = createName (tableName);
+        out << "static constexpr EndpointInfo " << name << "[] =" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+
+            for (auto& entry : entries)
+                out << entry << "," << newLine;
+        }
+
+        out << ";" << blankLine;
+        return name;
+    }
+
+    //==============================================================================
+    std::string createOutput()
+    {
+        auto& main = program.getMainProcessor();
+        std::vector<EndpointDetails> inputDetails, outputDetails;
+
+        for (auto& i : main.inputs)   inputDetails.push_back (i->getDetails());
+        for (auto& o : main.outputs)  outputDetails.push_back (o->getDetails());
+
+        std::vector<std::string> renderFunctionNames;
+        std::unordered_map<uint64_t, std::string> dispatchFunctionNames;
+
+        for (auto& n : nodes)
+        {
+            renderFunctionNames.push_back (createName ("render_" + n.memberName));
+
+            for (uint32_t o = 0; o < n.outputs.size(); ++o)
+                if (n.outputs[o]->isEventEndpoint() && ! n.eventRoutes[o].empty())
+                    dispatchFunctionNames[(static_cast<uint64_t> (n.index) << 32) | o]
+                        = createName ("dispatch_" + n.memberName + "_" + std::to_string (o));
+        }
+
+        choc::text::CodePrinter nodeFunctions, renderCalls;
+
+        for (auto& n : nodes)
+        {
+            auto code = writeRenderFunction (n, renderFunctionNames[n.index]);
+
+            if (code.empty())
+                renderFunctionNames[n.index].clear();
+            else
+                nodeFunctions << code << blankLine;
+        }
+
+        for (auto index : graph.renderOrder)
+            if (! renderFunctionNames[index].empty())
+                renderCalls << renderFunctionNames[index] << " (chunkEnd);" << newLine;
+
+        for (auto& n : nodes)
+            for (uint32_t o = 0; o < n.outputs.size(); ++o)
+                if (auto found = dispatchFunctionNames.find ((static_cast<uint64_t> (n.index) << 32) | o); found != dispatchFunctionNames.end())
+                    nodeFunctions << writeDispatchFunction (n, o, found->second, dispatchFunctionNames) << blankLine;
+
+        choc::text::CodePrinter api;
+        writeLifecycleFunctions (api, renderCalls.toString());
+        writeInputFunctions (api, dispatchFunctionNames);
+        writeOutputFunctions (api);
+
+        choc::text::CodePrinter writeEventFunction;
+        writeWriteEventFunction (writeEventFunction, dispatchFunctionNames);
+
+        choc::text::CodePrinter tables;
+        auto inputTable  = writeEndpointTable (tables, main.inputs, inputDetails, "inputEndpoints");
+        auto outputTable = writeEndpointTable (tables, main.outputs, outputDetails, "outputEndpoints");
+        auto stringTable = writeStringTable (tables);
+
+        choc::text::CodePrinter out;
+        out << "#pragma once" << blankLine
+            << "//==============================================================================" << newLine
+            << "// This class was generated from the SOUL program \"" << main.originalFullName << "\"." << newLine
+            << "// It has no dependencies beyond the C++ standard library, and should be built as C++17." << newLine
+            << "//==============================================================================" << blankLine;
+
+        for (auto chunk : runtimeCode)
+            out << chunk;
+
+        out << blankLine;
+
+        if (! options.namespaceName.empty())
+            out << "namespace " << options.namespaceName << newLine << "{" << blankLine;
+
+        out << "//==============================================================================" << newLine
+            << "class " << className << "  : private soul_generated::Runtime" << newLine
+            << "{" << newLine
+            << "public:" << newLine;
+
+        {
+            auto indent = out.createIndent (4);
+
+            out << className << "() = default;" << blankLine
+                << "static constexpr const char* name = " << toCppStringLiteral (main.originalFullName, 0, false, false, true) << ";" << newLine
+                << "static constexpr uint32_t maxBlockSize = " << settings.maxBlockSize << ";" << newLine
+                << "static constexpr uint32_t latency = " << main.latency << ";" << newLine
+                << "static constexpr uint32_t numInputEndpoints = " << main.inputs.size() << ";" << newLine
+                << "static constexpr uint32_t numOutputEndpoints = " << main.outputs.size() << ";" << newLine
+                << "static constexpr uint32_t numStringLiterals = " << program.getStringDictionary().getItems().size() << ";" << blankLine
+                << "enum class EndpointKind  { value, stream, event };" << newLine
+                << "enum class PropertyType  { boolean, integer, floatingPoint, string };" << blankLine
+                << "/** A type, serialised in the format used by choc::value::Type::serialise(). */" << newLine
+                << "struct SerialisedType" << newLine
+                << "{" << newLine
+                << "    const char* data;" << newLine
+                << "    uint32_t size;" << newLine
+                << "};" << blankLine
+                << "struct AnnotationProperty" << newLine
+                << "{" << newLine
+                << "    const char* name;" << newLine
+                << "    PropertyType type;" << newLine
+                << "    double number;" << newLine
+                << "    const char* text;" << newLine
+                << "};" << blankLine
+                << "struct EndpointInfo" << newLine
+                << "{" << newLine
+                << "    const char* endpointID;" << newLine
+                << "    const char* name;" << newLine
+                << "    EndpointKind kind;" << newLine
+                << "    const SerialisedType* dataTypes;" << newLine
+                << "    uint32_t numDataTypes;" << newLine
+                << "    const AnnotationProperty* annotation;" << newLine
+                << "    uint32_t numAnnotationProperties;" << newLine
+                << "};" << blankLine
+                << "struct StringLiteral" << newLine
+                << "{" << newLine
+                << "    int32_t handle;" << newLine
+                << "    const char* text;" << newLine
+                << "};" << blankLine
+                << "static const EndpointInfo* getInputEndpoints() noexcept     { return " << inputTable << "; }" << newLine
+                << "static const EndpointInfo* getOutputEndpoints() noexcept    { return " << outputTable << "; }" << newLine
+                << "static const StringLiteral* getStringLiterals() noexcept    { return " << stringTable << "; }" << blankLine
+                << api.toString();
+        }
+
+        out << blankLine
+            << "private:" << newLine;
+
+        {
+            auto indent = out.createIndent (4);
+
+            out << tables.toString() << blankLine
+                << structDeclarations.toString() << blankLine
+                << constantDeclarations.toString() << blankLine
+                << namespaceFunctions.toString() << blankLine;
+
+            for (auto& p : processors)
+                writeProcessorStruct (out, *p);
+
+            for (auto& n : nodes)
+                writeNodeStruct (out, n);
+
+            out << "//==============================================================================" << newLine;
+
+            for (auto& n : nodes)
+                out << n.structName << " " << n.memberName << ";" << newLine;
+
+            out << blankLine
+                << "double sampleRate = 0;" << newLine
+                << "int32_t sessionID = 0;" << newLine
+                << "uint64_t currentTick = 0, blockStartFrame = 0, currentNodeTick = 0;" << newLine
+                << "uint32_t numFramesToRender = 0, lastBlockSize = 0, xruns = 0;" << newLine
+                << "alignas (8) uint8_t packingBuffer[" << ((packingBufferSize + 7) & ~size_t (7)) << "];" << blankLine
+                << "//==============================================================================" << newLine
+                << nodeFunctions.toString() << blankLine;
+
+            writeNodeHelperFunctions (out);
+
+            out << blankLine
+                << writeEventFunction.toString() << blankLine
+                << packingFunctions.toString();
+        }
+
+        out << "};" << newLine;
+
+        if (! options.namespaceName.empty())
+            out << blankLine << "} // namespace " << options.namespaceName << newLine;
+
+        return tidyBlankLines (out.toString());
+    }
+
+    /** Removes any runs of blank lines which the sections above leave behind when they're empty. */
+    static std::string tidyBlankLines (const std::string& code)
+    {
+        auto lines = choc::text::splitIntoLines (code, false);
+        std::string result;
+        bool lastWasBlank = false, lastOpenedBrace = false;
+
+        for (auto& line : lines)
+        {
+            auto trimmed = choc::text::trim (line);
+            auto isBlank = trimmed.empty();
+
+            if (isBlank && (lastWasBlank || lastOpenedBrace))
+                continue;
+
+            if (lastWasBlank && (trimmed == "}" || trimmed == "};"))
+                result.resize (result.size() - 1);
+
+            result += choc::text::trimEnd (line) + "\n";
+            lastWasBlank = isBlank;
+            lastOpenedBrace = trimmed == "{" || endsWith (trimmed, ":");
+        }
+
+        return result;
+    }
+
+    //==============================================================================
+    std::string writeStringTable (choc::text::CodePrinter& out)
+    {
+        auto& strings = program.getStringDictionary().getItems();
+
+        if (strings.empty())
+            return "nullptr";
+
+        auto name = createName ("stringLiterals");
+        out << "static constexpr StringLiteral " << name << "[] =" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+
+            for (auto& s : strings)
+                out << "{ " << s.handle.handle << ", " << toCppStringLiteral (s.text, 0, false, false, true) << " }," << newLine;
+        }
+
+        out << ";" << blankLine;
+        return name;
+    }
+
+    NodeInfo& getTopLevelInput (size_t index)     { return nodes[graph.topLevelInputs[index]]; }
+    NodeInfo& getTopLevelOutput (size_t index)    { return nodes[graph.topLevelOutputs[index]]; }
+
+    void writeLifecycleFunctions (choc::text::CodePrinter& out, const std::string& renderCalls)
+    {
+        out << "//==============================================================================" << newLine
+            << "/** Sets the rate and session ID, and resets all the state. This must be called before anything else. */" << newLine
+            << "void initialise (double newSampleRate, int32_t newSessionID) noexcept" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << "sampleRate = newSampleRate;" << newLine
+                << "sessionID = newSessionID;" << newLine
+                << "reset();" << newLine;
+        }
+
+        out << blankLine
+            << "/** Returns all the processors to their initial state. */" << newLine
+            << "void reset() noexcept" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << "currentTick = 0;" << newLine
+                << "blockStartFrame = 0;" << newLine
+                << "currentNodeTick = 0;" << newLine
+                << "numFramesToRender = 0;" << newLine
+                << "lastBlockSize = 0;" << newLine
+                << "xruns = 0;" << blankLine;
+
+            for (auto& n : nodes)
+            {
+                out << "clearNode (" << n.memberName << ");" << newLine;
+
+                if (n.hasEventQueue)
+                    out << n.memberName << ".events.clear();" << newLine;
+
+                if (auto p = n.processor)
+                {
+                    out << "initialiseProcessor (" << n.memberName << ".processor, " << n.index << ", sampleRate"
+                        << (n.sampleRateFactor != 1.0 ? " * " + getFloatLiteral (n.sampleRateFactor, false) : std::string())
+                        << ", " << n.node->instanceID << ");" << newLine;
+
+                    if (! p->systemInit.empty())  out << n.memberName << ".processor." << p->systemInit << "();" << newLine;
+                    if (! p->userInit.empty())    out << n.memberName << ".processor." << p->userInit << "();" << newLine;
+                }
+
+                out << blankLine;
+            }
+        }
+
+        out << blankLine
+            << "/** Sets the number of frames which the next call to advance() will render. */" << newLine
+            << "void prepare (uint32_t numFrames) noexcept" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << "numFramesToRender = numFrames < maxBlockSize ? numFrames : maxBlockSize;" << newLine;
+
+            for (size_t i = 0; i < graph.topLevelInputs.size(); ++i)
+                if (getTopLevelInput (i).inputs.front()->isStreamEndpoint())
+                    out << getTopLevelInput (i).memberName << ".hasTopLevelFrames = false;" << newLine;
+
+            for (size_t i = 0; i < graph.topLevelOutputs.size(); ++i)
+                if (getTopLevelOutput (i).inputs.front()->isEventEndpoint())
+                    out << getTopLevelOutput (i).memberName << ".outputEvents.numItems = 0;" << newLine;
+        }
+
+        out << blankLine
+            << "/** Renders the block of frames which was set up by prepare(). */" << newLine
+            << "void advance() noexcept" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+
+            for (size_t i = 0; i < graph.topLevelOutputs.size(); ++i)
+                if (getTopLevelOutput (i).inputs.front()->isEventEndpoint())
+                    out << getTopLevelOutput (i).memberName << ".outputEvents.numItems = 0;" << newLine;
+
+            out << blankLine
+                << "auto endTick = currentTick + static_cast<uint64_t> (numFramesToRender) * " << ticksPerTopLevelFrame << "u;" << blankLine
+                << "while (currentTick < endTick)" << newLine;
+
+            {
+                auto loopIndent = out.createIndentWithBraces();
+                out << "auto chunkEnd = endTick < currentTick + " << maxChunkTicks << "u ? endTick : currentTick + " << maxChunkTicks << "u;" << blankLine
+                    << renderCalls << blankLine
+                    << "currentTick = chunkEnd;" << newLine;
+            }
+
+            out << blankLine
+                << "blockStartFrame += numFramesToRender;" << newLine
+                << "lastBlockSize = numFramesToRender;" << newLine;
+        }
+
+        out << blankLine
+            << "/** Returns the number of over- or under-runs since the last reset. */" << newLine
+            << "uint32_t getXRuns() const noexcept    { return xruns; }" << blankLine;
+    }
+
+    void writeInputFunctions (choc::text::CodePrinter& out, const std::unordered_map<uint64_t, std::string>& dispatchFunctionNames)
+    {
+        choc::text::CodePrinter streams, targets, values, events;
+
+        for (uint32_t i = 0; i < graph.topLevelInputs.size(); ++i)
+        {
+            auto& n = getTopLevelInput (i);
+            auto& endpoint = n.inputs.front().get();
+
+            if (endpoint.isStreamEndpoint())
+            {
+                auto canRamp = ! (n.outputFrameRanges.front().primitiveType.isInteger() || n.outputFrameRanges.front().primitiveType.isBool());
+                streams << "case " << i << ":  setTopLevelFrames (" << n.memberName << ", frames, numFrames); break;" << newLine;
+                targets << "case " << i << ":  setTopLevelTarget<" << (canRamp ? "true" : "false") << "> ("
+                        << n.memberName << ", target, numFramesToReachValue); break;" << newLine;
+            }
+            else if (endpoint.isValueEndpoint())
+            {
+                values << "case " << i << ":  " << unpackFromData (endpoint.getFrameOrValueType(), n.memberName + ".slot", "value") << " break;" << newLine;
+            }
+            else
+            {
+                auto found = dispatchFunctionNames.find (static_cast<uint64_t> (n.index) << 32);
+
+                if (found == dispatchFunctionNames.end())
+                    continue;
+
+                for (uint32_t t = 0; t < endpoint.dataTypes.size(); ++t)
+                {
+                    auto& type = endpoint.dataTypes[t];
+                    events << "case " << ((i << 16) | t) << ":" << newLine;
+
+                    {
+                        auto indent = events.createIndentWithBraces();
+                        events << getTypeName (type) << " event;" << newLine
+                               << unpackFromData (type, "event", "eventData") << newLine
+                               << found->second << " (0, typeIndex, std::addressof (event), tick);" << newLine
+                               << "break;" << newLine;
+                    }
+
+                    events << newLine;
+                }
+            }
+        }
+
+        out << "//==============================================================================" << newLine
+            << "/** Provides the frames for an input stream for the next block. The data must be an array of the" << newLine
+            << "    stream's frame type, and if there are fewer frames than the block size, the rest are filled with zeros." << newLine
+            << "*/" << newLine;
+
+        writeFunction (out, "void setInputStreamFrames",
+                       { { "uint32_t", "inputIndex" }, { "const void*", "frames" }, { "uint32_t", "numFrames" } },
+                       " noexcept", getSwitch ("inputIndex", streams.toString(), "break"));
+
+        out << blankLine
+            << "/** Makes an input stream ramp towards a target value over a number of frames. */" << newLine;
+
+        writeFunction (out, "void setSparseInputStreamTarget",
+                       { { "uint32_t", "inputIndex" }, { "const void*", "target" }, { "uint32_t", "numFramesToReachValue" } },
+                       " noexcept", getSwitch ("inputIndex", targets.toString(), "break"));
+
+        out << blankLine
+            << "/** Sets an input value endpoint, from data in the endpoint type's packed format. */" << newLine;
+
+        writeFunction (out, "void setInputValue",
+                       { { "uint32_t", "inputIndex" }, { "const void*", "value" } },
+                       " noexcept", getSwitch ("inputIndex", values.toString(), "break"));
+
+        out << blankLine
+            << "/** Queues an event to be delivered at a frame offset within the next block. The type index refers to the" << newLine
+            << "    endpoint's list of types, and the data must be in that type's packed format." << newLine
+            << "*/" << newLine;
+
+        auto eventCode = getSwitch ("(inputIndex << 16) | typeIndex", events.toString(), "break");
+
+        if (! eventCode.empty())
+            eventCode = "auto tick = currentTick + static_cast<uint64_t> (frameOffset) * " + std::to_string (ticksPerTopLevelFrame) + "u;\n\n" + eventCode;
+
+        writeFunction (out, "void addInputEvent",
+                       { { "uint32_t", "inputIndex" }, { "uint32_t", "typeIndex" }, { "uint32_t", "frameOffset" }, { "const void*", "eventData" } },
+                       " noexcept", eventCode);
+
+        out << blankLine;
+    }
+
+    /** Returns a switch statement for some cases, or nothing if there aren't any. */
+    static std::string getSwitch (const std::string& condition, const std::string& cases, const std::string& defaultStatement)
+    {
+        if (cases.empty())
+            return {};
+
+        choc::text::CodePrinter out;
+        out << "switch (" << condition << ")" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << cases << "default: " << defaultStatement << ";" << newLine;
+        }
+
+        out << newLine;
+        return out.toString();
+    }
+
+    void writeOutputFunctions (choc::text::CodePrinter& out)
+    {
+        choc::text::CodePrinter streams, values, events;
+
+        for (uint32_t i = 0; i < graph.topLevelOutputs.size(); ++i)
+        {
+            auto& n = getTopLevelOutput (i);
+            auto& endpoint = n.inputs.front().get();
+
+            if (endpoint.isStreamEndpoint())
+            {
+                streams << "case " << i << ":  return " << n.memberName << ".topLevelFrames;" << newLine;
+            }
+            else if (endpoint.isValueEndpoint())
+            {
+                auto type = endpoint.getFrameOrValueType();
+
+                if (needsPacking (type))
+                    values << "case " << i << ":  " << packIntoBuffer (type, n.memberName + ".slot") << " return packingBuffer;" << newLine;
+                else
+                    values << "case " << i << ":  return std::addressof (" << n.memberName << ".slot);" << newLine;
+            }
+            else
+            {
+                events << "case " << i << ":" << newLine;
+
+                {
+                    auto indent = events.createIndentWithBraces();
+                    events << "auto& node = " << n.memberName << ";" << blankLine
+                           << "for (uint32_t j = 0; j < node.outputEvents.numItems; ++j)" << newLine;
+
+                    {
+                        auto loopIndent = events.createIndentWithBraces();
+                        events << "auto& item = node.outputEvents.items[j];" << newLine
+                               << "const void* eventData = node.outputEvents.getData (j);" << blankLine;
+
+                        choc::text::CodePrinter packing;
+
+                        for (uint32_t t = 0; t < endpoint.dataTypes.size(); ++t)
+                        {
+                            auto& type = endpoint.dataTypes[t];
+
+                            if (needsPacking (type))
+                                packing << "case " << t << ":  "
+                                        << packIntoBuffer (type, "*reinterpret_cast<const " + getTypeName (type) + "*> (eventData)")
+                                        << " eventData = packingBuffer; break;" << newLine;
+                        }
+
+                        if (! packing.toString().empty())
+                        {
+                            events << "switch (item.typeIndex)" << newLine;
+
+                            {
+                                auto switchIndent = events.createIndentWithBraces();
+                                events << packing.toString() << "default: break;" << newLine;
+                            }
+
+                            events << blankLine;
+                        }
+
+                        events << "if (! callback (item.frame, item.typeIndex, eventData))" << newLine
+                               << "    break;" << newLine;
+                    }
+
+                    events << blankLine << "break;" << newLine;
+                }
+
+                events << newLine;
+            }
+        }
+
+        out << "//==============================================================================" << newLine
+            << "/** Returns the number of frames which the last call to advance() rendered. */" << newLine
+            << "uint32_t getNumOutputFrames() const noexcept    { return lastBlockSize; }" << blankLine
+            << "/** Returns the frames which an output stream produced during the last block, or nullptr if the index is invalid. */" << newLine;
+
+        auto getPointerSwitch = [] (const std::string& cases)
+        {
+            auto code = getSwitch ("outputIndex", cases, "return nullptr");
+            return code.empty() ? std::string ("return nullptr;\n") : code;
+        };
+
+        writeFunction (out, "const void* getOutputStreamFrames", { { "uint32_t", "outputIndex" } },
+                       " const noexcept", getPointerSwitch (streams.toString()));
+
+        out << blankLine
+            << "/** Returns the current value of an output value endpoint, in the endpoint type's packed format." << newLine
+            << "    The pointer is only valid until the next call to one of this class's methods." << newLine
+            << "*/" << newLine;
+
+        writeFunction (out, "const void* getOutputValue", { { "uint32_t", "outputIndex" } },
+                       " noexcept", getPointerSwitch (values.toString()));
+
+        out << blankLine
+            << "/** Calls a function for each of the events which an output produced during the last block. The callback" << newLine
+            << "    is given the frame offset, type index and packed data of each event, and can return false to stop." << newLine
+            << "*/" << newLine
+            << "template <typename Callback>" << newLine;
+
+        writeFunction (out, "void iterateOutputEvents", { { "uint32_t", "outputIndex" }, { "Callback&&", "callback" } },
+                       " noexcept", getSwitch ("outputIndex", events.toString(), "break"));
+
+    }
+
+    /** Writes the private templates which the API functions use for each kind of node. */
+    void writeNodeHelperFunctions (choc::text::CodePrinter& out)
+    {
+        out << "template <typename Node>" << newLine
+            << "void setTopLevelFrames (Node& node, const void* frames, uint32_t numFrames) noexcept" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << "auto numToCopy = numFrames < numFramesToRender ? numFrames : numFramesToRender;" << newLine
+                << "std::memcpy (node.topLevelFrames, frames, numToCopy * sizeof (node.topLevelFrames[0]));" << blankLine
+                << "if (numToCopy < numFramesToRender)" << newLine;
+
+            {
+                auto ifIndent = out.createIndentWithBraces();
+                out << "std::memset (static_cast<void*> (node.topLevelFrames + numToCopy), 0, (numFramesToRender - numToCopy) * sizeof (node.topLevelFrames[0]));" << newLine
+                    << "++xruns;" << newLine;
+            }
+
+            out << blankLine
+                << "node.hasTopLevelFrames = true;" << newLine
+                << "node.rampFramesRemaining = 0;" << newLine;
+        }
+
+        out << blankLine
+            << "template <typename Node>" << newLine
+            << "static void clearNode (Node& node) noexcept" << newLine
+            << "{" << newLine
+            << "    std::memset (static_cast<void*> (std::addressof (node)), 0, sizeof (node));" << newLine
+            << "}" << blankLine
+            << "template <typename Processor>" << newLine
+            << "void initialiseProcessor (Processor& processor, uint32_t nodeIndex, double frequency, int32_t id) noexcept" << newLine
+            << "{" << newLine
+            << "    processor.owner = this;" << newLine
+            << "    processor.nodeIndex = nodeIndex;" << newLine
+            << "    processor.frequency = frequency;" << newLine
+            << "    processor.period = 1.0 / frequency;" << newLine
+            << "    processor.id = id;" << newLine
+            << "    processor.initialiseState();" << newLine
+            << "}" << blankLine
+            << "template <bool canRamp, typename Node>" << newLine
+            << "void setTopLevelTarget (Node& node, const void* target, uint32_t numFramesToReachValue) noexcept" << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+            out << "if constexpr (canRamp)" << newLine;
+
+            {
+                auto ifIndent = out.createIndentWithBraces();
+                out << "if (numFramesToReachValue != 0)" << newLine;
+
+                {
+                    auto innerIndent = out.createIndentWithBraces();
+                    out << "decltype (node.slot) targetFrame;" << newLine
+                        << "std::memcpy (std::addressof (targetFrame), target, sizeof (targetFrame));" << newLine
+                        << "setRamp (node.rampIncrement, node.slot, targetFrame, numFramesToReachValue);" << newLine
+                        << "node.rampFramesRemaining = numFramesToReachValue;" << newLine
+                        << "node.hasTopLevelFrames = false;" << newLine
+                        << "return;" << newLine;
+                }
+
+                out << newLine;
+            }
+
+            out << blankLine
+                << "std::memcpy (std::addressof (node.slot), target, sizeof (node.slot));" << newLine
+                << "node.rampFramesRemaining = 0;" << newLine;
+        }
+
+        out << newLine;
+    }
+
+    void writeWriteEventFunction (choc::text::CodePrinter& out, const std::unordered_map<uint64_t, std::string>& dispatchFunctionNames)
+    {
+        choc::text::CodePrinter cases;
+
+        for (auto& n : nodes)
+        {
+            if (n.isJunction())
+                continue;
+
+            for (uint32_t o = 0; o < n.outputs.size(); ++o)
+                if (auto found = dispatchFunctionNames.find ((static_cast<uint64_t> (n.index) << 32) | o); found != dispatchFunctionNames.end())
+                    cases << "case " << ((n.index << 16) | o) << ":  " << found->second
+                          << " (element, typeIndex, eventData, currentNodeTick); break;" << newLine;
+        }
+
+        writeFunction (out, "void writeEvent",
+                       { { "uint32_t", "nodeIndex" }, { "uint32_t", "outputIndex" }, { "uint32_t", "element" }, { "uint32_t", "typeIndex" }, { "const void*", "eventData" } },
+                       " noexcept", getSwitch ("(nodeIndex << 16) | outputIndex", cases.toString(), "break"));
+    }
+};
+
+} // namespace soul::cplusplus
+
+namespace soul
+{
+
+std::string generateCPlusPlus (CompileMessageList& messageList, const Program& program,
+                               const BuildSettings& settings, const CPlusPlusGeneratorOptions& options)
+{
+    CompileMessageHandler handler (messageList);
+
+    try
+    {
+        return cplusplus::CPlusPlusGenerator (program, settings, options).generate();
+    }
+    catch (AbortCompilationException) {}
+
+    return {};
+}
+
+} // namespace soul
@@ -0,0 +1,60 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/** Options which control the class that generateCPlusPlus() creates. */
+struct CPlusPlusGeneratorOptions
+{
+    /** The name of the generated class. */
+    std::string className = "SOULPatch";
+
+    /** If this isn't empty, the class is declared inside a namespace with this name. */
+    std::string namespaceName;
+
+    /** The values to use for the program's external variables. These get baked into
+        the generated code, so there must be a value for every external that the
+        program declares.
+    */
+    std::unordered_map<std::string, choc::value::Value> externalValues;
+};
+
+/** Converts a linked program into the source code for a self-contained C++ class.
+
+    The generated code has no dependencies beyond the standard library, so it can be
+    compiled ahead-of-time into a product with full optimisation. The class provides
+    initialise(), reset(), prepare() and advance() methods along with functions for reading
+    and writing endpoints, which mirror the Performer API, and GeneratedCodePerformer can
+    wrap it up as a Performer so that it can be used by anything which hosts one.
+
+    Because the result is compiled without any knowledge of the host, the maximum block
+    size in the BuildSettings is fixed at this point, but the sample rate and session ID are
+    supplied when the class is initialised. The settings must be the ones that the program
+    was linked with, and programs linked with BuildSettings::useFastMaths aren't supported,
+    because the generated code only contains the precise maths functions.
+
+    Returns an empty string if the program can't be converted, in which case the reasons
+    are added to the message list.
+*/
+std::string generateCPlusPlus (CompileMessageList&, const Program&, const BuildSettings&, const CPlusPlusGeneratorOptions&);
+
+} // namespace soul
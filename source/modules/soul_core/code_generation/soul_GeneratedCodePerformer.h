@@ -0,0 +1,415 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Wraps a class created by generateCPlusPlus() as a Performer, so that it can be used
+    by AudioMIDIWrapper, ThreadedVenue or anything else which hosts one.
+
+    The generated code already contains the program, so the one that's passed to load()
+    is ignored, and because the values of any external variables were baked in when the
+    code was generated, it doesn't report any.
+*/
+template <typename GeneratedClass>
+class GeneratedCodePerformer  : public Performer
+{
+public:
+    GeneratedCodePerformer() = default;
+    ~GeneratedCodePerformer() override    { unload(); }
+
+    bool load (CompileMessageList&, const Program&) noexcept override
+    {
+        unload();
+
+        for (uint32_t i = 0; i < GeneratedClass::numInputEndpoints; ++i)
+            inputEndpoints.push_back (createDetails (GeneratedClass::getInputEndpoints()[i]));
+
+        for (uint32_t i = 0; i < GeneratedClass::numOutputEndpoints; ++i)
+            outputEndpoints.push_back (createDetails (GeneratedClass::getOutputEndpoints()[i]));
+
+        for (uint32_t i = 0; i < GeneratedClass::numStringLiterals; ++i)
+        {
+            auto& s = GeneratedClass::getStringLiterals()[i];
+            stringDictionary.addItem ({ static_cast<uint32_t> (s.handle) }, s.text);
+        }
+
+        isProgramLoaded = true;
+        return true;
+    }
+
+    void unload() noexcept override
+    {
+        generated.reset();
+        inputEndpoints.clear();
+        outputEndpoints.clear();
+        stringDictionary.clear();
+        scratch.clear();
+        isProgramLoaded = false;
+        hasPreparedBlock = false;
+        xruns = 0;
+    }
+
+    ArrayView<const EndpointDetails> getInputEndpoints() noexcept override         { return inputEndpoints; }
+    ArrayView<const EndpointDetails> getOutputEndpoints() noexcept override        { return outputEndpoints; }
+    ArrayView<const ExternalVariable> getExternalVariables() noexcept override     { return {}; }
+    bool setExternalVariable (const char*, const choc::value::ValueView&) noexcept override  { return false; }
+
+    bool link (CompileMessageList& messageList, const BuildSettings& buildSettings, LinkerCache*) noexcept override
+    {
+        if (! isProgramLoaded || generated != nullptr)
+            return false;
+
+        SOUL_TRACE_SCOPE ("link", "Performer::link");
+        CompileMessageHandler handler (messageList);
+
+        try
+        {
+            settings = buildSettings;
+
+            if (settings.maxBlockSize == 0 || settings.maxBlockSize > GeneratedClass::maxBlockSize)
+                CodeLocation().throwError (Errors::unsupportedBlockSize());
+
+            if (! (settings.sampleRate > 0))
+                CodeLocation().throwError (Errors::unsupportedSampleRate());
+
+            size_t maxFrameSize = 8;
+
+            for (auto& e : inputEndpoints)
+                for (auto& t : e.dataTypes)
+                    maxFrameSize = std::max (maxFrameSize, t.getValueDataSize());
+
+            scratch.resize ((maxFrameSize * settings.maxBlockSize + 7) / 8);
+            generated = std::make_unique<GeneratedClass>();
+            generated->initialise (settings.sampleRate, settings.sessionID);
+            return true;
+        }
+        catch (AbortCompilationException) {}
+
+        return false;
+    }
+
+    bool isLoaded() noexcept override       { return isProgramLoaded; }
+    bool isLinked() noexcept override       { return generated != nullptr; }
+
+    void reset() noexcept override
+    {
+        if (generated != nullptr)
+            generated->reset();
+
+        xruns = 0;
+    }
+
+    EndpointHandle getEndpointHandle (const EndpointID& endpointID) noexcept override
+    {
+        for (uint32_t i = 0; i < inputEndpoints.size(); ++i)
+            if (inputEndpoints[i].endpointID == endpointID)
+                return EndpointHandle::create (inputEndpoints[i].endpointType, i + 1);
+
+        for (uint32_t i = 0; i < outputEndpoints.size(); ++i)
+            if (outputEndpoints[i].endpointID == endpointID)
+                return EndpointHandle::create (outputEndpoints[i].endpointType, outputHandleFlag | (i + 1));
+
+        return {};
+    }
+
+    void prepare (uint32_t numFramesToBeRendered) noexcept override
+    {
+        if (generated != nullptr)
+        {
+            generated->prepare (std::min (numFramesToBeRendered, settings.maxBlockSize));
+            hasPreparedBlock = true;
+        }
+    }
+
+    void setNextInputStreamFrames (EndpointHandle handle, const choc::value::ValueView& frameArray) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::stream))
+        {
+            auto& frameType = inputEndpoints[*index].dataTypes.front();
+
+            if (frameArray.getType().isArray() && frameArray.getType().getElementType() == frameType)
+                return generated->setInputStreamFrames (*index, frameArray.getRawData(), frameArray.size());
+
+            auto numFrames = std::min (frameArray.size(), settings.maxBlockSize);
+            auto frameSize = frameType.getValueDataSize();
+            auto dest = reinterpret_cast<uint8_t*> (scratch.data());
+
+            for (uint32_t i = 0; i < numFrames; ++i)
+                copyNumericValue (dest + i * frameSize, frameType, frameArray[i]);
+
+            generated->setInputStreamFrames (*index, dest, numFrames);
+        }
+    }
+
+    void setSparseInputStreamTarget (EndpointHandle handle, const choc::value::ValueView& targetFrameValue,
+                                     uint32_t numFramesToReachValue) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::stream))
+        {
+            auto& frameType = inputEndpoints[*index].dataTypes.front();
+
+            // The generated code ramps from the current value, so the target starts as a copy of nothing
+            std::memset (scratch.data(), 0, frameType.getValueDataSize());
+
+            if (targetFrameValue.getType() == frameType)
+                std::memcpy (scratch.data(), targetFrameValue.getRawData(), frameType.getValueDataSize());
+            else
+                copyNumericValue (scratch.data(), frameType, targetFrameValue);
+
+            generated->setSparseInputStreamTarget (*index, scratch.data(), numFramesToReachValue);
+        }
+    }
+
+    void setInputValue (EndpointHandle handle, const choc::value::ValueView& newValue) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::value))
+        {
+            auto& type = inputEndpoints[*index].dataTypes.front();
+
+            if (newValue.getType() == type)
+                return generated->setInputValue (*index, newValue.getRawData());
+
+            if (isNumeric (type))
+            {
+                std::memset (scratch.data(), 0, type.getValueDataSize());
+                copyNumericValue (scratch.data(), type, newValue);
+                generated->setInputValue (*index, scratch.data());
+            }
+        }
+    }
+
+    void addInputEvent (EndpointHandle handle, const choc::value::ValueView& eventData) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::event))
+        {
+            auto& types = inputEndpoints[*index].dataTypes;
+
+            for (uint32_t i = 0; i < types.size(); ++i)
+                if (eventData.getType() == types[i])
+                    return generated->addInputEvent (*index, i, 0, eventData.getRawData());
+
+            // No exact match, so try a primitive conversion
+            for (uint32_t i = 0; i < types.size(); ++i)
+            {
+                if (types[i].isPrimitive() && (eventData.isFloat() || eventData.isInt() || eventData.isBool()))
+                {
+                    uint64_t converted = 0;
+                    copyNumericValue (std::addressof (converted), types[i], eventData);
+                    return generated->addInputEvent (*index, i, 0, std::addressof (converted));
+                }
+            }
+
+            ++xruns;
+        }
+    }
+
+    choc::value::ValueView getOutputStreamFrames (EndpointHandle handle) noexcept override
+    {
+        if (auto index = getOutputIndex (handle, EndpointType::stream))
+            return createView (choc::value::Type::createArray (outputEndpoints[*index].dataTypes.front(), generated->getNumOutputFrames()),
+                               generated->getOutputStreamFrames (*index));
+
+        return {};
+    }
+
+    choc::value::ValueView getOutputValue (EndpointHandle handle) noexcept override
+    {
+        if (auto index = getOutputIndex (handle, EndpointType::value))
+            return createView (outputEndpoints[*index].dataTypes.front(), generated->getOutputValue (*index));
+
+        return {};
+    }
+
+    void iterateOutputEvents (EndpointHandle handle, HandleNextOutputEventFn fn) noexcept override
+    {
+        if (auto index = getOutputIndex (handle, EndpointType::event))
+        {
+            auto& types = outputEndpoints[*index].dataTypes;
+
+            generated->iterateOutputEvents (*index, [&] (uint32_t frame, uint32_t typeIndex, const void* data)
+            {
+                return fn (frame, createView (types[typeIndex], data));
+            });
+        }
+    }
+
+    void advance() noexcept override
+    {
+        if (generated != nullptr && hasPreparedBlock)
+        {
+            generated->advance();
+            hasPreparedBlock = false;
+        }
+    }
+
+    bool isEndpointActive (const EndpointID& endpointID) noexcept override
+    {
+        return static_cast<bool> (getEndpointHandle (endpointID));
+    }
+
+    uint32_t getLatency() noexcept override         { return isProgramLoaded ? GeneratedClass::latency : 0; }
+    uint32_t getXRuns() noexcept override           { return generated != nullptr ? generated->getXRuns() + xruns : 0; }
+    uint32_t getBlockSize() noexcept override       { return settings.maxBlockSize; }
+    bool hasError() noexcept override               { return false; }
+    const char* getError() noexcept override        { return nullptr; }
+
+private:
+    //==============================================================================
+    std::unique_ptr<GeneratedClass> generated;
+    BuildSettings settings;
+    std::vector<EndpointDetails> inputEndpoints, outputEndpoints;
+    StringDictionary stringDictionary;
+    std::vector<uint64_t> scratch;
+    uint32_t xruns = 0;
+    bool isProgramLoaded = false, hasPreparedBlock = false;
+
+    static constexpr uint32_t outputHandleFlag = 0x10000;
+
+    using EndpointInfo = typename GeneratedClass::EndpointInfo;
+    using PropertyType = typename GeneratedClass::PropertyType;
+    using EndpointKind = typename GeneratedClass::EndpointKind;
+
+    static EndpointDetails createDetails (const EndpointInfo& info)
+    {
+        EndpointDetails details;
+        details.endpointID = EndpointID::create (info.endpointID);
+        details.name = info.name;
+        details.endpointType = info.kind == EndpointKind::stream ? EndpointType::stream
+                                                                 : (info.kind == EndpointKind::value ? EndpointType::value : EndpointType::event);
+
+        for (uint32_t i = 0; i < info.numDataTypes; ++i)
+        {
+            auto start = reinterpret_cast<const uint8_t*> (info.dataTypes[i].data);
+            choc::value::InputData input { start, start + info.dataTypes[i].size };
+            details.dataTypes.push_back (choc::value::Type::deserialise (input));
+        }
+
+        for (uint32_t i = 0; i < info.numAnnotationProperties; ++i)
+        {
+            auto& p = info.annotation[i];
+
+            switch (p.type)
+            {
+                case PropertyType::boolean:        details.annotation.set (p.name, p.number != 0); break;
+                case PropertyType::integer:        details.annotation.set (p.name, static_cast<int64_t> (p.number)); break;
+                case PropertyType::floatingPoint:  details.annotation.set (p.name, p.number); break;
+                case PropertyType::string:         details.annotation.set (p.name, std::string (p.text)); break;
+                default:                           break;
+            }
+        }
+
+        return details;
+    }
+
+    choc::value::ValueView createView (const choc::value::Type& type, const void* data)
+    {
+        return choc::value::ValueView (type, const_cast<void*> (data), std::addressof (stringDictionary));
+    }
+
+    static bool isNumeric (const choc::value::Type& type)
+    {
+        if (type.isArray())
+            return isNumeric (type.getElementType());
+
+        return type.isPrimitive() || type.isVector();
+    }
+
+    /** Converts a primitive, vector or array into the given type, element by element. */
+    static void copyNumericValue (void* dest, const choc::value::Type& destType, const choc::value::ValueView& source) noexcept
+    {
+        auto numElements = destType.isPrimitive() ? 1u : destType.getNumElements();
+        auto elementType = destType.isPrimitive() ? destType : destType.getElementType();
+        auto elementSize = elementType.getValueDataSize();
+        auto d = static_cast<uint8_t*> (dest);
+
+        if (! elementType.isPrimitive())
+            return;
+
+        try
+        {
+            if (source.isVector() || source.isArray())
+            {
+                auto num = std::min (numElements, source.size());
+
+                for (uint32_t i = 0; i < num; ++i)
+                    writePrimitive (d + i * elementSize, elementType, source[i].get<double>());
+            }
+            else
+            {
+                auto v = source.get<double>();
+
+                for (uint32_t i = 0; i < numElements; ++i)
+                    writePrimitive (d + i * elementSize, elementType, v);
+            }
+        }
+        catch (...) {}
+    }
+
+    static void writePrimitive (uint8_t* dest, const choc::value::Type& type, double value) noexcept
+    {
+        if (type.isFloat32())       { auto v = static_cast<float> (value);    std::memcpy (dest, std::addressof (v), sizeof (v)); }
+        else if (type.isFloat64())  { std::memcpy (dest, std::addressof (value), sizeof (value)); }
+        else if (type.isInt32())    { auto v = static_cast<int32_t> (value);  std::memcpy (dest, std::addressof (v), sizeof (v)); }
+        else if (type.isInt64())    { auto v = static_cast<int64_t> (value);  std::memcpy (dest, std::addressof (v), sizeof (v)); }
+        else if (type.isBool())     { *dest = value != 0 ? 1 : 0; }
+    }
+
+    std::optional<uint32_t> getInputIndex (EndpointHandle handle, EndpointType type) const noexcept
+    {
+        auto raw = handle.getRawHandle();
+
+        if (generated != nullptr && handle.getType() == type && (raw & outputHandleFlag) == 0
+             && raw > 0 && raw <= inputEndpoints.size())
+            return raw - 1;
+
+        return {};
+    }
+
+    std::optional<uint32_t> getOutputIndex (EndpointHandle handle, EndpointType type) const noexcept
+    {
+        auto raw = handle.getRawHandle();
+
+        if (generated != nullptr && handle.getType() == type && (raw & outputHandleFlag) != 0)
+        {
+            auto index = raw & ~outputHandleFlag;
+
+            if (index > 0 && index <= outputEndpoints.size())
+                return index - 1;
+        }
+
+        return {};
+    }
+};
+
+//==============================================================================
+/** A factory which creates GeneratedCodePerformer objects for a generated class. */
+template <typename GeneratedClass>
+struct GeneratedCodePerformerFactory  : public PerformerFactory
+{
+    std::unique_ptr<Performer> createPerformer() override
+    {
+        return std::make_unique<GeneratedCodePerformer<GeneratedClass>>();
+    }
+};
+
+} // namespace soul
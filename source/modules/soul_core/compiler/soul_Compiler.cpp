@@ -37,8 +37,18 @@ void Compiler::reset()
     auto rootNamespaceName = allocator.get (Program::getRootNamespaceName());
     topLevelNamespace = allocator.allocate<AST::Namespace> (AST::Context(), rootNamespaceName);
 
-    if (includeStandardLibrary)
+    // The library isn't added until some code actually needs it, so that the reset at the
+    // end of link() doesn't pay for a library that may never be used
+    needsStandardLibrary = includeStandardLibrary;
+}
+
+void Compiler::addStandardLibraryIfNeeded()
+{
+    if (needsStandardLibrary)
+    {
+        needsStandardLibrary = false;
         addDefaultBuiltInLibrary();
+    }
 }
 
 bool Compiler::addCode (CompileMessageList& messageList, CodeLocation code)
@@ -51,6 +61,7 @@ bool Compiler::addCode (CompileMessageList& messageList, CodeLocation code)
         if (code.isEmpty())
             code.throwError (Errors::emptyProgram());
 
+        addStandardLibraryIfNeeded();
         SOUL_LOG_TIME_OF_SCOPE ("initial resolution pass: " + code.getFilename());
         soul::CompileMessageHandler handler (messageList);
         compile (std::move (code));
@@ -68,18 +79,20 @@ void Compiler::addDefaultBuiltInLibrary()
     try
     {
         soul::CompileMessageHandler handler (list);
-        compile (getDefaultLibraryCode());
 
+        // All the chunks are parsed before resolving them, because a single resolution
+        // pass over the lot is much quicker than running one after each chunk.
         // TODO: when we have import & module support, these will no longer be hard-coded here
-        compile (getSystemModule ("soul.audio.utils"));
-        compile (getSystemModule ("soul.midi"));
-        compile (getSystemModule ("soul.notes"));
-        compile (getSystemModule ("soul.frequency"));
-        compile (getSystemModule ("soul.mixing"));
-        compile (getSystemModule ("soul.oscillators"));
-        compile (getSystemModule ("soul.noise"));
-        compile (getSystemModule ("soul.timeline"));
-        compile (getSystemModule ("soul.complex"));
+        compile ({ getDefaultLibraryCode(),
+                   getSystemModule ("soul.audio.utils"),
+                   getSystemModule ("soul.midi"),
+                   getSystemModule ("soul.notes"),
+                   getSystemModule ("soul.frequency"),
+                   getSystemModule ("soul.mixing"),
+                   getSystemModule ("soul.oscillators"),
+                   getSystemModule ("soul.noise"),
+                   getSystemModule ("soul.timeline"),
+                   getSystemModule ("soul.complex") });
     }
     catch (soul::AbortCompilationException)
     {
@@ -147,6 +160,7 @@ Program Compiler::build (CompileMessageList& messageList, const BuildBundle& bun
         return buildHEART (messageList, heartFiles.front());
     }
 
+    SOUL_PROFILE_SCOPE ("build");
     Compiler c (bundle.settings.overrideStandardLibrary.empty());
 
     if (! bundle.settings.overrideStandardLibrary.empty())
@@ -167,15 +181,38 @@ std::vector<pool_ref<AST::ModuleBase>> Compiler::parseTopLevelDeclarations (AST:
     return StructuralParser::parseTopLevelDeclarations (allocator, code, parentNamespace);
 }
 
+Program Compiler::build (CompileMessageList& messageList, const BuildBundle& bundle, CompileProfile& profile)
+{
+    CompileProfile::Recorder recorder (profile);
+    return build (messageList, bundle);
+}
+
 //==============================================================================
 void Compiler::compile (CodeLocation code)
 {
-    SOUL_LOG_TIME_OF_SCOPE ("compile: " + code.getFilename());
+    compile (std::vector<CodeLocation> { std::move (code) });
+}
 
-    for (auto& m : StructuralParser::parseTopLevelDeclarations (allocator, code, *topLevelNamespace))
-        SanityCheckPass::runPreResolution (m);
+void Compiler::compile (const std::vector<CodeLocation>& chunks)
+{
+    SOUL_PROFILE_SCOPE ("compile");
+
+    for (auto& code : chunks)
+    {
+        SOUL_LOG_TIME_OF_SCOPE ("compile: " + code.getFilename());
+        SOUL_PROFILE_SCOPE ("parse");
+
+        for (auto& m : StructuralParser::parseTopLevelDeclarations (allocator, code, *topLevelNamespace))
+            SanityCheckPass::runPreResolution (m);
+    }
+
+    {
+        SOUL_LOG_TIME_OF_SCOPE ("resolution pass over " + std::to_string (chunks.size()) + " source chunks");
 
-    ResolutionPass::run (allocator, *topLevelNamespace, true);
+        // The BuildSettings aren't known until link(), so calls to intrinsics are left unfolded
+        // until then, when they can be folded with the maths that the program will run with
+        ResolutionPass::run (allocator, *topLevelNamespace, true, ResolutionPass::IntrinsicFolding::none);
+    }
 
     ASTUtilities::mergeDuplicateNamespaces (*topLevelNamespace);
     SanityCheckPass::runDuplicateNameChecker (*topLevelNamespace);
@@ -229,25 +266,29 @@ Program Compiler::link (CompileMessageList& messageList, const BuildSettings& se
     {
         CompileMessageHandler handler (messageList);
         sanityCheckBuildSettings (settings);
-        return link (messageList, findMainProcessor (settings));
+        addStandardLibraryIfNeeded();
+        return link (messageList, settings, findMainProcessor (settings));
     }
     catch (AbortCompilationException) {}
 
     return {};
 }
 
-Program Compiler::link (CompileMessageList& messageList, AST::ProcessorBase& processorToRun)
+Program Compiler::link (CompileMessageList& messageList, const BuildSettings& settings, AST::ProcessorBase& processorToRun)
 {
     try
     {
         SOUL_LOG_TIME_OF_SCOPE ("link time");
+        SOUL_PROFILE_SCOPE ("link");
         CompileMessageHandler handler (messageList);
         ASTUtilities::resolveHoistedEndpoints (allocator, *topLevelNamespace);
         ASTUtilities::mergeDuplicateNamespaces (*topLevelNamespace);
         ConvertComplexPass::run (allocator, *topLevelNamespace);
-        ResolutionPass::run (allocator, *topLevelNamespace, true);
+        auto folding = settings.useFastMaths ? ResolutionPass::IntrinsicFolding::fast
+                                             : ResolutionPass::IntrinsicFolding::precise;
+        ResolutionPass::run (allocator, *topLevelNamespace, true, folding);
         ASTUtilities::removeModulesWithSpecialisationParams (*topLevelNamespace);
-        ResolutionPass::run (allocator, *topLevelNamespace, false);
+        ResolutionPass::run (allocator, *topLevelNamespace, false, folding);
         ASTUtilities::connectAnyChildEndpointsNeedingToBeExposed (allocator, processorToRun);
 
         Program program;
@@ -261,7 +302,10 @@ Program Compiler::link (CompileMessageList& messageList, AST::ProcessorBase& pro
                   [&] { return program.toHEART(); });
 
         heart::Checker::testHEARTRoundTrip (program);
+        Optimisations::inlineFunctionsByCost (program, settings);
         Optimisations::optimiseFunctionBlocks (program);
+        DataflowOptimisations::optimise (program, settings);
+        StreamLoopVectoriser::apply (program, settings);
         Optimisations::removeUnusedVariables (program);
         return program;
     }
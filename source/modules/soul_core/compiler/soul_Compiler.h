@@ -41,6 +41,13 @@ public:
     static Program build (CompileMessageList& messageList,
                           const BuildBundle& buildBundle);
 
+    /** Runs a complete build in the same way as the other build() method, and also adds
+        the time and pool memory used by each stage of the compilation to the given profile.
+    */
+    static Program build (CompileMessageList& messageList,
+                          const BuildBundle& buildBundle,
+                          CompileProfile& profile);
+
     /** Compiles a chunk of code which is expected to contain a list of top-level
         processor/graph/namespace decls, and these are added to the program.
     */
@@ -64,13 +71,15 @@ private:
 
     void reset();
     void addDefaultBuiltInLibrary();
+    void addStandardLibraryIfNeeded();
     void compile (CodeLocation);
-    Program link (CompileMessageList&, AST::ProcessorBase& processorToRun);
+    void compile (const std::vector<CodeLocation>&);
+    Program link (CompileMessageList&, const BuildSettings&, AST::ProcessorBase& processorToRun);
     AST::ProcessorBase& findMainProcessor (const BuildSettings&);
 
     void compileAllModules (const AST::Namespace& parentNamespace, Program&, AST::ProcessorBase& processorToRun);
 
-    bool includeStandardLibrary;
+    bool includeStandardLibrary, needsStandardLibrary = false;
 };
 
 } // namespace soul
@@ -37,6 +37,7 @@ struct ConvertComplexPass  final
 {
     static void run (AST::Allocator& a, AST::ModuleBase& m)
     {
+        SOUL_PROFILE_SCOPE ("ConvertComplexPass");
         ConvertComplexPass (a, m).run();
     }
 
@@ -31,6 +31,7 @@ struct HEARTGenerator  : public ASTVisitor
                        ArrayView<pool_ref<Module>> targetModules,
                        uint32_t maxNestedExpressionDepth = 255)
     {
+        SOUL_PROFILE_SCOPE ("HEARTGenerator");
         for (auto& m : sourceModules)
             SanityCheckPass::runPostResolution (m);
 
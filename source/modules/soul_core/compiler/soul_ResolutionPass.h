@@ -28,20 +28,57 @@ namespace soul
 */
 struct ResolutionPass  final
 {
-    static void run (AST::Allocator& a, AST::ModuleBase& m, bool ignoreTypeAndConstantErrors)
+    /** Chooses whether calls to intrinsics with constant arguments get folded, and if so,
+        whether to use the precise or BuildSettings::useFastMaths versions of the functions.
+    */
+    enum class IntrinsicFolding
     {
-        ResolutionPass (a, m).run (ignoreTypeAndConstantErrors);
+        none,
+        precise,
+        fast
+    };
+
+    static void run (AST::Allocator& a, AST::ModuleBase& m, bool ignoreTypeAndConstantErrors, IntrinsicFolding folding)
+    {
+        SOUL_PROFILE_SCOPE ("ResolutionPass");
+        ChangeTracker changes;
+        ResolutionPass (a, m, changes, folding).run (ignoreTypeAndConstantErrors);
     }
 
 private:
-    ResolutionPass (AST::Allocator& a, AST::ModuleBase& m) : allocator (a), module (m)
+    //==============================================================================
+    /** Shared by all the nested passes of a run, this keeps count of everything that has
+        been modified anywhere in the tree, so that work whose inputs can't have changed
+        since it was last done can be skipped.
+    */
+    struct ChangeTracker
+    {
+        struct StalledModule
+        {
+            size_t changeCount = 0, numFailures = 0;
+        };
+
+        size_t numItemsReplaced = 0, numUseCountRebuilds = 0;
+
+        // Sub-modules which failed to make any progress on their last attempt, and the
+        // state of the tree at that point. Until something else changes, running them
+        // again would just produce the same failures.
+        std::unordered_map<const AST::ModuleBase*, StalledModule> stalledModules;
+    };
+
+    ResolutionPass (AST::Allocator& a, AST::ModuleBase& m, ChangeTracker& c, IntrinsicFolding folding)
+        : allocator (a), module (m), changes (c), intrinsicFolding (folding)
     {
         intrinsicsNamespacePath = IdentifierPath::fromString (allocator.identifiers, getIntrinsicsNamespaceName());
     }
 
     AST::Allocator& allocator;
     AST::ModuleBase& module;
+    ChangeTracker& changes;
+    const IntrinsicFolding intrinsicFolding;
     IdentifierPath intrinsicsNamespacePath;
+    size_t useCountsReplacementCount = 0, useCountsRebuildCount = 0;
+    bool useCountsAreValid = false;
 
     struct RunStats
     {
@@ -76,19 +113,18 @@ private:
             tryPass<ProcessorInstanceResolver> (runStats, true);
             tryPass<NamespaceAliasResolver> (runStats, true);
             tryPass<ConvertStreamOperations> (runStats, true);
-            rebuildVariableUseCounts (module);
+            updateVariableUseCounts();
             tryPass<FunctionResolver> (runStats, true);
             tryPass<ConstantFolder> (runStats, true);
 
-            rebuildVariableUseCounts (module);
+            updateVariableUseCounts();
 
             if (runStats.numReplaced == 0)
                 tryPass<GenericFunctionResolver> (runStats, true);
 
             // Can't use a range-based-for here because the array will change during the loop
             for (size_t i = 0; i < module.getSubModules().size(); ++i)
-                runStats.add (ResolutionPass (allocator, module.getSubModules()[i])
-                                .run (ignoreTypeAndConstantErrors));
+                runStats.add (runSubModule (module.getSubModules()[i], ignoreTypeAndConstantErrors));
 
             if (runStats.numFailures == 0)
                 break;
@@ -110,7 +146,10 @@ private:
             }
         }
 
-        FullResolver (*this).visitObject (module);
+        {
+            SOUL_PROFILE_SCOPE (FullResolver::getPassName());
+            FullResolver (*this).visitObject (module);
+        }
 
         module.isFullyResolved = true;
         return runStats;
@@ -119,10 +158,49 @@ private:
     template <typename PassType>
     void tryPass (RunStats& runStats, bool ignoreErrors)
     {
+        SOUL_PROFILE_SCOPE (PassType::getPassName());
         PassType pass (*this, ignoreErrors);
         pass.performPass();
         runStats.numFailures += pass.numFails;
         runStats.numReplaced += pass.itemsReplaced;
+        changes.numItemsReplaced += pass.itemsReplaced;
+    }
+
+    RunStats runSubModule (AST::ModuleBase& subModule, bool ignoreTypeAndConstantErrors)
+    {
+        auto stalled = changes.stalledModules.find (std::addressof (subModule));
+
+        if (stalled != changes.stalledModules.end() && stalled->second.changeCount == changes.numItemsReplaced)
+        {
+            RunStats previousStats;
+            previousStats.numFailures = stalled->second.numFailures;
+            return previousStats;
+        }
+
+        auto stats = ResolutionPass (allocator, subModule, changes, intrinsicFolding).run (ignoreTypeAndConstantErrors);
+
+        if (subModule.isFullyResolved)
+            changes.stalledModules.erase (std::addressof (subModule));
+        else
+            changes.stalledModules[std::addressof (subModule)] = { changes.numItemsReplaced, stats.numFailures };
+
+        return stats;
+    }
+
+    void updateVariableUseCounts()
+    {
+        // If nothing has been replaced and no other pass has touched the counts since
+        // this module last rebuilt them, then they're still correct
+        if (useCountsAreValid
+             && useCountsReplacementCount == changes.numItemsReplaced
+             && useCountsRebuildCount == changes.numUseCountRebuilds)
+            return;
+
+        SOUL_PROFILE_SCOPE ("rebuildVariableUseCounts");
+        rebuildVariableUseCounts (module);
+        useCountsReplacementCount = changes.numItemsReplaced;
+        useCountsRebuildCount = ++changes.numUseCountRebuilds;
+        useCountsAreValid = true;
     }
 
     //==============================================================================
@@ -927,7 +1005,7 @@ private:
 
                 isUsedAsReference = savedIsUsedAsReference;
 
-                if (c.targetFunction.isIntrinsic())
+                if (c.targetFunction.isIntrinsic() && owner.intrinsicFolding != IntrinsicFolding::none)
                 {
                     ArrayWithPreallocation<Value, 4> constantArgs;
 
@@ -944,7 +1022,8 @@ private:
 
                     if (constantArgs.size() == c.arguments->items.size())
                     {
-                        auto result = performIntrinsic (c.targetFunction.intrinsic, constantArgs);
+                        auto result = performIntrinsic (c.targetFunction.intrinsic, constantArgs,
+                                                        owner.intrinsicFolding == IntrinsicFolding::fast);
 
                         if (result.isValid())
                             return createConstant (c.context, std::move (result));
@@ -30,12 +30,14 @@ struct SanityCheckPass  final
     /** Does some high-level checks after an initial parse and before name resolution, */
     static void runPreResolution (AST::ModuleBase& module)
     {
+        SOUL_PROFILE_SCOPE ("SanityCheckPass::runPreResolution");
         checkOverallStructure (module);
     }
 
     /** After the AST is resolved, this pass checks for more subtle errors */
     static void runPostResolution (AST::ModuleBase& module)
     {
+        SOUL_PROFILE_SCOPE ("SanityCheckPass::runPostResolution");
         runEventFunctionChecker (module);
         runDuplicateNameChecker (module);
         PostResolutionChecks().ASTVisitor::visitObject (module);
@@ -49,6 +51,7 @@ struct SanityCheckPass  final
 
     static void runDuplicateNameChecker (AST::ModuleBase& module)
     {
+        SOUL_PROFILE_SCOPE ("SanityCheckPass::runDuplicateNameChecker");
         DuplicateNameChecker().visitObject (module);
     }
 
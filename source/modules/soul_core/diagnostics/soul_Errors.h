@@ -315,10 +315,12 @@ namespace soul
     X(unsupportedSampleRate,                "Unsupported sample rate") \
     X(unsupportedOptimisationLevel,         "Unsupported optimisation level") \
     X(unsupportedNumChannels,               "Unsupported number of channels") \
+    X(fastMathsNotSupportedInCPlusPlus,     "The C++ code generator doesn't support the useFastMaths build setting") \
 
 #define SOUL_ERRORS_RUNTIME(X) \
     X(customRuntimeError,                   "$0$") \
     X(failedToLoadProgram,                  "Failed to load program") \
+    X(invalidBinaryProgram,                 "The binary program data is invalid or was written by an incompatible version") \
     X(cannotOverwriteFile,                  "Cannot overwrite existing file $Q0$") \
     X(cannotCreateOutputFile,               "Cannot create output file $Q0$") \
     X(cannotCreateFolder,                   "Cannot create folder $Q0$") \
@@ -50,6 +50,102 @@ std::string ScopedTimer::getElapsedTimeDescription() const
     return getDescriptionOfTimeInSeconds (getElapsedSeconds());
 }
 
+//==============================================================================
+static thread_local CompileProfile::Recorder* currentProfileRecorder = nullptr;
+
+void CompileProfile::clear()
+{
+    stages.clear();
+}
+
+const CompileProfile::Stage* CompileProfile::findStage (std::string_view path) const
+{
+    for (auto& s : stages)
+        if (s.path == path)
+            return std::addressof (s);
+
+    return {};
+}
+
+choc::value::Value CompileProfile::toValue() const
+{
+    auto result = choc::value::createEmptyArray();
+
+    for (auto& s : stages)
+        result.addArrayElement (choc::value::createObject ("Stage",
+                                                           "path", s.path,
+                                                           "calls", static_cast<int64_t> (s.numCalls),
+                                                           "seconds", s.totalSeconds,
+                                                           "allocations", static_cast<int64_t> (s.numAllocations),
+                                                           "allocatedBytes", static_cast<int64_t> (s.numAllocatedBytes)));
+
+    return result;
+}
+
+std::string CompileProfile::toJSON() const
+{
+    return choc::json::toString (toValue());
+}
+
+CompileProfile::Recorder::Recorder (CompileProfile& p)
+    : profile (p), previousRecorder (currentProfileRecorder)
+{
+    for (size_t i = 0; i < profile.stages.size(); ++i)
+        stageIndexes[profile.stages[i].path] = i;
+
+    currentProfileRecorder = this;
+}
+
+CompileProfile::Recorder::~Recorder()
+{
+    currentProfileRecorder = previousRecorder;
+}
+
+CompileProfile::ScopedStage::ScopedStage (const char* name)
+    : traceEvent ("compile", name), recorder (currentProfileRecorder)
+{
+    if (recorder != nullptr)
+    {
+        auto& path = recorder->currentPath;
+        parentPathLength = path.length();
+
+        if (parentPathLength != 0)
+            path += '/';
+
+        path += name;
+
+        auto& stages = recorder->profile.stages;
+        auto index = recorder->stageIndexes.find (path);
+
+        if (index == recorder->stageIndexes.end())
+        {
+            index = recorder->stageIndexes.emplace (path, stages.size()).first;
+            stages.push_back ({ path });
+        }
+
+        stageIndex = index->second;
+        allocationsAtStart = PoolAllocator::getThreadStatistics();
+        start = clock::now();
+    }
+}
+
+CompileProfile::ScopedStage::~ScopedStage()
+{
+    if (recorder != nullptr)
+    {
+        auto elapsed = std::chrono::duration<double> (clock::now() - start).count();
+        auto allocations = PoolAllocator::getThreadStatistics();
+
+        auto& stage = recorder->profile.stages[stageIndex];
+        stage.numCalls++;
+        stage.totalSeconds += elapsed;
+        stage.numAllocations += allocations.numAllocations - allocationsAtStart.numAllocations;
+        stage.numAllocatedBytes += allocations.numBytes - allocationsAtStart.numBytes;
+
+        recorder->currentPath.resize (parentPathLength);
+    }
+}
+
 //==============================================================================
 CPULoadMeasurer::CPULoadMeasurer() { reset(); }
 
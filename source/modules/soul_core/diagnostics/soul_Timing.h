@@ -39,7 +39,79 @@ private:
 };
 
 #define SOUL_LOG_TIME_OF_SCOPE(description) \
-    const ScopedTimer timer_ ## __LINE__ (description);
+    const ScopedTimer SOUL_CONCAT (timer_, __LINE__) (description);
+
+//==============================================================================
+/**
+    Collects the time taken and the pool memory allocated by each stage of a build.
+
+    While a CompileProfile::Recorder is active on a thread, every SOUL_PROFILE_SCOPE
+    that runs on that thread adds its measurements to the recorder's profile. Stages
+    which are nested are given paths like "link/ResolutionPass/TypeResolver", and a
+    stage that runs many times accumulates its totals in a single entry.
+
+    Each stage is also recorded as an event in the TraceRecorder's "compile" category.
+*/
+struct CompileProfile
+{
+    struct Stage
+    {
+        std::string path;
+        uint32_t numCalls = 0;
+        double totalSeconds = 0;
+        uint64_t numAllocations = 0, numAllocatedBytes = 0;
+    };
+
+    /** The stages, in the order in which they were first entered. */
+    std::vector<Stage> stages;
+
+    void clear();
+
+    /** Returns the stage with the given path, or nullptr if it wasn't recorded. */
+    const Stage* findStage (std::string_view path) const;
+
+    /** Returns the stages as an array of objects. */
+    choc::value::Value toValue() const;
+
+    /** Returns the stages as a JSON array. */
+    std::string toJSON() const;
+
+    //==============================================================================
+    /** Makes a profile the target for any stages that are run by the current thread,
+        for the lifetime of this object.
+    */
+    struct Recorder
+    {
+        Recorder (CompileProfile&);
+        ~Recorder();
+
+        CompileProfile& profile;
+        Recorder* const previousRecorder;
+        std::string currentPath;
+        std::unordered_map<std::string, size_t> stageIndexes;
+    };
+
+    /** Adds the time and allocations made during its lifetime to the named stage of
+        the profile that is being recorded on this thread, if there is one.
+    */
+    struct ScopedStage
+    {
+        ScopedStage (const char* name);
+        ~ScopedStage();
+
+    private:
+        using clock = std::chrono::high_resolution_clock;
+
+        TraceRecorder::ScopedEvent traceEvent;
+        Recorder* const recorder;
+        size_t parentPathLength = 0, stageIndex = 0;
+        clock::time_point start;
+        PoolAllocator::ThreadStatistics allocationsAtStart;
+    };
+};
+
+#define SOUL_PROFILE_SCOPE(stageName) \
+    const soul::CompileProfile::ScopedStage SOUL_CONCAT (profileStage_, __LINE__) (stageName);
 
 // Helper method to read the bela audio load
 float getBelaLoadFromString (const std::string& input);
@@ -0,0 +1,303 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#if ! SOUL_INSIDE_CORE_CPP
+ #error "Don't add this cpp file to your build, it gets included indirectly by soul_core.cpp"
+#endif
+
+namespace soul
+{
+
+struct TraceEvent
+{
+    const char* category;
+    const char* name;
+    int64_t value;
+    uint64_t nanoseconds;
+    char phase;
+    bool hasValue;
+};
+
+struct TraceThreadBuffer
+{
+    // The storage is owned by the TraceRecorderState, and once it has been set it isn't
+    // changed or freed, so a thread which is writing into it never sees it disappear
+    std::atomic<TraceEvent*> events { nullptr };
+    std::atomic<uint32_t> numEvents { 0 };
+    std::atomic<uint32_t> recordingIndex { 0 };
+    std::atomic<bool> isClaimed { false };
+    std::atomic<bool> wasClaimedWithoutStorage { false };
+};
+
+struct TraceRecorderState
+{
+    using clock = std::chrono::steady_clock;
+
+    std::mutex allocationLock;
+    TraceThreadBuffer buffers[TraceRecorder::maxNumThreads];
+    std::unique_ptr<TraceEvent[]> eventStorage[TraceRecorder::maxNumThreads];
+    std::atomic<bool> recording { false };
+    std::atomic<uint32_t> recordingIndex { 0 };
+    std::atomic<clock::rep> startTime { 0 };
+
+    // The number of unclaimed buffers which are given storage by each startRecording(), ready
+    // for threads that begin recording after it
+    static constexpr uint32_t numSpareBuffers = 4;
+
+    // Called by startRecording(), so that threads recording events never need to allocate.
+    // Storage is only created for the buffers which threads have claimed or needed during an
+    // earlier recording, and for a few spare ones, so the memory used grows with the number
+    // of threads that actually record.
+    void allocateBuffers()
+    {
+        std::lock_guard<decltype (allocationLock)> l (allocationLock);
+        uint32_t numSpare = 0;
+
+        for (uint32_t i = 0; i < TraceRecorder::maxNumThreads; ++i)
+        {
+            bool isClaimed = buffers[i].isClaimed.load (std::memory_order_acquire);
+            bool wasNeeded = isClaimed || buffers[i].wasClaimedWithoutStorage.load (std::memory_order_relaxed);
+
+            if (eventStorage[i] == nullptr && (wasNeeded || numSpare < numSpareBuffers))
+            {
+                eventStorage[i].reset (new TraceEvent[TraceRecorder::maxEventsPerThread]);
+                buffers[i].events.store (eventStorage[i].get(), std::memory_order_release);
+            }
+
+            if (! isClaimed && eventStorage[i] != nullptr)
+                ++numSpare;
+        }
+    }
+
+    // Claims the first free buffer which has some storage, or failing that, any free buffer
+    TraceThreadBuffer* claimFreeBuffer() noexcept
+    {
+        for (bool requireStorage : { true, false })
+        {
+            for (auto& b : buffers)
+            {
+                if (requireStorage && b.events.load (std::memory_order_acquire) == nullptr)
+                    continue;
+
+                bool wasClaimed = false;
+
+                if (b.isClaimed.compare_exchange_strong (wasClaimed, true, std::memory_order_acquire))
+                {
+                    if (! requireStorage)
+                        b.wasClaimedWithoutStorage.store (true, std::memory_order_relaxed);
+
+                    return std::addressof (b);
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
+    // A thread claims a buffer the first time it records something, and keeps it until
+    // the thread exits, so each buffer only ever has one writer, and a new recording can't
+    // hand it to another thread while an event is being written into it. If all the
+    // buffers are taken, this returns nullptr and the thread's events are dropped until
+    // the next recording, when it tries again. A thread that could only claim a buffer
+    // without any storage also drops its events until the next recording gives it some.
+    TraceThreadBuffer* getBufferForThisThread (uint32_t currentRecording) noexcept
+    {
+        struct ThreadBufferClaim
+        {
+            ~ThreadBufferClaim()
+            {
+                if (buffer != nullptr)
+                    buffer->isClaimed.store (false, std::memory_order_release);
+            }
+
+            TraceThreadBuffer* buffer = nullptr;
+            uint32_t lastFailedRecording = 0;
+        };
+
+        static thread_local ThreadBufferClaim claim;
+
+        if (claim.buffer == nullptr)
+        {
+            if (claim.lastFailedRecording == currentRecording)
+                return nullptr;
+
+            claim.buffer = claimFreeBuffer();
+
+            if (claim.buffer == nullptr)
+            {
+                claim.lastFailedRecording = currentRecording;
+                return nullptr;
+            }
+        }
+
+        // Only the owning thread resets its buffer, when it sees that a new recording has begun
+        if (claim.buffer->recordingIndex.load (std::memory_order_relaxed) != currentRecording)
+        {
+            claim.buffer->numEvents.store (0, std::memory_order_relaxed);
+            claim.buffer->recordingIndex.store (currentRecording, std::memory_order_release);
+        }
+
+        return claim.buffer;
+    }
+
+    void addEvent (char phase, const char* category, const char* name, int64_t value, bool hasValue) noexcept
+    {
+        auto now = clock::now().time_since_epoch().count();
+        auto buffer = getBufferForThisThread (recordingIndex.load (std::memory_order_acquire));
+
+        if (buffer == nullptr)
+            return;
+
+        auto events = buffer->events.load (std::memory_order_acquire);
+        auto index = buffer->numEvents.load (std::memory_order_relaxed);
+
+        if (events != nullptr && index < TraceRecorder::maxEventsPerThread)
+        {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds> (clock::duration (now - startTime.load (std::memory_order_relaxed)));
+            events[index] = { category, name, value, static_cast<uint64_t> (std::max<int64_t> (0, elapsed.count())), phase, hasValue };
+            buffer->numEvents.store (index + 1, std::memory_order_release);
+        }
+    }
+};
+
+static TraceRecorderState& getTraceRecorderState()
+{
+    static TraceRecorderState state;
+    return state;
+}
+
+//==============================================================================
+void TraceRecorder::startRecording()
+{
+    auto& state = getTraceRecorderState();
+    state.recording = false;
+    state.allocateBuffers();
+    state.startTime = TraceRecorderState::clock::now().time_since_epoch().count();
+    ++state.recordingIndex;
+    state.recording = true;
+}
+
+void TraceRecorder::stopRecording()
+{
+    getTraceRecorderState().recording = false;
+}
+
+bool TraceRecorder::isRecording() noexcept
+{
+    return getTraceRecorderState().recording.load (std::memory_order_relaxed);
+}
+
+void TraceRecorder::beginEvent (const char* category, const char* name) noexcept
+{
+    auto& state = getTraceRecorderState();
+
+    if (state.recording.load (std::memory_order_relaxed))
+        state.addEvent ('B', category, name, 0, false);
+}
+
+void TraceRecorder::beginEvent (const char* category, const char* name, int64_t value) noexcept
+{
+    auto& state = getTraceRecorderState();
+
+    if (state.recording.load (std::memory_order_relaxed))
+        state.addEvent ('B', category, name, value, true);
+}
+
+void TraceRecorder::endEvent (const char* category, const char* name) noexcept
+{
+    auto& state = getTraceRecorderState();
+
+    if (state.recording.load (std::memory_order_relaxed))
+        state.addEvent ('E', category, name, 0, false);
+}
+
+std::string TraceRecorder::toJSON()
+{
+    auto& state = getTraceRecorderState();
+    auto currentRecording = state.recordingIndex.load();
+
+    std::ostringstream out;
+    out << "{\"traceEvents\": [";
+    bool isFirst = true;
+
+    for (uint32_t threadIndex = 0; threadIndex < maxNumThreads; ++threadIndex)
+    {
+        auto& buffer = state.buffers[threadIndex];
+        auto events = buffer.events.load (std::memory_order_acquire);
+
+        if (events == nullptr || buffer.recordingIndex.load (std::memory_order_acquire) != currentRecording)
+            continue;
+
+        auto numEvents = buffer.numEvents.load (std::memory_order_acquire);
+
+        for (uint32_t i = 0; i < numEvents; ++i)
+        {
+            auto& e = events[i];
+
+            out << (isFirst ? "\n  " : ",\n  ")
+                << "{\"name\": " << choc::json::getEscapedQuotedString (e.name)
+                << ", \"cat\": " << choc::json::getEscapedQuotedString (e.category)
+                << ", \"ph\": \"" << e.phase << "\""
+                << ", \"ts\": " << choc::json::doubleToString (static_cast<double> (e.nanoseconds) / 1000.0)
+                << ", \"pid\": 1, \"tid\": " << (threadIndex + 1);
+
+            if (e.hasValue)
+                out << ", \"args\": {\"value\": " << e.value << "}";
+
+            out << "}";
+            isFirst = false;
+        }
+    }
+
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return out.str();
+}
+
+//==============================================================================
+// The index of the recording that a ScopedEvent began in, or 0 if nothing was being
+// recorded, so that its end event isn't added to a different recording
+static uint32_t getCurrentRecordingIndex() noexcept
+{
+    auto& state = getTraceRecorderState();
+    return state.recording.load (std::memory_order_relaxed) ? state.recordingIndex.load (std::memory_order_acquire) : 0;
+}
+
+TraceRecorder::ScopedEvent::ScopedEvent (const char* c, const char* n) noexcept
+    : category (c), name (n), recordingIndex (getCurrentRecordingIndex())
+{
+    if (recordingIndex != 0)
+        beginEvent (category, name);
+}
+
+TraceRecorder::ScopedEvent::ScopedEvent (const char* c, const char* n, int64_t value) noexcept
+    : category (c), name (n), recordingIndex (getCurrentRecordingIndex())
+{
+    if (recordingIndex != 0)
+        beginEvent (category, name, value);
+}
+
+TraceRecorder::ScopedEvent::~ScopedEvent()
+{
+    if (recordingIndex != 0 && recordingIndex == getCurrentRecordingIndex())
+        endEvent (category, name);
+}
+
+
+} // namespace soul
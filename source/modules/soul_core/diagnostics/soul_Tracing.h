@@ -0,0 +1,97 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Records begin/end events from any number of threads, and writes them out in the
+    trace-event JSON format that chrome://tracing and Perfetto can display.
+
+    Each thread writes into its own fixed-size buffer, so recording an event doesn't
+    take any locks or allocate any memory. Each thread claims a buffer the first time it
+    records an event and keeps it until the thread exits, so recording can safely be
+    restarted while other threads are adding events. The storage for the buffers is only
+    allocated by startRecording(), for the threads which have recorded so far and a few
+    spare ones, so nothing is allocated until tracing is used. A thread that claims a
+    buffer with no storage yet has its events dropped until the next startRecording().
+    Events from threads beyond the first maxNumThreads are dropped, as are any further
+    events from a thread once its buffer is full, until recording is restarted.
+
+    Event names and categories are stored as pointers, so they must be string literals
+    or other strings which will outlive the recording.
+*/
+class TraceRecorder  final
+{
+public:
+    /** Discards any previously recorded events and begins recording. */
+    static void startRecording();
+
+    /** Stops recording. Events which were already recorded are kept until the next
+        call to startRecording().
+    */
+    static void stopRecording();
+
+    /** Returns true if events are currently being recorded. */
+    static bool isRecording() noexcept;
+
+    /** Records the start of an event on the current thread. */
+    static void beginEvent (const char* category, const char* name) noexcept;
+
+    /** Records the start of an event which has a numeric value attached to it. */
+    static void beginEvent (const char* category, const char* name, int64_t value) noexcept;
+
+    /** Records the end of the most recent event that was begun on the current thread. */
+    static void endEvent (const char* category, const char* name) noexcept;
+
+    /** Returns the recorded events as a trace-event JSON object. This should only be
+        called when recording has been stopped.
+    */
+    static std::string toJSON();
+
+    /** The number of events that each thread can record before it starts dropping them. */
+    static constexpr uint32_t maxEventsPerThread = 32768;
+
+    /** The number of threads that can record events at once. */
+    static constexpr uint32_t maxNumThreads = 16;
+
+    //==============================================================================
+    /** Records a begin event when created and a matching end event when deleted.
+        The end event is skipped if recording was stopped or restarted in the meantime.
+    */
+    struct ScopedEvent
+    {
+        ScopedEvent (const char* category, const char* name) noexcept;
+        ScopedEvent (const char* category, const char* name, int64_t value) noexcept;
+        ~ScopedEvent();
+
+    private:
+        const char* const category;
+        const char* const name;
+        const uint32_t recordingIndex;
+    };
+};
+
+#define SOUL_TRACE_SCOPE(category, name) \
+    const soul::TraceRecorder::ScopedEvent SOUL_CONCAT (traceEvent_, __LINE__) (category, name);
+
+
+} // namespace soul
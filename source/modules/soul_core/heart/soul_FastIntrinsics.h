@@ -0,0 +1,341 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+namespace soul
+{
+
+//==============================================================================
+/**
+    Polynomial approximations of the transcendental intrinsics, which are used in place
+    of the standard library versions when BuildSettings::useFastMaths is enabled.
+
+    The interpreter, the bytecode VM and compile-time evaluation all use these same
+    functions, so a call which the compiler folds into a constant has exactly the value
+    that the running program would have calculated.
+
+    The coefficients are least-maximum-error fits over each function's reduced range.
+    These are the worst errors measured against long double versions:
+
+      function    float32        float64        notes
+      sin, cos    1.6e-7 abs     5.4e-14 abs    for |x| < 1e5 (float32: 1e-6 near the limit) or
+                                                1e9 (float64), and within [-1, 1] beyond that
+      tan         7.8e-7         1.4e-13        for |x| < 1.5, growing with tan's own sensitivity
+                                                nearer the poles
+      exp         1e-7           5.7e-16
+      log, log10  2.5e-7         1e-15          including subnormals
+      pow         1.5e-7 * (1 + |b log a|)      float64: 6e-16 * (1 + |b log a|)
+      sinh, cosh  1.6e-7         7.8e-16
+      tanh        1.7e-7         4.6e-14
+
+    Errors are relative unless marked as absolute. Infinities, NaNs, overflow and
+    underflow behave like the standard library functions.
+
+    There are two variants which give identical results: FastIntrinsics is the one to call
+    on single values, and VectorisableFastIntrinsics is for loops over all the elements of
+    a vector. The vectorisable one has no data-dependent branches, so the native compiler
+    can turn those loops into SIMD code, but its bit-mask selects would slow down the
+    scalar version.
+*/
+template <bool vectorisable>
+struct FastIntrinsicsImpl
+{
+    template <typename T> static T sin (T x) noexcept
+    {
+        auto r = reduceByPi (x, static_cast<T> (0));
+        return sinOfReduced (r.remainder) * signOf<T> (r.multiple);
+    }
+
+    template <typename T> static T cos (T x) noexcept
+    {
+        // cos (x) = sin (x - (k + 1/2) pi) * -1^(k + 1)
+        auto r = reduceByPi (x, static_cast<T> (0.5));
+        return sinOfReduced (r.remainder) * -signOf<T> (r.multiple);
+    }
+
+    template <typename T> static T tan (T x) noexcept
+    {
+        // tan has a period of pi, so the sign flips of sin and cos cancel out
+        auto r = reduceByPi (x, static_cast<T> (0));
+        return sinOfReduced (r.remainder) / sinOfReduced (static_cast<T> (halfPi) - std::abs (r.remainder));
+    }
+
+    template <typename T> static T exp (T x) noexcept
+    {
+        // Beyond these limits the result has overflowed to infinity or underflowed to zero
+        constexpr auto low  = static_cast<T> (isFloat<T> ? -104.0 : -746.0);
+        constexpr auto high = static_cast<T> (isFloat<T> ? 89.0 : 710.0);
+
+        // exp (x) = 2^n * exp (f), where n = round (x / ln2) and |f| <= ln2 / 2
+        auto clamped = select (x < low, low, select (x > high, high, x));
+        auto n = roundToInteger (clamped * static_cast<T> (log2e));
+        auto nf = static_cast<T> (n);
+        auto f = (clamped - nf * static_cast<T> (ln2Hi)) - nf * static_cast<T> (ln2Lo);
+
+        // 2^n is applied in two halves, so that the result can go into the subnormal
+        // range or overflow without needing any special cases
+        auto halfN = n / 2;
+        return (static_cast<T> (1) + f * expPolynomial (f)) * powerOfTwo<T> (halfN) * powerOfTwo<T> (n - halfN);
+    }
+
+    template <typename T> static T log (T x) noexcept
+    {
+        using Bits = BitsType<T>;
+        constexpr int mantissaBits = isFloat<T> ? 23 : 52;
+        constexpr Bits mantissaMask = (static_cast<Bits> (1) << mantissaBits) - 1;
+        constexpr Bits sqrtHalfBits = isFloat<T> ? 0x3f3504f3u : 0x3fe6a09e667f3bcdull;
+        constexpr auto infinity = std::numeric_limits<T>::infinity();
+
+        // Subnormals are scaled up into the normal range first
+        auto isSubnormal = x < std::numeric_limits<T>::min();
+        auto bits = toBits (x * select (isSubnormal, static_cast<T> (isFloat<T> ? 0x1p32 : 0x1p64), static_cast<T> (1)));
+
+        // log (x) = e * ln2 + log (m), with m in [sqrt (1/2), sqrt (2)). Offsetting the bits by
+        // those of sqrt (1/2) moves the exponent boundary to the right place in one step.
+        auto offsetBits = bits - sqrtHalfBits;
+        auto m = fromBits<T> ((offsetBits & mantissaMask) + sqrtHalfBits);
+        auto exponent = static_cast<T> (static_cast<int32_t> (static_cast<typename std::make_signed<Bits>::type> (offsetBits) >> mantissaBits))
+                          - select (isSubnormal, static_cast<T> (isFloat<T> ? 32 : 64), static_cast<T> (0));
+
+        // log (m) = 2 atanh (s), where s = (m - 1) / (m + 1)
+        auto s = (m - 1) / (m + 1);
+        auto result = exponent * static_cast<T> (ln2Hi) + (exponent * static_cast<T> (ln2Lo) + s * logPolynomial (s * s));
+
+        result = select (x == infinity, infinity, result);
+        result = select (x == 0, -infinity, result);
+        return select (! (x >= 0), std::numeric_limits<T>::quiet_NaN(), result);
+    }
+
+    template <typename T> static T log10 (T x) noexcept
+    {
+        return log (x) * static_cast<T> (log10e);
+    }
+
+    template <typename T> static T pow (T a, T b) noexcept
+    {
+        auto magnitude = exp (b * log (std::abs (a)));
+
+        // A negative base only has a real result for integer powers. Every value beyond
+        // the clamp is an even integer, and the clamp keeps the conversion in range.
+        using Integer = typename std::conditional<isFloat<T>, int32_t, int64_t>::type;
+        constexpr auto limit = static_cast<T> (isFloat<T> ? 0x1p24 : 0x1p53);
+        auto clampedB = select (b > limit, limit, select (b < -limit, -limit, b));
+        auto integerB = static_cast<Integer> (clampedB);
+        auto isInteger = static_cast<T> (integerB) == clampedB;
+        auto oddSign = static_cast<T> (1) - static_cast<T> (2) * static_cast<T> (integerB & 1);
+        auto sign = select ((a < 0) & isInteger, oddSign, static_cast<T> (1));
+        auto notReal = select ((a < 0) & ! isInteger, std::numeric_limits<T>::quiet_NaN(), static_cast<T> (0));
+
+        return select ((b == 0) | (a == 1), static_cast<T> (1), magnitude * sign + notReal);
+    }
+
+    template <typename T> static T sinh (T x) noexcept
+    {
+        auto magnitude = std::abs (x);
+        auto e = exp (magnitude);
+        auto large = static_cast<T> (0.5) * (e - static_cast<T> (1) / e);
+
+        // Near zero, the difference of the exponentials loses too much precision
+        auto small = magnitude * sinhPolynomial (magnitude * magnitude);
+        return std::copysign (select (magnitude <= 1, small, large), x);
+    }
+
+    template <typename T> static T cosh (T x) noexcept
+    {
+        auto e = exp (std::abs (x));
+        return static_cast<T> (0.5) * (e + static_cast<T> (1) / e);
+    }
+
+    template <typename T> static T tanh (T x) noexcept
+    {
+        auto magnitude = std::abs (x);
+        auto large = static_cast<T> (1) - static_cast<T> (2) / (exp (magnitude * 2) + 1);
+        auto small = magnitude * tanhPolynomial (magnitude * magnitude);
+        return std::copysign (select (magnitude <= static_cast<T> (0.55), small, large), x);
+    }
+
+private:
+    //==============================================================================
+    template <typename T> static constexpr bool isFloat = std::is_same<T, float>::value;
+    template <typename T> using BitsType = typename std::conditional<isFloat<T>, uint32_t, uint64_t>::type;
+
+    static constexpr double halfPi = pi / 2;
+    static constexpr double log2e  = 1.4426950408889634074;
+    static constexpr double log10e = 0.43429448190325182765;
+
+    // ln2 split so that n * ln2Hi is exact for any exponent that exp() can produce
+    static constexpr double ln2Hi  = 6.93145751953125e-1;
+    static constexpr double ln2Lo  = 1.42860682030941723212e-6;
+
+    template <typename T> static BitsType<T> toBits (T value) noexcept
+    {
+        BitsType<T> bits;
+        std::memcpy (std::addressof (bits), std::addressof (value), sizeof (T));
+        return bits;
+    }
+
+    template <typename T> static T fromBits (BitsType<T> bits) noexcept
+    {
+        T value;
+        std::memcpy (std::addressof (value), std::addressof (bits), sizeof (T));
+        return value;
+    }
+
+    /** In the vectorisable variant, this chooses between the values using bit masks rather
+        than a branch. A compiler can't turn a conditional expression into a SIMD blend when
+        the unused side might raise a floating point exception, so ordinary conditionals
+        would stop loops vectorising.
+    */
+    template <typename T> static T select (bool condition, T ifTrue, T ifFalse) noexcept
+    {
+        if constexpr (vectorisable)
+        {
+            auto mask = static_cast<BitsType<T>> (0) - static_cast<BitsType<T>> (condition);
+            return fromBits<T> ((toBits (ifTrue) & mask) | (toBits (ifFalse) & ~mask));
+        }
+        else
+        {
+            return condition ? ifTrue : ifFalse;
+        }
+    }
+
+    /** Returns -1^n */
+    template <typename T> static T signOf (int32_t n) noexcept
+    {
+        return static_cast<T> (1 - 2 * (n & 1));
+    }
+
+    // These stick to 32-bit integers, as 64-bit conversions don't vectorise on most targets
+    template <typename T> static int32_t roundToInteger (T value) noexcept
+    {
+        return static_cast<int32_t> (value + std::copysign (static_cast<T> (0.5), value));
+    }
+
+    /** Returns 2^n, for n within the normal exponent range of T. */
+    template <typename T> static T powerOfTwo (int32_t n) noexcept
+    {
+        return fromBits<T> (static_cast<BitsType<T>> (n + (isFloat<T> ? 127 : 1023)) << (isFloat<T> ? 23 : 52));
+    }
+
+    template <typename T>
+    struct ReducedArgument
+    {
+        T remainder;
+        int32_t multiple;
+    };
+
+    /** Finds k and r such that x = (k + offset) * pi + r, where |r| <= pi / 2. The subtraction
+        is done in three parts (Cody and Waite) so that r stays accurate for large values of x.
+    */
+    template <typename T> static ReducedArgument<T> reduceByPi (T x, T offset) noexcept
+    {
+        auto k = roundToInteger (x * static_cast<T> (1.0 / pi) - offset);
+        auto multiple = static_cast<T> (k) + offset;
+        T r;
+
+        if constexpr (isFloat<T>)
+            r = ((x - multiple * 3.140625f) - multiple * 9.67502593994140625e-4f) - multiple * 1.509957990978376432e-7f;
+        else
+            r = ((x - multiple * 3.14159250259399414062) - multiple * 1.509957883172319270672e-7) - multiple * 1.0780605716316238105800e-14;
+
+        // Beyond the accurate range, clamping keeps the results between -1 and 1, and
+        // adding x * 0 turns an infinite argument into a NaN
+        constexpr auto limit = static_cast<T> (halfPi);
+        r = select (r > limit, limit, select (r < -limit, -limit, r));
+        return { r + x * 0, k };
+    }
+
+    template <typename T> static T horner (T) noexcept     { return 0; }
+
+    template <typename T, typename... Coefficients>
+    static T horner (T x, double first, Coefficients... rest) noexcept
+    {
+        if constexpr (sizeof... (rest) == 0)
+            return static_cast<T> (first);
+        else
+            return static_cast<T> (first) + x * horner (x, rest...);
+    }
+
+    /** sin (r) for |r| <= pi / 2 */
+    template <typename T> static T sinOfReduced (T r) noexcept
+    {
+        auto r2 = r * r;
+
+        if constexpr (isFloat<T>)
+            return r * horner (r2, 9.99999994686006465731e-01, -1.66666566840060684115e-01, 8.33302513894814496532e-03,
+                                   -1.98074187260842285187e-04, 2.60190306498045318631e-06);
+        else
+            return r * horner (r2, 9.99999999999917024652e-01, -1.66666666663843271575e-01, 8.33333331679312527420e-03,
+                                   -1.98412661031268646940e-04, 2.75569095811940133662e-06, -2.50287607434990054156e-08,
+                                   1.53914147931390734633e-10);
+    }
+
+    /** (exp (f) - 1) / f for |f| <= ln2 / 2 */
+    template <typename T> static T expPolynomial (T f) noexcept
+    {
+        if constexpr (isFloat<T>)
+            return horner (f, 1.00000001062796753306e+00, 4.99999981247873856693e-01, 1.66665062195553347966e-01,
+                              4.16671362113254900392e-02, 8.36906856219894072291e-03, 1.38888726186196162726e-03);
+        else
+            return horner (f, 1.00000000000000130484e+00, 4.99999999999989655139e-01, 1.66666666666143256200e-01,
+                              4.16666666677551022872e-02, 8.33333336773226174838e-03, 1.38888885842673971421e-03,
+                              1.98411901863652420203e-04, 2.48018862505264636495e-05, 2.76328055233995461481e-06,
+                              2.74862895860723704176e-07);
+    }
+
+    /** 2 atanh (s) / s as a function of s^2, for s^2 <= 0.0295 */
+    template <typename T> static T logPolynomial (T s2) noexcept
+    {
+        if constexpr (isFloat<T>)
+            return horner (s2, 1.99999999862133022021e+00, 6.66668159508336849309e-01, 3.99747949267816898421e-01,
+                               2.99256506566651888230e-01);
+        else
+            return horner (s2, 2.00000000000000122493e+00, 6.66666666663393814210e-01, 4.00000001461932300076e-01,
+                               2.85714037607216122670e-01, 2.22242396907538008124e-01, 1.80975647901779236297e-01,
+                               1.71142026918585207310e-01);
+    }
+
+    /** sinh (x) / x as a function of x^2, for |x| <= 1 */
+    template <typename T> static T sinhPolynomial (T x2) noexcept
+    {
+        if constexpr (isFloat<T>)
+            return horner (x2, 9.99999979700703049289e-01, 1.66667338269697038627e-01, 8.32991192027922008532e-03,
+                               2.03939897358817576638e-04);
+        else
+            return horner (x2, 9.99999999999999944923e-01, 1.66666666666662750018e-01, 8.33333333348337260378e-03,
+                               1.98412697291405473801e-04, 2.75573526232573744275e-06, 2.50474188915508219112e-08,
+                               1.63683266157599528250e-10);
+    }
+
+    /** tanh (x) / x as a function of x^2, for |x| <= 0.55 */
+    template <typename T> static T tanhPolynomial (T x2) noexcept
+    {
+        if constexpr (isFloat<T>)
+            return horner (x2, 9.99999967637238506668e-01, -3.33327950231117442156e-01, 1.33188769064215169964e-01,
+                               -5.25893193717944029310e-02, 1.63154429380622863221e-02);
+        else
+            return horner (x2, 9.99999999999999077832e-01, -3.33333333329415659486e-01, 1.33333332790846696795e-01,
+                               -5.39682306423799137515e-02, 2.18690247657572167285e-02, -8.85823972497699085045e-03,
+                               3.56095202346449423990e-03, -1.34181967748731698093e-03, 3.55769617355244365242e-04);
+    }
+};
+
+using FastIntrinsics             = FastIntrinsicsImpl<false>;
+using VectorisableFastIntrinsics = FastIntrinsicsImpl<true>;
+
+} // namespace soul
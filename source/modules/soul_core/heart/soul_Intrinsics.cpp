@@ -127,9 +127,30 @@ namespace CompileTimeIntrinsicEvaluation
 
         return {};
     }
+
+    template <typename FloatType>
+    Value performFast (IntrinsicType i, ArrayView<Value> args)
+    {
+        auto arg = [&] (size_t index) { return static_cast<FloatType> (args[index]); };
+
+        switch (i)
+        {
+            case IntrinsicType::pow:    SOUL_ASSERT (args.size() == 2); return Value (FastIntrinsics::pow (arg (0), arg (1)));
+            case IntrinsicType::exp:    SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::exp (arg (0)));
+            case IntrinsicType::log:    SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::log (arg (0)));
+            case IntrinsicType::log10:  SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::log10 (arg (0)));
+            case IntrinsicType::sin:    SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::sin (arg (0)));
+            case IntrinsicType::cos:    SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::cos (arg (0)));
+            case IntrinsicType::tan:    SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::tan (arg (0)));
+            case IntrinsicType::sinh:   SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::sinh (arg (0)));
+            case IntrinsicType::cosh:   SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::cosh (arg (0)));
+            case IntrinsicType::tanh:   SOUL_ASSERT (args.size() == 1); return Value (FastIntrinsics::tanh (arg (0)));
+            default:                    return {};
+        }
+    }
 }
 
-Value performIntrinsic (IntrinsicType i, ArrayView<Value> args)
+Value performIntrinsic (IntrinsicType i, ArrayView<Value> args, bool useFastMaths)
 {
     auto argType = args.front().getType();
 
@@ -149,7 +170,15 @@ Value performIntrinsic (IntrinsicType i, ArrayView<Value> args)
     for (auto& a : args)
         castArgs.push_back (a.castToTypeExpectingSuccess (argType));
 
-    auto result = CompileTimeIntrinsicEvaluation::perform (i, castArgs, argType.isFloatingPoint());
+    Value result;
+
+    // The approximations are evaluated at the argument's own precision, because that's
+    // what the runtime versions will do
+    if (useFastMaths && argType.isFloat32())       result = CompileTimeIntrinsicEvaluation::performFast<float>  (i, castArgs);
+    else if (useFastMaths && argType.isFloat64())  result = CompileTimeIntrinsicEvaluation::performFast<double> (i, castArgs);
+
+    if (! result.isValid())
+        result = CompileTimeIntrinsicEvaluation::perform (i, castArgs, argType.isFloatingPoint());
 
     if (! result.isValid())
         return {};
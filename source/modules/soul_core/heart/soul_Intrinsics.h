@@ -62,8 +62,11 @@ namespace soul
         readLinearInterpolated
     };
 
-    /** Used for compile-time evaluation of an intrinsic function */
-    Value performIntrinsic (IntrinsicType, ArrayView<Value> args);
+    /** Used for compile-time evaluation of an intrinsic function. If useFastMaths is set, the
+        functions which FastIntrinsics approximates are evaluated with those approximations, to
+        match the results that a program built with BuildSettings::useFastMaths will produce.
+    */
+    Value performIntrinsic (IntrinsicType, ArrayView<Value> args, bool useFastMaths = false);
 
     /** All intrinsics have function declarations in a dedicated namespace with this name. */
     constexpr const char* getIntrinsicsNamespaceName()              { return "soul::intrinsics"; }
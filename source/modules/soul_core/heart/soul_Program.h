@@ -55,6 +55,20 @@ public:
     */
     static Program createFromHEART (CompileMessageList&, CodeLocation heartCode);
 
+    /** Creates a compact binary representation of this program, which can be loaded
+        much more quickly than HEART code. The format is only readable by builds with the
+        same format version and pointer size.
+        @see createFromBinary()
+    */
+    std::vector<uint8_t> toBinary() const;
+
+    /** Converts a block of data that was created by toBinary() back to a Program.
+        If the data is malformed or from an incompatible version, this adds an error to
+        the message list and returns an empty program.
+        @see toBinary()
+    */
+    static Program createFromBinary (CompileMessageList&, const void* data, size_t size);
+
     //==============================================================================
     /** Return true if the program contains no modules. */
     bool isEmpty() const;
@@ -92,7 +106,10 @@ public:
     /** Looks for a variable with a (fully-qualified) name. */
     pool_ptr<heart::Variable> findVariableWithName (const std::string& name) const;
 
-    /** Generates a repeatable hash code for the complete state of this program. */
+    /** Generates a repeatable 128-bit hash code for the complete state of this program.
+        This walks the program's structure directly rather than printing it, so it's cheap
+        enough to use as a cache key each time a program is loaded.
+    */
     std::string getHash() const;
 
     /** Provides access to the program's string dictionary */
@@ -72,6 +72,7 @@ struct heart
 
     struct Parser;
     struct Printer;
+    struct BinaryFormat;
     struct Checker;
     struct Utilities;
 
@@ -79,6 +80,7 @@ struct heart
     static constexpr const char* getUserInitFunctionName()          { return "init"; }
     static constexpr const char* getSystemInitFunctionName()        { return "_initialise"; }
     static constexpr const char* getGenericSpecialisationNameTag()  { return "_specialised"; }
+    static constexpr const char* getVectorisedRunFunctionName()     { return "_run_vectorised"; }
 
     static bool isReservedFunctionName (const std::string& name)
     {
@@ -277,6 +279,8 @@ struct heart
         ClockMultiplier (const ClockMultiplier& c) : multiplier (c.multiplier), divider (c.divider) {}
 
         bool hasValue() const         { return multiplier.has_value() || divider.has_value(); }
+        std::optional<int64_t> getMultiplier() const  { return multiplier; }
+        std::optional<int64_t> getDivider() const     { return divider; }
         double getRatio() const       { return static_cast<double> (multiplier.value_or (1)) / static_cast<double> (divider.value_or (1)); }
 
         std::string toString() const
@@ -1030,13 +1034,13 @@ struct heart
             condition->visitExpressions (fn, AccessType::read);
             fn (condition, AccessType::read);
 
-            for (auto arg : targetArgs[0])
+            for (auto& arg : targetArgs[0])
             {
                 arg->visitExpressions (fn, AccessType::read);
                 fn (arg, AccessType::read);
             }
 
-            for (auto arg : targetArgs[1])
+            for (auto& arg : targetArgs[1])
             {
                 arg->visitExpressions (fn, AccessType::read);
                 fn (arg, AccessType::read);
@@ -0,0 +1,1434 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Reads and writes a compact binary form of a Program.
+
+    This holds the same information as the HEART text (apart from source code locations),
+    but objects refer to each other by index rather than by name, and values are stored as
+    their packed bytes, so it can be loaded in a single pass without any tokenising or
+    name lookups. The data is only portable between builds which use the same format
+    version and pointer size, because unsized array handles are stored as pointer-sized
+    values.
+
+    The layout is:
+      - a header
+      - the string dictionary
+      - each module's kind, names and properties, with the names of its structs and functions
+      - the members of every struct
+      - the constant table
+      - every module's state variables
+      - every module's endpoints, nodes, connections and function bodies
+    Declarations come before any bodies, so that a body can refer to anything in the program.
+*/
+struct heart::BinaryFormat
+{
+    static std::vector<uint8_t> write (const Program& program)
+    {
+        Writer<ByteArrayOutput> w (program);
+        w.writeProgram();
+        return std::move (w.output.data);
+    }
+
+    /** Returns a 128-bit hash of the same stream that write() would produce, without
+        actually building it. Constants are hashed as their raw bytes.
+    */
+    static std::string getHash (const Program& program)
+    {
+        Writer<HashBuilder128> w (program);
+        w.writeProgram();
+        return w.output.toString();
+    }
+
+    /** Throws an invalidBinaryProgram error if the data isn't something that write() created. */
+    static Program read (const void* data, size_t size)
+    {
+        try
+        {
+            Reader r (static_cast<const uint8_t*> (data), size);
+            return r.readProgram();
+        }
+        catch (const Reader::MalformedData&) {}
+
+        soul::throwError (Errors::invalidBinaryProgram());
+    }
+
+private:
+    static constexpr uint32_t magicNumber = 0x54524548; // "HERT"
+    static constexpr uint32_t formatVersion = 1;
+
+    enum class ModuleKind : uint8_t  { processor, graph, namespace_ };
+
+    enum class TypeKind : uint8_t
+    {
+        invalid, primitive, vector, array, wrap, clamp, structure, stringLiteral
+    };
+
+    static constexpr uint8_t constFlag = 0x40, referenceFlag = 0x80;
+
+    enum class ExpressionKind : uint8_t
+    {
+        none, constant, stateVariable, localVariable, newLocalVariable, arrayElement,
+        structElement, typeCast, unaryOperator, binaryOperator, pureFunctionCall, processorProperty
+    };
+
+    enum class StatementKind : uint8_t
+    {
+        assignFromValue, functionCall, readStream, writeStream, advanceClock,
+        branch, branchIf, returnVoid, returnValue
+    };
+
+    //==============================================================================
+    struct ByteArrayOutput
+    {
+        std::vector<uint8_t> data;
+
+        void addBytes (const void* source, size_t size)
+        {
+            auto start = static_cast<const uint8_t*> (source);
+            data.insert (data.end(), start, start + size);
+        }
+    };
+
+    template <typename Output>
+    struct Writer
+    {
+        Writer (const Program& p) : program (p) {}
+
+        const Program& program;
+        Output output;
+
+        struct ItemIndex
+        {
+            uint32_t module, item;
+        };
+
+        std::unordered_map<const Structure*, ItemIndex> structIndexes;
+        std::unordered_map<const heart::Function*, ItemIndex> functionIndexes;
+        std::unordered_map<const heart::Variable*, ItemIndex> stateVariableIndexes;
+
+        // These are reset for each function
+        std::unordered_map<const heart::Variable*, uint32_t> localVariableIndexes;
+        std::unordered_map<const heart::Block*, uint32_t> blockIndexes;
+
+        //==============================================================================
+        void writeProgram()
+        {
+            writeRaw (magicNumber);
+            writeUInt (formatVersion);
+            writeUInt (static_cast<uint64_t> (getHEARTFormatVersion()));
+            writeUInt (sizeof (void*));
+
+            auto& modules = program.getModules();
+
+            for (uint32_t i = 0; i < modules.size(); ++i)
+            {
+                auto& m = modules[i].get();
+
+                for (uint32_t j = 0; j < m.structs.size(); ++j)         structIndexes[m.structs.get()[j].get()] = { i, j };
+                for (uint32_t j = 0; j < m.functions.size(); ++j)       functionIndexes[m.functions.get()[j].getPointer()] = { i, j };
+                for (uint32_t j = 0; j < m.stateVariables.size(); ++j)  stateVariableIndexes[m.stateVariables.get()[j].getPointer()] = { i, j };
+            }
+
+            writeStringDictionary (program.getStringDictionary());
+            writeUInt (modules.size());
+
+            for (auto& m : modules)
+                writeModuleDeclaration (m);
+
+            for (auto& m : modules)
+                for (auto& s : m->structs.get())
+                    writeStructMembers (*s);
+
+            writeUInt (program.getConstantTable().size());
+
+            for (auto& item : program.getConstantTable())
+            {
+                writeInt (item.handle);
+                writeValue (*item.value);
+            }
+
+            for (auto& m : modules)
+            {
+                writeUInt (m->stateVariables.size());
+
+                for (auto& v : m->stateVariables.get())
+                    writeVariableDeclaration (v);
+            }
+
+            for (auto& m : modules)
+                writeModuleBody (m);
+        }
+
+        //==============================================================================
+        template <typename Type>
+        void writeRaw (Type v)
+        {
+            static_assert (std::is_trivially_copyable<Type>::value);
+            output.addBytes (std::addressof (v), sizeof (Type));
+        }
+
+        void writeByte (uint8_t b)      { output.addBytes (std::addressof (b), 1); }
+        void writeBool (bool b)         { writeByte (b ? 1 : 0); }
+
+        void writeUInt (uint64_t n)
+        {
+            while (n >= 0x80)
+            {
+                writeByte (static_cast<uint8_t> (n | 0x80));
+                n >>= 7;
+            }
+
+            writeByte (static_cast<uint8_t> (n));
+        }
+
+        void writeInt (int64_t n)
+        {
+            writeUInt ((static_cast<uint64_t> (n) << 1) ^ static_cast<uint64_t> (n >> 63));
+        }
+
+        void writeBytes (const void* source, size_t size)
+        {
+            writeUInt (size);
+            output.addBytes (source, size);
+        }
+
+        void writeString (std::string_view s)   { writeBytes (s.data(), s.length()); }
+
+        void writeIdentifier (Identifier i)
+        {
+            writeBool (i.isValid());
+
+            if (i.isValid())
+                writeString (i.toString());
+        }
+
+        template <typename IntType>
+        void writeOptional (const std::optional<IntType>& value)
+        {
+            writeBool (value.has_value());
+
+            if (value.has_value())
+                writeInt (static_cast<int64_t> (*value));
+        }
+
+        void writeStringDictionary (const StringDictionary& d)
+        {
+            writeUInt (d.getItems().size());
+
+            for (auto& s : d.getItems())
+            {
+                writeUInt (s.handle.handle);
+                writeString (s.text);
+            }
+        }
+
+        //==============================================================================
+        void writeType (const Type& t)
+        {
+            auto flags = static_cast<uint8_t> ((t.isConst() ? constFlag : 0) | (t.isReference() ? referenceFlag : 0));
+            auto writeKind = [&] (TypeKind k)  { writeByte (static_cast<uint8_t> (static_cast<uint8_t> (k) | flags)); };
+
+            if (! t.isValid())          return writeKind (TypeKind::invalid);
+            if (t.isStringLiteral())    return writeKind (TypeKind::stringLiteral);
+
+            if (t.isArray())
+            {
+                writeKind (TypeKind::array);
+                writeType (t.getArrayElementType().removeReferenceIfPresent().removeConstIfPresent());
+                writeUInt (t.isUnsizedArray() ? 0 : t.getArraySize());
+                return;
+            }
+
+            if (t.isStruct())
+            {
+                auto index = structIndexes.find (t.getStruct().get());
+                SOUL_ASSERT (index != structIndexes.end());
+                writeKind (TypeKind::structure);
+                writeUInt (index->second.module);
+                writeUInt (index->second.item);
+                return;
+            }
+
+            if (t.isBoundedInt())
+            {
+                writeKind (t.isWrapped() ? TypeKind::wrap : TypeKind::clamp);
+                writeUInt (static_cast<uint64_t> (t.getBoundedIntLimit()));
+                return;
+            }
+
+            if (t.isVector())
+            {
+                writeKind (TypeKind::vector);
+                writeByte (static_cast<uint8_t> (t.getVectorElementType().type));
+                writeUInt (t.getVectorSize());
+                return;
+            }
+
+            writeKind (TypeKind::primitive);
+            writeByte (static_cast<uint8_t> (t.getPrimitiveType().type));
+        }
+
+        void writeTypes (ArrayView<Type> types)
+        {
+            writeUInt (types.size());
+
+            for (auto& t : types)
+                writeType (t);
+        }
+
+        void writeValue (const Value& v)
+        {
+            writeType (v.getType());
+
+            if (v.isValid())
+                writeBytes (v.getPackedData(), v.getPackedDataSize());
+        }
+
+        void writeAnnotation (const Annotation& a)
+        {
+            writeStringDictionary (a.getDictionary());
+            auto names = a.getNames();
+            writeUInt (names.size());
+
+            for (auto& name : names)
+            {
+                writeString (name);
+                writeValue (a.getValue (name));
+            }
+        }
+
+        //==============================================================================
+        void writeModuleDeclaration (const Module& m)
+        {
+            writeByte (static_cast<uint8_t> (m.isProcessor() ? ModuleKind::processor
+                                                             : (m.isGraph() ? ModuleKind::graph : ModuleKind::namespace_)));
+            writeString (m.shortName);
+            writeString (m.fullName);
+            writeString (m.originalFullName);
+            writeAnnotation (m.annotation);
+            writeRaw (m.sampleRate);
+            writeUInt (m.latency);
+
+            writeUInt (m.structs.size());
+
+            for (auto& s : m.structs.get())
+                writeString (s->getName());
+
+            writeUInt (m.functions.size());
+
+            for (auto& f : m.functions.get())
+            {
+                writeIdentifier (f->name);
+                writeBool (f->functionType.isEvent());
+            }
+        }
+
+        void writeStructMembers (const Structure& s)
+        {
+            writeUInt (s.getNumMembers());
+
+            for (auto& m : s.getMembers())
+            {
+                writeType (m.type);
+                writeString (m.name);
+            }
+        }
+
+        void writeVariableDeclaration (const heart::Variable& v)
+        {
+            writeType (v.type);
+            writeIdentifier (v.name);
+            writeByte (static_cast<uint8_t> (v.role));
+            writeAnnotation (v.annotation);
+            writeInt (v.externalHandle);
+        }
+
+        void writeEndpoint (const heart::IODeclaration& io)
+        {
+            writeIdentifier (io.name);
+            writeUInt (io.index);
+            writeByte (static_cast<uint8_t> (io.endpointType));
+            writeTypes (io.dataTypes);
+            writeOptional (io.arraySize);
+            writeAnnotation (io.annotation);
+        }
+
+        void writeEndpointReference (const Module& m, const heart::EndpointReference& e)
+        {
+            if (e.processor == nullptr)
+                writeUInt (0);
+            else
+                writeUInt (1 + indexOf (m.processorInstances, *e.processor));
+
+            writeString (e.endpointName);
+            writeOptional (e.endpointIndex);
+        }
+
+        void writeModuleBody (const Module& m)
+        {
+            writeUInt (m.inputs.size());
+
+            for (auto& io : m.inputs)
+                writeEndpoint (io);
+
+            writeUInt (m.outputs.size());
+
+            for (auto& io : m.outputs)
+                writeEndpoint (io);
+
+            writeUInt (m.processorInstances.size());
+
+            for (auto& p : m.processorInstances)
+            {
+                writeString (p->instanceName);
+                writeString (p->sourceName);
+                writeUInt (p->arraySize);
+                writeOptional (p->clockMultiplier.getMultiplier());
+                writeOptional (p->clockMultiplier.getDivider());
+            }
+
+            writeUInt (m.connections.size());
+
+            for (auto& c : m.connections)
+            {
+                writeEndpointReference (m, c->source);
+                writeEndpointReference (m, c->dest);
+                writeByte (static_cast<uint8_t> (c->interpolationType));
+                writeOptional (c->delayLength);
+            }
+
+            for (auto& v : m.stateVariables.get())
+                writeOptionalExpression (v->initialValue);
+
+            for (auto& f : m.functions.get())
+                writeFunction (m, f);
+        }
+
+        //==============================================================================
+        void writeFunction (const Module& m, const heart::Function& f)
+        {
+            localVariableIndexes.clear();
+            blockIndexes.clear();
+
+            writeType (f.returnType);
+            writeByte (static_cast<uint8_t> (f.functionType.type));
+            writeUInt (static_cast<uint32_t> (f.intrinsicType));
+            writeBool (f.isExported);
+            writeBool (f.hasNoBody);
+            writeAnnotation (f.annotation);
+            writeParameters (f.parameters);
+
+            writeUInt (f.blocks.size());
+
+            for (uint32_t i = 0; i < f.blocks.size(); ++i)
+            {
+                auto& b = f.blocks[i].get();
+                blockIndexes[std::addressof (b)] = i;
+                writeIdentifier (b.name);
+            }
+
+            for (auto& b : f.blocks)
+            {
+                writeParameters (b->parameters);
+
+                for (auto s : b->statements)
+                    writeStatement (m, *s);
+
+                SOUL_ASSERT (b->isTerminated());
+                writeTerminator (*b->terminator);
+            }
+        }
+
+        void writeParameters (ArrayView<pool_ref<heart::Variable>> params)
+        {
+            writeUInt (params.size());
+
+            for (auto& p : params)
+                writeNewLocalVariable (p);
+        }
+
+        void writeNewLocalVariable (const heart::Variable& v)
+        {
+            localVariableIndexes[std::addressof (v)] = static_cast<uint32_t> (localVariableIndexes.size());
+            writeVariableDeclaration (v);
+        }
+
+        void writeArguments (ArrayView<pool_ref<heart::Expression>> args)
+        {
+            writeUInt (args.size());
+
+            for (auto& a : args)
+                writeExpression (a);
+        }
+
+        void writeStatementKind (StatementKind k)    { writeByte (static_cast<uint8_t> (k)); }
+
+        void writeStatement (const Module& m, const heart::Statement& s)
+        {
+            if (auto a = cast<const heart::AssignFromValue> (s))
+            {
+                writeStatementKind (StatementKind::assignFromValue);
+                writeOptionalExpression (a->target);
+                return writeExpression (a->source);
+            }
+
+            if (auto fc = cast<const heart::FunctionCall> (s))
+            {
+                writeStatementKind (StatementKind::functionCall);
+                writeOptionalExpression (fc->target);
+                writeFunctionReference (fc->getFunction());
+                return writeArguments (fc->arguments);
+            }
+
+            if (auto r = cast<const heart::ReadStream> (s))
+            {
+                writeStatementKind (StatementKind::readStream);
+                writeOptionalExpression (r->target);
+                writeUInt (indexOf (m.inputs, r->source.get()));
+                return writeOptionalExpression (r->element);
+            }
+
+            if (auto w = cast<const heart::WriteStream> (s))
+            {
+                writeStatementKind (StatementKind::writeStream);
+                writeUInt (indexOf (m.outputs, w->target.get()));
+                writeOptionalExpression (w->element);
+                return writeExpression (w->value);
+            }
+
+            SOUL_ASSERT (is_type<const heart::AdvanceClock> (s));
+            writeStatementKind (StatementKind::advanceClock);
+        }
+
+        void writeTerminator (const heart::Terminator& t)
+        {
+            if (auto b = cast<const heart::Branch> (t))
+            {
+                writeStatementKind (StatementKind::branch);
+                writeUInt (blockIndexes[b->target.getPointer()]);
+                return writeArguments (b->targetArgs);
+            }
+
+            if (auto b = cast<const heart::BranchIf> (t))
+            {
+                writeStatementKind (StatementKind::branchIf);
+                writeExpression (b->condition);
+
+                for (int i = 0; i < 2; ++i)
+                {
+                    writeUInt (blockIndexes[b->targets[i].getPointer()]);
+                    writeArguments (b->targetArgs[i]);
+                }
+
+                return;
+            }
+
+            if (auto r = cast<const heart::ReturnValue> (t))
+            {
+                writeStatementKind (StatementKind::returnValue);
+                return writeExpression (r->returnValue);
+            }
+
+            SOUL_ASSERT (is_type<const heart::ReturnVoid> (t));
+            writeStatementKind (StatementKind::returnVoid);
+        }
+
+        void writeFunctionReference (const heart::Function& f)
+        {
+            auto index = functionIndexes.find (std::addressof (f));
+            SOUL_ASSERT (index != functionIndexes.end());
+            writeUInt (index->second.module);
+            writeUInt (index->second.item);
+        }
+
+        //==============================================================================
+        void writeExpressionKind (ExpressionKind k)    { writeByte (static_cast<uint8_t> (k)); }
+
+        void writeOptionalExpression (pool_ptr<heart::Expression> e)
+        {
+            if (e == nullptr)
+                return writeExpressionKind (ExpressionKind::none);
+
+            writeExpression (*e);
+        }
+
+        void writeExpression (const heart::Expression& e)
+        {
+            if (auto c = cast<const heart::Constant> (e))
+            {
+                writeExpressionKind (ExpressionKind::constant);
+                return writeValue (c->value);
+            }
+
+            if (auto v = cast<const heart::Variable> (e))
+            {
+                if (v->isState())
+                {
+                    auto index = stateVariableIndexes.find (v.get());
+                    SOUL_ASSERT (index != stateVariableIndexes.end());
+                    writeExpressionKind (ExpressionKind::stateVariable);
+                    writeUInt (index->second.module);
+                    writeUInt (index->second.item);
+                    return;
+                }
+
+                auto index = localVariableIndexes.find (v.get());
+
+                if (index != localVariableIndexes.end())
+                {
+                    writeExpressionKind (ExpressionKind::localVariable);
+                    writeUInt (index->second);
+                    return;
+                }
+
+                writeExpressionKind (ExpressionKind::newLocalVariable);
+                return writeNewLocalVariable (*v);
+            }
+
+            if (auto a = cast<const heart::ArrayElement> (e))
+            {
+                writeExpressionKind (ExpressionKind::arrayElement);
+                writeExpression (a->parent);
+                writeOptionalExpression (a->dynamicIndex);
+                writeUInt (a->fixedStartIndex);
+                writeUInt (a->fixedEndIndex);
+                writeBool (a->isRangeTrusted);
+                writeBool (a->suppressWrapWarning);
+                return;
+            }
+
+            if (auto s = cast<const heart::StructElement> (e))
+            {
+                writeExpressionKind (ExpressionKind::structElement);
+                writeExpression (s->parent);
+                return writeString (s->memberName);
+            }
+
+            if (auto c = cast<const heart::TypeCast> (e))
+            {
+                writeExpressionKind (ExpressionKind::typeCast);
+                writeExpression (c->source);
+                return writeType (c->destType);
+            }
+
+            if (auto u = cast<const heart::UnaryOperator> (e))
+            {
+                writeExpressionKind (ExpressionKind::unaryOperator);
+                writeExpression (u->source);
+                return writeByte (static_cast<uint8_t> (u->operation));
+            }
+
+            if (auto b = cast<const heart::BinaryOperator> (e))
+            {
+                writeExpressionKind (ExpressionKind::binaryOperator);
+                writeExpression (b->lhs);
+                writeExpression (b->rhs);
+                return writeByte (static_cast<uint8_t> (b->operation));
+            }
+
+            if (auto fc = cast<const heart::PureFunctionCall> (e))
+            {
+                writeExpressionKind (ExpressionKind::pureFunctionCall);
+                writeFunctionReference (fc->function);
+                return writeArguments (fc->arguments);
+            }
+
+            auto pp = cast<const heart::ProcessorProperty> (e);
+            SOUL_ASSERT (pp != nullptr);
+            writeExpressionKind (ExpressionKind::processorProperty);
+            writeByte (static_cast<uint8_t> (pp->property));
+        }
+
+        template <typename ListType, typename ItemType>
+        static uint32_t indexOf (const ListType& list, const ItemType& item)
+        {
+            for (uint32_t i = 0; i < list.size(); ++i)
+                if (list[i].getPointer() == std::addressof (item))
+                    return i;
+
+            SOUL_ASSERT_FALSE;
+            return 0;
+        }
+    };
+
+    //==============================================================================
+    struct Reader
+    {
+        Reader (const uint8_t* d, size_t size)  : data (d), end (d + size) {}
+
+        struct MalformedData {};
+
+        const uint8_t* data;
+        const uint8_t* const end;
+
+        Program program;
+        std::vector<pool_ref<Module>> modules;
+
+        // These are reset for each function
+        std::vector<pool_ref<heart::Variable>> localVariables;
+        std::vector<pool_ref<heart::Block>> blocks;
+
+        //==============================================================================
+        Program readProgram()
+        {
+            check (readRaw<uint32_t>() == magicNumber
+                    && readUInt() == formatVersion
+                    && readUInt() == static_cast<uint64_t> (getHEARTFormatVersion())
+                    && readUInt() == sizeof (void*));
+
+            readStringDictionary (program.getStringDictionary());
+
+            auto numModules = readCount();
+            modules.reserve (numModules);
+
+            for (size_t i = 0; i < numModules; ++i)
+                readModuleDeclaration();
+
+            for (auto& m : modules)
+                for (auto& s : m->structs.get())
+                    readStructMembers (*s);
+
+            auto& constants = program.getConstantTable();
+            ConstantTable::Handle lastHandle = 0;
+
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto handle = static_cast<ConstantTable::Handle> (readInt());
+                check (handle > lastHandle);
+                lastHandle = handle;
+                constants.addItem ({ handle, std::make_unique<Value> (readValue (program.getStringDictionary())) });
+            }
+
+            for (auto& m : modules)
+                readStateVariables (m);
+
+            for (auto& m : modules)
+                readModuleBody (m);
+
+            for (auto& m : modules)
+                for (auto& f : m->functions.get())
+                    checkFunctionBody (f);
+
+            check (data == end);
+            return std::move (program);
+        }
+
+        //==============================================================================
+        static void check (bool condition)
+        {
+            if (! condition)
+                throw MalformedData();
+        }
+
+        template <typename Type>
+        Type readRaw()
+        {
+            static_assert (std::is_trivially_copyable<Type>::value);
+            check (static_cast<size_t> (end - data) >= sizeof (Type));
+            auto v = readUnaligned<Type> (data);
+            data += sizeof (Type);
+            return v;
+        }
+
+        uint8_t readByte()      { check (data < end); return *data++; }
+        bool readBool()         { return readByte() != 0; }
+
+        uint64_t readUInt()
+        {
+            uint64_t n = 0;
+
+            for (uint32_t shift = 0; shift < 64; shift += 7)
+            {
+                auto b = readByte();
+                n |= static_cast<uint64_t> (b & 0x7f) << shift;
+
+                if ((b & 0x80) == 0)
+                    return n;
+            }
+
+            throw MalformedData();
+        }
+
+        int64_t readInt()
+        {
+            auto n = readUInt();
+            return static_cast<int64_t> (n >> 1) ^ -static_cast<int64_t> (n & 1);
+        }
+
+        /** Reads a number of items, which can't be more than the number of bytes left. */
+        size_t readCount()
+        {
+            auto n = readUInt();
+            check (n <= static_cast<uint64_t> (end - data));
+            return static_cast<size_t> (n);
+        }
+
+        uint32_t readIndex (size_t limit)
+        {
+            auto n = readUInt();
+            check (n < limit);
+            return static_cast<uint32_t> (n);
+        }
+
+        std::string_view readString()
+        {
+            auto length = readCount();
+            auto start = reinterpret_cast<const char*> (data);
+            data += length;
+            auto s = std::string_view (start, length);
+            check (isValidUTF8 (s));
+            return s;
+        }
+
+        /** Strings end up being iterated by code that assumes they've already been validated,
+            so this is stricter than choc::text::findInvalidUTF8Data, which can itself trip over
+            a sequence that's truncated by bad continuation bytes.
+        */
+        static bool isValidUTF8 (std::string_view s)
+        {
+            for (size_t i = 0; i < s.length();)
+            {
+                auto byte = static_cast<uint8_t> (s[i++]);
+
+                if (byte < 0x80)
+                    continue;
+
+                if (byte < 0xc0 || byte >= 0xf8)
+                    return false;
+
+                auto numExtraBytes = byte >= 0xf0 ? 3u : (byte >= 0xe0 ? 2u : 1u);
+
+                if (i + numExtraBytes > s.length())
+                    return false;
+
+                for (; numExtraBytes > 0; --numExtraBytes)
+                    if ((static_cast<uint8_t> (s[i++]) & 0xc0) != 0x80)
+                        return false;
+            }
+
+            return true;
+        }
+
+        Identifier readIdentifier()
+        {
+            if (readBool())
+            {
+                auto name = readString();
+                check (! name.empty());
+                return program.getAllocator().get (name);
+            }
+
+            return {};
+        }
+
+        template <typename IntType>
+        std::optional<IntType> readOptional()
+        {
+            if (readBool())
+                return static_cast<IntType> (readInt());
+
+            return {};
+        }
+
+        template <typename EnumType>
+        EnumType readEnum (EnumType limit)
+        {
+            auto n = readByte();
+            check (n <= static_cast<uint8_t> (limit));
+            return static_cast<EnumType> (n);
+        }
+
+        void readStringDictionary (StringDictionary& d)
+        {
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto handle = readUInt();
+                check (d.getHandleForString (readString()).handle == handle);
+            }
+        }
+
+        //==============================================================================
+        Type readType()
+        {
+            auto byte = readByte();
+            auto isConst = (byte & constFlag) != 0;
+            auto isRef = (byte & referenceFlag) != 0;
+            auto kind = static_cast<TypeKind> (byte & ~(constFlag | referenceFlag));
+            Type t;
+
+            switch (kind)
+            {
+                case TypeKind::invalid:         return {};
+                case TypeKind::stringLiteral:   t = Type::createStringLiteral(); break;
+                case TypeKind::primitive:       t = Type (readPrimitive()); break;
+
+                case TypeKind::vector:
+                {
+                    auto element = readPrimitive();
+                    auto size = readUInt();
+                    check (element.canBeVectorElementType() && Type::isLegalVectorSize (static_cast<int64_t> (size)));
+                    t = Type::createVector (element, static_cast<Type::ArraySize> (size));
+                    break;
+                }
+
+                case TypeKind::array:
+                {
+                    auto element = readType();
+                    auto size = readUInt();
+                    check (element.canBeArrayElementType() && size < Type::maxArraySize);
+                    t = element.createArray (static_cast<Type::ArraySize> (size));
+                    break;
+                }
+
+                case TypeKind::wrap:
+                case TypeKind::clamp:
+                {
+                    auto limit = readUInt();
+                    check (Type::isLegalBoundedIntSize (limit));
+                    t = kind == TypeKind::wrap ? Type::createWrappedInt (static_cast<Type::BoundedIntSize> (limit))
+                                               : Type::createClampedInt (static_cast<Type::BoundedIntSize> (limit));
+                    break;
+                }
+
+                case TypeKind::structure:
+                {
+                    auto& m = modules[readIndex (modules.size())].get();
+                    t = Type::createStruct (*m.structs.get()[readIndex (m.structs.size())]);
+                    break;
+                }
+
+                default:
+                    throw MalformedData();
+            }
+
+            return t.withConstAndRefFlags (isConst, isRef);
+        }
+
+        PrimitiveType readPrimitive()
+        {
+            auto p = readEnum (PrimitiveType::bool_);
+            check (p != PrimitiveType::invalid);
+            return PrimitiveType (p);
+        }
+
+        std::vector<Type> readTypes()
+        {
+            std::vector<Type> types;
+            types.resize (readCount());
+
+            for (auto& t : types)
+                t = readType();
+
+            return types;
+        }
+
+        /** Reads a value whose string literals must all be handles in the given dictionary. */
+        Value readValue (const StringDictionary& strings)
+        {
+            auto type = readType();
+
+            if (! type.isValid())
+                return {};
+
+            check (! type.isVoid());
+            auto size = readCount();
+            check (size == type.getPackedSizeInBytes());
+            auto v = Value::createFromRawData (std::move (type), data, size);
+            data += size;
+
+            StringHandleChecker checker (strings);
+            v.print (checker);
+            return v;
+        }
+
+        struct StringHandleChecker  : public ValuePrinter
+        {
+            StringHandleChecker (const StringDictionary& d) : strings (d.getItems()) {}
+
+            void printStringLiteral (StringDictionary::Handle h) override
+            {
+                if (h != StringDictionary::Handle())
+                    check (std::binary_search (strings.begin(), strings.end(), StringDictionary::Item { h, {} },
+                                               [] (auto& a, auto& b) { return a.handle.handle < b.handle.handle; }));
+            }
+
+            void printUnsizedArrayContent (const Type&, const void*) override {}
+            void print (std::string_view) override {}
+
+            const std::vector<StringDictionary::Item>& strings;
+        };
+
+        Annotation readAnnotation()
+        {
+            StringDictionary strings;
+            readStringDictionary (strings);
+            Annotation a;
+
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto name = std::string (readString());
+                check (! name.empty());
+                a.set (name, readValue (strings), strings);
+            }
+
+            return a;
+        }
+
+        //==============================================================================
+        void readModuleDeclaration()
+        {
+            auto kind = readEnum (ModuleKind::namespace_);
+            auto& m = kind == ModuleKind::processor ? program.addProcessor()
+                                                    : (kind == ModuleKind::graph ? program.addGraph() : program.addNamespace());
+            modules.push_back (m);
+
+            m.shortName = readString();
+            m.fullName = readString();
+            m.originalFullName = readString();
+            m.annotation = readAnnotation();
+            m.sampleRate = readRaw<double>();
+            m.latency = static_cast<uint32_t> (readUInt());
+
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto name = std::string (readString());
+                check (! name.empty() && ! containsChar (name, '#') && m.structs.find (name) == nullptr);
+                m.structs.add (std::move (name));
+            }
+
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto name = readIdentifier();
+                auto isEvent = readBool();
+                check (name.isValid() && m.functions.find (name) == nullptr);
+                check (! (isEvent && heart::isReservedFunctionName (name)));
+                m.functions.add (name, isEvent);
+            }
+        }
+
+        void readStructMembers (Structure& s)
+        {
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto type = readType();
+                auto name = std::string (readString());
+                check (type.isValid() && ! type.isVoid() && ! name.empty() && ! s.hasMemberWithName (name));
+                s.addMember (std::move (type), std::move (name));
+            }
+        }
+
+        heart::Variable& readVariableDeclaration (Module& m)
+        {
+            auto type = readType();
+            auto name = readIdentifier();
+            auto role = readEnum (heart::Variable::Role::external);
+
+            auto& v = name.isValid() ? m.allocate<heart::Variable> (CodeLocation(), std::move (type), name, role)
+                                     : m.allocate<heart::Variable> (CodeLocation(), std::move (type), role);
+
+            v.annotation = readAnnotation();
+            v.externalHandle = static_cast<ConstantTable::Handle> (readInt());
+            return v;
+        }
+
+        void readStateVariables (Module& m)
+        {
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto& v = readVariableDeclaration (m);
+                check (v.isState() && v.name.isValid() && m.stateVariables.find (v.name.toString()) == nullptr);
+                m.stateVariables.add (v);
+            }
+        }
+
+        template <typename IODeclarationType>
+        void readEndpoints (Module& m, std::vector<pool_ref<IODeclarationType>>& list)
+        {
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto& io = m.allocate<IODeclarationType> (CodeLocation());
+                io.name = readIdentifier();
+                io.index = static_cast<uint32_t> (readUInt());
+                io.endpointType = readEnum (EndpointType::event);
+                io.dataTypes = readTypes();
+                io.arraySize = readOptional<uint32_t>();
+                io.annotation = readAnnotation();
+                check (io.name.isValid() && ! heart::isReservedFunctionName (io.name)
+                        && io.endpointType != EndpointType::unknown);
+                list.push_back (io);
+            }
+        }
+
+        void readEndpointReference (Module& m, heart::EndpointReference& e)
+        {
+            if (auto index = readIndex (m.processorInstances.size() + 1))
+                e.processor = m.processorInstances[index - 1];
+
+            e.endpointName = readString();
+            e.endpointIndex = readOptional<size_t>();
+        }
+
+        void readClockRatio (heart::ClockMultiplier& c, bool isMultiplier)
+        {
+            if (auto ratio = readOptional<int64_t>())
+            {
+                check (*ratio >= 1 && *ratio <= 512 && choc::math::isPowerOf2 (*ratio) && ! c.hasValue());
+
+                if (isMultiplier)
+                    c.setMultiplier (CodeLocation(), Value::createInt64 (*ratio));
+                else
+                    c.setDivider (CodeLocation(), Value::createInt64 (*ratio));
+            }
+        }
+
+        void readModuleBody (Module& m)
+        {
+            readEndpoints (m, m.inputs);
+            readEndpoints (m, m.outputs);
+
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto& p = m.allocate<heart::ProcessorInstance> (CodeLocation());
+                p.instanceName = readString();
+                p.sourceName = readString();
+                p.arraySize = static_cast<uint32_t> (readUInt());
+                readClockRatio (p.clockMultiplier, true);
+                readClockRatio (p.clockMultiplier, false);
+                m.processorInstances.push_back (p);
+            }
+
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto& c = m.allocate<heart::Connection> (CodeLocation());
+                readEndpointReference (m, c.source);
+                readEndpointReference (m, c.dest);
+                c.interpolationType = readEnum (InterpolationType::best);
+                c.delayLength = readOptional<int64_t>();
+                m.connections.push_back (c);
+            }
+
+            for (auto& v : m.stateVariables.get())
+                v->initialValue = readOptionalExpression (m);
+
+            for (auto& f : m.functions.get())
+                readFunction (m, f);
+        }
+
+        //==============================================================================
+        void readFunction (Module& m, heart::Function& f)
+        {
+            localVariables.clear();
+            blocks.clear();
+
+            f.returnType = readType();
+            auto functionType = readEnum (heart::FunctionType::Type::intrinsic);
+            check (f.functionType.type == functionType || f.functionType.isNormal() || functionType == heart::FunctionType::Type::normal);
+            f.functionType = heart::FunctionType { functionType };
+            auto intrinsic = readUInt();
+            check (intrinsic <= static_cast<uint64_t> (IntrinsicType::readLinearInterpolated));
+            f.intrinsicType = static_cast<IntrinsicType> (intrinsic);
+            f.isExported = readBool();
+            f.hasNoBody = readBool();
+            f.annotation = readAnnotation();
+
+            for (auto i = readCount(); i > 0; --i)
+                f.parameters.push_back (readNewLocalVariable (m));
+
+            for (auto i = readCount(); i > 0; --i)
+            {
+                auto name = readIdentifier();
+                check (name.isValid() && name.toString()[0] == '@');
+                auto& b = m.allocate<heart::Block> (name);
+                blocks.push_back (b);
+            }
+
+            f.blocks = blocks;
+
+            for (auto& b : f.blocks)
+            {
+                for (auto i = readCount(); i > 0; --i)
+                    b->parameters.push_back (readNewLocalVariable (m));
+
+                LinkedList<heart::Statement>::Iterator last;
+
+                for (;;)
+                {
+                    auto kind = readEnum (StatementKind::returnValue);
+
+                    if (kind >= StatementKind::branch)
+                    {
+                        b->terminator = readTerminator (m, kind);
+                        break;
+                    }
+
+                    last = b->statements.insertAfter (last, readStatement (m, kind));
+                }
+            }
+        }
+
+        /** Checks the things that a body can only get wrong once all the functions it calls
+            have been read: every call must match its target's parameter list, and every
+            local that it uses must be a parameter of the function or of one of its blocks,
+            or a variable which the function assigns to. Anything else would leave later
+            passes like the printer holding a variable with no declaration.
+        */
+        static void checkFunctionBody (heart::Function& f)
+        {
+            f.visitStatements<heart::FunctionCall> ([] (heart::FunctionCall& fc)
+            {
+                check (fc.arguments.size() == fc.getFunction().parameters.size());
+            });
+
+            auto declaredLocals = f.getAllLocalVariables();
+            auto parameters = f.parameters;
+
+            for (auto& b : f.blocks)
+                for (auto& p : b->parameters)
+                    parameters.push_back (p);
+
+            f.visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+            {
+                if (auto fc = cast<heart::PureFunctionCall> (e))
+                    check (fc->arguments.size() == fc->function.parameters.size());
+
+                if (auto v = cast<heart::Variable> (e))
+                {
+                    if (v->isParameter())
+                        check (contains (parameters, v));
+                    else if (v->isFunctionLocal())
+                        check (contains (declaredLocals, v));
+                }
+            });
+        }
+
+        heart::Variable& readNewLocalVariable (Module& m)
+        {
+            auto& v = readVariableDeclaration (m);
+            check (! v.isState());
+            localVariables.push_back (v);
+            return v;
+        }
+
+        template <typename ArgListType>
+        void readArguments (Module& m, ArgListType& args)
+        {
+            for (auto i = readCount(); i > 0; --i)
+                args.push_back (readExpression (m));
+        }
+
+        heart::Block& readBlockReference()
+        {
+            return blocks[readIndex (blocks.size())];
+        }
+
+        heart::Function& readFunctionReference()
+        {
+            auto& m = modules[readIndex (modules.size())].get();
+            return m.functions.at (readIndex (m.functions.size()));
+        }
+
+        heart::Statement& readStatement (Module& m, StatementKind kind)
+        {
+            switch (kind)
+            {
+                case StatementKind::assignFromValue:
+                {
+                    auto target = readOptionalExpression (m);
+                    auto& source = readExpression (m);
+                    check (target != nullptr);
+                    return m.allocate<heart::AssignFromValue> (CodeLocation(), *target, source);
+                }
+
+                case StatementKind::functionCall:
+                {
+                    auto target = readOptionalExpression (m);
+                    auto& fc = m.allocate<heart::FunctionCall> (CodeLocation(), target, readFunctionReference());
+                    readArguments (m, fc.arguments);
+                    return fc;
+                }
+
+                case StatementKind::readStream:
+                {
+                    auto target = readOptionalExpression (m);
+                    auto& source = m.inputs[readIndex (m.inputs.size())].get();
+                    check (target != nullptr);
+                    auto& r = m.allocate<heart::ReadStream> (CodeLocation(), *target, source);
+                    r.element = readOptionalExpression (m);
+                    return r;
+                }
+
+                case StatementKind::writeStream:
+                {
+                    auto& target = m.outputs[readIndex (m.outputs.size())].get();
+                    auto element = readOptionalExpression (m);
+                    auto& value = readExpression (m);
+                    return m.allocate<heart::WriteStream> (CodeLocation(), target, element, value);
+                }
+
+                case StatementKind::advanceClock:
+                    return m.allocate<heart::AdvanceClock> (CodeLocation());
+
+                default:
+                    throw MalformedData();
+            }
+        }
+
+        heart::Terminator& readTerminator (Module& m, StatementKind kind)
+        {
+            switch (kind)
+            {
+                case StatementKind::branch:
+                {
+                    auto& b = m.allocate<heart::Branch> (readBlockReference());
+                    readArguments (m, b.targetArgs);
+                    return b;
+                }
+
+                case StatementKind::branchIf:
+                {
+                    auto& condition = readExpression (m);
+                    auto& trueBlock = readBlockReference();
+                    heart::BranchIf::ArgListType trueArgs;
+                    readArguments (m, trueArgs);
+                    auto& falseBlock = readBlockReference();
+                    check (std::addressof (trueBlock) != std::addressof (falseBlock));
+                    auto& b = m.allocate<heart::BranchIf> (condition, trueBlock, falseBlock);
+                    b.targetArgs[0] = std::move (trueArgs);
+                    readArguments (m, b.targetArgs[1]);
+                    return b;
+                }
+
+                case StatementKind::returnValue:    return m.allocate<heart::ReturnValue> (readExpression (m));
+                case StatementKind::returnVoid:     return m.allocate<heart::ReturnVoid>();
+                default:                            throw MalformedData();
+            }
+        }
+
+        //==============================================================================
+        pool_ptr<heart::Expression> readOptionalExpression (Module& m)
+        {
+            auto kind = readEnum (ExpressionKind::processorProperty);
+
+            if (kind == ExpressionKind::none)
+                return {};
+
+            return readExpression (m, kind);
+        }
+
+        heart::Expression& readExpression (Module& m)
+        {
+            auto e = readOptionalExpression (m);
+            check (e != nullptr);
+            return *e;
+        }
+
+        heart::Expression& readExpression (Module& m, ExpressionKind kind)
+        {
+            switch (kind)
+            {
+                case ExpressionKind::constant:
+                    return m.allocate<heart::Constant> (CodeLocation(), readValue (program.getStringDictionary()));
+
+                case ExpressionKind::stateVariable:
+                {
+                    auto& source = modules[readIndex (modules.size())].get();
+                    return source.stateVariables.get()[readIndex (source.stateVariables.size())];
+                }
+
+                case ExpressionKind::localVariable:
+                    return localVariables[readIndex (localVariables.size())];
+
+                case ExpressionKind::newLocalVariable:
+                    return readNewLocalVariable (m);
+
+                case ExpressionKind::arrayElement:
+                {
+                    auto& parent = readExpression (m);
+                    auto dynamicIndex = readOptionalExpression (m);
+                    auto start = static_cast<size_t> (readUInt());
+                    auto endIndex = static_cast<size_t> (readUInt());
+                    check (parent.getType().isArrayOrVector() && start <= endIndex);
+                    auto& a = m.allocate<heart::ArrayElement> (CodeLocation(), parent, start, endIndex);
+                    a.dynamicIndex = dynamicIndex;
+                    a.isRangeTrusted = readBool();
+                    a.suppressWrapWarning = readBool();
+                    return a;
+                }
+
+                case ExpressionKind::structElement:
+                {
+                    auto& parent = readExpression (m);
+                    auto member = std::string (readString());
+                    check (parent.getType().isStruct() && parent.getType().getStructRef().hasMemberWithName (member));
+                    return m.allocate<heart::StructElement> (CodeLocation(), parent, std::move (member));
+                }
+
+                case ExpressionKind::typeCast:
+                {
+                    auto& source = readExpression (m);
+                    return m.allocate<heart::TypeCast> (CodeLocation(), source, readType());
+                }
+
+                case ExpressionKind::unaryOperator:
+                {
+                    auto& source = readExpression (m);
+                    auto op = readEnum (UnaryOp::Op::bitwiseNot);
+                    check (UnaryOp::isTypeSuitable (op, source.getType()));
+                    return m.allocate<heart::UnaryOperator> (CodeLocation(), source, op);
+                }
+
+                case ExpressionKind::binaryOperator:
+                {
+                    auto& lhs = readExpression (m);
+                    auto& rhs = readExpression (m);
+                    auto op = readEnum (BinaryOp::Op::rightShiftUnsigned);
+                    auto& operandType = lhs.getType();
+                    check (operandType.isEqual (rhs.getType(), Type::ignoreReferences | Type::ignoreConst));
+                    check (BinaryOp::getTypes (op, operandType, operandType).operandType.isEqual (operandType, Type::ignoreReferences | Type::ignoreConst));
+                    return m.allocate<heart::BinaryOperator> (CodeLocation(), lhs, rhs, op);
+                }
+
+                case ExpressionKind::pureFunctionCall:
+                {
+                    auto& fc = m.allocate<heart::PureFunctionCall> (CodeLocation(), readFunctionReference());
+                    readArguments (m, fc.arguments);
+                    return fc;
+                }
+
+                case ExpressionKind::processorProperty:
+                {
+                    auto property = readEnum (heart::ProcessorProperty::Property::latency);
+                    check (property != heart::ProcessorProperty::Property::none);
+                    return m.allocate<heart::ProcessorProperty> (CodeLocation(), property);
+                }
+
+                default:
+                    throw MalformedData();
+            }
+        }
+    };
+};
+
+} // namespace soul
@@ -25,6 +25,7 @@ struct heart::Checker
 {
     static void sanityCheck (const Program& program)
     {
+        SOUL_PROFILE_SCOPE ("heart::Checker::sanityCheck");
         ignoreUnused (program.getMainProcessor());
         sanityCheckModules (program);
         sanityCheckAdvanceAndStreamCalls (program);
@@ -412,9 +413,12 @@ struct heart::Checker
         ignoreUnused (program);
 
        #if SOUL_ENABLE_ASSERTIONS && (SOUL_TEST_HEART_ROUNDTRIP || (SOUL_DEBUG && ! defined (SOUL_TEST_HEART_ROUNDTRIP)))
+        SOUL_PROFILE_SCOPE ("testHEARTRoundTrip");
         auto dump = program.toHEART();
         SOUL_ASSERT (dump == program.clone().toHEART());
         SOUL_ASSERT (dump == heart::Parser::parse (CodeLocation::createFromString ("internal test dump", dump)).toHEART());
+        auto binary = heart::BinaryFormat::write (program);
+        SOUL_ASSERT (dump == heart::BinaryFormat::read (binary.data(), binary.size()).toHEART());
        #endif
     }
 };
@@ -0,0 +1,2706 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Optimisations which track values through a function's control flow.
+
+    Each function is converted to SSA form: every local scalar or vector variable is
+    split into a set of values which are only assigned once, and block parameters are
+    used as the phi-nodes where branches join. Copy propagation, conditional constant
+    propagation, value numbering and dead value removal then run on those values, and
+    the function is converted back to normal HEART afterwards. This is one of the most
+    expensive parts of a link, so it only runs when optimisation level 2 or 3 has been
+    asked for, and not at level 1 or the default level.
+*/
+struct DataflowOptimisations
+{
+    static void optimise (Program& program, const BuildSettings& settings)
+    {
+        if (settings.optimisationLevel < 2)
+            return;
+
+        SOUL_PROFILE_SCOPE ("DataflowOptimisations");
+
+        for (auto& m : program.getModules())
+            for (auto f : m->functions.get())
+                optimise (m, f);
+    }
+
+    static void optimise (Module& module, heart::Function& f)
+    {
+        if (f.blocks.empty())
+            return;
+
+        SSAFunction ssa (module, f);
+
+        if (ssa.convertToSSA())
+        {
+            ssa.propagateCopies();
+            ssa.propagateConstants();
+            ssa.numberValues();
+            ssa.replaceWrapsWithMasks();
+            ssa.optimiseLoops();
+            ssa.removeDeadValues();
+            ssa.convertFromSSA();
+        }
+
+        removeDeadStores (f);
+        Optimisations::optimiseFunctionBlocks (f, module.allocator);
+    }
+
+private:
+    //==============================================================================
+    struct SSAFunction
+    {
+        SSAFunction (Module& m, heart::Function& f) : module (m), function (f) {}
+
+        //==============================================================================
+        bool convertToSSA()
+        {
+            if (! canConvertToSSA())
+                return false;
+
+            rebuildGraph();
+
+            if (blocks.size() != function.blocks.size() || ! isInDeclarationOrder())
+                return false;
+
+            if (! findPromotableVariables())
+                return false;
+
+            placePhis();
+            renameVariables();
+            return true;
+        }
+
+        void convertFromSSA()
+        {
+            auto parameterLiveness = findBlockParameterLiveness();
+            auto numBlocks = blocks.size();
+
+            for (size_t i = 0; i < numBlocks; ++i)
+            {
+                auto& block = blocks[i].get();
+
+                if (auto br = cast<heart::Branch> (block.terminator))
+                {
+                    if (! br->targetArgs.empty())
+                    {
+                        appendParallelCopy (block, br->target->parameters, br->targetArgs);
+                        br->targetArgs.clear();
+                    }
+                }
+                else if (auto bi = cast<heart::BranchIf> (block.terminator))
+                {
+                    bool bothEdgesHaveArgs = ! (bi->targetArgs[0].empty() || bi->targetArgs[1].empty());
+
+                    for (size_t edge = 0; edge < 2; ++edge)
+                    {
+                        auto& args = bi->targetArgs[edge];
+
+                        if (args.empty())
+                            continue;
+
+                        auto& target = bi->targets[edge].get();
+
+                        if (! bothEdgesHaveArgs && canCopyBeforeBranch (*bi, target, bi->targets[1 - edge], parameterLiveness))
+                        {
+                            appendParallelCopy (block, target.parameters, args);
+                        }
+                        else
+                        {
+                            auto& edgeBlock = insertEdgeBlock (block, target);
+                            appendParallelCopy (edgeBlock, target.parameters, args);
+                            bi->targets[edge] = edgeBlock;
+                        }
+
+                        args.clear();
+                    }
+                }
+            }
+
+            for (auto& b : function.blocks)
+            {
+                for (auto& p : b->parameters)
+                {
+                    p->role = heart::Variable::Role::mutableLocal;
+                    p->type = p->type.removeConstIfPresent();
+                }
+
+                b->parameters.clear();
+            }
+
+            coalesceCopies();
+            values.clear();
+            function.rebuildBlockPredecessors();
+        }
+
+        //==============================================================================
+        /** Replaces values which are just copies of other values, or phis whose inputs
+            are all the same value.
+        */
+        void propagateCopies()
+        {
+            for (;;)
+            {
+                findValuesThatMustStayVariables();
+                Replacements replacements;
+
+                for (auto& b : blocks)
+                {
+                    for (size_t i = 0; i < b->parameters.size(); ++i)
+                    {
+                        auto& phi = b->parameters[i].get();
+
+                        if (auto replacement = findTrivialPhiValue (b, i, replacements))
+                            replacements.emplace (phi, *replacement);
+                    }
+
+                    for (auto s : b->statements)
+                    {
+                        if (auto a = cast<heart::AssignFromValue> (*s))
+                        {
+                            if (auto target = getDefinedValue (*a))
+                            {
+                                if (auto source = cast<heart::Variable> (a->source))
+                                {
+                                    if (isValue (*source) && replacements.find (*source) == replacements.end()
+                                         && source->type.isEqual (target->type, Type::ignoreConst))
+                                        replacements.emplace (*target, *source);
+                                }
+                                else if (auto c = cast<heart::Constant> (a->source))
+                                {
+                                    if (canBeReplacedByConstant (*target))
+                                    {
+                                        auto value = castConstant (c->value, target->type);
+
+                                        if (value.isValid())
+                                            replacements.emplace (*target, module.allocate<heart::Constant> (c->location, value));
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+
+                if (replacements.empty())
+                    return;
+
+                replaceValues (replacements);
+            }
+        }
+
+        //==============================================================================
+        /** Sparse conditional constant propagation: finds the values which are constant
+            along every path that can actually be taken, and folds the branches whose
+            conditions are known.
+        */
+        void propagateConstants()
+        {
+            findValuesThatMustStayVariables();
+
+            ConstantLattice lattice;
+            auto numBlocks = blocks.size();
+            std::vector<bool> blockExecutable (numBlocks, false);
+            std::vector<std::array<bool, 2>> edgeExecutable (numBlocks, { false, false });
+            blockExecutable[0] = true;
+
+            for (bool anyChanged = true; anyChanged;)
+            {
+                anyChanged = false;
+
+                for (size_t i = 0; i < numBlocks; ++i)
+                {
+                    if (! blockExecutable[i])
+                        continue;
+
+                    auto& block = blocks[i].get();
+
+                    for (size_t paramIndex = 0; paramIndex < block.parameters.size(); ++paramIndex)
+                    {
+                        auto& param = block.parameters[paramIndex].get();
+                        LatticeValue result;
+
+                        for (auto pred : predecessors[i])
+                        {
+                            auto& predBlock = blocks[pred].get();
+
+                            for (size_t edge = 0; edge < successors[pred].size(); ++edge)
+                                if (successors[pred][edge] == i && edgeExecutable[pred][edge])
+                                    result = meet (result, castToType (lattice.evaluate (*this, getBranchArgs (*predBlock.terminator, edge)[paramIndex]),
+                                                                       param.type));
+                        }
+
+                        anyChanged = lattice.update (param, result) || anyChanged;
+                    }
+
+                    for (auto s : block.statements)
+                    {
+                        if (auto a = cast<heart::Assignment> (*s))
+                        {
+                            if (auto target = getDefinedValue (*a))
+                            {
+                                if (auto assignment = cast<heart::AssignFromValue> (a))
+                                    anyChanged = lattice.update (*target, castToType (lattice.evaluate (*this, assignment->source), target->type)) || anyChanged;
+                                else
+                                    anyChanged = lattice.update (*target, LatticeValue::variable()) || anyChanged;
+                            }
+                        }
+                    }
+
+                    auto setEdgeExecutable = [&] (size_t edge)
+                    {
+                        if (! edgeExecutable[i][edge])
+                        {
+                            edgeExecutable[i][edge] = true;
+                            blockExecutable[successors[i][edge]] = true;
+                            anyChanged = true;
+                        }
+                    };
+
+                    if (auto bi = cast<heart::BranchIf> (block.terminator))
+                    {
+                        auto condition = lattice.evaluate (*this, bi->condition);
+
+                        if (condition.isConstant())
+                        {
+                            setEdgeExecutable (condition.value.getAsBool() ? 0 : 1);
+                        }
+                        else if (condition.isVariable())
+                        {
+                            setEdgeExecutable (0);
+                            setEdgeExecutable (1);
+                        }
+                    }
+                    else if (! successors[i].empty())
+                    {
+                        setEdgeExecutable (0);
+                    }
+                }
+            }
+
+            // Every condition in a reachable block should have been resolved by now, but if
+            // anything is still unknown, the edges can't be trusted, so give up.
+            for (size_t i = 0; i < numBlocks; ++i)
+                if (blockExecutable[i])
+                    if (auto bi = cast<heart::BranchIf> (blocks[i]->terminator))
+                        if (lattice.evaluate (*this, bi->condition).isUnknown())
+                            return;
+
+            Replacements replacements;
+
+            for (auto& item : lattice.values)
+                if (item.second.isConstant() && canBeReplacedByConstant (item.first))
+                    replacements.emplace (item.first, module.allocate<heart::Constant> (item.first->location, item.second.value));
+
+            bool anyBranchesFolded = false;
+
+            for (size_t i = 0; i < numBlocks; ++i)
+            {
+                if (blockExecutable[i])
+                {
+                    if (auto bi = cast<heart::BranchIf> (blocks[i]->terminator))
+                    {
+                        auto condition = lattice.evaluate (*this, bi->condition);
+
+                        if (condition.isConstant())
+                        {
+                            auto edge = condition.value.getAsBool() ? 0u : 1u;
+                            auto& branch = module.allocate<heart::Branch> (bi->targets[edge]);
+                            branch.targetArgs = bi->targetArgs[edge];
+                            blocks[i]->terminator = branch;
+                            anyBranchesFolded = true;
+                        }
+                    }
+                }
+            }
+
+            if (! replacements.empty())
+                replaceValues (replacements);
+
+            if (anyBranchesFolded)
+                removeUnreachableBlocks();
+        }
+
+        //==============================================================================
+        /** Global value numbering: any value which is calculated from the same operands
+            as a value that dominates it is replaced by that earlier value.
+        */
+        void numberValues()
+        {
+            std::unordered_map<std::string, pool_ref<heart::Variable>> availableValues;
+            std::vector<std::string> addedKeys;
+            Replacements replacements;
+
+            visitDominatorTree ([&] (size_t blockIndex)
+            {
+                auto numKeysBefore = addedKeys.size();
+
+                for (auto s : blocks[blockIndex]->statements)
+                {
+                    if (auto a = cast<heart::AssignFromValue> (*s))
+                    {
+                        if (auto target = getDefinedValue (*a))
+                        {
+                            std::string key (target->type.removeConstIfPresent().getDescription());
+                            key += '=';
+
+                            if (appendValueKey (key, a->source))
+                            {
+                                auto existing = availableValues.find (key);
+
+                                if (existing != availableValues.end())
+                                {
+                                    replacements.emplace (*target, existing->second);
+                                }
+                                else
+                                {
+                                    availableValues.emplace (key, *target);
+                                    addedKeys.push_back (std::move (key));
+                                }
+                            }
+                        }
+                    }
+                }
+
+                return numKeysBefore;
+            },
+            [&] (size_t, size_t numKeysBefore)
+            {
+                while (addedKeys.size() > numKeysBefore)
+                {
+                    availableValues.erase (addedKeys.back());
+                    addedKeys.pop_back();
+                }
+            });
+
+            if (! replacements.empty())
+                replaceValues (replacements);
+        }
+
+        //==============================================================================
+        /** Replaces wraps and modulos by a power of two with bitwise masks, in the cases
+            where the result is guaranteed to be the same.
+        */
+        void replaceWrapsWithMasks()
+        {
+            for (auto& b : blocks)
+            {
+                LinkedList<heart::Statement>::Iterator previous;
+
+                for (auto s : b->statements)
+                {
+                    s->visitExpressions ([this] (pool_ref<heart::Expression>& e, AccessType mode)
+                    {
+                        if (mode == AccessType::read)
+                            if (auto bo = cast<heart::BinaryOperator> (e))
+                                if (auto masked = createMaskForModulo (*bo))
+                                    e = *masked;
+                    });
+
+                    if (auto fc = cast<heart::FunctionCall> (*s))
+                    {
+                        if (auto mask = getMaskForWrap (*fc))
+                        {
+                            auto& replacement = module.allocate<heart::AssignFromValue> (fc->location, *fc->target,
+                                                                                         module.allocate<heart::BinaryOperator> (fc->location, fc->arguments[0], *mask,
+                                                                                                                                 BinaryOp::Op::bitwiseAnd));
+                            if (auto v = getDefinedValue (*fc))
+                                values[*v].definition = replacement;
+
+                            b->statements.replaceAfter (previous, replacement);
+                            s = std::addressof (replacement);
+                        }
+                    }
+
+                    previous = s;
+                }
+            }
+        }
+
+        //==============================================================================
+        /** Finds the loops in the function, moves any calculations which give the same
+            result on every iteration out into the block before the loop, and replaces
+            multiplies of induction variables with additions.
+        */
+        void optimiseLoops()
+        {
+            if (createLoopPreheaders())
+                rebuildGraph();
+
+            for (auto& loop : findLoops())
+            {
+                if (loop.preheader != notFound)
+                {
+                    hoistLoopInvariants (loop);
+                    reduceInductionVariableMultiplies (loop);
+                }
+            }
+        }
+
+        //==============================================================================
+        /** Removes any values which don't contribute to a side-effect, a branch or
+            the function's result.
+        */
+        void removeDeadValues()
+        {
+            std::unordered_set<pool_ref<heart::Variable>> liveValues;
+            std::vector<pool_ref<heart::Variable>> valuesToVisit;
+
+            auto markLive = [&] (heart::Expression& e)
+            {
+                visitVariables (e, [&] (heart::Variable& v)
+                {
+                    if (isValue (v) && liveValues.insert (v).second)
+                        valuesToVisit.push_back (v);
+                });
+            };
+
+            for (auto& b : blocks)
+            {
+                for (auto s : b->statements)
+                {
+                    if (auto a = cast<heart::AssignFromValue> (*s))
+                        if (getDefinedValue (*a) != nullptr)
+                            continue;
+
+                    s->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType mode)
+                    {
+                        if (mode != AccessType::write)
+                            markLive (e);
+                    });
+                }
+
+                if (auto bi = cast<heart::BranchIf> (b->terminator))
+                    markLive (bi->condition);
+                else if (auto r = cast<heart::ReturnValue> (b->terminator))
+                    markLive (r->returnValue);
+            }
+
+            while (! valuesToVisit.empty())
+            {
+                auto& v = valuesToVisit.back().get();
+                valuesToVisit.pop_back();
+                auto& info = values.find (v)->second;
+
+                if (auto a = cast<heart::AssignFromValue> (info.definition))
+                {
+                    markLive (a->source);
+                }
+                else if (info.definition == nullptr && info.block != nullptr)
+                {
+                    auto paramIndex = getParameterIndex (*info.block, v);
+                    auto blockIndex = getIndex (*info.block);
+
+                    for (auto pred : predecessors[blockIndex])
+                        for (size_t edge = 0; edge < successors[pred].size(); ++edge)
+                            if (successors[pred][edge] == blockIndex)
+                                markLive (getBranchArgs (*blocks[pred]->terminator, edge)[paramIndex]);
+                }
+            }
+
+            for (auto& b : blocks)
+            {
+                b->statements.removeMatches ([&] (heart::Statement& s)
+                {
+                    if (auto a = cast<heart::Assignment> (s))
+                    {
+                        if (auto target = getDefinedValue (*a))
+                        {
+                            if (liveValues.find (*target) == liveValues.end())
+                            {
+                                if (is_type<heart::AssignFromValue> (a))
+                                {
+                                    values.erase (*target);
+                                    return true;
+                                }
+
+                                if (auto fc = cast<heart::FunctionCall> (a))
+                                {
+                                    values.erase (*target);
+                                    fc->target = nullptr;
+                                }
+                            }
+                        }
+                    }
+
+                    return false;
+                });
+
+                for (size_t i = b->parameters.size(); i > 0; --i)
+                {
+                    auto& param = b->parameters[i - 1].get();
+
+                    if (liveValues.find (param) == liveValues.end())
+                    {
+                        values.erase (param);
+                        removeBlockParameter (b, i - 1);
+                    }
+                }
+            }
+        }
+
+    private:
+        //==============================================================================
+        struct ValueInfo
+        {
+            pool_ptr<heart::Assignment> definition;   // null for block and function parameters
+            pool_ptr<heart::Block> block;             // null for function parameters
+        };
+
+        struct PhiInfo
+        {
+            size_t variableIndex;
+            pool_ref<heart::Variable> phi;
+        };
+
+        using Replacements = std::unordered_map<pool_ref<heart::Variable>, pool_ref<heart::Expression>>;
+        using VariableSet = std::vector<uint64_t>;
+
+        static constexpr size_t notFound = std::numeric_limits<size_t>::max();
+
+        Module& module;
+        heart::Function& function;
+        mutable std::optional<std::unordered_set<pool_ref<heart::Variable>>> stateWrittenByOtherFunctions;
+
+        std::vector<pool_ref<heart::Block>> blocks;   // in reverse post-order, so blocks[0] is the entry block
+        std::vector<std::vector<size_t>> predecessors, successors, dominatorTreeChildren;
+        std::vector<size_t> immediateDominators;
+
+        std::unordered_map<pool_ref<heart::Variable>, ValueInfo> values;
+        std::unordered_set<pool_ref<heart::Variable>> valuesThatMustStayVariables;
+
+        std::vector<pool_ref<heart::Variable>> promotedVariables;
+        std::unordered_map<pool_ref<heart::Variable>, size_t> promotedVariableIndexes;
+        std::vector<std::vector<size_t>> definingBlocks;
+        std::vector<VariableSet> liveIn;
+        std::vector<std::vector<PhiInfo>> phis;
+
+        //==============================================================================
+        static size_t getIndex (const heart::Block& b)     { return b.tempData.get<size_t>(); }
+
+        bool isValue (heart::Variable& v) const           { return values.find (v) != values.end(); }
+
+        pool_ptr<heart::Variable> getDefinedValue (heart::Assignment& a) const
+        {
+            if (auto v = cast<heart::Variable> (a.target))
+            {
+                auto info = values.find (*v);
+
+                if (info != values.end() && info->second.definition == a)
+                    return v;
+            }
+
+            return {};
+        }
+
+        bool canBeReplacedByConstant (heart::Variable& v) const
+        {
+            return valuesThatMustStayVariables.find (v) == valuesThatMustStayVariables.end();
+        }
+
+        static heart::Branch::ArgListType& getBranchArgs (heart::Terminator& t, size_t edge)
+        {
+            if (auto br = cast<heart::Branch> (t))
+                return br->targetArgs;
+
+            auto bi = cast<heart::BranchIf> (t);
+            SOUL_ASSERT (bi != nullptr && edge < 2);
+            return bi->targetArgs[edge];
+        }
+
+        static size_t getParameterIndex (const heart::Block& b, heart::Variable& v)
+        {
+            for (size_t i = 0; i < b.parameters.size(); ++i)
+                if (b.parameters[i] == v)
+                    return i;
+
+            SOUL_ASSERT_FALSE;
+            return 0;
+        }
+
+        template <typename Visitor>
+        static void visitVariables (heart::Expression& e, Visitor&& visit)
+        {
+            if (auto v = cast<heart::Variable> (e))
+                return visit (*v);
+
+            e.visitExpressions ([&] (pool_ref<heart::Expression>& sub, AccessType)
+            {
+                if (auto v = cast<heart::Variable> (sub))
+                    visit (*v);
+            }, AccessType::read);
+        }
+
+        static bool canBePromoted (const heart::Variable& v)
+        {
+            if (! v.isFunctionLocal())
+                return false;
+
+            const auto& type = v.type;
+
+            if (type.isReference())
+                return false;
+
+            return type.isBoundedInt()
+                    || (type.isPrimitiveOrVector() && ! (type.isComplex() || type.isStringLiteral()));
+        }
+
+        //==============================================================================
+        bool canConvertToSSA() const
+        {
+            if (! function.blocks.front()->parameters.empty())
+                return false;
+
+            for (auto& b : function.blocks)
+            {
+                if (b->terminator == nullptr)
+                    return false;
+
+                if (auto bi = cast<heart::BranchIf> (b->terminator))
+                    if (bi->targets[0] == bi->targets[1])
+                        return false;
+
+                for (auto s : b->statements)
+                    if (auto r = cast<heart::ReadStream> (*s))
+                        if (r->element != nullptr)
+                            return false;
+            }
+
+            return true;
+        }
+
+        void rebuildGraph()
+        {
+            const auto unvisited = notFound, visited = notFound - 1;
+
+            for (auto& b : function.blocks)
+                b->tempData.set (unvisited);
+
+            std::vector<pool_ref<heart::Block>> postOrder;
+            std::vector<std::pair<pool_ref<heart::Block>, size_t>> stack;
+            auto& entry = function.blocks.front().get();
+            entry.tempData.set (visited);
+            stack.push_back ({ entry, 0 });
+
+            while (! stack.empty())
+            {
+                auto block = stack.back().first;
+                auto destinations = block->terminator->getDestinationBlocks();
+                auto nextIndex = stack.back().second++;
+
+                if (nextIndex < destinations.size())
+                {
+                    auto& next = destinations[nextIndex].get();
+
+                    if (next.tempData.get<size_t>() == unvisited)
+                    {
+                        next.tempData.set (visited);
+                        stack.push_back ({ next, 0 });
+                    }
+                }
+                else
+                {
+                    postOrder.push_back (block);
+                    stack.pop_back();
+                }
+            }
+
+            blocks.assign (postOrder.rbegin(), postOrder.rend());
+            auto numBlocks = blocks.size();
+
+            for (size_t i = 0; i < numBlocks; ++i)
+                blocks[i]->tempData.set (i);
+
+            predecessors.assign (numBlocks, {});
+            successors.assign (numBlocks, {});
+
+            for (size_t i = 0; i < numBlocks; ++i)
+            {
+                for (auto& dest : blocks[i]->terminator->getDestinationBlocks())
+                {
+                    auto destIndex = getIndex (dest);
+                    successors[i].push_back (destIndex);
+                    predecessors[destIndex].push_back (i);
+                }
+            }
+
+            findDominators();
+        }
+
+        /** HEART must declare each value before any code that uses it, so this checks that the
+            blocks are laid out with each one after its dominator and at least one of its predecessors.
+        */
+        bool isInDeclarationOrder() const
+        {
+            std::vector<size_t> positions (blocks.size());
+
+            for (size_t i = 0; i < function.blocks.size(); ++i)
+                positions[getIndex (function.blocks[i])] = i;
+
+            for (size_t i = 1; i < blocks.size(); ++i)
+            {
+                if (positions[immediateDominators[i]] > positions[i])
+                    return false;
+
+                if (std::none_of (predecessors[i].begin(), predecessors[i].end(),
+                                  [&] (size_t pred) { return positions[pred] < positions[i]; }))
+                    return false;
+            }
+
+            return true;
+        }
+
+        void findDominators()
+        {
+            auto numBlocks = blocks.size();
+            immediateDominators.assign (numBlocks, notFound);
+            immediateDominators[0] = 0;
+
+            auto intersect = [this] (size_t a, size_t b)
+            {
+                while (a != b)
+                {
+                    while (a > b)  a = immediateDominators[a];
+                    while (b > a)  b = immediateDominators[b];
+                }
+
+                return a;
+            };
+
+            for (bool anyChanged = true; anyChanged;)
+            {
+                anyChanged = false;
+
+                for (size_t i = 1; i < numBlocks; ++i)
+                {
+                    auto newDominator = notFound;
+
+                    for (auto pred : predecessors[i])
+                        if (immediateDominators[pred] != notFound)
+                            newDominator = (newDominator == notFound) ? pred : intersect (pred, newDominator);
+
+                    if (immediateDominators[i] != newDominator)
+                    {
+                        immediateDominators[i] = newDominator;
+                        anyChanged = true;
+                    }
+                }
+            }
+
+            dominatorTreeChildren.assign (numBlocks, {});
+
+            for (size_t i = 1; i < numBlocks; ++i)
+                dominatorTreeChildren[immediateDominators[i]].push_back (i);
+        }
+
+        /** Calls onEntry for each block in dominator tree pre-order, and onExit after all the
+            blocks that it dominates have been visited, passing it the value returned by onEntry.
+        */
+        template <typename OnEntry, typename OnExit>
+        void visitDominatorTree (OnEntry&& onEntry, OnExit&& onExit)
+        {
+            std::vector<std::pair<size_t, size_t>> stack;
+            std::vector<bool> entered (blocks.size(), false);
+            stack.push_back ({ 0, 0 });
+
+            while (! stack.empty())
+            {
+                auto blockIndex = stack.back().first;
+
+                if (! entered[blockIndex])
+                {
+                    entered[blockIndex] = true;
+                    stack.back().second = onEntry (blockIndex);
+                    auto& children = dominatorTreeChildren[blockIndex];
+
+                    for (auto i = children.rbegin(); i != children.rend(); ++i)
+                        stack.push_back ({ *i, 0 });
+                }
+                else
+                {
+                    onExit (blockIndex, stack.back().second);
+                    stack.pop_back();
+                }
+            }
+        }
+
+        void removeUnreachableBlocks()
+        {
+            rebuildGraph();
+
+            if (blocks.size() == function.blocks.size())
+                return;
+
+            for (auto i = values.begin(); i != values.end();)
+            {
+                if (i->second.block != nullptr && getIndex (*i->second.block) >= blocks.size())
+                    i = values.erase (i);
+                else
+                    ++i;
+            }
+
+            removeIf (function.blocks, [this] (heart::Block& b) { return getIndex (b) >= blocks.size(); });
+        }
+
+        //==============================================================================
+        static VariableSet createVariableSet (size_t numVariables, bool initialState)
+        {
+            return VariableSet ((numVariables + 63) / 64, initialState ? ~(uint64_t) 0 : 0);
+        }
+
+        static bool setContains (const VariableSet& set, size_t index)   { return (set[index >> 6] & (((uint64_t) 1) << (index & 63))) != 0; }
+        static void addToSet (VariableSet& set, size_t index)            { set[index >> 6] |= (((uint64_t) 1) << (index & 63)); }
+
+        size_t getPromotedIndex (heart::Variable& v) const
+        {
+            auto i = promotedVariableIndexes.find (v);
+            return i != promotedVariableIndexes.end() ? i->second : notFound;
+        }
+
+        /** Finds the local variables which are only ever read or assigned as a whole,
+            and are always assigned before being read, so can be split into SSA values.
+        */
+        bool findPromotableVariables()
+        {
+            struct VariableUse
+            {
+                uint32_t numWrites = 0, numWholeAssignments = 0;
+                bool isElementParent = false;
+            };
+
+            std::unordered_map<pool_ref<heart::Variable>, VariableUse> uses;
+            std::unordered_set<pool_ref<heart::Variable>> blockParameters, writtenParameters;
+
+            for (auto& b : blocks)
+                for (auto& p : b->parameters)
+                    blockParameters.insert (p);
+
+            auto visitUse = [&] (pool_ref<heart::Expression>& e, AccessType mode)
+            {
+                if (auto v = cast<heart::Variable> (e))
+                {
+                    if (mode != AccessType::read)
+                    {
+                        if (v->isParameter())
+                            writtenParameters.insert (*v);
+
+                        uses[*v].numWrites++;
+                    }
+                }
+                else if (auto ae = cast<heart::ArrayElement> (e))
+                {
+                    if (auto parent = cast<heart::Variable> (ae->parent))
+                        uses[*parent].isElementParent = true;
+                }
+                else if (auto se = cast<heart::StructElement> (e))
+                {
+                    if (auto parent = cast<heart::Variable> (se->parent))
+                        uses[*parent].isElementParent = true;
+                }
+            };
+
+            for (auto& b : blocks)
+            {
+                for (auto s : b->statements)
+                {
+                    s->visitExpressions (visitUse);
+
+                    if (auto a = cast<heart::Assignment> (*s))
+                        if (auto v = cast<heart::Variable> (a->target))
+                            uses[*v].numWholeAssignments++;
+                }
+
+                b->terminator->visitExpressions (visitUse);
+            }
+
+            for (auto& p : blockParameters)
+                if (writtenParameters.find (p) != writtenParameters.end())
+                    return false;
+
+            for (auto& item : uses)
+            {
+                auto& v = item.first.get();
+
+                if (canBePromoted (v) && ! item.second.isElementParent
+                     && item.second.numWrites == item.second.numWholeAssignments)
+                {
+                    promotedVariableIndexes[v] = promotedVariables.size();
+                    promotedVariables.push_back (v);
+                }
+            }
+
+            // Make sure the order doesn't depend on the hash map, so that the output is deterministic
+            std::sort (promotedVariables.begin(), promotedVariables.end(),
+                       [] (const pool_ref<heart::Variable>& a, const pool_ref<heart::Variable>& b)
+                       {
+                           return a->location.location.getAddress() < b->location.location.getAddress();
+                       });
+
+            for (size_t i = 0; i < promotedVariables.size(); ++i)
+                promotedVariableIndexes[promotedVariables[i]] = i;
+
+            for (auto& p : blockParameters)
+                values[p] = { nullptr, getBlockOwningParameter (p) };
+
+            for (auto& p : function.parameters)
+                if (! p->type.isReference() && writtenParameters.find (p) == writtenParameters.end())
+                    values[p] = {};
+
+            if (promotedVariables.empty())
+                return true;
+
+            findVariableLiveness();
+            return true;
+        }
+
+        pool_ptr<heart::Block> getBlockOwningParameter (heart::Variable& v) const
+        {
+            for (auto& b : blocks)
+                for (auto& p : b->parameters)
+                    if (p == v)
+                        return b;
+
+            return {};
+        }
+
+        void findVariableLiveness()
+        {
+            auto numBlocks = blocks.size();
+            auto numVariables = promotedVariables.size();
+            std::vector<VariableSet> upwardExposedUses, assignments;
+            definingBlocks.assign (numVariables, {});
+
+            for (size_t i = 0; i < numBlocks; ++i)
+            {
+                auto used = createVariableSet (numVariables, false);
+                auto assigned = createVariableSet (numVariables, false);
+
+                auto visitRead = [&] (pool_ref<heart::Expression>& e, AccessType mode)
+                {
+                    if (mode == AccessType::read)
+                        if (auto v = cast<heart::Variable> (e))
+                            if (auto index = getPromotedIndex (*v); index != notFound)
+                                if (! setContains (assigned, index))
+                                    addToSet (used, index);
+                };
+
+                for (auto s : blocks[i]->statements)
+                {
+                    s->visitExpressions (visitRead);
+
+                    if (auto a = cast<heart::Assignment> (*s))
+                    {
+                        if (auto v = cast<heart::Variable> (a->target))
+                        {
+                            if (auto index = getPromotedIndex (*v); index != notFound)
+                            {
+                                if (! setContains (assigned, index))
+                                    definingBlocks[index].push_back (i);
+
+                                addToSet (assigned, index);
+                            }
+                        }
+                    }
+                }
+
+                blocks[i]->terminator->visitExpressions (visitRead);
+                upwardExposedUses.push_back (std::move (used));
+                assignments.push_back (std::move (assigned));
+            }
+
+            // Any variable which might be read before it has been assigned is left alone
+            std::vector<VariableSet> assignedAtStart (numBlocks, createVariableSet (numVariables, true)),
+                                     assignedAtEnd (numBlocks, createVariableSet (numVariables, true));
+            assignedAtStart[0] = createVariableSet (numVariables, false);
+
+            for (bool anyChanged = true; anyChanged;)
+            {
+                anyChanged = false;
+
+                for (size_t i = 0; i < numBlocks; ++i)
+                {
+                    auto newStart = (i == 0) ? assignedAtStart[0] : createVariableSet (numVariables, true);
+
+                    for (auto pred : predecessors[i])
+                        for (size_t w = 0; w < newStart.size(); ++w)
+                            newStart[w] &= assignedAtEnd[pred][w];
+
+                    auto newEnd = newStart;
+
+                    for (size_t w = 0; w < newEnd.size(); ++w)
+                        newEnd[w] |= assignments[i][w];
+
+                    if (newEnd != assignedAtEnd[i] || newStart != assignedAtStart[i])
+                    {
+                        assignedAtStart[i] = std::move (newStart);
+                        assignedAtEnd[i] = std::move (newEnd);
+                        anyChanged = true;
+                    }
+                }
+            }
+
+            std::vector<bool> isUnsafe (numVariables, false);
+
+            for (size_t i = 0; i < numBlocks; ++i)
+                for (size_t v = 0; v < numVariables; ++v)
+                    if (setContains (upwardExposedUses[i], v) && ! setContains (assignedAtStart[i], v))
+                        isUnsafe[v] = true;
+
+            liveIn.assign (numBlocks, createVariableSet (numVariables, false));
+
+            for (bool anyChanged = true; anyChanged;)
+            {
+                anyChanged = false;
+
+                for (size_t i = numBlocks; i > 0; --i)
+                {
+                    auto b = i - 1;
+                    auto live = createVariableSet (numVariables, false);
+
+                    for (auto succ : successors[b])
+                        for (size_t w = 0; w < live.size(); ++w)
+                            live[w] |= liveIn[succ][w];
+
+                    for (size_t w = 0; w < live.size(); ++w)
+                        live[w] = (live[w] & ~assignments[b][w]) | upwardExposedUses[b][w];
+
+                    if (live != liveIn[b])
+                    {
+                        liveIn[b] = std::move (live);
+                        anyChanged = true;
+                    }
+                }
+            }
+
+            for (size_t v = 0; v < numVariables; ++v)
+                if (isUnsafe[v])
+                    promotedVariableIndexes.erase (promotedVariables[v]);
+        }
+
+        //==============================================================================
+        void placePhis()
+        {
+            auto numBlocks = blocks.size();
+            phis.assign (numBlocks, {});
+
+            if (promotedVariableIndexes.empty())
+                return;
+
+            std::vector<std::vector<size_t>> dominanceFrontiers (numBlocks);
+
+            for (size_t i = 0; i < numBlocks; ++i)
+            {
+                if (predecessors[i].size() > 1)
+                {
+                    for (auto pred : predecessors[i])
+                    {
+                        for (auto runner = pred; runner != immediateDominators[i]; runner = immediateDominators[runner])
+                        {
+                            if (! contains (dominanceFrontiers[runner], i))
+                                dominanceFrontiers[runner].push_back (i);
+
+                            if (runner == 0)
+                                break;
+                        }
+                    }
+                }
+            }
+
+            std::vector<size_t> hasPhi (numBlocks, notFound), hasBeenQueued (numBlocks, notFound);
+            std::vector<size_t> blocksToVisit;
+
+            for (size_t v = 0; v < promotedVariables.size(); ++v)
+            {
+                auto& variable = promotedVariables[v].get();
+
+                if (getPromotedIndex (variable) == notFound)
+                    continue;
+
+                blocksToVisit = definingBlocks[v];
+
+                for (auto b : blocksToVisit)
+                    hasBeenQueued[b] = v;
+
+                while (! blocksToVisit.empty())
+                {
+                    auto b = blocksToVisit.back();
+                    blocksToVisit.pop_back();
+
+                    for (auto frontier : dominanceFrontiers[b])
+                    {
+                        if (hasPhi[frontier] != v && setContains (liveIn[frontier], v))
+                        {
+                            hasPhi[frontier] = v;
+                            auto& phi = module.allocate<heart::Variable> (variable.location, variable.type.removeConstIfPresent(),
+                                                                          variable.name, heart::Variable::Role::parameter);
+                            blocks[frontier]->addParameter (phi);
+                            phis[frontier].push_back ({ v, phi });
+                            values[phi] = { nullptr, blocks[frontier] };
+                        }
+
+                        if (hasBeenQueued[frontier] != v)
+                        {
+                            hasBeenQueued[frontier] = v;
+                            blocksToVisit.push_back (frontier);
+                        }
+                    }
+                }
+            }
+        }
+
+        void renameVariables()
+        {
+            if (promotedVariableIndexes.empty())
+                return;
+
+            std::vector<std::vector<pool_ref<heart::Expression>>> currentValues (promotedVariables.size());
+            std::vector<size_t> pushedValues;
+            std::vector<bool> originalHasBeenUsed (promotedVariables.size(), false);
+
+            auto getCurrentValue = [&] (size_t index) -> heart::Expression&
+            {
+                auto& stack = currentValues[index];
+
+                // This can only happen on paths where the variable was never assigned,
+                // which the liveness checks should already have ruled out
+                if (stack.empty())
+                {
+                    SOUL_ASSERT_FALSE;
+                    auto& v = promotedVariables[index].get();
+                    return module.allocate<heart::Constant> (v.location, Value::zeroInitialiser (v.type.removeConstIfPresent()));
+                }
+
+                return stack.back();
+            };
+
+            auto pushValue = [&] (size_t index, heart::Expression& value)
+            {
+                currentValues[index].push_back (value);
+                pushedValues.push_back (index);
+            };
+
+            auto renameReads = [&] (pool_ref<heart::Expression>& e, AccessType mode)
+            {
+                if (mode == AccessType::read)
+                    if (auto v = cast<heart::Variable> (e))
+                        if (auto index = getPromotedIndex (*v); index != notFound)
+                            e = getCurrentValue (index);
+            };
+
+            visitDominatorTree ([&] (size_t blockIndex)
+            {
+                auto numPushedBefore = pushedValues.size();
+                auto& block = blocks[blockIndex].get();
+
+                for (auto& phi : phis[blockIndex])
+                    pushValue (phi.variableIndex, phi.phi);
+
+                for (auto s : block.statements)
+                {
+                    s->visitExpressions (renameReads);
+
+                    if (auto a = cast<heart::Assignment> (*s))
+                    {
+                        if (auto v = cast<heart::Variable> (a->target))
+                        {
+                            if (auto index = getPromotedIndex (*v); index != notFound)
+                            {
+                                auto& newValue = createNewVersion (index, originalHasBeenUsed);
+                                a->target = newValue;
+                                values[newValue] = { *a, block };
+                                pushValue (index, newValue);
+                            }
+                        }
+                    }
+                }
+
+                block.terminator->visitExpressions (renameReads);
+
+                for (size_t edge = 0; edge < successors[blockIndex].size(); ++edge)
+                {
+                    auto& args = getBranchArgs (*block.terminator, edge);
+
+                    for (auto& phi : phis[successors[blockIndex][edge]])
+                        args.push_back (getCurrentValue (phi.variableIndex));
+                }
+
+                return numPushedBefore;
+            },
+            [&] (size_t, size_t numPushedBefore)
+            {
+                while (pushedValues.size() > numPushedBefore)
+                {
+                    currentValues[pushedValues.back()].pop_back();
+                    pushedValues.pop_back();
+                }
+            });
+
+            phis.clear();
+            liveIn.clear();
+            promotedVariableIndexes.clear();
+        }
+
+        heart::Variable& createNewVersion (size_t index, std::vector<bool>& originalHasBeenUsed)
+        {
+            auto& original = promotedVariables[index].get();
+
+            // The first assignment keeps the original variable, so that its name survives
+            if (! originalHasBeenUsed[index])
+            {
+                originalHasBeenUsed[index] = true;
+                original.role = heart::Variable::Role::constant;
+                return original;
+            }
+
+            return module.allocate<heart::Variable> (original.location, original.type, original.name,
+                                                     heart::Variable::Role::constant);
+        }
+
+        //==============================================================================
+        /** Finds the values which appear in places where substituting a constant could
+            change the meaning or validity of the code, e.g. divisors and array indexes.
+        */
+        void findValuesThatMustStayVariables()
+        {
+            valuesThatMustStayVariables.clear();
+
+            auto addIfVariable = [this] (pool_ptr<heart::Expression> e)
+            {
+                if (auto v = cast<heart::Variable> (e))
+                    valuesThatMustStayVariables.insert (*v);
+            };
+
+            auto visit = [&] (pool_ref<heart::Expression>& e, AccessType)
+            {
+                if (auto ae = cast<heart::ArrayElement> (e))
+                {
+                    addIfVariable (ae->parent);
+                    addIfVariable (ae->dynamicIndex);
+                }
+                else if (auto se = cast<heart::StructElement> (e))
+                {
+                    addIfVariable (se->parent);
+                }
+                else if (auto bo = cast<heart::BinaryOperator> (e))
+                {
+                    if (bo->operation == BinaryOp::Op::divide || bo->operation == BinaryOp::Op::modulo)
+                        addIfVariable (bo->rhs);
+                }
+            };
+
+            for (auto& b : blocks)
+            {
+                for (auto s : b->statements)
+                {
+                    s->visitExpressions (visit);
+
+                    if (auto w = cast<heart::WriteStream> (*s))
+                        addIfVariable (w->element);
+                }
+
+                b->terminator->visitExpressions (visit);
+            }
+        }
+
+        pool_ptr<heart::Expression> findTrivialPhiValue (heart::Block& block, size_t paramIndex, const Replacements& replacements)
+        {
+            auto& phi = block.parameters[paramIndex].get();
+
+            if (replacements.find (phi) != replacements.end())
+                return {};
+
+            pool_ptr<heart::Expression> uniqueValue;
+            auto blockIndex = getIndex (block);
+
+            for (auto pred : predecessors[blockIndex])
+            {
+                for (size_t edge = 0; edge < successors[pred].size(); ++edge)
+                {
+                    if (successors[pred][edge] != blockIndex)
+                        continue;
+
+                    auto& arg = getBranchArgs (*blocks[pred]->terminator, edge)[paramIndex].get();
+
+                    if (std::addressof (arg) == std::addressof (phi))
+                        continue;
+
+                    if (uniqueValue == nullptr)
+                    {
+                        if (auto v = cast<heart::Variable> (arg))
+                        {
+                            if (! isValue (*v) || replacements.find (*v) != replacements.end()
+                                 || ! v->type.isEqual (phi.type, Type::ignoreConst))
+                                return {};
+                        }
+                        else if (auto c = cast<heart::Constant> (arg))
+                        {
+                            if (! (canBeReplacedByConstant (phi) && c->value.getType().isEqual (phi.type, Type::ignoreConst)))
+                                return {};
+                        }
+                        else
+                        {
+                            return {};
+                        }
+
+                        uniqueValue = arg;
+                        continue;
+                    }
+
+                    if (uniqueValue == arg)
+                        continue;
+
+                    auto c1 = cast<heart::Constant> (uniqueValue);
+                    auto c2 = cast<heart::Constant> (arg);
+
+                    if (c1 == nullptr || c2 == nullptr || c1->value != c2->value)
+                        return {};
+                }
+            }
+
+            if (auto c = cast<heart::Constant> (uniqueValue))
+                return module.allocate<heart::Constant> (c->location, c->value);
+
+            return uniqueValue;
+        }
+
+        void replaceValues (const Replacements& replacements)
+        {
+            auto getReplacement = [&] (heart::Variable& v) -> pool_ptr<heart::Expression>
+            {
+                pool_ptr<heart::Expression> result;
+
+                for (auto* current = std::addressof (v);;)
+                {
+                    auto found = replacements.find (*current);
+
+                    if (found == replacements.end())
+                        break;
+
+                    result = found->second;
+
+                    if (auto next = cast<heart::Variable> (result))
+                        current = next.get();
+                    else
+                        break;
+                }
+
+                if (auto c = cast<heart::Constant> (result))
+                    return module.allocate<heart::Constant> (c->location, c->value);
+
+                return result;
+            };
+
+            auto replaceReads = [&] (pool_ref<heart::Expression>& e, AccessType mode)
+            {
+                if (mode == AccessType::read)
+                    if (auto v = cast<heart::Variable> (e))
+                        if (auto replacement = getReplacement (*v))
+                            e = *replacement;
+            };
+
+            for (auto& b : blocks)
+            {
+                for (auto s : b->statements)
+                    s->visitExpressions (replaceReads);
+
+                b->terminator->visitExpressions (replaceReads);
+            }
+
+            for (auto& b : blocks)
+            {
+                b->statements.removeMatches ([&] (heart::Statement& s)
+                {
+                    if (auto a = cast<heart::AssignFromValue> (s))
+                        if (auto target = getDefinedValue (*a))
+                            return replacements.find (*target) != replacements.end();
+
+                    return false;
+                });
+
+                for (size_t i = b->parameters.size(); i > 0; --i)
+                    if (replacements.find (b->parameters[i - 1]) != replacements.end())
+                        removeBlockParameter (b, i - 1);
+            }
+
+            for (auto& r : replacements)
+                values.erase (r.first);
+        }
+
+        void removeBlockParameter (heart::Block& block, size_t index)
+        {
+            auto blockIndex = getIndex (block);
+
+            for (auto pred : predecessors[blockIndex])
+            {
+                for (size_t edge = 0; edge < successors[pred].size(); ++edge)
+                {
+                    if (successors[pred][edge] == blockIndex)
+                    {
+                        auto& args = getBranchArgs (*blocks[pred]->terminator, edge);
+                        args.erase (args.begin() + index);
+                    }
+                }
+            }
+
+            block.parameters.erase (block.parameters.begin() + (ptrdiff_t) index);
+        }
+
+        //==============================================================================
+        static bool isPowerOfTwo (int64_t n)    { return n > 0 && (n & (n - 1)) == 0; }
+
+        pool_ptr<heart::Constant> getMaskForWrap (heart::FunctionCall& fc) const
+        {
+            if (fc.target == nullptr || fc.getFunction().intrinsicType != IntrinsicType::wrap || fc.arguments.size() != 2)
+                return {};
+
+            auto type = fc.arguments[0]->getType().removeConstIfPresent();
+
+            if (! (type.isPrimitiveInteger() && fc.target->getType().isEqual (type, Type::ignoreConst)))
+                return {};
+
+            if (auto range = cast<heart::Constant> (fc.arguments[1]))
+            {
+                if (range->value.getType().isEqual (type, Type::ignoreConst))
+                {
+                    auto limit = range->value.getAsInt64();
+
+                    if (isPowerOfTwo (limit))
+                        return module.allocate<heart::Constant> (range->location, castConstant (Value (limit - 1), type));
+                }
+            }
+
+            return {};
+        }
+
+        /** A modulo is only equivalent to a mask when the value can't be negative, so this
+            only handles values with a bounded int type.
+        */
+        pool_ptr<heart::Expression> createMaskForModulo (heart::BinaryOperator& b)
+        {
+            if (b.operation != BinaryOp::Op::modulo || ! b.lhs->getType().isBoundedInt())
+                return {};
+
+            auto divisor = cast<heart::Constant> (b.rhs);
+
+            if (divisor == nullptr || ! divisor->value.getType().isPrimitiveInteger())
+                return {};
+
+            auto limit = divisor->value.getAsInt64();
+
+            if (! isPowerOfTwo (limit))
+                return {};
+
+            auto& mask = module.allocate<heart::Constant> (divisor->location, castConstant (Value (limit - 1), divisor->value.getType()));
+            auto types = BinaryOp::getTypes (BinaryOp::Op::bitwiseAnd, b.lhs->getType(), mask.getType());
+
+            if (! types.resultType.isIdentical (b.getType()))
+                return {};
+
+            return module.allocate<heart::BinaryOperator> (b.location, b.lhs, mask, BinaryOp::Op::bitwiseAnd);
+        }
+
+        //==============================================================================
+        struct Loop
+        {
+            size_t header = 0, preheader = notFound;
+            std::vector<size_t> blocks, latches;
+            std::vector<bool> contains;
+        };
+
+        bool dominates (size_t dominator, size_t block) const
+        {
+            while (block > dominator)
+                block = immediateDominators[block];
+
+            return block == dominator;
+        }
+
+        /** Returns the natural loops, innermost first. */
+        std::vector<Loop> findLoops() const
+        {
+            std::vector<Loop> loops;
+            auto numBlocks = blocks.size();
+
+            for (size_t header = 0; header < numBlocks; ++header)
+            {
+                Loop loop;
+                loop.header = header;
+
+                for (auto pred : predecessors[header])
+                    if (dominates (header, pred))
+                        loop.latches.push_back (pred);
+
+                if (loop.latches.empty())
+                    continue;
+
+                loop.contains.resize (numBlocks, false);
+                loop.contains[header] = true;
+                std::vector<size_t> blocksToVisit;
+
+                for (auto latch : loop.latches)
+                {
+                    if (! loop.contains[latch])
+                    {
+                        loop.contains[latch] = true;
+                        blocksToVisit.push_back (latch);
+                    }
+                }
+
+                while (! blocksToVisit.empty())
+                {
+                    auto b = blocksToVisit.back();
+                    blocksToVisit.pop_back();
+
+                    for (auto pred : predecessors[b])
+                    {
+                        if (! loop.contains[pred])
+                        {
+                            loop.contains[pred] = true;
+                            blocksToVisit.push_back (pred);
+                        }
+                    }
+                }
+
+                bool isReducible = true;
+
+                for (size_t i = 0; i < numBlocks; ++i)
+                {
+                    if (loop.contains[i])
+                    {
+                        loop.blocks.push_back (i);
+                        isReducible = isReducible && dominates (header, i);
+                    }
+                }
+
+                auto outsidePredecessor = findOnlyPredecessorFromOutside (loop);
+
+                if (isReducible && outsidePredecessor != notFound && successors[outsidePredecessor].size() == 1)
+                    loop.preheader = outsidePredecessor;
+
+                loops.push_back (std::move (loop));
+            }
+
+            std::stable_sort (loops.begin(), loops.end(),
+                              [] (const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+
+            return loops;
+        }
+
+        size_t findOnlyPredecessorFromOutside (const Loop& loop) const
+        {
+            auto result = notFound;
+
+            for (auto pred : predecessors[loop.header])
+            {
+                if (! loop.contains[pred])
+                {
+                    if (result != notFound)
+                        return notFound;
+
+                    result = pred;
+                }
+            }
+
+            return result;
+        }
+
+        /** Where a loop is entered from a conditional branch, this gives it a block of its
+            own to go in front of it, so that there's somewhere to put the hoisted code.
+        */
+        bool createLoopPreheaders()
+        {
+            bool anyCreated = false;
+
+            for (auto& loop : findLoops())
+            {
+                auto outsidePredecessor = findOnlyPredecessorFromOutside (loop);
+
+                if (outsidePredecessor == notFound || successors[outsidePredecessor].size() != 2)
+                    continue;
+
+                auto& header = blocks[loop.header].get();
+                auto& branch = *cast<heart::BranchIf> (blocks[outsidePredecessor]->terminator);
+                auto edge = branch.targets[0] == header ? 0u : 1u;
+
+                auto name = addSuffixToMakeUnique (header.name.toString() + "_preheader",
+                                                   [this] (const std::string& nm)
+                                                   {
+                                                       return heart::Utilities::findBlock (function, nm) != nullptr;
+                                                   });
+
+                auto headerPosition = static_cast<size_t> (std::distance (function.blocks.begin(),
+                                                                          std::find (function.blocks.begin(), function.blocks.end(), header)));
+
+                auto& preheader = heart::Utilities::insertBlock (module, function, headerPosition, name);
+                auto& newBranch = module.allocate<heart::Branch> (header);
+                newBranch.targetArgs = branch.targetArgs[edge];
+                preheader.terminator = newBranch;
+                branch.targets[edge] = preheader;
+                branch.targetArgs[edge].clear();
+                anyCreated = true;
+            }
+
+            return anyCreated;
+        }
+
+        //==============================================================================
+        struct LoopSideEffects
+        {
+            bool mayChangeAnyState = false, containsAdvance = false, writesViaReference = false, writesStateOrReference = false;
+            std::unordered_set<pool_ref<heart::Variable>> writtenVariables;
+        };
+
+        LoopSideEffects findSideEffects (const Loop& loop) const
+        {
+            LoopSideEffects effects;
+
+            for (auto b : loop.blocks)
+            {
+                for (auto s : blocks[b]->statements)
+                {
+                    if (is_type<heart::AdvanceClock> (*s))
+                        effects.containsAdvance = true;
+
+                    if (auto fc = cast<heart::FunctionCall> (*s))
+                        if (fc->getFunction().mayHaveSideEffects())
+                            effects.mayChangeAnyState = true;
+
+                    s->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType mode)
+                    {
+                        if (mode != AccessType::read)
+                        {
+                            if (auto v = e->getRootVariable())
+                            {
+                                effects.writtenVariables.insert (*v);
+
+                                if (v->type.isReference())
+                                    effects.writesViaReference = true;
+
+                                if (v->type.isReference() || v->isState())
+                                    effects.writesStateOrReference = true;
+                            }
+                        }
+                    });
+                }
+            }
+
+            return effects;
+        }
+
+        bool isLoopInvariant (heart::Expression& e, const Loop& loop, const LoopSideEffects& effects) const
+        {
+            if (is_type<heart::Constant> (e) || is_type<heart::ProcessorProperty> (e))
+                return true;
+
+            if (auto v = cast<heart::Variable> (e))
+            {
+                auto info = values.find (*v);
+
+                if (info != values.end())
+                    return info->second.block == nullptr || ! loop.contains[getIndex (*info->second.block)];
+
+                if (effects.mayChangeAnyState || effects.writtenVariables.find (*v) != effects.writtenVariables.end())
+                    return false;
+
+                if (v->type.isReference())
+                    return ! (effects.writesStateOrReference || effects.containsAdvance);
+
+                // Event handlers run during an advance(), so that's where they can change the state
+                if (effects.containsAdvance && v->isState() && isStateWrittenByOtherFunctions (*v))
+                    return false;
+
+                return ! (v->isState() && effects.writesViaReference);
+            }
+
+            if (auto u = cast<heart::UnaryOperator> (e))
+                return isLoopInvariant (u->source, loop, effects);
+
+            if (auto b = cast<heart::BinaryOperator> (e))
+                return ! mightTrap (*b)
+                        && isLoopInvariant (b->lhs, loop, effects)
+                        && isLoopInvariant (b->rhs, loop, effects);
+
+            if (auto t = cast<heart::TypeCast> (e))
+                return isLoopInvariant (t->source, loop, effects);
+
+            if (auto fc = cast<heart::PureFunctionCall> (e))
+            {
+                for (auto& arg : fc->arguments)
+                    if (! isLoopInvariant (arg, loop, effects))
+                        return false;
+
+                return true;
+            }
+
+            if (auto ae = cast<heart::ArrayElement> (e))
+                return ae->dynamicIndex == nullptr && isLoopInvariant (ae->parent, loop, effects);
+
+            if (auto se = cast<heart::StructElement> (e))
+                return isLoopInvariant (se->parent, loop, effects);
+
+            return false;
+        }
+
+        /** Finds whether a state variable is written anywhere other than in this function or the
+            init functions, which all run before it. Any other function could be, or be called by,
+            an event handler, and so might change the variable while this one is inside an advance().
+        */
+        bool isStateWrittenByOtherFunctions (heart::Variable& v) const
+        {
+            if (! stateWrittenByOtherFunctions.has_value())
+            {
+                stateWrittenByOtherFunctions.emplace();
+
+                for (auto& f : module.functions.get())
+                {
+                    if (f.getPointer() == std::addressof (function) || f->functionType.isSystemInit() || f->functionType.isUserInit())
+                        continue;
+
+                    for (auto& b : f->blocks)
+                    {
+                        for (auto s : b->statements)
+                        {
+                            s->visitExpressions ([this] (pool_ref<heart::Expression>& e, AccessType mode)
+                            {
+                                if (mode != AccessType::read)
+                                    if (auto written = e->getRootVariable())
+                                        if (written->isState())
+                                            stateWrittenByOtherFunctions->insert (*written);
+                            });
+                        }
+                    }
+                }
+            }
+
+            return stateWrittenByOtherFunctions->find (v) != stateWrittenByOtherFunctions->end();
+        }
+
+        /** Moving code out of a loop means that it may run when it wouldn't otherwise have done,
+            so anything that could fail at runtime has to stay where it is.
+        */
+        static bool mightTrap (heart::BinaryOperator& b)
+        {
+            if (b.operation != BinaryOp::Op::divide && b.operation != BinaryOp::Op::modulo)
+                return false;
+
+            if (! BinaryOp::getTypes (b.operation, b.lhs->getType(), b.rhs->getType()).operandType.isInteger())
+                return false;
+
+            if (auto divisor = cast<heart::Constant> (b.rhs))
+            {
+                auto n = divisor->value.getAsInt64();
+                return n == 0 || n == -1;
+            }
+
+            return true;
+        }
+
+        static bool isPureIntrinsic (heart::Function& f)
+        {
+            if (f.intrinsicType == IntrinsicType::none)
+                return false;
+
+            for (auto& p : f.parameters)
+                if (p->type.isReference())
+                    return false;
+
+            return true;
+        }
+
+        static bool canBeHoistedIntoValue (const Type& type)
+        {
+            return ! type.isReference()
+                    && (type.isBoundedInt() || (type.isPrimitiveOrVector() && ! type.isStringLiteral()));
+        }
+
+        bool canHoist (heart::Statement& s, const Loop& loop, const LoopSideEffects& effects) const
+        {
+            if (auto a = cast<heart::AssignFromValue> (s))
+                return getDefinedValue (*a) != nullptr && isLoopInvariant (a->source, loop, effects);
+
+            if (auto fc = cast<heart::FunctionCall> (s))
+            {
+                if (getDefinedValue (*fc) == nullptr || ! isPureIntrinsic (fc->getFunction()))
+                    return false;
+
+                for (auto& arg : fc->arguments)
+                    if (! isLoopInvariant (arg, loop, effects))
+                        return false;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        void hoistLoopInvariants (const Loop& loop)
+        {
+            auto& preheader = blocks[loop.preheader].get();
+            auto effects = findSideEffects (loop);
+
+            auto hoistOperand = [&] (pool_ref<heart::Expression>& e)
+            {
+                hoistInvariantSubExpressions (e, preheader, loop, effects);
+            };
+
+            for (auto blockIndex : loop.blocks)
+            {
+                auto& block = blocks[blockIndex].get();
+                LinkedList<heart::Statement>::Iterator previous;
+
+                for (auto i = block.statements.begin(); i != nullptr;)
+                {
+                    auto& s = **i;
+                    auto next = i.next();
+
+                    if (canHoist (s, loop, effects))
+                    {
+                        block.statements.removeNext (previous);
+                        s.nextObject = nullptr;
+                        preheader.statements.append (s);
+                        values[*getDefinedValue (*cast<heart::Assignment> (s))].block = preheader;
+                    }
+                    else
+                    {
+                        if (auto a = cast<heart::AssignFromValue> (s))
+                        {
+                            hoistOperand (a->source);
+                        }
+                        else if (auto fc = cast<heart::FunctionCall> (s))
+                        {
+                            for (size_t arg = 0; arg < fc->arguments.size(); ++arg)
+                                if (! fc->getFunction().parameters[arg]->type.isReference())
+                                    hoistOperand (fc->arguments[arg]);
+                        }
+                        else if (auto w = cast<heart::WriteStream> (s))
+                        {
+                            hoistOperand (w->value);
+                        }
+
+                        previous = i;
+                    }
+
+                    i = next;
+                }
+
+                if (auto bi = cast<heart::BranchIf> (block.terminator))
+                    hoistOperand (bi->condition);
+                else if (auto r = cast<heart::ReturnValue> (block.terminator))
+                    hoistOperand (r->returnValue);
+            }
+        }
+
+        void hoistInvariantSubExpressions (pool_ref<heart::Expression>& e, heart::Block& preheader,
+                                           const Loop& loop, const LoopSideEffects& effects)
+        {
+            if (is_type<heart::Variable> (e) || is_type<heart::ProcessorProperty> (e) || e->getAsConstant().isValid())
+                return;
+
+            auto type = e->getType().removeConstIfPresent();
+
+            if (canBeHoistedIntoValue (type) && isLoopInvariant (e, loop, effects))
+            {
+                auto& value = module.allocate<heart::Variable> (e->location, type, heart::Variable::Role::constant);
+                auto& assignment = module.allocate<heart::AssignFromValue> (e->location, value, e);
+                preheader.statements.append (assignment);
+                values[value] = { assignment, preheader };
+                e = value;
+                return;
+            }
+
+            visitSubExpressions (e.get(), [&] (pool_ref<heart::Expression>& child) { hoistInvariantSubExpressions (child, preheader, loop, effects); });
+        }
+
+        template <typename VisitorFn>
+        static void visitSubExpressions (heart::Expression& e, VisitorFn&& visit)
+        {
+            if (auto u = cast<heart::UnaryOperator> (e))
+            {
+                visit (u->source);
+            }
+            else if (auto b = cast<heart::BinaryOperator> (e))
+            {
+                visit (b->lhs);
+                visit (b->rhs);
+            }
+            else if (auto t = cast<heart::TypeCast> (e))
+            {
+                visit (t->source);
+            }
+            else if (auto fc = cast<heart::PureFunctionCall> (e))
+            {
+                for (auto& arg : fc->arguments)
+                    visit (arg);
+            }
+            else if (auto ae = cast<heart::ArrayElement> (e))
+            {
+                if (ae->dynamicIndex != nullptr)
+                {
+                    pool_ref<heart::Expression> index (*ae->dynamicIndex);
+                    visit (index);
+                    ae->dynamicIndex = index;
+                }
+            }
+        }
+
+        //==============================================================================
+        /** Where a loop counter is multiplied by a constant, this adds a second counter which
+            steps by the scaled amount, so the multiply becomes an add. This is only done for
+            integers, where the result is exactly the same.
+        */
+        void reduceInductionVariableMultiplies (const Loop& loop)
+        {
+            if (loop.latches.size() != 1 || predecessors[loop.header].size() != 2)
+                return;
+
+            auto& header = blocks[loop.header].get();
+            auto& preheader = blocks[loop.preheader].get();
+            auto latch = loop.latches.front();
+            auto& entryArgs = getBranchArgs (*preheader.terminator, 0);
+            auto& loopArgs = getBranchArgs (*blocks[latch]->terminator, successors[latch][0] == loop.header ? 0 : 1);
+            auto numOriginalParameters = header.parameters.size();
+            Replacements replacements;
+
+            for (size_t paramIndex = 0; paramIndex < numOriginalParameters; ++paramIndex)
+            {
+                auto& counter = header.parameters[paramIndex].get();
+                auto type = counter.type.removeConstIfPresent();
+
+                if (! type.isPrimitiveInteger())
+                    continue;
+
+                auto increment = findCounterIncrement (counter, loopArgs[paramIndex], loop);
+
+                if (increment == nullptr)
+                    continue;
+
+                std::vector<std::pair<Value, pool_ref<heart::Variable>>> scaledCounters;
+
+                auto getScaledCounter = [&] (heart::Expression& e) -> pool_ptr<heart::Variable>
+                {
+                    auto multiply = cast<heart::BinaryOperator> (e);
+
+                    if (multiply == nullptr || multiply->operation != BinaryOp::Op::multiply
+                         || ! multiply->getType().isEqual (type, Type::ignoreConst))
+                        return {};
+
+                    auto scale = multiply->lhs == counter ? cast<heart::Constant> (multiply->rhs)
+                                                          : (multiply->rhs == counter ? cast<heart::Constant> (multiply->lhs) : nullptr);
+
+                    if (scale == nullptr || ! scale->value.getType().isEqual (type, Type::ignoreConst))
+                        return {};
+
+                    for (auto& existing : scaledCounters)
+                        if (existing.first == scale->value)
+                            return existing.second;
+
+                    auto scaledCounter = createScaledCounter (header, preheader, counter, paramIndex, *increment, scale->value, entryArgs, loopArgs);
+
+                    if (scaledCounter != nullptr)
+                        scaledCounters.push_back ({ scale->value, *scaledCounter });
+
+                    return scaledCounter;
+                };
+
+                std::function<void(pool_ref<heart::Expression>&)> replaceMultiplies;
+
+                replaceMultiplies = [&] (pool_ref<heart::Expression>& e)
+                {
+                    if (auto scaledCounter = getScaledCounter (e))
+                        e = *scaledCounter;
+                    else
+                        visitSubExpressions (e.get(), replaceMultiplies);
+                };
+
+                auto visitOperand = [&] (pool_ref<heart::Expression>& e, AccessType mode)
+                {
+                    if (mode == AccessType::read)
+                        replaceMultiplies (e);
+                    else
+                        visitSubExpressions (e.get(), replaceMultiplies);
+                };
+
+                for (auto b : loop.blocks)
+                {
+                    auto& block = blocks[b].get();
+
+                    for (auto s : block.statements)
+                    {
+                        if (auto a = cast<heart::AssignFromValue> (*s))
+                        {
+                            if (auto product = getDefinedValue (*a))
+                            {
+                                if (auto scaledCounter = getScaledCounter (a->source))
+                                {
+                                    replacements.emplace (*product, *scaledCounter);
+                                    continue;
+                                }
+                            }
+                        }
+
+                        s->visitExpressions (visitOperand);
+                    }
+
+                    block.terminator->visitExpressions (visitOperand);
+                }
+            }
+
+            if (! replacements.empty())
+                replaceValues (replacements);
+        }
+
+        /** Checks whether the value passed back to the top of the loop is the counter plus or
+            minus a constant, and if so returns its definition.
+        */
+        pool_ptr<heart::AssignFromValue> findCounterIncrement (heart::Variable& counter, heart::Expression& nextValue, const Loop& loop) const
+        {
+            auto next = cast<heart::Variable> (nextValue);
+
+            if (next == nullptr)
+                return {};
+
+            auto info = values.find (*next);
+
+            if (info == values.end() || info->second.block == nullptr || ! loop.contains[getIndex (*info->second.block)])
+                return {};
+
+            auto a = cast<heart::AssignFromValue> (info->second.definition);
+
+            if (a == nullptr)
+                return {};
+
+            if (auto b = cast<heart::BinaryOperator> (a->source))
+            {
+                if (b->operation == BinaryOp::Op::add)
+                {
+                    if ((b->lhs == counter && is_type<heart::Constant> (b->rhs))
+                         || (b->rhs == counter && is_type<heart::Constant> (b->lhs)))
+                        return a;
+                }
+                else if (b->operation == BinaryOp::Op::subtract)
+                {
+                    if (b->lhs == counter && is_type<heart::Constant> (b->rhs))
+                        return a;
+                }
+            }
+
+            return {};
+        }
+
+        pool_ptr<heart::Variable> createScaledCounter (heart::Block& header, heart::Block& preheader, heart::Variable& counter,
+                                                       size_t paramIndex, heart::AssignFromValue& increment, const Value& scale,
+                                                       heart::Branch::ArgListType& entryArgs, heart::Branch::ArgListType& loopArgs)
+        {
+            auto& step = *cast<heart::BinaryOperator> (increment.source);
+            auto stepValue = cast<heart::Constant> (step.lhs == counter ? step.rhs : step.lhs)->value;
+            auto type = counter.type.removeConstIfPresent();
+            auto scaledStep = castConstant (stepValue, type);
+            auto ignoreError = [] (const CompileMessage&) {};
+
+            if (! (scaledStep.isValid() && BinaryOp::apply (scaledStep, scale, BinaryOp::Op::multiply, ignoreError)))
+                return {};
+
+            auto location = counter.location;
+            auto& scaledCounter = module.allocate<heart::Variable> (location, type, module.allocator.get (counter.name.toString() + "_scaled"),
+                                                                    heart::Variable::Role::parameter);
+            auto& initialValue = entryArgs[paramIndex].get();
+
+            if (auto c = cast<heart::Constant> (initialValue))
+            {
+                auto scaledInitialValue = castConstant (c->value, type);
+
+                if (! (scaledInitialValue.isValid() && BinaryOp::apply (scaledInitialValue, scale, BinaryOp::Op::multiply, ignoreError)))
+                    return {};
+
+                entryArgs.push_back (module.allocate<heart::Constant> (location, scaledInitialValue));
+            }
+            else
+            {
+                auto& scaledInitial = module.allocate<heart::Variable> (location, type, heart::Variable::Role::constant);
+                auto& assignment = module.allocate<heart::AssignFromValue> (location, scaledInitial,
+                                                                            module.allocate<heart::BinaryOperator> (location, initialValue,
+                                                                                                                    module.allocate<heart::Constant> (location, scale),
+                                                                                                                    BinaryOp::Op::multiply));
+                preheader.statements.append (assignment);
+                values[scaledInitial] = { assignment, preheader };
+                entryArgs.push_back (scaledInitial);
+            }
+
+            auto& nextScaledValue = module.allocate<heart::Variable> (location, type, heart::Variable::Role::constant);
+            auto& nextAssignment = module.allocate<heart::AssignFromValue> (location, nextScaledValue,
+                                                                            module.allocate<heart::BinaryOperator> (location, scaledCounter,
+                                                                                                                    module.allocate<heart::Constant> (location, scaledStep),
+                                                                                                                    step.operation));
+            auto& incrementBlock = values.find (*cast<heart::Variable> (increment.target))->second.block;
+            incrementBlock->statements.insertAfter (LinkedList<heart::Statement>::Iterator (increment), nextAssignment);
+            values[nextScaledValue] = { nextAssignment, incrementBlock };
+
+            header.addParameter (scaledCounter);
+            values[scaledCounter] = { nullptr, header };
+            loopArgs.push_back (nextScaledValue);
+            return scaledCounter;
+        }
+
+        //==============================================================================
+        struct LatticeValue
+        {
+            enum class State { unknown, constant, variable };
+
+            State state = State::unknown;
+            Value value;
+
+            static LatticeValue constant (Value v)    { return { State::constant, std::move (v) }; }
+            static LatticeValue variable()            { return { State::variable, {} }; }
+
+            bool isUnknown() const     { return state == State::unknown; }
+            bool isConstant() const    { return state == State::constant; }
+            bool isVariable() const    { return state == State::variable; }
+        };
+
+        static LatticeValue meet (const LatticeValue& a, const LatticeValue& b)
+        {
+            if (a.isUnknown())   return b;
+            if (b.isUnknown())   return a;
+
+            if (a.isConstant() && b.isConstant() && a.value == b.value)
+                return a;
+
+            return LatticeValue::variable();
+        }
+
+        static bool isFoldableType (const Type& type)
+        {
+            return type.isBoundedInt()
+                    || (type.isPrimitive() && (type.isInteger() || type.isFloatingPoint() || type.isBool()));
+        }
+
+        static Value castConstant (const Value& value, const Type& type)
+        {
+            auto targetType = type.removeConstIfPresent();
+
+            if (value.getType().isIdentical (targetType))
+                return value;
+
+            if (isFoldableType (value.getType()) && isFoldableType (targetType))
+                return value.tryCastToType (targetType);
+
+            return {};
+        }
+
+        static LatticeValue castToType (const LatticeValue& v, const Type& type)
+        {
+            if (! v.isConstant())
+                return v;
+
+            auto result = castConstant (v.value, type);
+
+            if (result.isValid())
+                return LatticeValue::constant (std::move (result));
+
+            return LatticeValue::variable();
+        }
+
+        static LatticeValue applyUnaryOp (const Value& source, UnaryOp::Op op)
+        {
+            if (isFoldableType (source.getType()))
+            {
+                auto result = source;
+
+                if (UnaryOp::apply (result, op))
+                    return LatticeValue::constant (std::move (result));
+            }
+
+            return LatticeValue::variable();
+        }
+
+        static LatticeValue applyBinaryOp (const Value& lhs, const Value& rhs, BinaryOp::Op op, const Type& resultType)
+        {
+            if (! (isFoldableType (lhs.getType()) && isFoldableType (rhs.getType())))
+                return LatticeValue::variable();
+
+            auto types = BinaryOp::getTypes (op, lhs.getType(), rhs.getType());
+
+            if (! types.operandType.isValid())
+                return LatticeValue::variable();
+
+            // Equality of floats can't be folded safely, as the values are compared bitwise
+            if (BinaryOp::isEqualityOperator (op) && types.operandType.isFloatingPoint())
+                return LatticeValue::variable();
+
+            if (types.operandType.isInteger())
+            {
+                if ((op == BinaryOp::Op::divide || op == BinaryOp::Op::modulo) && rhs.getAsInt64() == -1)
+                    return LatticeValue::variable();
+
+                if (op == BinaryOp::Op::leftShift || op == BinaryOp::Op::rightShift || op == BinaryOp::Op::rightShiftUnsigned)
+                {
+                    auto shift = rhs.getAsInt64();
+
+                    if (shift < 0 || shift >= (types.operandType.isInteger64() ? 64 : 32))
+                        return LatticeValue::variable();
+                }
+            }
+
+            auto result = lhs;
+
+            if (! BinaryOp::apply (result, rhs, op, [] (const CompileMessage&) {}))
+                return LatticeValue::variable();
+
+            return castToType (LatticeValue::constant (std::move (result)), resultType);
+        }
+
+        struct ConstantLattice
+        {
+            std::unordered_map<pool_ref<heart::Variable>, LatticeValue> values;
+
+            bool update (heart::Variable& v, const LatticeValue& newValue)
+            {
+                auto& current = values[v];
+                auto result = meet (current, newValue);
+
+                if (result.state == current.state && (! result.isConstant() || result.value == current.value))
+                    return false;
+
+                current = std::move (result);
+                return true;
+            }
+
+            LatticeValue evaluate (const SSAFunction& ssa, heart::Expression& e) const
+            {
+                if (auto c = cast<heart::Constant> (e))
+                    return LatticeValue::constant (c->value);
+
+                if (auto v = cast<heart::Variable> (e))
+                {
+                    auto info = ssa.values.find (*v);
+
+                    if (info == ssa.values.end() || info->second.block == nullptr)
+                        return LatticeValue::variable();
+
+                    auto i = values.find (*v);
+                    return i != values.end() ? i->second : LatticeValue();
+                }
+
+                if (auto u = cast<heart::UnaryOperator> (e))
+                {
+                    auto source = evaluate (ssa, u->source);
+
+                    if (source.isConstant())
+                        return applyUnaryOp (source.value, u->operation);
+
+                    return source;
+                }
+
+                if (auto b = cast<heart::BinaryOperator> (e))
+                {
+                    auto lhs = evaluate (ssa, b->lhs);
+                    auto rhs = evaluate (ssa, b->rhs);
+
+                    if (lhs.isVariable() || rhs.isVariable())
+                        return LatticeValue::variable();
+
+                    if (lhs.isUnknown() || rhs.isUnknown())
+                        return {};
+
+                    return applyBinaryOp (lhs.value, rhs.value, b->operation, b->getType());
+                }
+
+                if (auto t = cast<heart::TypeCast> (e))
+                    return castToType (evaluate (ssa, t->source), t->destType);
+
+                return LatticeValue::variable();
+            }
+        };
+
+        //==============================================================================
+        bool appendValueKey (std::string& key, heart::Expression& e) const
+        {
+            if (auto c = cast<heart::Constant> (e))
+            {
+                const auto& type = c->value.getType();
+
+                if (! (type.isBoundedInt() || (type.isPrimitiveOrVector() && ! type.isStringLiteral())))
+                    return false;
+
+                key += "c" + type.getDescription() + ":" + std::to_string (c->value.getPackedDataSize()) + ":";
+                key.append (static_cast<const char*> (c->value.getPackedData()), c->value.getPackedDataSize());
+                return true;
+            }
+
+            if (auto v = cast<heart::Variable> (e))
+            {
+                if (! isValue (*v))
+                    return false;
+
+                key += "v" + std::to_string (reinterpret_cast<uintptr_t> (v.get()));
+                return true;
+            }
+
+            if (auto p = cast<heart::ProcessorProperty> (e))
+            {
+                key += "p" + std::to_string (static_cast<int> (p->property));
+                return true;
+            }
+
+            if (auto u = cast<heart::UnaryOperator> (e))
+            {
+                key += "u" + std::to_string (static_cast<int> (u->operation)) + "(";
+
+                if (! appendValueKey (key, u->source))
+                    return false;
+
+                key += ")";
+                return true;
+            }
+
+            if (auto b = cast<heart::BinaryOperator> (e))
+            {
+                std::string lhs, rhs;
+
+                if (! (appendValueKey (lhs, b->lhs) && appendValueKey (rhs, b->rhs)))
+                    return false;
+
+                if (isCommutative (b->operation) && rhs < lhs)
+                    std::swap (lhs, rhs);
+
+                key += "b" + std::to_string (static_cast<int> (b->operation)) + "(" + lhs + "," + rhs + ")";
+                return true;
+            }
+
+            if (auto t = cast<heart::TypeCast> (e))
+            {
+                if (! (t->destType.isBoundedInt() || t->destType.isPrimitiveOrVector()))
+                    return false;
+
+                key += "t" + t->destType.getDescription() + "(";
+
+                if (! appendValueKey (key, t->source))
+                    return false;
+
+                key += ")";
+                return true;
+            }
+
+            if (auto fc = cast<heart::PureFunctionCall> (e))
+            {
+                key += "f" + std::to_string (reinterpret_cast<uintptr_t> (std::addressof (fc->function))) + "(";
+
+                for (auto& arg : fc->arguments)
+                {
+                    if (! appendValueKey (key, arg))
+                        return false;
+
+                    key += ",";
+                }
+
+                key += ")";
+                return true;
+            }
+
+            return false;
+        }
+
+        static bool isCommutative (BinaryOp::Op op)
+        {
+            return op == BinaryOp::Op::add        || op == BinaryOp::Op::multiply
+                || op == BinaryOp::Op::bitwiseAnd || op == BinaryOp::Op::bitwiseOr  || op == BinaryOp::Op::bitwiseXor
+                || op == BinaryOp::Op::logicalAnd || op == BinaryOp::Op::logicalOr
+                || op == BinaryOp::Op::equals     || op == BinaryOp::Op::notEquals;
+        }
+
+        //==============================================================================
+        using ParameterLiveness = std::unordered_map<pool_ref<heart::Variable>, std::vector<bool>>;
+
+        /** For each block parameter, finds the blocks at whose start its value is still needed. */
+        ParameterLiveness findBlockParameterLiveness() const
+        {
+            ParameterLiveness liveness;
+            std::unordered_map<pool_ref<heart::Variable>, size_t> owners;
+            std::unordered_map<pool_ref<heart::Variable>, std::vector<size_t>> useBlocks;
+
+            for (size_t i = 0; i < blocks.size(); ++i)
+                for (auto& p : blocks[i]->parameters)
+                    owners.emplace (p, i);
+
+            if (owners.empty())
+                return liveness;
+
+            for (size_t i = 0; i < blocks.size(); ++i)
+            {
+                auto visitUse = [&] (pool_ref<heart::Expression>& e, AccessType)
+                {
+                    if (auto v = cast<heart::Variable> (e))
+                    {
+                        if (owners.find (*v) != owners.end())
+                        {
+                            auto& list = useBlocks[*v];
+
+                            if (list.empty() || list.back() != i)
+                                list.push_back (i);
+                        }
+                    }
+                };
+
+                for (auto s : blocks[i]->statements)
+                    s->visitExpressions (visitUse);
+
+                blocks[i]->terminator->visitExpressions (visitUse);
+            }
+
+            for (auto& owner : owners)
+            {
+                auto& live = liveness[owner.first];
+                live.resize (blocks.size(), false);
+                auto found = useBlocks.find (owner.first);
+
+                if (found == useBlocks.end())
+                    continue;
+
+                std::vector<size_t> blocksToVisit;
+
+                for (auto b : found->second)
+                {
+                    if (b != owner.second)
+                    {
+                        live[b] = true;
+                        blocksToVisit.push_back (b);
+                    }
+                }
+
+                while (! blocksToVisit.empty())
+                {
+                    auto b = blocksToVisit.back();
+                    blocksToVisit.pop_back();
+
+                    for (auto pred : predecessors[b])
+                    {
+                        if (pred != owner.second && ! live[pred])
+                        {
+                            live[pred] = true;
+                            blocksToVisit.push_back (pred);
+                        }
+                    }
+                }
+            }
+
+            return liveness;
+        }
+
+        /** Checks whether the copies into a target block's parameters can go at the end of a
+            block that ends in a conditional branch, rather than needing a block of their own.
+        */
+        bool canCopyBeforeBranch (heart::BranchIf& branch, heart::Block& target, heart::Block& otherTarget,
+                                  const ParameterLiveness& liveness) const
+        {
+            for (auto& p : target.parameters)
+            {
+                if (branch.condition->readsVariable (p))
+                    return false;
+
+                auto live = liveness.find (p);
+
+                if (live != liveness.end() && live->second[getIndex (otherTarget)])
+                    return false;
+            }
+
+            return true;
+        }
+
+        heart::Block& insertEdgeBlock (heart::Block& source, heart::Block& target)
+        {
+            auto name = addSuffixToMakeUnique (target.name.toString() + "_edge",
+                                               [this] (const std::string& nm)
+                                               {
+                                                   return heart::Utilities::findBlock (function, nm) != nullptr;
+                                               });
+
+            // The new block goes straight after the source, so that any values it reads
+            // will still have been declared before it when the code is printed
+            auto sourceIndex = static_cast<size_t> (std::distance (function.blocks.begin(),
+                                                                   std::find (function.blocks.begin(), function.blocks.end(), source)));
+
+            auto& newBlock = heart::Utilities::insertBlock (module, function, sourceIndex + 1, name);
+            newBlock.terminator = module.allocate<heart::Branch> (target);
+            return newBlock;
+        }
+
+        /** Appends assignments which copy a list of branch arguments into the target block's
+            parameters, behaving as if all the arguments were evaluated before any of them is assigned.
+        */
+        void appendParallelCopy (heart::Block& block, const std::vector<pool_ref<heart::Variable>>& params,
+                                 const heart::Branch::ArgListType& args)
+        {
+            SOUL_ASSERT (params.size() == args.size());
+            std::vector<size_t> copies;
+
+            for (size_t i = 0; i < params.size(); ++i)
+                if (args[i].getPointer() != params[i].getPointer())
+                    copies.push_back (i);
+
+            bool needsTemporaries = false;
+
+            for (auto i : copies)
+                for (auto j : copies)
+                    if (i != j && args[i]->readsVariable (params[j]))
+                        needsTemporaries = true;
+
+            if (! needsTemporaries)
+            {
+                for (auto i : copies)
+                    block.statements.append (module.allocate<heart::AssignFromValue> (args[i]->location, params[i], args[i]));
+
+                return;
+            }
+
+            std::vector<pool_ref<heart::Variable>> temporaries;
+
+            for (auto i : copies)
+            {
+                auto& temp = module.allocate<heart::Variable> (args[i]->location, params[i]->type, heart::Variable::Role::constant);
+                block.statements.append (module.allocate<heart::AssignFromValue> (args[i]->location, temp, args[i]));
+                temporaries.push_back (temp);
+            }
+
+            for (size_t i = 0; i < copies.size(); ++i)
+                block.statements.append (module.allocate<heart::AssignFromValue> (args[copies[i]]->location,
+                                                                                  params[copies[i]], temporaries[i]));
+        }
+
+        /** Where a value is calculated and then immediately copied into a variable, this
+            assigns it to the variable directly instead.
+        */
+        void coalesceCopies()
+        {
+            std::unordered_map<pool_ref<heart::Variable>, uint32_t> numReads;
+
+            for (auto& b : function.blocks)
+                b->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType mode)
+                {
+                    if (mode != AccessType::write)
+                        if (auto v = cast<heart::Variable> (e))
+                            numReads[*v]++;
+                });
+
+            for (auto& b : function.blocks)
+            {
+                std::vector<heart::Statement*> copiesToRemove;
+
+                for (auto s : b->statements)
+                {
+                    auto copy = cast<heart::AssignFromValue> (*s);
+
+                    if (copy == nullptr)
+                        continue;
+
+                    auto dest = cast<heart::Variable> (copy->target);
+                    auto source = cast<heart::Variable> (copy->source);
+
+                    if (dest == nullptr || source == nullptr || ! dest->isMutableLocal() || ! source->isConstant()
+                         || numReads[*source] != 1 || ! source->type.isEqual (dest->type, Type::ignoreConst))
+                        continue;
+
+                    pool_ptr<heart::Assignment> definition;
+
+                    for (auto other : b->statements)
+                    {
+                        if (other == s)
+                            break;
+
+                        if (auto a = cast<heart::Assignment> (*other))
+                        {
+                            if (a->target == source)
+                            {
+                                definition = a;
+                                continue;
+                            }
+                        }
+
+                        if (definition != nullptr && (other->readsVariable (*dest) || other->writesVariable (*dest)))
+                            definition = nullptr;
+                    }
+
+                    if (definition == nullptr || (is_type<heart::FunctionCall> (definition) && definition->readsVariable (*dest)))
+                        continue;
+
+                    definition->target = dest;
+                    copiesToRemove.push_back (s);
+                }
+
+                if (! copiesToRemove.empty())
+                    b->statements.removeMatches ([&] (heart::Statement& s) { return contains (copiesToRemove, std::addressof (s)); });
+            }
+        }
+    };
+
+    //==============================================================================
+    /** Removes assignments to local variables which are overwritten later in the same
+        block before anything reads them.
+    */
+    static void removeDeadStores (heart::Function& f)
+    {
+        for (auto& b : f.blocks)
+        {
+            std::vector<heart::Statement*> deadStores;
+
+            for (auto s : b->statements)
+                if (auto a = cast<heart::AssignFromValue> (*s))
+                    if (auto v = cast<heart::Variable> (a->target))
+                        if (v->isFunctionLocal() && isOverwrittenBeforeBeingRead (*v, s->nextObject))
+                            deadStores.push_back (s);
+
+            if (! deadStores.empty())
+                b->statements.removeMatches ([&] (heart::Statement& s) { return contains (deadStores, std::addressof (s)); });
+        }
+    }
+
+    static bool isOverwrittenBeforeBeingRead (heart::Variable& v, heart::Statement* s)
+    {
+        for (; s != nullptr; s = s->nextObject)
+        {
+            if (auto a = cast<heart::Assignment> (*s))
+            {
+                if (a->target == v)
+                {
+                    if (auto assignment = cast<heart::AssignFromValue> (a))
+                        return ! assignment->source->readsVariable (v);
+
+                    if (auto call = cast<heart::FunctionCall> (a))
+                        for (auto& arg : call->arguments)
+                            if (arg->readsVariable (v))
+                                return false;
+
+                    return true;
+                }
+            }
+
+            if (s->readsVariable (v))
+                return false;
+        }
+
+        return false;
+    }
+};
+
+} // namespace soul
@@ -29,6 +29,7 @@ struct Optimisations
 {
     static void removeUnusedVariables (Program& program)
     {
+        SOUL_PROFILE_SCOPE ("removeUnusedVariables");
         for (auto& m : program.getModules())
         {
             m->rebuildVariableUseCounts();
@@ -50,6 +51,7 @@ struct Optimisations
 
     static void removeUnusedFunctions (Program& program, Module& mainModule)
     {
+        SOUL_PROFILE_SCOPE ("removeUnusedFunctions");
         removeCallsToVoidFunctionsWithoutSideEffects (program);
 
         for (auto& m : program.getModules())
@@ -71,6 +73,7 @@ struct Optimisations
 
     static void removeUnusedProcessors (Program& program)
     {
+        SOUL_PROFILE_SCOPE ("removeUnusedProcessors");
         auto modules = program.getModules();
 
         for (auto& m : modules)
@@ -80,6 +83,7 @@ struct Optimisations
 
     static void removeUnusedNamespaces (Program& program)
     {
+        SOUL_PROFILE_SCOPE ("removeUnusedNamespaces");
         auto modules = program.getModules();
 
         for (auto& m : modules)
@@ -90,6 +94,7 @@ struct Optimisations
 
     static void removeUnusedStructs (Program& program)
     {
+        SOUL_PROFILE_SCOPE ("removeUnusedStructs");
         for (auto& m : program.getModules())
             for (auto& s : m->structs.get())
                 s->activeUseFlag = false;
@@ -151,6 +156,7 @@ struct Optimisations
 
     static void optimiseFunctionBlocks (Program& program)
     {
+        SOUL_PROFILE_SCOPE ("optimiseFunctionBlocks");
         for (auto& m : program.getModules())
             for (auto f : m->functions.get())
                 optimiseFunctionBlocks (f, program.getAllocator());
@@ -176,6 +182,7 @@ struct Optimisations
 
     static bool inlineAllCallsToFunction (Program& program, heart::Function& functionToInline)
     {
+        SOUL_PROFILE_SCOPE ("Inliner");
         bool anyChanged = false;
 
         for (auto& m : program.getModules())
@@ -199,9 +206,19 @@ struct Optimisations
         return true;
     }
 
+    /** Inlines the calls that the CostBasedInliner thinks are worth it, within the limits
+        set by the optimisation level and BuildSettings::inlineSizeBudget.
+    */
+    static void inlineFunctionsByCost (Program& program, const BuildSettings& settings)
+    {
+        SOUL_PROFILE_SCOPE ("inlineFunctionsByCost");
+        CostBasedInliner (program, settings).perform();
+    }
+
     static void garbageCollectStringDictionary (Program& program)
     {
-        std::vector<StringDictionary::Handle> handlesUsed;
+        SOUL_PROFILE_SCOPE ("garbageCollectStringDictionary");
+        std::vector<uint32_t> handlesUsed;
 
         for (auto& m : program.getModules())
             for (auto f : m->functions.get())
@@ -212,17 +229,16 @@ struct Optimisations
                                              const auto& type = c->value.getType();
 
                                              if (type.isStringLiteral())
-                                             {
-                                                 auto handle = c->value.getStringLiteral();
-
-                                                 if (! contains (handlesUsed, handle))
-                                                     handlesUsed.push_back (handle);
-                                             }
+                                                 handlesUsed.push_back (c->value.getStringLiteral().handle);
                                          }
                                      });
 
-        removeIf (program.getStringDictionary().strings,
-                  [&] (const StringDictionary::Item& item) { return ! contains (handlesUsed, item.handle); });
+        std::sort (handlesUsed.begin(), handlesUsed.end());
+
+        program.getStringDictionary().removeIf ([&] (const StringDictionary::Item& item)
+        {
+            return ! std::binary_search (handlesUsed.begin(), handlesUsed.end(), item.handle.handle);
+        });
     }
 
 
@@ -516,6 +532,9 @@ private:
 
         void cloneBlock (heart::Block& target, const heart::Block& source)
         {
+            for (auto& p : source.parameters)
+                target.addParameter (getRemappedVariable (p));
+
             LinkedList<heart::Statement>::Iterator last;
 
             for (auto s : source.statements)
@@ -548,14 +567,25 @@ private:
 
         heart::Branch& clone (const heart::Branch& old)
         {
-            return module.allocate<heart::Branch> (*remappedBlocks[old.target]);
+            auto& b = module.allocate<heart::Branch> (*remappedBlocks[old.target]);
+
+            for (auto& arg : old.targetArgs)
+                b.targetArgs.push_back (cloneExpression (arg));
+
+            return b;
         }
 
         heart::BranchIf& clone (const heart::BranchIf& old)
         {
-            return module.allocate<heart::BranchIf> (cloneExpression (old.condition),
-                                                     *remappedBlocks[old.targets[0]],
-                                                     *remappedBlocks[old.targets[1]]);
+            auto& b = module.allocate<heart::BranchIf> (cloneExpression (old.condition),
+                                                        *remappedBlocks[old.targets[0]],
+                                                        *remappedBlocks[old.targets[1]]);
+
+            for (int i = 0; i < 2; ++i)
+                for (auto& arg : old.targetArgs[i])
+                    b.targetArgs[i].push_back (cloneExpression (arg));
+
+            return b;
         }
 
         heart::Terminator& clone (const heart::ReturnVoid&)    { return module.allocate<heart::Branch> (*postCallResumeBlock); }
@@ -746,6 +776,278 @@ private:
             anyChanged = true;
         }
     }
+
+    //==============================================================================
+    /**
+        Decides which calls to inline by estimating the size of each callee in HEART
+        instructions, and weighing that against how often the call is likely to run.
+
+        Calls made from run() or anything it calls are treated as hot, calls inside loops
+        elsewhere as warm, and everything else (e.g. event handlers and init code) as cold.
+        Tiny functions are inlined into code of any frequency, because the call costs about
+        as much as the body, but larger ones are only inlined into hot or warm code. Every
+        inline is charged to the budget, including the tiny ones, so the total amount of code
+        added can never exceed it. Functions are visited callees-first, so a callee's size
+        includes anything that has already been inlined into it.
+    */
+    struct CostBasedInliner
+    {
+        CostBasedInliner (Program& p, const BuildSettings& settings)  : program (p)
+        {
+            auto level = settings.optimisationLevel < 0 ? 2 : settings.optimisationLevel;
+
+            if (level == 0)
+                return;
+
+            remainingBudget = 1000;
+
+            if (level >= 2)
+            {
+                auto scale = level >= 3 ? 2 : 1;
+                warmSizeLimit = 24 * scale;
+                hotSizeLimit = 64 * scale;
+                remainingBudget = 4000 * scale * scale;
+            }
+
+            if (settings.inlineSizeBudget != 0)
+                remainingBudget = settings.inlineSizeBudget;
+
+            isEnabled = true;
+        }
+
+        void perform()
+        {
+            if (! isEnabled)
+                return;
+
+            findHotFunctions();
+
+            for (auto& f : getFunctionsInCallOrder())
+            {
+                inlineCallsWithin (f);
+                sizes[std::addressof (f.get())] = getSize (f);
+            }
+
+            removeFunctionsNoLongerCalled();
+        }
+
+    private:
+        enum class Frequency { cold, warm, hot };
+
+        static constexpr uint32_t alwaysInlineSize = 12;
+        static constexpr uint32_t constantArgumentBonus = 3;
+        static constexpr uint32_t maxNestingDepth = 4;
+
+        Program& program;
+        bool isEnabled = false;
+        int64_t warmSizeLimit = 0, hotSizeLimit = 0, remainingBudget = 0;
+        std::unordered_set<const heart::Function*> hotFunctions, inlinedFunctions;
+        std::unordered_map<const heart::Function*, uint32_t> sizes, nestingDepths;
+
+        template <typename Visitor>
+        static void visitCalls (const heart::Function& f, Visitor&& visit)
+        {
+            for (auto& b : f.blocks)
+                for (auto s : b->statements)
+                    if (auto call = cast<heart::FunctionCall> (*s))
+                        visit (call->getFunction());
+        }
+
+        void findHotFunctions()
+        {
+            std::vector<pool_ref<heart::Function>> toVisit;
+
+            for (auto& m : program.getModules())
+                for (auto& f : m->functions.get())
+                    if (f->functionType.isRun())
+                        toVisit.push_back (f);
+
+            while (! toVisit.empty())
+            {
+                auto& f = toVisit.back().get();
+                toVisit.pop_back();
+
+                if (hotFunctions.insert (std::addressof (f)).second)
+                    visitCalls (f, [&] (heart::Function& callee) { toVisit.push_back (callee); });
+            }
+        }
+
+        std::vector<pool_ref<heart::Function>> getFunctionsInCallOrder()
+        {
+            std::vector<pool_ref<heart::Function>> result;
+            std::unordered_set<const heart::Function*> visited;
+
+            std::function<void(heart::Function&)> visit = [&] (heart::Function& f)
+            {
+                if (visited.insert (std::addressof (f)).second)
+                {
+                    visitCalls (f, visit);
+                    result.push_back (f);
+                }
+            };
+
+            for (auto& m : program.getModules())
+                for (auto& f : m->functions.get())
+                    visit (f);
+
+            return result;
+        }
+
+        static uint32_t getSize (const heart::Function& f)
+        {
+            uint32_t size = 0;
+
+            auto countExpression = [&] (pool_ref<heart::Expression>& e, AccessType)
+            {
+                if (! (is_type<heart::Variable> (e) || is_type<heart::Constant> (e)))
+                    ++size;
+            };
+
+            for (auto& b : f.blocks)
+            {
+                for (auto s : b->statements)
+                {
+                    s->visitExpressions (countExpression);
+                    ++size;
+                }
+
+                b->terminator->visitExpressions (countExpression);
+                ++size;
+            }
+
+            return size;
+        }
+
+        uint32_t getCachedSize (const heart::Function& f)
+        {
+            auto existing = sizes.find (std::addressof (f));
+
+            if (existing != sizes.end())
+                return existing->second;
+
+            return sizes[std::addressof (f)] = getSize (f);
+        }
+
+        static bool isInLoop (const heart::Function& f, heart::Block& block)
+        {
+            bool found = false;
+
+            CallFlowGraph::visitDownstreamBlocks (f, block, [&] (heart::Block& b)
+            {
+                found = std::addressof (b) == std::addressof (block);
+                return ! found;
+            });
+
+            return found;
+        }
+
+        Frequency getFrequency (const heart::Function& caller, heart::Block& block) const
+        {
+            if (hotFunctions.find (std::addressof (caller)) != hotFunctions.end())
+                return Frequency::hot;
+
+            return isInLoop (caller, block) ? Frequency::warm : Frequency::cold;
+        }
+
+        bool isCandidate (heart::Function& caller, heart::FunctionCall& call)
+        {
+            auto& callee = call.getFunction();
+
+            return std::addressof (callee) != std::addressof (caller)
+                    && callee.functionType.isNormal()
+                    && ! (callee.isExported || callee.hasNoBody)
+                    && callee.intrinsicType == IntrinsicType::none
+                    && ! callee.annotation.getBool ("do_not_optimise")
+                    && nestingDepths[std::addressof (callee)] < maxNestingDepth
+                    && heart::Utilities::canFunctionBeInlined (program, caller, call);
+        }
+
+        bool shouldInline (heart::Function& caller, heart::Block& block, heart::FunctionCall& call)
+        {
+            if (! isCandidate (caller, call))
+                return false;
+
+            auto calleeSize = (int64_t) getCachedSize (call.getFunction());
+            auto callSize = (int64_t) (1 + call.arguments.size());
+            auto growth = std::max ((int64_t) 0, calleeSize - callSize);
+            auto cost = calleeSize;
+
+            for (auto& arg : call.arguments)
+                if (is_type<heart::Constant> (arg))
+                    cost -= constantArgumentBonus;
+
+            if (growth > remainingBudget)
+                return false;
+
+            if (cost > alwaysInlineSize)
+            {
+                auto frequency = getFrequency (caller, block);
+                auto limit = frequency == Frequency::hot ? hotSizeLimit
+                                                         : (frequency == Frequency::warm ? warmSizeLimit : 0);
+
+                if (cost > limit)
+                    return false;
+            }
+
+            remainingBudget -= growth;
+            return true;
+        }
+
+        void inlineCallsWithin (heart::Function& f)
+        {
+            for (size_t blockIndex = 0; blockIndex < f.blocks.size(); ++blockIndex)
+            {
+                for (auto s : f.blocks[blockIndex]->statements)
+                {
+                    if (auto call = cast<heart::FunctionCall> (*s))
+                    {
+                        if (shouldInline (f, f.blocks[blockIndex], *call))
+                        {
+                            auto& callee = call->getFunction();
+                            auto& depth = nestingDepths[std::addressof (f)];
+                            depth = std::max (depth, nestingDepths[std::addressof (callee)] + 1);
+                            inlinedFunctions.insert (std::addressof (callee));
+
+                            // The rest of this block gets moved to a new block after the callee's
+                            // blocks, so skip over those and carry on from there
+                            makeFunctionCallInline (program, f, blockIndex, *call);
+                            blockIndex += callee.blocks.size();
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        void removeFunctionsNoLongerCalled()
+        {
+            if (inlinedFunctions.empty())
+                return;
+
+            std::unordered_set<const heart::Function*> stillUsed;
+
+            for (auto& m : program.getModules())
+            {
+                for (auto& f : m->functions.get())
+                {
+                    visitCalls (f, [&] (heart::Function& callee) { stillUsed.insert (std::addressof (callee)); });
+
+                    f->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+                    {
+                        if (auto pfc = cast<heart::PureFunctionCall> (e))
+                            stillUsed.insert (std::addressof (pfc->function));
+                    });
+                }
+            }
+
+            for (auto& m : program.getModules())
+                m->functions.removeIf ([&] (heart::Function& f)
+                {
+                    return inlinedFunctions.find (std::addressof (f)) != inlinedFunctions.end()
+                            && stillUsed.find (std::addressof (f)) == stillUsed.end();
+                });
+        }
+    };
 };
 
 } // namespace soul
@@ -0,0 +1,608 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Looks for processors whose run() function is a simple per-frame stream loop, e.g.
+    `loop { out << f (in); advance(); }`, and adds a version of that loop which works
+    on a group of frames at once, using vectors in place of the scalar stream values.
+
+    The new function takes a reference to a vector for each output stream, followed by a
+    parameter for each input that isn't an event: a vector of frames for a stream, or a
+    single value for a value endpoint. It adds the values that one pass of the loop would
+    have written to each output. An engine can call it instead of run() to render a block
+    of frames, and must set the outputs to zero beforehand. Event inputs have no parameter,
+    so the engine must deliver any events before the call and end the group before the
+    next one, and a value input must not change during the group.
+
+    Only loops with no dependencies between iterations can be handled, so the outputs must
+    be scalar streams, the run() function can't write any state or modify a variable that
+    it reads in a later frame, and the loop body must only contain arithmetic and calls to
+    element-wise intrinsics such as tanh() or clamp(), which map directly onto vector
+    operations.
+*/
+struct StreamLoopVectoriser
+{
+    static void apply (Program& program, const BuildSettings& settings)
+    {
+        if (settings.optimisationLevel == 0)
+            return;
+
+        SOUL_PROFILE_SCOPE ("StreamLoopVectoriser");
+
+        for (auto& m : program.getModules())
+            if (m->isProcessor())
+                StreamLoopVectoriser (m).createVectorisedRunFunction();
+    }
+
+    /** Returns the number of frames that each call to a vectorised run function will process. */
+    static uint32_t getFramesPerCall (const heart::Function& f)
+    {
+        return static_cast<uint32_t> (f.parameters.front()->type.removeReferenceIfPresent().getVectorSize());
+    }
+
+private:
+    StreamLoopVectoriser (Module& m) : module (m) {}
+
+    enum class Kind { uniform, varying, unsupported };
+
+    Module& module;
+    pool_ptr<heart::Block> prologue, loop;
+    std::unordered_set<const heart::Variable*> loopVariables, assignedLoopVariables, varyingVariables;
+    std::unordered_map<const heart::Variable*, pool_ptr<heart::Variable>> kernelVariables;
+    std::unordered_map<const heart::IODeclaration*, pool_ptr<heart::Variable>> endpointParameters;
+    Type::ArraySize numFrames = 8;
+
+    void createVectorisedRunFunction()
+    {
+        if (module.functions.find (heart::getVectorisedRunFunctionName()) != nullptr || ! canVectorise())
+            return;
+
+        FunctionBuilder::createFunction (module, heart::getVectorisedRunFunctionName(), PrimitiveType::void_,
+                                         [this] (FunctionBuilder& builder) { build (builder); });
+    }
+
+    //==============================================================================
+    static bool isSupportedType (const Type& type)
+    {
+        auto t = type.removeReferenceIfPresent().removeConstIfPresent();
+        return t.isPrimitive() && (t.isFloat32() || t.isFloat64() || t.isInteger32());
+    }
+
+    static bool isSupportedStream (const heart::IODeclaration& io)
+    {
+        return io.isStreamEndpoint() && ! io.arraySize.has_value() && isSupportedType (io.getFrameType());
+    }
+
+    static bool isSupportedValue (const heart::IODeclaration& io)
+    {
+        return io.isValueEndpoint() && ! io.arraySize.has_value() && isSupportedType (io.getValueType());
+    }
+
+    static bool isSupportedInput (const heart::IODeclaration& io)
+    {
+        return isSupportedStream (io) || isSupportedValue (io) || io.isEventEndpoint();
+    }
+
+    /** Only intrinsics which both engines can run natively on a vector are allowed, because
+        the vector versions are declared without a body.
+    */
+    static bool canVectoriseIntrinsic (const heart::Function& f)
+    {
+        auto type = f.returnType.removeReferenceIfPresent().removeConstIfPresent();
+
+        if (! isSupportedType (type) || f.parameters.empty())
+            return false;
+
+        for (auto& p : f.parameters)
+            if (! p->type.removeReferenceIfPresent().isEqual (type, Type::ignoreConst))
+                return false;
+
+        auto numArgs = f.parameters.size();
+
+        switch (f.intrinsicType)
+        {
+            case IntrinsicType::abs:    return numArgs == 1;
+            case IntrinsicType::min:
+            case IntrinsicType::max:    return numArgs == 2;
+            case IntrinsicType::clamp:  return numArgs == 3;
+            default:                    break;
+        }
+
+        if (! type.isPrimitiveFloat())
+            return false;
+
+        switch (f.intrinsicType)
+        {
+            case IntrinsicType::floor:  case IntrinsicType::ceil:   case IntrinsicType::sqrt:
+            case IntrinsicType::exp:    case IntrinsicType::log:    case IntrinsicType::log10:
+            case IntrinsicType::sin:    case IntrinsicType::cos:    case IntrinsicType::tan:
+            case IntrinsicType::sinh:   case IntrinsicType::cosh:   case IntrinsicType::tanh:
+                return numArgs == 1;
+
+            case IntrinsicType::fmod:   case IntrinsicType::pow:
+                return numArgs == 2;
+
+            default:
+                return false;
+        }
+    }
+
+    void useFrameTypeForWidth (const Type& type)
+    {
+        if (type.getPrimitiveType().getPackedSizeInBytes() > 4)
+            numFrames = 4;
+    }
+
+    static pool_ptr<heart::Variable> getLocalVariable (pool_ptr<heart::Expression> e)
+    {
+        if (auto v = cast<heart::Variable> (e))
+            if (v->isFunctionLocal())
+                return v;
+
+        return {};
+    }
+
+    bool canVectorise()
+    {
+        if (module.outputs.empty())
+            return false;
+
+        for (auto& output : module.outputs)
+            if (! isSupportedStream (output))
+                return false;
+
+        for (auto& input : module.inputs)
+            if (! isSupportedInput (input))
+                return false;
+
+        auto run = module.functions.findRunFunction();
+
+        if (run == nullptr || run->blocks.size() != 2)
+            return false;
+
+        prologue = run->blocks[0];
+        loop = run->blocks[1];
+
+        auto prologueBranch = cast<heart::Branch> (prologue->terminator);
+        auto loopBranch = cast<heart::Branch> (loop->terminator);
+
+        if (prologueBranch == nullptr || loopBranch == nullptr
+             || prologueBranch->target.getPointer() != loop.get() || loopBranch->target.getPointer() != loop.get()
+             || prologueBranch->isParameterised() || loopBranch->isParameterised()
+             || ! (prologue->parameters.empty() && loop->parameters.empty()))
+            return false;
+
+        for (auto s : prologue->statements)
+        {
+            auto a = cast<heart::AssignFromValue> (*s);
+
+            if (a == nullptr || getLocalVariable (a->target) == nullptr || classify (a->source) != Kind::uniform)
+                return false;
+        }
+
+        // The advance() must be the last statement, so that each pass of the loop is one frame
+        if (loop->statements.empty() || ! is_type<heart::AdvanceClock> (**loop->statements.getLast()))
+            return false;
+
+        for (auto s : loop->statements)
+            if (auto a = cast<heart::Assignment> (*s))
+                if (auto v = getLocalVariable (a->target))
+                    loopVariables.insert (v.get());
+
+        for (auto s : prologue->statements)
+            if (loopVariables.count (getLocalVariable (cast<heart::Assignment> (*s)->target).get()) != 0)
+                return false;
+
+        for (auto& output : module.outputs)  useFrameTypeForWidth (output->getFrameType());
+
+        for (auto& input : module.inputs)
+            if (input->isStreamEndpoint())
+                useFrameTypeForWidth (input->getFrameType());
+
+        for (auto s : loop->statements)
+            if (! canVectoriseStatement (*s))
+                return false;
+
+        return true;
+    }
+
+    bool canVectoriseStatement (heart::Statement& s)
+    {
+        if (is_type<heart::AdvanceClock> (s))
+            return std::addressof (s) == *loop->statements.getLast();
+
+        // A value input holds the same value for the whole group of frames
+        if (auto r = cast<heart::ReadStream> (s))
+            return r->element == nullptr
+                    && r->target->getType().removeReferenceIfPresent().isIdentical (r->source->getFrameOrValueType())
+                    && markAsAssigned (getLocalVariable (r->target), r->source->isValueEndpoint() ? Kind::uniform : Kind::varying);
+
+        if (auto w = cast<heart::WriteStream> (s))
+            return w->element == nullptr
+                    && w->value->getType().removeReferenceIfPresent().isIdentical (w->target->getFrameType())
+                    && classify (w->value) != Kind::unsupported;
+
+        if (auto a = cast<heart::AssignFromValue> (s))
+            return markAsAssigned (getLocalVariable (a->target), classify (a->source));
+
+        // Other functions could write state, so only intrinsics can be called as statements
+        if (auto c = cast<heart::FunctionCall> (s))
+            return c->target != nullptr
+                    && c->getFunction().intrinsicType != IntrinsicType::none
+                    && c->target->getType().removeReferenceIfPresent().isIdentical (c->getFunction().returnType.removeReferenceIfPresent())
+                    && markAsAssigned (getLocalVariable (c->target), classifyCall (c->getFunction(), c->arguments));
+
+        return false;
+    }
+
+    // Each variable that the loop uses must be set once per frame, before it's read
+    bool markAsAssigned (pool_ptr<heart::Variable> v, Kind kind)
+    {
+        if (v == nullptr || kind == Kind::unsupported || ! assignedLoopVariables.insert (v.get()).second)
+            return false;
+
+        if (kind == Kind::varying)
+        {
+            if (! isSupportedType (v->type))
+                return false;
+
+            useFrameTypeForWidth (v->type);
+            varyingVariables.insert (v.get());
+        }
+
+        return true;
+    }
+
+    static Kind combine (Kind a, Kind b)
+    {
+        if (a == Kind::unsupported || b == Kind::unsupported)  return Kind::unsupported;
+        if (a == Kind::varying || b == Kind::varying)          return Kind::varying;
+        return Kind::uniform;
+    }
+
+    static bool canVectoriseBinaryOp (BinaryOp::Op op, const Type& operandType)
+    {
+        switch (op)
+        {
+            case BinaryOp::Op::add:
+            case BinaryOp::Op::subtract:
+            case BinaryOp::Op::multiply:  return true;
+            case BinaryOp::Op::divide:    return operandType.isPrimitiveFloat();
+            default:                      return false;
+        }
+    }
+
+    /** Finds whether an expression has the same value on every frame, or whether it depends
+        on the stream values and needs to become a vector.
+    */
+    Kind classify (heart::Expression& e) const
+    {
+        if (is_type<heart::Constant> (e) || is_type<heart::ProcessorProperty> (e))
+            return Kind::uniform;
+
+        if (auto v = cast<heart::Variable> (e))
+        {
+            if (varyingVariables.count (v.get()) != 0)
+                return Kind::varying;
+
+            if (v->isFunctionLocal() && loopVariables.count (v.get()) != 0 && assignedLoopVariables.count (v.get()) == 0)
+                return Kind::unsupported;
+
+            return (v->isFunctionLocal() || v->isState()) ? Kind::uniform : Kind::unsupported;
+        }
+
+        if (auto b = cast<heart::BinaryOperator> (e))
+        {
+            auto kind = combine (classify (b->lhs), classify (b->rhs));
+
+            if (kind != Kind::varying)
+                return kind;
+
+            auto types = BinaryOp::getTypes (b->operation, b->lhs->getType(), b->rhs->getType());
+
+            if (isSupportedType (types.operandType) && types.resultType.isIdentical (types.operandType)
+                 && canVectoriseBinaryOp (b->operation, types.operandType))
+                return kind;
+
+            return Kind::unsupported;
+        }
+
+        if (auto u = cast<heart::UnaryOperator> (e))
+        {
+            auto kind = classify (u->source);
+
+            if (kind == Kind::varying && ! (u->operation == UnaryOp::Op::negate && isSupportedType (u->getType())))
+                return Kind::unsupported;
+
+            return kind;
+        }
+
+        if (auto c = cast<heart::TypeCast> (e))
+        {
+            auto kind = classify (c->source);
+
+            if (kind == Kind::varying && ! (isSupportedType (c->source->getType()) && isSupportedType (c->destType)))
+                return Kind::unsupported;
+
+            return kind;
+        }
+
+        if (auto a = cast<heart::ArrayElement> (e))
+        {
+            auto kind = classify (a->parent);
+
+            if (a->dynamicIndex != nullptr)
+                kind = combine (kind, classify (*a->dynamicIndex));
+
+            return kind == Kind::uniform ? kind : Kind::unsupported;
+        }
+
+        if (auto s = cast<heart::StructElement> (e))
+            return classify (s->parent) == Kind::uniform ? Kind::uniform : Kind::unsupported;
+
+        if (auto f = cast<heart::PureFunctionCall> (e))
+            return classifyCall (f->function, f->arguments);
+
+        return Kind::unsupported;
+    }
+
+    Kind classifyCall (const heart::Function& f, ArrayView<pool_ref<heart::Expression>> args) const
+    {
+        auto kind = Kind::uniform;
+
+        for (auto& arg : args)
+            kind = combine (kind, classify (arg));
+
+        if (kind == Kind::varying && ! canVectoriseIntrinsic (f))
+            return Kind::unsupported;
+
+        return kind;
+    }
+
+    //==============================================================================
+    void build (FunctionBuilder& builder)
+    {
+        for (auto& output : module.outputs)
+            endpointParameters[output.getPointer()] = builder.addParameter ("_vec_" + output->name.toString(),
+                                                                            getVectorType (output->getFrameType()).createReference());
+
+        for (auto& input : module.inputs)
+        {
+            if (input->isStreamEndpoint())
+                endpointParameters[input.getPointer()] = builder.addParameter ("_vec_" + input->name.toString(),
+                                                                               getVectorType (input->getFrameType()));
+            else if (input->isValueEndpoint())
+                endpointParameters[input.getPointer()] = builder.addParameter ("_value_" + input->name.toString(),
+                                                                               input->getValueType());
+        }
+
+        for (auto s : prologue->statements)
+        {
+            auto& a = *cast<heart::AssignFromValue> (*s);
+            builder.addAssignment (getScalarVariable (*getLocalVariable (a.target)), cloneUniform (a.source));
+        }
+
+        for (auto s : loop->statements)
+        {
+            if (auto r = cast<heart::ReadStream> (*s))
+            {
+                kernelVariables[getLocalVariable (r->target).get()] = endpointParameters[r->source.getPointer()];
+            }
+            else if (auto w = cast<heart::WriteStream> (*s))
+            {
+                auto& output = *endpointParameters[w->target.getPointer()];
+                builder.addAssignment (output, builder.createAdd (output, vectorise (w->value, w->target->getFrameType())));
+            }
+            else if (auto a = cast<heart::AssignFromValue> (*s))
+            {
+                auto& v = *getLocalVariable (a->target);
+
+                if (varyingVariables.count (std::addressof (v)) != 0)
+                    builder.addAssignment (getVectorVariable (v), vectorise (a->source, v.type));
+                else
+                    builder.addAssignment (getScalarVariable (v), cloneUniform (a->source));
+            }
+            else if (auto c = cast<heart::FunctionCall> (*s))
+            {
+                auto& v = *getLocalVariable (c->target);
+                auto& function = c->getFunction();
+                heart::FunctionCall::ArgListType args;
+
+                if (varyingVariables.count (std::addressof (v)) != 0)
+                {
+                    for (auto& arg : c->arguments)
+                        args.push_back (vectorise (arg, function.returnType));
+
+                    builder.addFunctionCall (getVectorVariable (v), getVectorIntrinsic (function), std::move (args));
+                }
+                else
+                {
+                    for (auto& arg : c->arguments)
+                        args.push_back (cloneUniform (arg));
+
+                    builder.addFunctionCall (getScalarVariable (v), function, std::move (args));
+                }
+            }
+        }
+
+        builder.setReturnTerminator();
+    }
+
+    Type getVectorType (const Type& scalarType) const
+    {
+        return Type::createVector (scalarType.removeReferenceIfPresent().getPrimitiveType(), numFrames);
+    }
+
+    heart::Variable& getScalarVariable (heart::Variable& old)
+    {
+        auto& v = kernelVariables[std::addressof (old)];
+
+        if (v == nullptr)
+            v = module.allocate<heart::Variable> (old.location, old.type, old.name, old.role);
+
+        return *v;
+    }
+
+    heart::Variable& getVectorVariable (heart::Variable& old)
+    {
+        auto& v = module.allocate<heart::Variable> (old.location, getVectorType (old.type), old.name, old.role);
+        kernelVariables[std::addressof (old)] = v;
+        return v;
+    }
+
+    /** Returns a declaration of an intrinsic which takes and returns vectors of frames. It has
+        no body, because the engines compile intrinsic calls into element-wise operations.
+    */
+    heart::Function& getVectorIntrinsic (const heart::Function& scalarVersion)
+    {
+        auto vectorType = getVectorType (scalarVersion.returnType);
+        auto name = std::string ("_vec_") + getIntrinsicName (scalarVersion.intrinsicType) + "_" + vectorType.getShortIdentifierDescription();
+
+        if (auto f = module.functions.find (name))
+            return *f;
+
+        auto& f = FunctionBuilder::createEmptyFunction (module, name, vectorType);
+        f.functionType = heart::FunctionType::intrinsic();
+        f.intrinsicType = scalarVersion.intrinsicType;
+        f.annotation = scalarVersion.annotation;
+        f.location = scalarVersion.location;
+
+        for (auto& p : scalarVersion.parameters)
+            f.parameters.push_back (FunctionBuilder::createVariable (module, vectorType, p->name.toString(), heart::Variable::Role::parameter));
+
+        return f;
+    }
+
+    /** Creates the vector version of an expression, with each element holding its value for one frame. */
+    heart::Expression& vectorise (heart::Expression& e, const Type& scalarType)
+    {
+        auto vectorType = getVectorType (scalarType);
+
+        if (classify (e) == Kind::uniform)
+        {
+            if (auto c = cast<heart::Constant> (e))
+            {
+                auto value = c->value.tryCastToType (vectorType);
+
+                if (value.isValid())
+                    return module.allocator.allocateConstant (std::move (value));
+            }
+
+            heart::Expression* scalar = std::addressof (cloneUniform (e));
+
+            if (scalar->getType().getPrimitiveType() != vectorType.getPrimitiveType())
+                scalar = std::addressof (module.allocate<heart::TypeCast> (e.location, *scalar, vectorType.getElementType()));
+
+            return module.allocate<heart::TypeCast> (e.location, *scalar, vectorType);
+        }
+
+        heart::Expression* result = nullptr;
+
+        if (auto v = cast<heart::Variable> (e))
+        {
+            result = kernelVariables[v.get()].get();
+        }
+        else if (auto b = cast<heart::BinaryOperator> (e))
+        {
+            auto operandType = BinaryOp::getTypes (b->operation, b->lhs->getType(), b->rhs->getType()).operandType;
+            result = std::addressof (module.allocate<heart::BinaryOperator> (b->location,
+                                                                             vectorise (b->lhs, operandType),
+                                                                             vectorise (b->rhs, operandType),
+                                                                             b->operation));
+        }
+        else if (auto u = cast<heart::UnaryOperator> (e))
+        {
+            result = std::addressof (module.allocate<heart::UnaryOperator> (u->location, vectorise (u->source, u->getType()), u->operation));
+        }
+        else if (auto c = cast<heart::TypeCast> (e))
+        {
+            result = std::addressof (vectorise (c->source, c->source->getType()));
+        }
+        else if (auto f = cast<heart::PureFunctionCall> (e))
+        {
+            auto& call = module.allocate<heart::PureFunctionCall> (f->location, getVectorIntrinsic (f->function));
+
+            for (auto& arg : f->arguments)
+                call.arguments.push_back (vectorise (arg, f->function.returnType));
+
+            result = std::addressof (call);
+        }
+
+        SOUL_ASSERT (result != nullptr);
+
+        if (result->getType().getPrimitiveType() == vectorType.getPrimitiveType())
+            return *result;
+
+        return module.allocate<heart::TypeCast> (e.location, *result, vectorType);
+    }
+
+    /** Copies an expression whose value is the same on every frame. */
+    heart::Expression& cloneUniform (heart::Expression& e)
+    {
+        if (auto c = cast<heart::Constant> (e))
+            return module.allocate<heart::Constant> (c->location, c->value);
+
+        if (auto v = cast<heart::Variable> (e))
+            return v->isFunctionLocal() ? getScalarVariable (*v) : *v;
+
+        if (auto b = cast<heart::BinaryOperator> (e))
+            return module.allocate<heart::BinaryOperator> (b->location, cloneUniform (b->lhs), cloneUniform (b->rhs), b->operation);
+
+        if (auto u = cast<heart::UnaryOperator> (e))
+            return module.allocate<heart::UnaryOperator> (u->location, cloneUniform (u->source), u->operation);
+
+        if (auto t = cast<heart::TypeCast> (e))
+            return module.allocate<heart::TypeCast> (t->location, cloneUniform (t->source), t->destType);
+
+        if (auto a = cast<heart::ArrayElement> (e))
+        {
+            auto& s = module.allocate<heart::ArrayElement> (a->location, cloneUniform (a->parent), a->fixedStartIndex, a->fixedEndIndex);
+
+            if (a->dynamicIndex != nullptr)
+                s.dynamicIndex = cloneUniform (*a->dynamicIndex);
+
+            s.suppressWrapWarning = a->suppressWrapWarning;
+            s.isRangeTrusted = a->isRangeTrusted;
+            return s;
+        }
+
+        if (auto s = cast<heart::StructElement> (e))
+            return module.allocate<heart::StructElement> (s->location, cloneUniform (s->parent), s->memberName);
+
+        if (auto f = cast<heart::PureFunctionCall> (e))
+        {
+            auto& call = module.allocate<heart::PureFunctionCall> (f->location, f->function);
+
+            for (auto& arg : f->arguments)
+                call.arguments.push_back (cloneUniform (arg));
+
+            return call;
+        }
+
+        auto& p = *cast<heart::ProcessorProperty> (e);
+        return module.allocate<heart::ProcessorProperty> (p.location, p.property);
+    }
+};
+
+} // namespace soul
@@ -187,6 +187,7 @@ struct heart::Utilities
     template <typename OptimiserClass>
     static void inlineFunctionsThatUseAdvanceOrStreams (Program& program)
     {
+        SOUL_PROFILE_SCOPE ("inlineFunctionsThatUseAdvanceOrStreams");
         auto inlineNextOccurrence = [&] (Module& module) -> bool
         {
             for (auto& f : module.functions.get())
@@ -0,0 +1,2010 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul::interpreter
+{
+
+// All values are stored in the same packed layout that soul::Value uses, so these
+// helpers are used to avoid making any assumptions about alignment.
+template <typename Type>
+static inline Type readValue (const void* source) noexcept
+{
+    Type v;
+    std::memcpy (std::addressof (v), source, sizeof (Type));
+    return v;
+}
+
+template <typename Type>
+static inline void writeValue (void* dest, Type v) noexcept
+{
+    std::memcpy (dest, std::addressof (v), sizeof (Type));
+}
+
+static inline uint32_t alignSlotSize (size_t size) noexcept
+{
+    return static_cast<uint32_t> ((size + 7u) & ~static_cast<size_t> (7u));
+}
+
+//==============================================================================
+/** Receives any events that a processor's code writes to its event outputs. */
+struct EventOutputHandler
+{
+    virtual ~EventOutputHandler() = default;
+
+    virtual void writeEvent (uint32_t outputIndex, uint32_t element, uint32_t typeIndex, const void* eventData) noexcept = 0;
+};
+
+/** The registers which a running function needs: the processor instance state, the current
+    stack frame, and the first free byte of the stack above that frame.
+*/
+struct ExecutionContext
+{
+    uint8_t* state = nullptr;
+    uint8_t* frame = nullptr;
+    uint8_t* stackTop = nullptr;
+    EventOutputHandler* eventOutputs = nullptr;
+};
+
+/** Marks the position that a run() function will resume from after an advance() call. */
+struct ResumePoint
+{
+    uint32_t block = 0, statement = 0;
+};
+
+//==============================================================================
+/** A node which computes a value and returns the address where it can be found. */
+struct Evaluator
+{
+    virtual ~Evaluator() = default;
+    virtual uint8_t* get (ExecutionContext&) const noexcept = 0;
+};
+
+/** A node which performs one statement of a function. */
+struct Operation
+{
+    virtual ~Operation() = default;
+    virtual void perform (ExecutionContext&) const noexcept = 0;
+};
+
+//==============================================================================
+struct FrameSlot  : public Evaluator
+{
+    FrameSlot (uint32_t o) : offset (o) {}
+    uint8_t* get (ExecutionContext& c) const noexcept override    { return c.frame + offset; }
+    const uint32_t offset;
+};
+
+struct StateSlot  : public Evaluator
+{
+    StateSlot (uint32_t o) : offset (o) {}
+    uint8_t* get (ExecutionContext& c) const noexcept override    { return c.state + offset; }
+    const uint32_t offset;
+};
+
+struct ReferenceParameter  : public Evaluator
+{
+    ReferenceParameter (uint32_t o) : offset (o) {}
+    uint8_t* get (ExecutionContext& c) const noexcept override    { return readValue<uint8_t*> (c.frame + offset); }
+    const uint32_t offset;
+};
+
+struct FixedAddress  : public Evaluator
+{
+    FixedAddress (const void* a) : address (static_cast<uint8_t*> (const_cast<void*> (a))) {}
+    uint8_t* get (ExecutionContext&) const noexcept override      { return address; }
+    uint8_t* const address;
+};
+
+template <bool parentIsUnsizedArray>
+struct SubElement  : public Evaluator
+{
+    SubElement (const Evaluator& p, size_t o) : parent (p), offset (o) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        if constexpr (parentIsUnsizedArray)
+            return readValue<uint8_t*> (parent.get (c)) + offset;
+        else
+            return parent.get (c) + offset;
+    }
+
+    const Evaluator& parent;
+    const size_t offset;
+};
+
+template <bool parentIsUnsizedArray, typename IndexType>
+struct DynamicElement  : public Evaluator
+{
+    DynamicElement (const Evaluator& p, const Evaluator& i, size_t elementSize, size_t size)
+        : parent (p), index (i), elementSizeBytes (elementSize), arraySize (static_cast<IndexType> (size)) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto i = readValue<IndexType> (index.get (c));
+
+        // an arraySize of zero means that the range doesn't need checking
+        if (arraySize != 0 && (i < 0 || i >= arraySize))
+        {
+            i %= arraySize;
+
+            if (i < 0)
+                i += arraySize;
+        }
+
+        if constexpr (parentIsUnsizedArray)
+            return readValue<uint8_t*> (parent.get (c)) + static_cast<size_t> (i) * elementSizeBytes;
+        else
+            return parent.get (c) + static_cast<size_t> (i) * elementSizeBytes;
+    }
+
+    const Evaluator& parent;
+    const Evaluator& index;
+    const size_t elementSizeBytes;
+    const IndexType arraySize;
+};
+
+//==============================================================================
+/** The primitive operations, with the same edge-case behaviour as the compile-time
+    evaluation in BinaryOp::apply(): integer overflow wraps, and division by zero gives zero.
+*/
+struct Ops
+{
+    template <typename T> using Unsigned = typename std::make_unsigned<T>::type;
+
+    template <typename T> static T add (T a, T b) noexcept        { if constexpr (std::is_integral<T>::value) return (T) ((Unsigned<T>) a + (Unsigned<T>) b); else return a + b; }
+    template <typename T> static T subtract (T a, T b) noexcept   { if constexpr (std::is_integral<T>::value) return (T) ((Unsigned<T>) a - (Unsigned<T>) b); else return a - b; }
+    template <typename T> static T multiply (T a, T b) noexcept   { if constexpr (std::is_integral<T>::value) return (T) ((Unsigned<T>) a * (Unsigned<T>) b); else return a * b; }
+
+    template <typename T> static T divide (T a, T b) noexcept
+    {
+        if constexpr (std::is_integral<T>::value)
+        {
+            if (b == 0)   return 0;
+            if (b == -1)  return subtract<T> (0, a);
+        }
+
+        return a / b;
+    }
+
+    template <typename T> static T modulo (T a, T b) noexcept
+    {
+        if constexpr (std::is_integral<T>::value)
+            return (b == 0 || b == -1) ? 0 : a % b;
+        else
+            return b != 0 ? static_cast<T> (std::fmod (a, b)) : 0;
+    }
+
+    template <typename T> static T bitwiseOr (T a, T b) noexcept    { return a | b; }
+    template <typename T> static T bitwiseAnd (T a, T b) noexcept   { return a & b; }
+    template <typename T> static T bitwiseXor (T a, T b) noexcept   { return a ^ b; }
+
+    template <typename T> static T leftShift (T a, T b) noexcept
+    {
+        return (b >= 0 && b < (T) (sizeof (T) * 8)) ? (T) (((Unsigned<T>) a) << b) : 0;
+    }
+
+    template <typename T> static T rightShift (T a, T b) noexcept
+    {
+        return (b >= 0 && b < (T) (sizeof (T) * 8)) ? (T) (a >> b) : (a < 0 ? -1 : 0);
+    }
+
+    template <typename T> static T rightShiftUnsigned (T a, T b) noexcept
+    {
+        return (b >= 0 && b < (T) (sizeof (T) * 8)) ? (T) (((Unsigned<T>) a) >> b) : 0;
+    }
+
+    template <typename T> static uint8_t logicalOr (T a, T b) noexcept            { return (a != 0 || b != 0) ? 1 : 0; }
+    template <typename T> static uint8_t logicalAnd (T a, T b) noexcept           { return (a != 0 && b != 0) ? 1 : 0; }
+    template <typename T> static uint8_t equals (T a, T b) noexcept               { return a == b ? 1 : 0; }
+    template <typename T> static uint8_t notEquals (T a, T b) noexcept            { return a != b ? 1 : 0; }
+    template <typename T> static uint8_t lessThan (T a, T b) noexcept             { return a <  b ? 1 : 0; }
+    template <typename T> static uint8_t lessThanOrEqual (T a, T b) noexcept      { return a <= b ? 1 : 0; }
+    template <typename T> static uint8_t greaterThan (T a, T b) noexcept          { return a >  b ? 1 : 0; }
+    template <typename T> static uint8_t greaterThanOrEqual (T a, T b) noexcept   { return a >= b ? 1 : 0; }
+
+    template <typename T> static T negate (T a) noexcept            { if constexpr (std::is_integral<T>::value) return subtract<T> (0, a); else return -a; }
+    template <typename T> static T bitwiseNot (T a) noexcept        { return ~a; }
+    template <typename T> static uint8_t logicalNot (T a) noexcept  { return a == 0 ? 1 : 0; }
+
+    template <typename T> static T wrap (T n, T range) noexcept
+    {
+        if (range == 0)
+            return 0;
+
+        if constexpr (std::is_integral<T>::value)
+        {
+            n = modulo (n, range);
+            return n < 0 ? n + range : n;
+        }
+        else
+        {
+            n = static_cast<T> (std::fmod (n, range));
+            return n < 0 ? n + range : n;
+        }
+    }
+
+    template <typename T> static T clamp (T n, T low, T high) noexcept   { return n < low ? low : (n > high ? high : n); }
+};
+
+template <typename OperandType, typename ResultType, ResultType (*function)(OperandType, OperandType)>
+struct BinaryOperation  : public Evaluator
+{
+    BinaryOperation (const Evaluator& l, const Evaluator& r, uint32_t result, uint32_t num)
+        : lhs (l), rhs (r), resultOffset (result), numElements (num) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto a = lhs.get (c);
+        auto b = rhs.get (c);
+        auto result = c.frame + resultOffset;
+
+        for (uint32_t i = 0; i < numElements; ++i)
+            writeValue<ResultType> (result + i * sizeof (ResultType),
+                                    function (readValue<OperandType> (a + i * sizeof (OperandType)),
+                                              readValue<OperandType> (b + i * sizeof (OperandType))));
+
+        return result;
+    }
+
+    const Evaluator& lhs;
+    const Evaluator& rhs;
+    const uint32_t resultOffset, numElements;
+};
+
+template <typename OperandType, typename ResultType, ResultType (*function)(OperandType)>
+struct UnaryOperation  : public Evaluator
+{
+    UnaryOperation (const Evaluator& s, uint32_t result, uint32_t num)
+        : source (s), resultOffset (result), numElements (num) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto a = source.get (c);
+        auto result = c.frame + resultOffset;
+
+        for (uint32_t i = 0; i < numElements; ++i)
+            writeValue<ResultType> (result + i * sizeof (ResultType),
+                                    function (readValue<OperandType> (a + i * sizeof (OperandType))));
+
+        return result;
+    }
+
+    const Evaluator& source;
+    const uint32_t resultOffset, numElements;
+};
+
+template <typename SourceType, typename DestType>
+struct Conversion  : public Evaluator
+{
+    Conversion (const Evaluator& s, uint32_t result, uint32_t num, uint32_t stride)
+        : source (s), resultOffset (result), numElements (num), sourceStride (stride * sizeof (SourceType)) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto src = source.get (c);
+        auto result = c.frame + resultOffset;
+
+        for (uint32_t i = 0; i < numElements; ++i)
+        {
+            auto v = readValue<SourceType> (src + i * sourceStride);
+
+            if constexpr (std::is_same<DestType, uint8_t>::value)
+                writeValue<uint8_t> (result + i, v != 0 ? 1 : 0);
+            else
+                writeValue<DestType> (result + i * sizeof (DestType), static_cast<DestType> (v));
+        }
+
+        return result;
+    }
+
+    const Evaluator& source;
+    const uint32_t resultOffset, numElements;
+    const size_t sourceStride;
+};
+
+template <typename SourceType, bool isWrapped>
+struct BoundedIntConversion  : public Evaluator
+{
+    BoundedIntConversion (const Evaluator& s, uint32_t result, uint32_t num, Type::BoundedIntSize l)
+        : source (s), resultOffset (result), numElements (num), limit (l) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto src = source.get (c);
+        auto result = c.frame + resultOffset;
+
+        for (uint32_t i = 0; i < numElements; ++i)
+        {
+            auto v = static_cast<int64_t> (readValue<SourceType> (src + i * sizeof (SourceType)));
+
+            if constexpr (isWrapped)
+                v = Ops::wrap<int64_t> (v, limit);
+            else
+                v = Ops::clamp<int64_t> (v, 0, limit - 1);
+
+            writeValue<int32_t> (result + i * sizeof (int32_t), static_cast<int32_t> (v));
+        }
+
+        return result;
+    }
+
+    const Evaluator& source;
+    const uint32_t resultOffset, numElements;
+    const int64_t limit;
+};
+
+/** Maps the data pointers of unsized arrays onto their sizes, so that get_array_size() can
+    find them. The sizes of external and constant arrays are added at link time, and casts
+    from fixed-size arrays record theirs in a small pre-allocated list as they execute, so
+    that nothing needs to be allocated while rendering.
+*/
+struct UnsizedArraySizes
+{
+    UnsizedArraySizes()  { clear(); }
+
+    void clear()
+    {
+        knownSizes.clear();
+        castSizes.clear();
+        castSizes.resize (64);
+        nextCastSlot = 0;
+    }
+
+    void add (const void* data, int32_t size)       { knownSizes[data] = size; }
+
+    void recordCast (const void* data, int32_t size) noexcept
+    {
+        for (auto& c : castSizes)
+        {
+            if (c.data == data)
+            {
+                c.size = size;
+                return;
+            }
+        }
+
+        castSizes[nextCastSlot] = { data, size };
+        nextCastSlot = (nextCastSlot + 1) % castSizes.size();
+    }
+
+    int32_t find (const void* data) const noexcept
+    {
+        for (auto& c : castSizes)
+            if (c.data == data)
+                return c.size;
+
+        auto found = knownSizes.find (data);
+        return found != knownSizes.end() ? found->second : 0;
+    }
+
+private:
+    struct CastSize
+    {
+        const void* data = nullptr;
+        int32_t size = 0;
+    };
+
+    std::unordered_map<const void*, int32_t> knownSizes;
+    std::vector<CastSize> castSizes;
+    size_t nextCastSlot = 0;
+};
+
+//==============================================================================
+/** Casting a fixed-size array to an unsized one just needs a pointer to its data, but its
+    size is recorded so that get_array_size() can find it later.
+*/
+struct ArrayToUnsizedArray  : public Evaluator
+{
+    ArrayToUnsizedArray (const Evaluator& s, UnsizedArraySizes& sizes, int32_t size, uint32_t result)
+        : source (s), knownSizes (sizes), arraySize (size), resultOffset (result) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto result = c.frame + resultOffset;
+        auto data = source.get (c);
+        knownSizes.recordCast (data, arraySize);
+        writeValue<uint8_t*> (result, data);
+        return result;
+    }
+
+    const Evaluator& source;
+    UnsizedArraySizes& knownSizes;
+    const int32_t arraySize;
+    const uint32_t resultOffset;
+};
+
+//==============================================================================
+/** Native versions of the intrinsics, matching the semantics of performIntrinsic(). */
+struct IntrinsicFunctions
+{
+    template <typename T> static T abs (T n) noexcept           { return n < 0 ? Ops::negate (n) : n; }
+    template <typename T> static T min (T a, T b) noexcept      { return a < b ? a : b; }
+    template <typename T> static T max (T a, T b) noexcept      { return a > b ? a : b; }
+    template <typename T> static T fmod (T a, T b) noexcept     { return b != 0 ? static_cast<T> (std::fmod (a, b)) : 0; }
+    template <typename T> static T remainder (T a, T b) noexcept{ return b != 0 ? static_cast<T> (std::remainder (a, b)) : 0; }
+    template <typename T> static T floor (T n) noexcept         { return static_cast<T> (std::floor (n)); }
+    template <typename T> static T ceil (T n) noexcept          { return static_cast<T> (std::ceil (n)); }
+    template <typename T> static T sqrt (T n) noexcept          { return static_cast<T> (std::sqrt (n)); }
+    template <typename T> static T pow (T a, T b) noexcept      { return static_cast<T> (std::pow (a, b)); }
+    template <typename T> static T exp (T n) noexcept           { return static_cast<T> (std::exp (n)); }
+    template <typename T> static T log (T n) noexcept           { return static_cast<T> (std::log (n)); }
+    template <typename T> static T log10 (T n) noexcept         { return static_cast<T> (std::log10 (n)); }
+    template <typename T> static T sin (T n) noexcept           { return static_cast<T> (std::sin (n)); }
+    template <typename T> static T cos (T n) noexcept           { return static_cast<T> (std::cos (n)); }
+    template <typename T> static T tan (T n) noexcept           { return static_cast<T> (std::tan (n)); }
+    template <typename T> static T sinh (T n) noexcept          { return static_cast<T> (std::sinh (n)); }
+    template <typename T> static T cosh (T n) noexcept          { return static_cast<T> (std::cosh (n)); }
+    template <typename T> static T tanh (T n) noexcept          { return static_cast<T> (std::tanh (n)); }
+    template <typename T> static T asinh (T n) noexcept         { return static_cast<T> (std::asinh (n)); }
+    template <typename T> static T acosh (T n) noexcept         { return static_cast<T> (std::acosh (n)); }
+    template <typename T> static T atanh (T n) noexcept         { return static_cast<T> (std::atanh (n)); }
+    template <typename T> static T asin (T n) noexcept          { return static_cast<T> (std::asin (n)); }
+    template <typename T> static T acos (T n) noexcept          { return static_cast<T> (std::acos (n)); }
+    template <typename T> static T atan (T n) noexcept          { return static_cast<T> (std::atan (n)); }
+    template <typename T> static T atan2 (T a, T b) noexcept    { return static_cast<T> (std::atan2 (a, b)); }
+    template <typename T> static uint8_t isnan (T n) noexcept   { return std::isnan (n) ? 1 : 0; }
+    template <typename T> static uint8_t isinf (T n) noexcept   { return std::isinf (n) ? 1 : 0; }
+
+    template <typename T> static T addModulo2Pi (T v, T increment) noexcept
+    {
+        constexpr auto twoPi = static_cast<T> (3.141592653589793238 * 2.0);
+        v += increment;
+        return v >= twoPi ? remainder (v, twoPi) : v;
+    }
+
+    template <typename T> static T roundToInt (T n) noexcept
+    {
+        return n + (n < 0 ? static_cast<T> (-0.5) : static_cast<T> (0.5));
+    }
+};
+
+template <typename Type, Type (*function)(Type, Type, Type)>
+struct TernaryOperation  : public Evaluator
+{
+    TernaryOperation (const Evaluator& a, const Evaluator& b, const Evaluator& c, uint32_t result, uint32_t num)
+        : arg1 (a), arg2 (b), arg3 (c), resultOffset (result), numElements (num) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto a = arg1.get (c);
+        auto b = arg2.get (c);
+        auto d = arg3.get (c);
+        auto result = c.frame + resultOffset;
+
+        for (uint32_t i = 0; i < numElements; ++i)
+        {
+            auto offset = i * sizeof (Type);
+            writeValue<Type> (result + offset, function (readValue<Type> (a + offset),
+                                                         readValue<Type> (b + offset),
+                                                         readValue<Type> (d + offset)));
+        }
+
+        return result;
+    }
+
+    const Evaluator& arg1;
+    const Evaluator& arg2;
+    const Evaluator& arg3;
+    const uint32_t resultOffset, numElements;
+};
+
+template <typename SourceType, typename ResultType>
+struct RoundToInt  : public Evaluator
+{
+    RoundToInt (const Evaluator& s, uint32_t result) : source (s), resultOffset (result) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto result = c.frame + resultOffset;
+        writeValue<ResultType> (result, static_cast<ResultType> (IntrinsicFunctions::roundToInt (readValue<SourceType> (source.get (c)))));
+        return result;
+    }
+
+    const Evaluator& source;
+    const uint32_t resultOffset;
+};
+
+template <typename Type, bool isProduct>
+struct SumOrProduct  : public Evaluator
+{
+    SumOrProduct (const Evaluator& s, uint32_t result, uint32_t num) : source (s), resultOffset (result), numElements (num) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto src = source.get (c);
+        auto total = static_cast<Type> (isProduct ? 1 : 0);
+
+        for (uint32_t i = 0; i < numElements; ++i)
+        {
+            auto v = readValue<Type> (src + i * sizeof (Type));
+            total = isProduct ? Ops::multiply (total, v) : Ops::add (total, v);
+        }
+
+        auto result = c.frame + resultOffset;
+        writeValue<Type> (result, total);
+        return result;
+    }
+
+    const Evaluator& source;
+    const uint32_t resultOffset, numElements;
+};
+
+struct UnsizedArraySize  : public Evaluator
+{
+    UnsizedArraySize (const Evaluator& s, const UnsizedArraySizes& sizes, uint32_t result)
+        : source (s), knownSizes (sizes), resultOffset (result) {}
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto result = c.frame + resultOffset;
+        writeValue<int32_t> (result, knownSizes.find (readValue<const void*> (source.get (c))));
+        return result;
+    }
+
+    const Evaluator& source;
+    const UnsizedArraySizes& knownSizes;
+    const uint32_t resultOffset;
+};
+
+//==============================================================================
+struct CopyValue  : public Operation
+{
+    CopyValue (const Evaluator& dst, const Evaluator& src, size_t numBytes) : dest (dst), source (src), size (numBytes) {}
+
+    void perform (ExecutionContext& c) const noexcept override
+    {
+        auto src = source.get (c);
+        std::memmove (dest.get (c), src, size);
+    }
+
+    const Evaluator& dest;
+    const Evaluator& source;
+    const size_t size;
+};
+
+struct DiscardResult  : public Operation
+{
+    DiscardResult (const Evaluator& v) : value (v) {}
+    void perform (ExecutionContext& c) const noexcept override   { value.get (c); }
+    const Evaluator& value;
+};
+
+template <typename Type>
+struct CopyPrimitive  : public Operation
+{
+    CopyPrimitive (const Evaluator& dst, const Evaluator& src) : dest (dst), source (src) {}
+
+    void perform (ExecutionContext& c) const noexcept override
+    {
+        writeValue<Type> (dest.get (c), readValue<Type> (source.get (c)));
+    }
+
+    const Evaluator& dest;
+    const Evaluator& source;
+};
+
+/** Writes to a stream output are summed into the output's accumulator for the current frame. */
+template <typename Type>
+struct AccumulateStream  : public Operation
+{
+    AccumulateStream (const Evaluator& dst, const Evaluator& src, uint32_t num) : dest (dst), source (src), numElements (num) {}
+
+    void perform (ExecutionContext& c) const noexcept override
+    {
+        auto src = source.get (c);
+        auto dst = dest.get (c);
+
+        for (uint32_t i = 0; i < numElements; ++i)
+        {
+            auto offset = i * sizeof (Type);
+            writeValue<Type> (dst + offset, Ops::add (readValue<Type> (dst + offset), readValue<Type> (src + offset)));
+        }
+    }
+
+    const Evaluator& dest;
+    const Evaluator& source;
+    const uint32_t numElements;
+};
+
+template <typename IndexType>
+struct WriteEvent  : public Operation
+{
+    WriteEvent (const Evaluator& v, const Evaluator* e, uint32_t output, uint32_t type, uint32_t size)
+        : value (v), element (e), outputIndex (output), typeIndex (type), arraySize (static_cast<IndexType> (size)) {}
+
+    void perform (ExecutionContext& c) const noexcept override
+    {
+        uint32_t elementIndex = 0;
+
+        if (element != nullptr)
+            elementIndex = static_cast<uint32_t> (Ops::wrap (readValue<IndexType> (element->get (c)), arraySize));
+
+        c.eventOutputs->writeEvent (outputIndex, elementIndex, typeIndex, value.get (c));
+    }
+
+    const Evaluator& value;
+    const Evaluator* element;
+    const uint32_t outputIndex, typeIndex;
+    const IndexType arraySize;
+};
+
+//==============================================================================
+/** The interface through which a GraphRuntime calls a compiled function, so that it doesn't
+    need to know what kind of code the function was compiled into.
+*/
+struct EntryPoint
+{
+    struct Parameter
+    {
+        uint32_t offset, size;
+        bool isReference;
+    };
+
+    virtual ~EntryPoint() = default;
+
+    /** Runs the function from the given resume point, returning true if it stopped at an
+        advance() call (in which case the resume point is updated) or false if it returned.
+    */
+    virtual bool execute (ExecutionContext&, ResumePoint&) const noexcept = 0;
+
+    /** The largest number of instances that executeBatch() will be given in one call. */
+    static constexpr uint32_t maxBatchSize = 16;
+
+    /** Runs the function for a set of instances of the same processor, setting each result
+        to the value that execute() would have returned for it. An engine can override this
+        to share work between the instances, but by default they're just run one at a time.
+    */
+    virtual void executeBatch (ExecutionContext* contexts, ResumePoint* resumePoints, bool* results, uint32_t numInstances) const noexcept
+    {
+        for (uint32_t i = 0; i < numInstances; ++i)
+            results[i] = execute (contexts[i], resumePoints[i]);
+    }
+
+    std::string name;
+    std::vector<Parameter> parameters;
+    uint32_t frameSize = 0, returnValueOffset = 0, returnValueSize = 0;
+};
+
+//==============================================================================
+/** A function, compiled into a list of blocks whose statements and terminators refer to
+    pre-resolved frame, state and constant slots.
+*/
+struct Function final  : public EntryPoint
+{
+    struct BlockArgument
+    {
+        const Evaluator* source;
+        uint32_t scratchOffset, parameterOffset, size;
+    };
+
+    struct Block
+    {
+        std::vector<const Operation*> operations;   // a nullptr entry marks an advance() call
+        const Evaluator* condition = nullptr;       // null for an unconditional branch or a return
+        const Evaluator* returnValue = nullptr;
+        uint32_t targets[2] = {};
+        std::vector<BlockArgument> targetArgs[2];
+        bool isReturn = false;
+    };
+
+    std::vector<Block> blocks;
+    bool isCompiled = false;
+
+    bool execute (ExecutionContext& context, ResumePoint& resumePoint) const noexcept override
+    {
+        auto blockIndex = resumePoint.block;
+        auto statementIndex = resumePoint.statement;
+
+        for (;;)
+        {
+            auto& b = blocks[blockIndex];
+            auto numOps = static_cast<uint32_t> (b.operations.size());
+
+            for (auto i = statementIndex; i < numOps; ++i)
+            {
+                if (auto op = b.operations[i])
+                {
+                    op->perform (context);
+                }
+                else
+                {
+                    resumePoint = { blockIndex, i + 1 };
+                    return true;
+                }
+            }
+
+            statementIndex = 0;
+
+            if (b.isReturn)
+            {
+                if (b.returnValue != nullptr)
+                    std::memcpy (context.frame + returnValueOffset, b.returnValue->get (context), returnValueSize);
+
+                return false;
+            }
+
+            uint32_t branch = 0;
+
+            if (b.condition != nullptr && readValue<uint8_t> (b.condition->get (context)) == 0)
+                branch = 1;
+
+            auto& args = b.targetArgs[branch];
+
+            // Arguments go via a scratch area because they may refer to the parameters being overwritten
+            for (auto& a : args)
+                std::memcpy (context.frame + a.scratchOffset, a.source->get (context), a.size);
+
+            for (auto& a : args)
+                std::memcpy (context.frame + a.parameterOffset, context.frame + a.scratchOffset, a.size);
+
+            blockIndex = b.targets[branch];
+        }
+    }
+};
+
+/** Calls a function, using the stack space above the caller's frame for the callee. */
+struct FunctionCall  : public Evaluator,
+                       public Operation
+{
+    struct Argument
+    {
+        const Evaluator* source;
+        uint32_t offset, size;
+        bool isReference;
+    };
+
+    FunctionCall (const Function& f, std::vector<Argument> args, const Evaluator* target, uint32_t result, uint32_t addresses)
+        : function (f), arguments (std::move (args)), resultTarget (target), resultOffset (result), addressesOffset (addresses) {}
+
+    uint8_t* call (ExecutionContext& c) const noexcept
+    {
+        // The argument evaluation may itself call functions which use the stack, so all the
+        // values must be found before anything gets copied into the new frame. They're kept
+        // in the caller's frame rather than in this node, because several threads may be
+        // running instances of the same processor at once.
+        // (Functions can't recurse, so a call node can never be re-entered)
+        auto addresses = reinterpret_cast<uint8_t**> (c.frame + addressesOffset);
+
+        for (size_t i = 0; i < arguments.size(); ++i)
+            addresses[i] = arguments[i].source->get (c);
+
+        auto newFrame = c.stackTop;
+
+        for (size_t i = 0; i < arguments.size(); ++i)
+        {
+            auto& arg = arguments[i];
+
+            if (arg.isReference)
+                writeValue<uint8_t*> (newFrame + arg.offset, addresses[i]);
+            else
+                std::memcpy (newFrame + arg.offset, addresses[i], arg.size);
+        }
+
+        ExecutionContext calleeContext { c.state, newFrame, newFrame + function.frameSize, c.eventOutputs };
+        ResumePoint start;
+        function.execute (calleeContext, start);
+        return newFrame + function.returnValueOffset;
+    }
+
+    uint8_t* get (ExecutionContext& c) const noexcept override
+    {
+        auto result = c.frame + resultOffset;
+        std::memcpy (result, call (c), function.returnValueSize);
+        return result;
+    }
+
+    void perform (ExecutionContext& c) const noexcept override
+    {
+        auto result = call (c);
+
+        if (resultTarget != nullptr)
+            std::memcpy (resultTarget->get (c), result, function.returnValueSize);
+    }
+
+    const Function& function;
+    const std::vector<Argument> arguments;
+    const Evaluator* resultTarget;
+    const uint32_t resultOffset, addressesOffset;
+};
+
+//==============================================================================
+/** The memory layout used by each instance of a processor, and its compiled entry points. */
+struct CompiledProcessor
+{
+    struct EventHandler
+    {
+        const EntryPoint* function = nullptr;
+        bool hasIndexParameter = false;
+    };
+
+    CompiledProcessor (Module& m) : module (m) {}
+
+    /** Allocates the slots for the state variables, endpoints and processor properties. */
+    void createLayout (const BuildSettings& settings)
+    {
+        uint32_t offset = 0;
+
+        auto allocate = [&] (size_t size)
+        {
+            auto start = offset;
+            offset += alignSlotSize (size);
+            return start;
+        };
+
+        for (auto& v : module.stateVariables.get())
+            if (! v->isExternal())
+                stateVariableOffsets[v.getPointer()] = allocate (v->type.getPackedSizeInBytes());
+
+        frequencyOffset   = allocate (sizeof (double));
+        periodOffset      = allocate (sizeof (double));
+        idOffset          = allocate (sizeof (int32_t));
+        resumePointOffset = allocate (sizeof (ResumePoint));
+
+        for (auto& input : module.inputs)
+            inputOffsets.push_back (input->isEventEndpoint() ? 0 : allocate (input->getFrameOrValueType().getPackedSizeInBytes()));
+
+        for (auto& output : module.outputs)
+            outputOffsets.push_back (output->isEventEndpoint() ? 0 : allocate (output->getFrameOrValueType().getPackedSizeInBytes()));
+
+        if (offset > settings.maxStateSize && settings.maxStateSize != 0)
+            CodeLocation().throwError (Errors::programStateTooLarge (getReadableDescriptionOfByteSize (offset),
+                                                                     getReadableDescriptionOfByteSize (settings.maxStateSize)));
+
+        stateSize = offset;
+    }
+
+    /** Reserves space in the state for the run() function's frame, which needs to be kept
+        between calls because run() can be suspended by advance().
+    */
+    void setRunFunction (const EntryPoint& run)
+    {
+        runFunction = std::addressof (run);
+        runFrameOffset = stateSize;
+        stateSize += alignSlotSize (run.frameSize);
+    }
+
+    /** Sets the function which StreamLoopVectoriser made from the run() loop, and reserves space
+        in the state for the groups of output frames that it writes.
+    */
+    void setVectorisedRunFunction (const EntryPoint& f, uint32_t framesPerCall)
+    {
+        vectorisedRunFunction = std::addressof (f);
+        vectorisedFramesPerCall = framesPerCall;
+
+        for (auto& output : module.outputs)
+        {
+            vectorisedOutputOffsets.push_back (stateSize);
+            stateSize += alignSlotSize (output->getFrameType().getPackedSizeInBytes() * framesPerCall);
+        }
+    }
+
+    Module& module;
+    uint32_t stateSize = 0;
+    uint32_t frequencyOffset = 0, periodOffset = 0, idOffset = 0, resumePointOffset = 0;
+    std::vector<uint32_t> inputOffsets, outputOffsets;   // the slots for stream and value endpoints
+    std::vector<std::vector<EventHandler>> eventHandlers; // indexed by input, then by type
+    std::unordered_map<const heart::Variable*, uint32_t> stateVariableOffsets;
+
+    const EntryPoint* stateInitialiser = nullptr;
+    const EntryPoint* systemInitFunction = nullptr;
+    const EntryPoint* userInitFunction = nullptr;
+    const EntryPoint* runFunction = nullptr;
+    uint32_t runFrameOffset = 0;
+
+    const EntryPoint* vectorisedRunFunction = nullptr;
+    uint32_t vectorisedFramesPerCall = 0;
+    std::vector<uint32_t> vectorisedOutputOffsets;
+};
+
+/** Creates the code and layout for the processors in a program, for a GraphRuntime to run. */
+struct ProcessorCompiler
+{
+    virtual ~ProcessorCompiler() = default;
+
+    virtual CompiledProcessor& getProcessor (Module&) = 0;
+
+    /** Returns a stack size which is big enough for any call sequence, given that the
+        functions can't be recursive.
+    */
+    virtual size_t getRequiredStackSize() const = 0;
+
+    /** Called when all the processors in the graph have been compiled. */
+    virtual void finishedCompiling() {}
+
+    /** Returns true if the engine's EntryPoints override executeBatch() to dispatch each
+        statement once for a whole group of instances. If not, grouping the instances would
+        gain nothing, so BuildSettings::processorBatchSize is ignored.
+    */
+    virtual bool canDispatchGroupedInstances() const     { return false; }
+};
+
+//==============================================================================
+/**
+    Converts the HEART functions of a program into trees of Evaluator and Operation
+    objects, with all variables, blocks and endpoints resolved to fixed offsets.
+*/
+class FunctionCompiler  : public ProcessorCompiler
+{
+public:
+    FunctionCompiler (Program& p, const BuildSettings& s,
+                      const std::unordered_map<const heart::Variable*, const Value*>& externals,
+                      UnsizedArraySizes& sizes)
+        : program (p), settings (s), externalValues (externals), unsizedArraySizes (sizes)
+    {
+    }
+
+    CompiledProcessor& getProcessor (Module& module) override
+    {
+        for (auto& p : processors)
+            if (std::addressof (p->module) == std::addressof (module))
+                return *p;
+
+        processors.push_back (std::make_unique<CompiledProcessor> (module));
+        auto& p = *processors.back();
+        p.createLayout (settings);
+
+        auto& moduleFunctions = module.functions;
+
+        p.stateInitialiser = std::addressof (createStateInitialiser (p));
+
+        for (auto& f : moduleFunctions.get())
+        {
+            if (f->functionType.isSystemInit())  p.systemInitFunction = std::addressof (getFunction (f));
+            if (f->functionType.isUserInit())    p.userInitFunction   = std::addressof (getFunction (f));
+        }
+
+        for (auto& input : module.inputs)
+        {
+            p.eventHandlers.emplace_back();
+
+            if (input->isEventEndpoint())
+            {
+                for (auto& type : input->dataTypes)
+                {
+                    CompiledProcessor::EventHandler handler;
+
+                    if (auto f = moduleFunctions.find (heart::getEventFunctionName (input->name.toString(), type)))
+                    {
+                        handler.function = std::addressof (getFunction (*f));
+                        handler.hasIndexParameter = f->parameters.size() > 1;
+                    }
+
+                    p.eventHandlers.back().push_back (handler);
+                }
+            }
+        }
+
+        if (auto run = moduleFunctions.findRunFunction())
+            p.setRunFunction (getFunction (*run));
+
+        if (auto f = moduleFunctions.find (heart::getVectorisedRunFunctionName()))
+            p.setVectorisedRunFunction (getFunction (*f), StreamLoopVectoriser::getFramesPerCall (*f));
+
+        return p;
+    }
+
+    size_t getRequiredStackSize() const override
+    {
+        size_t total = 64;
+
+        for (auto& f : functions)
+            total += f.second->frameSize;
+
+        return total;
+    }
+
+private:
+    //==============================================================================
+    Program& program;
+    const BuildSettings& settings;
+    const std::unordered_map<const heart::Variable*, const Value*>& externalValues;
+    UnsizedArraySizes& unsizedArraySizes;
+
+    std::vector<std::unique_ptr<CompiledProcessor>> processors;
+    std::unordered_map<const heart::Function*, std::unique_ptr<Function>> functions;
+    std::vector<std::unique_ptr<Function>> syntheticFunctions;
+    std::vector<std::unique_ptr<Evaluator>> evaluators;
+    std::vector<std::unique_ptr<Operation>> operations;
+    std::vector<std::unique_ptr<Value>> constants;
+
+    template <typename EvaluatorType, typename... Args>
+    const Evaluator& createEvaluator (Args&&... args)
+    {
+        auto e = std::make_unique<EvaluatorType> (std::forward<Args> (args)...);
+        auto& result = *e;
+        evaluators.push_back (std::move (e));
+        return result;
+    }
+
+    template <typename OperationType, typename... Args>
+    const Operation& createOperation (Args&&... args)
+    {
+        auto o = std::make_unique<OperationType> (std::forward<Args> (args)...);
+        auto& result = *o;
+        operations.push_back (std::move (o));
+        return result;
+    }
+
+    const Evaluator& createConstant (Value v)
+    {
+        v.convertAllHandlesToPointers (program.getConstantTable());
+        constants.push_back (std::make_unique<Value> (std::move (v)));
+        return createEvaluator<FixedAddress> (constants.back()->getPackedData());
+    }
+
+    //==============================================================================
+    const Function& createStateInitialiser (CompiledProcessor& p)
+    {
+        syntheticFunctions.push_back (std::make_unique<Function>());
+        auto& fn = *syntheticFunctions.back();
+        fn.name = p.module.fullName + "::_stateInitialiser";
+
+        FunctionBuilder builder (*this, fn, std::addressof (p));
+        Function::Block block;
+        block.isReturn = true;
+
+        for (auto& v : p.module.stateVariables.get())
+            if (v->initialValue != nullptr && ! v->isExternal())
+                block.operations.push_back (std::addressof (builder.createAssignment (builder.getVariable (v),
+                                                                                      builder.compileExpression (*v->initialValue, v->type),
+                                                                                      v->type)));
+
+        fn.blocks.push_back (std::move (block));
+        fn.frameSize = builder.frameSize;
+        fn.isCompiled = true;
+        return fn;
+    }
+
+    const Function& getFunction (heart::Function& f)
+    {
+        auto& fn = functions[std::addressof (f)];
+
+        if (fn == nullptr)
+        {
+            fn = std::make_unique<Function>();
+            compileFunction (*fn, f);
+        }
+
+        return *fn;
+    }
+
+    void compileFunction (Function& fn, heart::Function& f)
+    {
+        auto& module = program.getModuleContainingFunction (f);
+        fn.name = program.getFunctionNameWithQualificationIfNeeded (module, f);
+
+        if (f.hasNoBody)
+            f.location.throwError (Errors::functionHasNoImplementation());
+
+        FunctionBuilder builder (*this, fn, module.isProcessor() ? std::addressof (getProcessor (module)) : nullptr);
+        builder.build (f);
+        fn.isCompiled = true;
+    }
+
+    //==============================================================================
+    struct FunctionBuilder
+    {
+        FunctionBuilder (FunctionCompiler& c, Function& f, CompiledProcessor* p)
+            : compiler (c), function (f), processor (p) {}
+
+        FunctionCompiler& compiler;
+        Function& function;
+        CompiledProcessor* processor;
+        uint32_t frameSize = 0;
+        std::unordered_map<const heart::Variable*, const Evaluator*> localVariables;
+
+        uint32_t allocateFrameSlot (size_t size)
+        {
+            auto start = frameSize;
+            frameSize += alignSlotSize (std::max (size, (size_t) 1));
+            return start;
+        }
+
+        void build (heart::Function& f)
+        {
+            for (auto& param : f.parameters)
+            {
+                auto isReference = param->type.isReference();
+                auto size = isReference ? sizeof (void*) : param->type.getPackedSizeInBytes();
+                auto offset = allocateFrameSlot (size);
+                function.parameters.push_back ({ offset, static_cast<uint32_t> (size), isReference });
+
+                if (isReference)
+                    localVariables[param.getPointer()] = std::addressof (compiler.createEvaluator<ReferenceParameter> (offset));
+                else
+                    localVariables[param.getPointer()] = std::addressof (compiler.createEvaluator<FrameSlot> (offset));
+            }
+
+            if (! f.returnType.isVoid())
+            {
+                function.returnValueSize = static_cast<uint32_t> (f.returnType.getPackedSizeInBytes());
+                function.returnValueOffset = allocateFrameSlot (function.returnValueSize);
+            }
+
+            std::unordered_map<const heart::Block*, uint32_t> blockIndexes;
+
+            for (auto& b : f.blocks)
+            {
+                blockIndexes[b.getPointer()] = static_cast<uint32_t> (blockIndexes.size());
+
+                for (auto& param : b->parameters)
+                    localVariables[param.getPointer()] = std::addressof (compiler.createEvaluator<FrameSlot> (allocateFrameSlot (param->type.getPackedSizeInBytes())));
+            }
+
+            for (auto& b : f.blocks)
+            {
+                Function::Block block;
+
+                for (auto s : b->statements)
+                    block.operations.push_back (compileStatement (*s));
+
+                compileTerminator (block, *b->terminator, f, blockIndexes);
+                function.blocks.push_back (std::move (block));
+            }
+
+            function.frameSize = frameSize;
+        }
+
+        void compileTerminator (Function::Block& block, heart::Terminator& t, heart::Function& f,
+                                std::unordered_map<const heart::Block*, uint32_t>& blockIndexes)
+        {
+            auto addArgs = [&] (std::vector<Function::BlockArgument>& result, heart::Block& target,
+                                ArrayView<pool_ref<heart::Expression>> args)
+            {
+                SOUL_ASSERT (args.size() == target.parameters.size());
+
+                for (size_t i = 0; i < args.size(); ++i)
+                {
+                    auto& param = target.parameters[i];
+                    auto size = static_cast<uint32_t> (param->type.getPackedSizeInBytes());
+                    auto& paramSlot = static_cast<const FrameSlot&> (*localVariables[param.getPointer()]);
+
+                    result.push_back ({ std::addressof (compileExpression (args[i], param->type)),
+                                        allocateFrameSlot (size), paramSlot.offset, size });
+                }
+
+                return blockIndexes[std::addressof (target)];
+            };
+
+            if (auto br = cast<heart::Branch> (t))
+            {
+                block.targets[0] = addArgs (block.targetArgs[0], br->target, br->targetArgs);
+                return;
+            }
+
+            if (auto bi = cast<heart::BranchIf> (t))
+            {
+                block.condition = std::addressof (compileExpression (bi->condition, PrimitiveType::bool_));
+                block.targets[0] = addArgs (block.targetArgs[0], bi->targets[0], bi->targetArgs[0]);
+                block.targets[1] = addArgs (block.targetArgs[1], bi->targets[1], bi->targetArgs[1]);
+                return;
+            }
+
+            block.isReturn = true;
+
+            if (auto rv = cast<heart::ReturnValue> (t))
+                block.returnValue = std::addressof (compileExpression (rv->returnValue, f.returnType));
+        }
+
+        //==============================================================================
+        const Operation* compileStatement (heart::Statement& s)
+        {
+            if (is_type<heart::AdvanceClock> (s))
+                return nullptr;
+
+            if (auto a = cast<heart::AssignFromValue> (s))
+            {
+                auto& targetType = a->target->getType();
+                return std::addressof (createAssignment (compileExpression (*a->target),
+                                                         compileExpression (a->source, targetType),
+                                                         targetType));
+            }
+
+            if (auto fc = cast<heart::FunctionCall> (s))
+            {
+                auto& target = fc->getFunction();
+                const Evaluator* resultTarget = nullptr;
+
+                if (fc->target != nullptr)
+                {
+                    auto targetType = fc->target->getType().removeReferenceIfPresent();
+
+                    if (! targetType.isIdentical (target.returnType.removeReferenceIfPresent()))
+                    {
+                        auto& result = compileCallExpression (target, fc->arguments);
+                        return std::addressof (createAssignment (compileExpression (*fc->target),
+                                                                 createCast (result, target.returnType, targetType),
+                                                                 targetType));
+                    }
+
+                    resultTarget = std::addressof (compileExpression (*fc->target));
+                }
+
+                if (auto native = compileIntrinsic (target, fc->arguments))
+                {
+                    if (resultTarget == nullptr)
+                        return std::addressof (compiler.createOperation<DiscardResult> (*native));
+
+                    return std::addressof (createAssignment (*resultTarget, *native, target.returnType));
+                }
+
+                return std::addressof (compiler.createOperation<FunctionCall> (compiler.getFunction (target),
+                                                                                getCallArguments (target, fc->arguments),
+                                                                                resultTarget, 0, allocateArgumentAddresses (fc->arguments)));
+            }
+
+            if (auto r = cast<heart::ReadStream> (s))
+            {
+                auto& input = r->source.get();
+                auto& slot = getInputSlot (input, r->element);
+                auto& targetType = r->target->getType();
+                auto slotType = r->element != nullptr ? input.getFrameOrValueType().getElementType()
+                                                      : input.getFrameOrValueType();
+
+                return std::addressof (createAssignment (compileExpression (*r->target),
+                                                         createCast (slot, slotType, targetType),
+                                                         targetType));
+            }
+
+            if (auto w = cast<heart::WriteStream> (s))
+                return std::addressof (compileWrite (*w));
+
+            s.location.throwError (Errors::notYetImplemented ("statement type"));
+        }
+
+        const Operation& createAssignment (const Evaluator& dest, const Evaluator& source, const Type& type)
+        {
+            auto size = type.removeReferenceIfPresent().getPackedSizeInBytes();
+
+            if (size == 4)  return compiler.createOperation<CopyPrimitive<uint32_t>> (dest, source);
+            if (size == 8)  return compiler.createOperation<CopyPrimitive<uint64_t>> (dest, source);
+
+            return compiler.createOperation<CopyValue> (dest, source, size);
+        }
+
+        const Evaluator& getInputSlot (heart::InputDeclaration& input, pool_ptr<heart::Expression> element)
+        {
+            SOUL_ASSERT (processor != nullptr);
+            auto index = getEndpointIndex (processor->module.inputs, input);
+            auto& slot = compiler.createEvaluator<StateSlot> (processor->inputOffsets[index]);
+
+            if (element == nullptr)
+                return slot;
+
+            return createElementAccess (slot, input.getFrameOrValueType(), *element, false);
+        }
+
+        template <typename DeclType>
+        static size_t getEndpointIndex (const std::vector<pool_ref<DeclType>>& list, const heart::IODeclaration& endpoint)
+        {
+            for (size_t i = 0; i < list.size(); ++i)
+                if (list[i].getPointer() == std::addressof (endpoint))
+                    return i;
+
+            SOUL_ASSERT_FALSE;
+            return 0;
+        }
+
+        const Operation& compileWrite (heart::WriteStream& w)
+        {
+            SOUL_ASSERT (processor != nullptr);
+            auto& output = w.target.get();
+            auto outputIndex = getEndpointIndex (processor->module.outputs, output);
+            auto& valueType = w.value->getType();
+
+            if (output.isEventEndpoint())
+            {
+                uint32_t typeIndex = 0;
+
+                for (uint32_t i = 0; i < output.dataTypes.size(); ++i)
+                {
+                    if (output.dataTypes[i].isEqual (valueType, Type::ignoreReferences | Type::ignoreConst))
+                    {
+                        typeIndex = i;
+                        break;
+                    }
+
+                    if (TypeRules::canSilentlyCastTo (output.dataTypes[i], valueType))
+                        typeIndex = i;
+                }
+
+                auto& value = compileExpression (w.value, output.dataTypes[typeIndex]);
+                const Evaluator* element = nullptr;
+                auto arraySize = output.arraySize.value_or (1);
+
+                if (w.element != nullptr)
+                {
+                    auto& elementType = w.element->getType();
+
+                    if (elementType.isInteger64())
+                        return compiler.createOperation<WriteEvent<int64_t>> (value, std::addressof (compileExpression (*w.element)),
+                                                                              static_cast<uint32_t> (outputIndex), typeIndex, arraySize);
+
+                    element = std::addressof (compileExpression (*w.element, PrimitiveType::int32));
+                }
+
+                return compiler.createOperation<WriteEvent<int32_t>> (value, element, static_cast<uint32_t> (outputIndex), typeIndex, arraySize);
+            }
+
+            auto& slot = compiler.createEvaluator<StateSlot> (processor->outputOffsets[outputIndex]);
+            auto slotType = output.getFrameOrValueType();
+            auto* dest = std::addressof (slot);
+
+            if (w.element != nullptr)
+            {
+                dest = std::addressof (createElementAccess (slot, slotType, *w.element, false));
+                slotType = slotType.getElementType();
+            }
+
+            auto& value = compileExpression (w.value, slotType);
+
+            if (output.isValueEndpoint())
+                return createAssignment (*dest, value, slotType);
+
+            auto numElements = static_cast<uint32_t> (slotType.getPackedSizeInBytes() / slotType.getPrimitiveType().getPackedSizeInBytes());
+            auto prim = slotType.getPrimitiveType();
+
+            if (prim.isFloat32())   return compiler.createOperation<AccumulateStream<float>>   (*dest, value, numElements);
+            if (prim.isFloat64())   return compiler.createOperation<AccumulateStream<double>>  (*dest, value, numElements);
+            if (prim.isInteger32()) return compiler.createOperation<AccumulateStream<int32_t>> (*dest, value, numElements);
+            if (prim.isInteger64()) return compiler.createOperation<AccumulateStream<int64_t>> (*dest, value, numElements);
+
+            w.location.throwError (Errors::unsupportedType());
+        }
+
+        //==============================================================================
+        const Evaluator& getVariable (heart::Variable& v)
+        {
+            auto found = localVariables.find (std::addressof (v));
+
+            if (found != localVariables.end())
+                return *found->second;
+
+            if (v.isExternal())
+            {
+                auto external = compiler.externalValues.find (std::addressof (v));
+
+                if (external == compiler.externalValues.end())
+                    v.location.throwError (Errors::unresolvedExternal (v.name.toString()));
+
+                auto& e = compiler.createEvaluator<FixedAddress> (external->second->getPackedData());
+                localVariables[std::addressof (v)] = std::addressof (e);
+                return e;
+            }
+
+            if (v.isState())
+            {
+                if (processor != nullptr)
+                {
+                    auto offset = processor->stateVariableOffsets.find (std::addressof (v));
+
+                    if (offset != processor->stateVariableOffsets.end())
+                    {
+                        auto& e = compiler.createEvaluator<StateSlot> (offset->second);
+                        localVariables[std::addressof (v)] = std::addressof (e);
+                        return e;
+                    }
+                }
+
+                throwInternalCompilerError ("Unknown state variable", v.name.toString().c_str(), 0);
+            }
+
+            SOUL_ASSERT (v.isFunctionLocal());
+            auto& e = compiler.createEvaluator<FrameSlot> (allocateFrameSlot (v.type.getPackedSizeInBytes()));
+            localVariables[std::addressof (v)] = std::addressof (e);
+            return e;
+        }
+
+        const Evaluator& compileExpression (heart::Expression& e, const Type& targetType)
+        {
+            return createCast (compileExpression (e), e.getType(), targetType);
+        }
+
+        const Evaluator& compileExpression (heart::Expression& e)
+        {
+            if (auto v = cast<heart::Variable> (e))
+                return getVariable (*v);
+
+            if (auto c = cast<heart::Constant> (e))
+                return compiler.createConstant (c->value);
+
+            if (auto a = cast<heart::ArrayElement> (e))
+            {
+                auto& parent = compileExpression (a->parent);
+                auto parentType = a->parent->getType().removeReferenceIfPresent();
+
+                if (a->isDynamic())
+                    return createElementAccess (parent, parentType, *a->dynamicIndex, a->isRangeTrusted);
+
+                auto offset = a->fixedStartIndex * getElementSize (parentType);
+
+                if (parentType.isUnsizedArray())
+                    return compiler.createEvaluator<SubElement<true>> (parent, offset);
+
+                if (offset == 0)
+                    return parent;
+
+                return compiler.createEvaluator<SubElement<false>> (parent, offset);
+            }
+
+            if (auto s = cast<heart::StructElement> (e))
+            {
+                auto& parent = compileExpression (s->parent);
+                auto& structure = s->getStruct();
+                auto index = s->getMemberIndex();
+                size_t offset = 0;
+
+                for (size_t i = 0; i < index; ++i)
+                    offset += structure.getMemberType (i).getPackedSizeInBytes();
+
+                if (offset == 0)
+                    return parent;
+
+                return compiler.createEvaluator<SubElement<false>> (parent, offset);
+            }
+
+            if (auto c = cast<heart::TypeCast> (e))
+                return compileExpression (c->source, c->destType);
+
+            if (auto u = cast<heart::UnaryOperator> (e))
+                return compileUnaryOp (*u);
+
+            if (auto b = cast<heart::BinaryOperator> (e))
+                return compileBinaryOp (*b);
+
+            if (auto fc = cast<heart::PureFunctionCall> (e))
+                return compileCallExpression (fc->function, fc->arguments);
+
+            if (auto p = cast<heart::ProcessorProperty> (e))
+                return compileProcessorProperty (*p);
+
+            e.location.throwError (Errors::notYetImplemented ("expression type"));
+        }
+
+        static size_t getElementSize (const Type& arrayOrVector)
+        {
+            if (arrayOrVector.isPrimitive() || arrayOrVector.isBoundedInt())
+                return arrayOrVector.getPackedSizeInBytes();
+
+            return arrayOrVector.getElementType().getPackedSizeInBytes();
+        }
+
+        const Evaluator& createElementAccess (const Evaluator& parent, const Type& parentType, heart::Expression& index, bool isRangeTrusted)
+        {
+            auto elementSize = getElementSize (parentType);
+            auto isUnsized = parentType.isUnsizedArray();
+            size_t size = (isUnsized || isRangeTrusted) ? 0 : parentType.getArrayOrVectorSize();
+
+            if (index.getType().isInteger64())
+            {
+                auto& i = compileExpression (index);
+
+                if (isUnsized)
+                    return compiler.createEvaluator<DynamicElement<true, int64_t>> (parent, i, elementSize, size);
+
+                return compiler.createEvaluator<DynamicElement<false, int64_t>> (parent, i, elementSize, size);
+            }
+
+            auto& i = compileExpression (index, PrimitiveType::int32);
+
+            if (isUnsized)
+                return compiler.createEvaluator<DynamicElement<true, int32_t>> (parent, i, elementSize, size);
+
+            return compiler.createEvaluator<DynamicElement<false, int32_t>> (parent, i, elementSize, size);
+        }
+
+        const Evaluator& compileProcessorProperty (heart::ProcessorProperty& p)
+        {
+            using Property = heart::ProcessorProperty::Property;
+
+            if (processor == nullptr)
+                p.location.throwError (Errors::processorPropertyUsedOutsideDecl());
+
+            switch (p.property)
+            {
+                case Property::frequency:  return compiler.createEvaluator<StateSlot> (processor->frequencyOffset);
+                case Property::period:     return compiler.createEvaluator<StateSlot> (processor->periodOffset);
+                case Property::id:         return compiler.createEvaluator<StateSlot> (processor->idOffset);
+                case Property::session:    return compiler.createConstant (Value::createInt32 (compiler.settings.sessionID));
+                case Property::latency:    return compiler.createConstant (Value::createInt32 (processor->module.latency));
+                case Property::none:
+                default:                   p.location.throwError (Errors::unknownProperty());
+            }
+        }
+
+        //==============================================================================
+        const Evaluator& compileCallExpression (heart::Function& target, ArrayView<pool_ref<heart::Expression>> args)
+        {
+            if (auto native = compileIntrinsic (target, args))
+                return *native;
+
+            return compiler.createEvaluator<FunctionCall> (compiler.getFunction (target),
+                                                           getCallArguments (target, args),
+                                                           nullptr, allocateFrameSlot (target.returnType.getPackedSizeInBytes()),
+                                                           allocateArgumentAddresses (args));
+        }
+
+        uint32_t allocateArgumentAddresses (ArrayView<pool_ref<heart::Expression>> args)
+        {
+            return allocateFrameSlot (sizeof (uint8_t*) * args.size());
+        }
+
+        std::vector<FunctionCall::Argument> getCallArguments (heart::Function& target, ArrayView<pool_ref<heart::Expression>> args)
+        {
+            auto& callee = compiler.getFunction (target);
+            std::vector<FunctionCall::Argument> result;
+            SOUL_ASSERT (args.size() == callee.parameters.size());
+
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                auto& param = callee.parameters[i];
+
+                if (param.isReference)
+                    result.push_back ({ std::addressof (compileExpression (args[i])), param.offset, param.size, true });
+                else
+                    result.push_back ({ std::addressof (compileExpression (args[i], target.parameters[i]->type)), param.offset, param.size, false });
+            }
+
+            return result;
+        }
+
+        const Evaluator* compileIntrinsic (heart::Function& f, ArrayView<pool_ref<heart::Expression>> args)
+        {
+            if (f.intrinsicType == IntrinsicType::none)
+                return nullptr;
+
+            auto& returnType = f.returnType;
+
+            if (f.intrinsicType == IntrinsicType::get_array_size)
+            {
+                auto arrayType = args.front()->getType().removeReferenceIfPresent();
+                auto resultType = Type (PrimitiveType::int32);
+
+                if (arrayType.isUnsizedArray())
+                {
+                    auto& size = compiler.createEvaluator<UnsizedArraySize> (compileExpression (args.front()), compiler.unsizedArraySizes,
+                                                                             allocateFrameSlot (sizeof (int32_t)));
+                    return std::addressof (createCast (size, resultType, returnType));
+                }
+
+                return std::addressof (compiler.createConstant (Value::createInt32 (arrayType.getArrayOrVectorSize())
+                                                                  .castToTypeExpectingSuccess (returnType)));
+            }
+
+            if (f.intrinsicType == IntrinsicType::sum || f.intrinsicType == IntrinsicType::product)
+            {
+                auto argType = args.front()->getType().removeReferenceIfPresent();
+
+                if (! (argType.isFixedSizeArray() || argType.isVector()) || ! returnType.isPrimitive()
+                      || ! argType.getElementType().isEqual (returnType, Type::ignoreConst))
+                    return nullptr;
+
+                auto& source = compileExpression (args.front());
+                auto num = static_cast<uint32_t> (argType.getArrayOrVectorSize());
+                auto result = allocateFrameSlot (returnType.getPackedSizeInBytes());
+                auto isProduct = f.intrinsicType == IntrinsicType::product;
+
+                if (returnType.isFloat32())   return isProduct ? std::addressof (compiler.createEvaluator<SumOrProduct<float, true>>    (source, result, num))
+                                                               : std::addressof (compiler.createEvaluator<SumOrProduct<float, false>>   (source, result, num));
+                if (returnType.isFloat64())   return isProduct ? std::addressof (compiler.createEvaluator<SumOrProduct<double, true>>   (source, result, num))
+                                                               : std::addressof (compiler.createEvaluator<SumOrProduct<double, false>>  (source, result, num));
+                if (returnType.isInteger32()) return isProduct ? std::addressof (compiler.createEvaluator<SumOrProduct<int32_t, true>>  (source, result, num))
+                                                               : std::addressof (compiler.createEvaluator<SumOrProduct<int32_t, false>> (source, result, num));
+                if (returnType.isInteger64()) return isProduct ? std::addressof (compiler.createEvaluator<SumOrProduct<int64_t, true>>  (source, result, num))
+                                                               : std::addressof (compiler.createEvaluator<SumOrProduct<int64_t, false>> (source, result, num));
+                return nullptr;
+            }
+
+            // The remaining intrinsics operate element-wise on primitives or vectors which all share the same type
+            if (args.empty() || args.size() != f.parameters.size())
+                return nullptr;
+
+            auto argType = f.parameters.front()->type.removeReferenceIfPresent().removeConstIfPresent();
+
+            if (! argType.isPrimitiveOrVector() || argType.isBoundedInt())
+                return nullptr;
+
+            for (auto& p : f.parameters)
+                if (! p->type.removeReferenceIfPresent().isEqual (argType, Type::ignoreConst))
+                    return nullptr;
+
+            std::vector<const Evaluator*> argValues;
+
+            for (auto& a : args)
+                argValues.push_back (std::addressof (compileExpression (a, argType)));
+
+            auto num = static_cast<uint32_t> (argType.isVector() ? argType.getVectorSize() : 1);
+            auto prim = argType.getPrimitiveType();
+
+            if (f.intrinsicType == IntrinsicType::roundToInt)
+            {
+                if (! (argType.isPrimitive() && returnType.isPrimitiveInteger()))
+                    return nullptr;
+
+                auto result = allocateFrameSlot (8);
+                auto& arg = *argValues.front();
+
+                if (prim.isFloat32() && returnType.isInteger32())  return std::addressof (compiler.createEvaluator<RoundToInt<float, int32_t>>  (arg, result));
+                if (prim.isFloat32() && returnType.isInteger64())  return std::addressof (compiler.createEvaluator<RoundToInt<float, int64_t>>  (arg, result));
+                if (prim.isFloat64() && returnType.isInteger32())  return std::addressof (compiler.createEvaluator<RoundToInt<double, int32_t>> (arg, result));
+                if (prim.isFloat64() && returnType.isInteger64())  return std::addressof (compiler.createEvaluator<RoundToInt<double, int64_t>> (arg, result));
+                return nullptr;
+            }
+
+            if (f.intrinsicType == IntrinsicType::isnan || f.intrinsicType == IntrinsicType::isinf)
+            {
+                if (! (returnType.isBool() && returnType.getVectorSize() == argType.getVectorSize()))
+                    return nullptr;
+
+                auto result = allocateFrameSlot (num);
+                auto& arg = *argValues.front();
+                auto isNaN = f.intrinsicType == IntrinsicType::isnan;
+
+                if (prim.isFloat32())  return std::addressof (isNaN ? compiler.createEvaluator<UnaryOperation<float, uint8_t, IntrinsicFunctions::isnan<float>>> (arg, result, num)
+                                                                    : compiler.createEvaluator<UnaryOperation<float, uint8_t, IntrinsicFunctions::isinf<float>>> (arg, result, num));
+                if (prim.isFloat64())  return std::addressof (isNaN ? compiler.createEvaluator<UnaryOperation<double, uint8_t, IntrinsicFunctions::isnan<double>>> (arg, result, num)
+                                                                    : compiler.createEvaluator<UnaryOperation<double, uint8_t, IntrinsicFunctions::isinf<double>>> (arg, result, num));
+                return nullptr;
+            }
+
+            if (! returnType.isEqual (argType, Type::ignoreConst))
+                return nullptr;
+
+            auto result = allocateFrameSlot (argType.getPackedSizeInBytes());
+
+            if (prim.isFloat32())    return createElementwiseIntrinsic<float>   (f.intrinsicType, argValues, result, num);
+            if (prim.isFloat64())    return createElementwiseIntrinsic<double>  (f.intrinsicType, argValues, result, num);
+            if (prim.isInteger32())  return createElementwiseIntrinsic<int32_t> (f.intrinsicType, argValues, result, num);
+            if (prim.isInteger64())  return createElementwiseIntrinsic<int64_t> (f.intrinsicType, argValues, result, num);
+
+            return nullptr;
+        }
+
+        template <typename T>
+        const Evaluator* createElementwiseIntrinsic (IntrinsicType type, const std::vector<const Evaluator*>& args, uint32_t result, uint32_t num)
+        {
+            auto unary = [&] (auto fn) -> const Evaluator*
+            {
+                if (args.size() != 1) return nullptr;
+                return std::addressof (compiler.createEvaluator<UnaryOperation<T, T, decltype (fn)::value>> (*args[0], result, num));
+            };
+
+            auto binary = [&] (auto fn) -> const Evaluator*
+            {
+                if (args.size() != 2) return nullptr;
+                return std::addressof (compiler.createEvaluator<BinaryOperation<T, T, decltype (fn)::value>> (*args[0], *args[1], result, num));
+            };
+
+            auto ternary = [&] (auto fn) -> const Evaluator*
+            {
+                if (args.size() != 3) return nullptr;
+                return std::addressof (compiler.createEvaluator<TernaryOperation<T, decltype (fn)::value>> (*args[0], *args[1], *args[2], result, num));
+            };
+
+            #define SOUL_INTRINSIC_FN(name)  std::integral_constant<decltype (&IntrinsicFunctions::name<T>), &IntrinsicFunctions::name<T>>()
+
+            switch (type)
+            {
+                case IntrinsicType::abs:    return unary   (SOUL_INTRINSIC_FN (abs));
+                case IntrinsicType::min:    return binary  (SOUL_INTRINSIC_FN (min));
+                case IntrinsicType::max:    return binary  (SOUL_INTRINSIC_FN (max));
+                case IntrinsicType::clamp:  return ternary (std::integral_constant<decltype (&Ops::clamp<T>), &Ops::clamp<T>>());
+                case IntrinsicType::wrap:   return binary  (std::integral_constant<decltype (&Ops::wrap<T>), &Ops::wrap<T>>());
+                default: break;
+            }
+
+            if constexpr (std::is_floating_point<T>::value)
+            {
+                if (compiler.settings.useFastMaths)
+                {
+                    #define SOUL_FAST_INTRINSIC_FN(name)  std::integral_constant<decltype (&FastIntrinsics::name<T>), &FastIntrinsics::name<T>>()
+
+                    switch (type)
+                    {
+                        case IntrinsicType::pow:       return binary (SOUL_FAST_INTRINSIC_FN (pow));
+                        case IntrinsicType::exp:       return unary  (SOUL_FAST_INTRINSIC_FN (exp));
+                        case IntrinsicType::log:       return unary  (SOUL_FAST_INTRINSIC_FN (log));
+                        case IntrinsicType::log10:     return unary  (SOUL_FAST_INTRINSIC_FN (log10));
+                        case IntrinsicType::sin:       return unary  (SOUL_FAST_INTRINSIC_FN (sin));
+                        case IntrinsicType::cos:       return unary  (SOUL_FAST_INTRINSIC_FN (cos));
+                        case IntrinsicType::tan:       return unary  (SOUL_FAST_INTRINSIC_FN (tan));
+                        case IntrinsicType::sinh:      return unary  (SOUL_FAST_INTRINSIC_FN (sinh));
+                        case IntrinsicType::cosh:      return unary  (SOUL_FAST_INTRINSIC_FN (cosh));
+                        case IntrinsicType::tanh:      return unary  (SOUL_FAST_INTRINSIC_FN (tanh));
+                        default: break;
+                    }
+
+                    #undef SOUL_FAST_INTRINSIC_FN
+                }
+
+                switch (type)
+                {
+                    case IntrinsicType::fmod:          return binary (SOUL_INTRINSIC_FN (fmod));
+                    case IntrinsicType::remainder:     return binary (SOUL_INTRINSIC_FN (remainder));
+                    case IntrinsicType::floor:         return unary  (SOUL_INTRINSIC_FN (floor));
+                    case IntrinsicType::ceil:          return unary  (SOUL_INTRINSIC_FN (ceil));
+                    case IntrinsicType::addModulo2Pi:  return binary (SOUL_INTRINSIC_FN (addModulo2Pi));
+                    case IntrinsicType::sqrt:          return unary  (SOUL_INTRINSIC_FN (sqrt));
+                    case IntrinsicType::pow:           return binary (SOUL_INTRINSIC_FN (pow));
+                    case IntrinsicType::exp:           return unary  (SOUL_INTRINSIC_FN (exp));
+                    case IntrinsicType::log:           return unary  (SOUL_INTRINSIC_FN (log));
+                    case IntrinsicType::log10:         return unary  (SOUL_INTRINSIC_FN (log10));
+                    case IntrinsicType::sin:           return unary  (SOUL_INTRINSIC_FN (sin));
+                    case IntrinsicType::cos:           return unary  (SOUL_INTRINSIC_FN (cos));
+                    case IntrinsicType::tan:           return unary  (SOUL_INTRINSIC_FN (tan));
+                    case IntrinsicType::sinh:          return unary  (SOUL_INTRINSIC_FN (sinh));
+                    case IntrinsicType::cosh:          return unary  (SOUL_INTRINSIC_FN (cosh));
+                    case IntrinsicType::tanh:          return unary  (SOUL_INTRINSIC_FN (tanh));
+                    case IntrinsicType::asinh:         return unary  (SOUL_INTRINSIC_FN (asinh));
+                    case IntrinsicType::acosh:         return unary  (SOUL_INTRINSIC_FN (acosh));
+                    case IntrinsicType::atanh:         return unary  (SOUL_INTRINSIC_FN (atanh));
+                    case IntrinsicType::asin:          return unary  (SOUL_INTRINSIC_FN (asin));
+                    case IntrinsicType::acos:          return unary  (SOUL_INTRINSIC_FN (acos));
+                    case IntrinsicType::atan:          return unary  (SOUL_INTRINSIC_FN (atan));
+                    case IntrinsicType::atan2:         return binary (SOUL_INTRINSIC_FN (atan2));
+                    default: break;
+                }
+            }
+
+            #undef SOUL_INTRINSIC_FN
+            return nullptr;
+        }
+
+        //==============================================================================
+        const Evaluator& compileUnaryOp (heart::UnaryOperator& u)
+        {
+            auto type = u.getType().removeReferenceIfPresent();
+            auto& source = compileExpression (u.source, type);
+            auto num = static_cast<uint32_t> (type.isVector() ? type.getVectorSize() : 1);
+            auto result = allocateFrameSlot (type.getPackedSizeInBytes());
+            auto prim = type.getPrimitiveType();
+
+            switch (u.operation)
+            {
+                case UnaryOp::Op::negate:
+                    if (prim.isFloat32())    return compiler.createEvaluator<UnaryOperation<float,   float,   Ops::negate<float>>>   (source, result, num);
+                    if (prim.isFloat64())    return compiler.createEvaluator<UnaryOperation<double,  double,  Ops::negate<double>>>  (source, result, num);
+                    if (prim.isInteger32())  return compiler.createEvaluator<UnaryOperation<int32_t, int32_t, Ops::negate<int32_t>>> (source, result, num);
+                    if (prim.isInteger64())  return compiler.createEvaluator<UnaryOperation<int64_t, int64_t, Ops::negate<int64_t>>> (source, result, num);
+                    break;
+
+                case UnaryOp::Op::bitwiseNot:
+                    if (prim.isInteger32())  return compiler.createEvaluator<UnaryOperation<int32_t, int32_t, Ops::bitwiseNot<int32_t>>> (source, result, num);
+                    if (prim.isInteger64())  return compiler.createEvaluator<UnaryOperation<int64_t, int64_t, Ops::bitwiseNot<int64_t>>> (source, result, num);
+                    break;
+
+                case UnaryOp::Op::logicalNot:
+                    if (prim.isBool())       return compiler.createEvaluator<UnaryOperation<uint8_t, uint8_t, Ops::logicalNot<uint8_t>>> (source, result, num);
+                    break;
+
+                case UnaryOp::Op::unknown:
+                default:
+                    break;
+            }
+
+            u.location.throwError (Errors::unsupportedType());
+        }
+
+        const Evaluator& compileBinaryOp (heart::BinaryOperator& b)
+        {
+            auto lhsType = b.lhs->getType().removeReferenceIfPresent();
+            auto rhsType = b.rhs->getType().removeReferenceIfPresent();
+            auto types = BinaryOp::getTypes (b.operation, lhsType, rhsType);
+
+            if (! types.operandType.isValid())
+                b.location.throwError (Errors::unsupportedType());
+
+            auto operandType = types.operandType;
+            auto resultType = types.resultType;
+            auto& lhs = compileExpression (b.lhs, operandType);
+            auto& rhs = compileExpression (b.rhs, operandType);
+
+            if (operandType.isStringLiteral())
+                operandType = PrimitiveType::int32;
+
+            auto num = static_cast<uint32_t> (operandType.isVector() ? operandType.getVectorSize() : 1);
+            auto result = allocateFrameSlot (std::max (resultType.getPackedSizeInBytes(), operandType.getPackedSizeInBytes()));
+            auto prim = operandType.getPrimitiveType();
+            const Evaluator* op = nullptr;
+
+            if (prim.isFloat32())         op = createBinaryOp<float>   (b.operation, lhs, rhs, result, num);
+            else if (prim.isFloat64())    op = createBinaryOp<double>  (b.operation, lhs, rhs, result, num);
+            else if (prim.isInteger32())  op = createBinaryOp<int32_t> (b.operation, lhs, rhs, result, num);
+            else if (prim.isInteger64())  op = createBinaryOp<int64_t> (b.operation, lhs, rhs, result, num);
+            else if (prim.isBool())       op = createBinaryOp<uint8_t> (b.operation, lhs, rhs, result, num);
+
+            if (op == nullptr)
+                b.location.throwError (Errors::unsupportedType());
+
+            if (resultType.isBoundedInt())
+                return createBoundedIntCast (*op, PrimitiveType::int32, resultType);
+
+            return *op;
+        }
+
+        template <typename T>
+        const Evaluator* createBinaryOp (BinaryOp::Op op, const Evaluator& lhs, const Evaluator& rhs, uint32_t result, uint32_t num)
+        {
+            #define SOUL_CREATE_BINARY_OP(name, ResultType) \
+                return std::addressof (compiler.createEvaluator<BinaryOperation<T, ResultType, Ops::name<T>>> (lhs, rhs, result, num));
+
+            switch (op)
+            {
+                case BinaryOp::Op::equals:              SOUL_CREATE_BINARY_OP (equals, uint8_t)
+                case BinaryOp::Op::notEquals:           SOUL_CREATE_BINARY_OP (notEquals, uint8_t)
+                default: break;
+            }
+
+            if constexpr (std::is_same<T, uint8_t>::value)
+            {
+                switch (op)
+                {
+                    case BinaryOp::Op::logicalAnd:      SOUL_CREATE_BINARY_OP (logicalAnd, uint8_t)
+                    case BinaryOp::Op::logicalOr:       SOUL_CREATE_BINARY_OP (logicalOr, uint8_t)
+                    default: break;
+                }
+            }
+            else
+            {
+                switch (op)
+                {
+                    case BinaryOp::Op::add:                 SOUL_CREATE_BINARY_OP (add, T)
+                    case BinaryOp::Op::subtract:            SOUL_CREATE_BINARY_OP (subtract, T)
+                    case BinaryOp::Op::multiply:            SOUL_CREATE_BINARY_OP (multiply, T)
+                    case BinaryOp::Op::divide:              SOUL_CREATE_BINARY_OP (divide, T)
+                    case BinaryOp::Op::modulo:              SOUL_CREATE_BINARY_OP (modulo, T)
+                    case BinaryOp::Op::lessThan:            SOUL_CREATE_BINARY_OP (lessThan, uint8_t)
+                    case BinaryOp::Op::lessThanOrEqual:     SOUL_CREATE_BINARY_OP (lessThanOrEqual, uint8_t)
+                    case BinaryOp::Op::greaterThan:         SOUL_CREATE_BINARY_OP (greaterThan, uint8_t)
+                    case BinaryOp::Op::greaterThanOrEqual:  SOUL_CREATE_BINARY_OP (greaterThanOrEqual, uint8_t)
+                    default: break;
+                }
+
+                if constexpr (std::is_integral<T>::value)
+                {
+                    switch (op)
+                    {
+                        case BinaryOp::Op::bitwiseOr:           SOUL_CREATE_BINARY_OP (bitwiseOr, T)
+                        case BinaryOp::Op::bitwiseAnd:          SOUL_CREATE_BINARY_OP (bitwiseAnd, T)
+                        case BinaryOp::Op::bitwiseXor:          SOUL_CREATE_BINARY_OP (bitwiseXor, T)
+                        case BinaryOp::Op::leftShift:           SOUL_CREATE_BINARY_OP (leftShift, T)
+                        case BinaryOp::Op::rightShift:          SOUL_CREATE_BINARY_OP (rightShift, T)
+                        case BinaryOp::Op::rightShiftUnsigned:  SOUL_CREATE_BINARY_OP (rightShiftUnsigned, T)
+                        default: break;
+                    }
+                }
+            }
+
+            #undef SOUL_CREATE_BINARY_OP
+            return nullptr;
+        }
+
+        //==============================================================================
+        const Evaluator& createCast (const Evaluator& source, const Type& sourceType, const Type& destType)
+        {
+            auto src = sourceType.removeReferenceIfPresent().removeConstIfPresent();
+            auto dst = destType.removeReferenceIfPresent().removeConstIfPresent();
+
+            if (src.isIdentical (dst))
+                return source;
+
+            if (dst.isBoundedInt())
+                return createBoundedIntCast (source, src, dst);
+
+            if (src.isBoundedInt())
+                return createCast (source, PrimitiveType::int32, dst);
+
+            if (dst.isPrimitiveOrVector() && src.isPrimitiveOrVector())
+            {
+                auto srcNum = static_cast<uint32_t> (src.isVector() ? src.getVectorSize() : 1);
+                auto dstNum = static_cast<uint32_t> (dst.isVector() ? dst.getVectorSize() : 1);
+
+                if (srcNum != dstNum && srcNum != 1)
+                    throwCastError (src, dst);
+
+                if (srcNum == dstNum && src.getPrimitiveType() == dst.getPrimitiveType())
+                    return source;
+
+                return createConversion (source, src.getPrimitiveType(), dst.getPrimitiveType(), dstNum, srcNum == dstNum ? 1 : 0);
+            }
+
+            if (dst.isFixedSizeArray() && src.isFixedSizeArray() && dst.getArraySize() == src.getArraySize())
+            {
+                auto srcElement = src.getArrayElementType();
+                auto dstElement = dst.getArrayElementType();
+
+                if (srcElement.hasIdenticalLayout (dstElement))
+                    return source;
+
+                if (srcElement.isPrimitiveOrVector() && dstElement.isPrimitiveOrVector()
+                     && srcElement.getVectorSize() == dstElement.getVectorSize())
+                    return createConversion (source, srcElement.getPrimitiveType(), dstElement.getPrimitiveType(),
+                                             static_cast<uint32_t> (dst.getArraySize() * dstElement.getVectorSize()), 1);
+            }
+
+            if (dst.isUnsizedArray() && src.isFixedSizeArray()
+                 && src.getArrayElementType().hasIdenticalLayout (dst.getArrayElementType()))
+                return compiler.createEvaluator<ArrayToUnsizedArray> (source, compiler.unsizedArraySizes,
+                                                                      static_cast<int32_t> (src.getArraySize()),
+                                                                      allocateFrameSlot (sizeof (void*)));
+
+            if (src.hasIdenticalLayout (dst))
+                return source;
+
+            throwCastError (src, dst);
+        }
+
+        [[noreturn]] static void throwCastError (const Type& src, const Type& dst)
+        {
+            CodeLocation().throwError (Errors::notYetImplemented ("cast from " + src.getDescription() + " to " + dst.getDescription()));
+        }
+
+        const Evaluator& createConversion (const Evaluator& source, PrimitiveType src, PrimitiveType dst, uint32_t num, uint32_t stride)
+        {
+            if (src == dst && stride != 0)
+                return source;
+
+            auto result = allocateFrameSlot (dst.getPackedSizeInBytes() * num);
+
+            if (src.isFloat32())    return createConversionFrom<float>   (source, dst, result, num, stride);
+            if (src.isFloat64())    return createConversionFrom<double>  (source, dst, result, num, stride);
+            if (src.isInteger32())  return createConversionFrom<int32_t> (source, dst, result, num, stride);
+            if (src.isInteger64())  return createConversionFrom<int64_t> (source, dst, result, num, stride);
+            if (src.isBool())       return createConversionFrom<uint8_t> (source, dst, result, num, stride);
+
+            throwCastError (src, dst);
+        }
+
+        template <typename SourceType>
+        const Evaluator& createConversionFrom (const Evaluator& source, PrimitiveType dst, uint32_t result, uint32_t num, uint32_t stride)
+        {
+            if (dst.isFloat32())    return compiler.createEvaluator<Conversion<SourceType, float>>   (source, result, num, stride);
+            if (dst.isFloat64())    return compiler.createEvaluator<Conversion<SourceType, double>>  (source, result, num, stride);
+            if (dst.isInteger32())  return compiler.createEvaluator<Conversion<SourceType, int32_t>> (source, result, num, stride);
+            if (dst.isInteger64())  return compiler.createEvaluator<Conversion<SourceType, int64_t>> (source, result, num, stride);
+            if (dst.isBool())       return compiler.createEvaluator<Conversion<SourceType, uint8_t>> (source, result, num, stride);
+
+            throwCastError (Type(), dst);
+        }
+
+        const Evaluator& createBoundedIntCast (const Evaluator& source, const Type& sourceType, const Type& destType)
+        {
+            auto num = static_cast<uint32_t> (destType.isArrayOrVector() ? destType.getArrayOrVectorSize() : 1);
+            auto limit = destType.getBoundedIntLimit();
+            auto result = allocateFrameSlot (sizeof (int32_t) * num);
+            auto isWrapped = destType.isWrapped();
+
+            if (sourceType.isInteger64())
+                return isWrapped ? compiler.createEvaluator<BoundedIntConversion<int64_t, true>>  (source, result, num, limit)
+                                 : compiler.createEvaluator<BoundedIntConversion<int64_t, false>> (source, result, num, limit);
+
+            if (sourceType.isInteger32())
+                return isWrapped ? compiler.createEvaluator<BoundedIntConversion<int32_t, true>>  (source, result, num, limit)
+                                 : compiler.createEvaluator<BoundedIntConversion<int32_t, false>> (source, result, num, limit);
+
+            if (sourceType.isFloatingPoint())
+                return createBoundedIntCast (createCast (source, sourceType, PrimitiveType::int64), PrimitiveType::int64, destType);
+
+            throwCastError (sourceType, destType);
+        }
+    };
+};
+
+} // namespace soul::interpreter
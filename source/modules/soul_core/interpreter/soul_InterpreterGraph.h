@@ -0,0 +1,395 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul::interpreter
+{
+
+//==============================================================================
+/**
+    Expands the hierarchy of graphs in a program into a flat list of processor
+    instances, and the connections between them.
+
+    Each endpoint of a graph becomes a "junction" node which simply passes its
+    data through, so that connections never need to know about graph nesting.
+    The nodes are sorted so that every node comes after all the nodes which feed
+    it through a non-delayed connection, and are also grouped into levels, where
+    none of the nodes in a level depend on each other, so can be run in parallel.
+*/
+struct FlattenedGraph
+{
+    struct Node
+    {
+        pool_ptr<Module> processor;             // null for a junction
+        pool_ptr<heart::IODeclaration> endpoint; // the graph endpoint that a junction represents
+        bool isInput = false, isTopLevel = false;
+        std::string path;
+        int clockExponent = 0;                  // log2 of the clock ratio relative to the main processor
+        uint32_t instanceID = 0;
+
+        bool isJunction() const     { return processor == nullptr; }
+    };
+
+    struct Port
+    {
+        uint32_t node;
+        pool_ptr<heart::IODeclaration> endpoint;
+        std::optional<uint32_t> element;
+    };
+
+    struct Connection
+    {
+        Port source, dest;
+        InterpolationType interpolation = InterpolationType::none;
+        int64_t delayLength = 0;
+        CodeLocation location;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Connection> connections;
+    std::vector<uint32_t> renderOrder;
+    std::vector<std::vector<uint32_t>> renderLevels; // each level is in render order
+    std::vector<uint32_t> topLevelInputs, topLevelOutputs;
+
+    //==============================================================================
+    void build (Program& program)
+    {
+        auto& main = program.getMainProcessor();
+        Instance top;
+
+        for (auto& input : main.inputs)
+        {
+            auto node = addJunction (input, true, main.fullName, 0);
+            nodes[node].isTopLevel = true;
+            topLevelInputs.push_back (node);
+            top.inputJunctions.push_back (node);
+        }
+
+        for (auto& output : main.outputs)
+        {
+            auto node = addJunction (output, false, main.fullName, 0);
+            nodes[node].isTopLevel = true;
+            topLevelOutputs.push_back (node);
+            top.outputJunctions.push_back (node);
+        }
+
+        if (main.isGraph())
+        {
+            addGraphContents (program, main, top, main.fullName, 0);
+        }
+        else
+        {
+            // A processor on its own is treated as though it were inside a graph with
+            // its endpoints connected straight through
+            auto node = addProcessor (main, main.fullName, 0);
+
+            for (size_t i = 0; i < main.inputs.size(); ++i)
+                connections.push_back ({ { top.inputJunctions[i], main.inputs[i].get(), {} },
+                                         { node, main.inputs[i].get(), {} }, InterpolationType::none, 0, {} });
+
+            for (size_t i = 0; i < main.outputs.size(); ++i)
+                connections.push_back ({ { node, main.outputs[i].get(), {} },
+                                         { top.outputJunctions[i], main.outputs[i].get(), {} }, InterpolationType::none, 0, {} });
+        }
+
+        normaliseClockExponents();
+        createRenderOrder();
+    }
+
+    int getMaxClockExponent() const
+    {
+        int maxExponent = 0;
+
+        for (auto& n : nodes)
+            maxExponent = std::max (maxExponent, n.clockExponent);
+
+        return maxExponent;
+    }
+
+private:
+    //==============================================================================
+    struct Instance
+    {
+        std::vector<uint32_t> inputJunctions, outputJunctions, processorNodes;
+    };
+
+    uint32_t addJunction (heart::IODeclaration& endpoint, bool isInput, const std::string& path, int clockExponent)
+    {
+        Node n;
+        n.endpoint = endpoint;
+        n.isInput = isInput;
+        n.path = path + "." + endpoint.name.toString();
+        n.clockExponent = clockExponent;
+        nodes.push_back (std::move (n));
+        return static_cast<uint32_t> (nodes.size() - 1);
+    }
+
+    uint32_t addProcessor (Module& module, const std::string& path, int clockExponent)
+    {
+        Node n;
+        n.processor = module;
+        n.path = path;
+        n.clockExponent = clockExponent;
+        nodes.push_back (std::move (n));
+        return static_cast<uint32_t> (nodes.size() - 1);
+    }
+
+    static int getClockExponent (const heart::ProcessorInstance& instance)
+    {
+        auto ratio = instance.clockMultiplier.getRatio();
+        return static_cast<int> (std::lround (std::log2 (ratio)));
+    }
+
+    void addGraphContents (Program& program, Module& graph, Instance& graphInstance, const std::string& path, int clockExponent)
+    {
+        std::vector<std::vector<Instance>> childInstances;
+
+        for (auto& pi : graph.processorInstances)
+        {
+            auto& module = program.getModuleWithName (pi->sourceName);
+            auto childExponent = clockExponent + getClockExponent (pi);
+            childInstances.emplace_back();
+
+            for (uint32_t i = 0; i < pi->arraySize; ++i)
+            {
+                auto childPath = path + "." + pi->instanceName;
+
+                if (pi->arraySize > 1)
+                    childPath += "[" + std::to_string (i) + "]";
+
+                childInstances.back().push_back (createInstance (program, module, childPath, childExponent));
+            }
+        }
+
+        auto getChildInstances = [&] (const heart::ProcessorInstance& pi) -> std::vector<Instance>&
+        {
+            for (size_t i = 0; i < graph.processorInstances.size(); ++i)
+                if (graph.processorInstances[i].getPointer() == std::addressof (pi))
+                    return childInstances[i];
+
+            SOUL_ASSERT_FALSE;
+            return childInstances.front();
+        };
+
+        for (auto& c : graph.connections)
+        {
+            auto sources = getPorts (program, graph, graphInstance, c->source, true, getChildInstances);
+            auto dests   = getPorts (program, graph, graphInstance, c->dest, false, getChildInstances);
+
+            expandArrayPortIfNeeded (sources, dests.size());
+            expandArrayPortIfNeeded (dests, sources.size());
+
+            auto addConnection = [&] (const Port& src, const Port& dst)
+            {
+                connections.push_back ({ src, dst, c->interpolationType, c->delayLength.value_or (0), c->location });
+            };
+
+            if (sources.size() == dests.size())
+            {
+                for (size_t i = 0; i < sources.size(); ++i)
+                    addConnection (sources[i], dests[i]);
+            }
+            else if (sources.size() == 1)
+            {
+                for (auto& d : dests)
+                    addConnection (sources.front(), d);
+            }
+            else if (dests.size() == 1)
+            {
+                for (auto& s : sources)
+                    addConnection (s, dests.front());
+            }
+            else
+            {
+                c->location.throwError (Errors::notYetImplemented ("Connections between arrays of different sizes"));
+            }
+        }
+    }
+
+    Instance createInstance (Program& program, Module& module, const std::string& path, int clockExponent)
+    {
+        Instance instance;
+
+        if (module.isGraph())
+        {
+            for (auto& input : module.inputs)
+                instance.inputJunctions.push_back (addJunction (input, true, path, clockExponent));
+
+            for (auto& output : module.outputs)
+                instance.outputJunctions.push_back (addJunction (output, false, path, clockExponent));
+
+            addGraphContents (program, module, instance, path, clockExponent);
+        }
+        else
+        {
+            instance.processorNodes.push_back (addProcessor (module, path, clockExponent));
+        }
+
+        return instance;
+    }
+
+    template <typename GetChildInstances>
+    std::vector<Port> getPorts (Program& program, Module& graph, Instance& graphInstance,
+                                const heart::EndpointReference& ref, bool isSource,
+                                GetChildInstances&& getChildInstances)
+    {
+        std::optional<uint32_t> element;
+
+        if (ref.endpointIndex)
+            element = static_cast<uint32_t> (*ref.endpointIndex);
+
+        std::vector<Port> ports;
+
+        if (ref.processor == nullptr)
+        {
+            // a reference to one of the graph's own endpoints
+            if (isSource)
+            {
+                for (size_t i = 0; i < graph.inputs.size(); ++i)
+                    if (graph.inputs[i]->name.toString() == ref.endpointName)
+                        ports.push_back ({ graphInstance.inputJunctions[i], graph.inputs[i].get(), element });
+            }
+            else
+            {
+                for (size_t i = 0; i < graph.outputs.size(); ++i)
+                    if (graph.outputs[i]->name.toString() == ref.endpointName)
+                        ports.push_back ({ graphInstance.outputJunctions[i], graph.outputs[i].get(), element });
+            }
+
+            SOUL_ASSERT (ports.size() == 1);
+            return ports;
+        }
+
+        auto& module = program.getModuleWithName (ref.processor->sourceName);
+
+        for (auto& child : getChildInstances (*ref.processor))
+        {
+            if (isSource)
+            {
+                for (size_t i = 0; i < module.outputs.size(); ++i)
+                    if (module.outputs[i]->name.toString() == ref.endpointName)
+                        ports.push_back ({ module.isGraph() ? child.outputJunctions[i] : child.processorNodes.front(),
+                                           module.outputs[i].get(), element });
+            }
+            else
+            {
+                for (size_t i = 0; i < module.inputs.size(); ++i)
+                    if (module.inputs[i]->name.toString() == ref.endpointName)
+                        ports.push_back ({ module.isGraph() ? child.inputJunctions[i] : child.processorNodes.front(),
+                                           module.inputs[i].get(), element });
+            }
+        }
+
+        return ports;
+    }
+
+    /** If a single un-indexed array endpoint is connected to a list of ports with
+        the same size as the array, this splits it into its individual elements.
+    */
+    static void expandArrayPortIfNeeded (std::vector<Port>& ports, size_t otherSize)
+    {
+        if (ports.size() == 1 && otherSize > 1 && ! ports.front().element)
+        {
+            auto port = ports.front();
+
+            if (port.endpoint->arraySize.value_or (1) == otherSize)
+            {
+                ports.clear();
+
+                for (uint32_t i = 0; i < otherSize; ++i)
+                    ports.push_back ({ port.node, port.endpoint, i });
+            }
+        }
+    }
+
+    void normaliseClockExponents()
+    {
+        int minExponent = 0;
+
+        for (auto& n : nodes)
+            minExponent = std::min (minExponent, n.clockExponent);
+
+        // all the exponents are kept relative to the slowest node, so that they're never negative
+        if (minExponent < 0)
+            for (auto& n : nodes)
+                n.clockExponent -= minExponent;
+
+        uint32_t nextID = 1;
+
+        for (auto& n : nodes)
+            if (! n.isJunction())
+                n.instanceID = nextID++;
+    }
+
+    void createRenderOrder()
+    {
+        std::vector<uint32_t> numInputs (nodes.size());
+        std::vector<std::vector<uint32_t>> destinations (nodes.size());
+
+        for (auto& c : connections)
+        {
+            if (c.delayLength == 0)
+            {
+                ++numInputs[c.dest.node];
+                destinations[c.source.node].push_back (c.dest.node);
+            }
+        }
+
+        for (uint32_t i = 0; i < nodes.size(); ++i)
+            if (numInputs[i] == 0)
+                renderOrder.push_back (i);
+
+        for (size_t i = 0; i < renderOrder.size(); ++i)
+            for (auto dest : destinations[renderOrder[i]])
+                if (--numInputs[dest] == 0)
+                    renderOrder.push_back (dest);
+
+        if (renderOrder.size() != nodes.size())
+        {
+            for (uint32_t i = 0; i < nodes.size(); ++i)
+            {
+                if (numInputs[i] != 0)
+                {
+                    for (auto& c : connections)
+                        if (c.dest.node == i && c.delayLength == 0)
+                            c.location.throwError (Errors::feedbackInGraph (nodes[i].path));
+
+                    CodeLocation().throwError (Errors::feedbackInGraph (nodes[i].path));
+                }
+            }
+        }
+
+        // A node's level is one more than the deepest of its sources, which will
+        // always have been visited first when going through the render order
+        std::vector<uint32_t> levels (nodes.size());
+
+        for (auto index : renderOrder)
+        {
+            for (auto dest : destinations[index])
+                levels[dest] = std::max (levels[dest], levels[index] + 1);
+
+            if (levels[index] >= renderLevels.size())
+                renderLevels.resize (levels[index] + 1);
+
+            renderLevels[levels[index]].push_back (index);
+        }
+    }
+};
+
+} // namespace soul::interpreter
@@ -0,0 +1,1786 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#if ! SOUL_INSIDE_CORE_CPP
+ #error "Don't add this cpp file to your build, it gets included indirectly by soul_core.cpp"
+#endif
+
+namespace soul::interpreter
+{
+
+//==============================================================================
+static double readElement (const uint8_t* source, PrimitiveType type) noexcept
+{
+    if (type.isFloat32())    return readValue<float> (source);
+    if (type.isFloat64())    return readValue<double> (source);
+    if (type.isInteger32())  return readValue<int32_t> (source);
+    if (type.isInteger64())  return static_cast<double> (readValue<int64_t> (source));
+    if (type.isBool())       return readValue<uint8_t> (source) != 0 ? 1.0 : 0.0;
+    return 0;
+}
+
+static void writeElement (uint8_t* dest, PrimitiveType type, double value) noexcept
+{
+    if (type.isFloat32())         writeValue<float>   (dest, static_cast<float> (value));
+    else if (type.isFloat64())    writeValue<double>  (dest, value);
+    else if (type.isInteger32())  writeValue<int32_t> (dest, static_cast<int32_t> (value));
+    else if (type.isInteger64())  writeValue<int64_t> (dest, static_cast<int64_t> (value));
+    else if (type.isBool())       writeValue<uint8_t> (dest, value != 0 ? 1 : 0);
+}
+
+static int64_t floorDivide (int64_t n, int64_t d) noexcept
+{
+    auto q = n / d;
+    return (n % d != 0 && n < 0) ? q - 1 : q;
+}
+
+/** Describes a run of primitive elements within a frame or value, e.g. a float<2>, or one
+    element of an array endpoint.
+*/
+struct ElementRange
+{
+    ElementRange() = default;
+
+    ElementRange (const Type& endpointType, std::optional<uint32_t> element)
+    {
+        auto type = endpointType;
+
+        if (element)
+        {
+            auto elementType = type.getElementType();
+            offset = static_cast<uint32_t> (*element * elementType.getPackedSizeInBytes());
+            type = elementType;
+        }
+
+        size = static_cast<uint32_t> (type.getPackedSizeInBytes());
+        isNumeric = type.isPrimitiveOrVector() || (type.isFixedSizeArray() && type.getArrayElementType().isPrimitiveOrVector());
+
+        if (isNumeric && ! type.isBoundedInt())
+        {
+            primitiveType = type.getPrimitiveType();
+            numElements = static_cast<uint32_t> (size / primitiveType.getPackedSizeInBytes());
+        }
+        else
+        {
+            isNumeric = false;
+        }
+    }
+
+    bool canCopyDirectlyTo (const ElementRange& other) const
+    {
+        return isNumeric && other.isNumeric && size == other.size && primitiveType == other.primitiveType;
+    }
+
+    bool canConvertTo (const ElementRange& other) const
+    {
+        return isNumeric && other.isNumeric && (numElements == other.numElements || numElements == 1);
+    }
+
+    uint32_t offset = 0, size = 0, numElements = 0;
+    PrimitiveType primitiveType;
+    bool isNumeric = false;
+};
+
+//==============================================================================
+/** A ring-buffer holding the most recent frames written to a stream output. */
+struct StreamBuffer
+{
+    StreamBuffer (uint32_t bytesPerFrame, uint64_t minNumFrames)
+        : frameSize (bytesPerFrame)
+    {
+        uint64_t numFrames = 1;
+
+        while (numFrames < minNumFrames)
+            numFrames <<= 1;
+
+        mask = numFrames - 1;
+        data.resize (static_cast<size_t> (numFrames * frameSize));
+    }
+
+    uint8_t* getFrame (int64_t frame) noexcept               { return data.data() + (static_cast<uint64_t> (frame) & mask) * frameSize; }
+    const uint8_t* getFrame (int64_t frame) const noexcept   { return data.data() + (static_cast<uint64_t> (frame) & mask) * frameSize; }
+    void clear() noexcept                                    { std::fill (data.begin(), data.end(), (uint8_t) 0); }
+
+    std::vector<uint8_t> data;
+    uint32_t frameSize;
+    uint64_t mask;
+};
+
+//==============================================================================
+/** A fixed-capacity, time-ordered queue of events waiting to be delivered to a node.
+
+    Events for the same tick are sorted by a sequence number, which the GraphRuntime uses
+    to keep them in the order they'd have arrived in when rendering serially, even when
+    they were sent by nodes that are running on different threads.
+*/
+struct PendingEventQueue
+{
+    struct Item
+    {
+        uint64_t tick, sequence;
+        uint32_t input, element, typeIndex, dataSlot;
+    };
+
+    void initialise (uint32_t capacity, uint32_t maxDataSize)
+    {
+        slotSize = alignSlotSize (std::max (maxDataSize, 1u));
+        items.reserve (capacity);
+        freeSlots.reserve (capacity);
+        data.resize (static_cast<size_t> (capacity) * slotSize);
+        clear();
+    }
+
+    void clear() noexcept
+    {
+        items.clear();
+        freeSlots.clear();
+        head = 0;
+
+        for (auto i = static_cast<uint32_t> (items.capacity()); i > 0; --i)
+            freeSlots.push_back (i - 1);
+    }
+
+    bool push (uint64_t tick, uint64_t sequence, uint32_t input, uint32_t element, uint32_t typeIndex,
+               const void* eventData, uint32_t size) noexcept
+    {
+        if (items.size() == items.capacity() && head != 0)
+        {
+            items.erase (items.begin(), items.begin() + static_cast<std::ptrdiff_t> (head));
+            head = 0;
+        }
+
+        if (freeSlots.empty() || items.size() == items.capacity() || size > slotSize)
+            return false;
+
+        auto slot = freeSlots.back();
+        freeSlots.pop_back();
+        std::memcpy (data.data() + static_cast<size_t> (slot) * slotSize, eventData, size);
+
+        auto pos = items.size();
+
+        while (pos > head && (items[pos - 1].tick > tick || (items[pos - 1].tick == tick && items[pos - 1].sequence > sequence)))
+            --pos;
+
+        items.insert (items.begin() + static_cast<std::ptrdiff_t> (pos), { tick, sequence, input, element, typeIndex, slot });
+        return true;
+    }
+
+    const Item* getNext (uint64_t maxTick) const noexcept
+    {
+        if (head < items.size() && items[head].tick <= maxTick)
+            return std::addressof (items[head]);
+
+        return nullptr;
+    }
+
+    const uint8_t* getData (const Item& item) const noexcept    { return data.data() + static_cast<size_t> (item.dataSlot) * slotSize; }
+
+    void popNext() noexcept
+    {
+        freeSlots.push_back (items[head].dataSlot);
+
+        if (++head == items.size())
+        {
+            items.clear();
+            head = 0;
+        }
+    }
+
+    std::vector<Item> items;
+    std::vector<uint32_t> freeSlots;
+    std::vector<uint8_t> data;
+    uint32_t slotSize = 0;
+    size_t head = 0;
+};
+
+//==============================================================================
+/**
+    Renders a FlattenedGraph, by running the compiled code for each processor node.
+
+    Time is measured in "ticks", where a frame of the fastest-running node in the graph
+    lasts for one tick. The graph is rendered in chunks of ticks which are no longer than
+    the shortest delayed connection, so that within a chunk each node can render all its
+    frames in one go, in an order where its inputs have already been rendered.
+
+    If the settings allow more than one render thread, and the graph has levels containing
+    several processors, each level of a chunk is handed to a WorkStealingScheduler, which
+    renders its nodes in parallel and joins before the next level starts.
+
+    If the settings ask for processor batches, and the engine can dispatch grouped instances
+    (which only the bytecode engine does), the instances of a processor which share a level
+    (e.g. the voices of a processor array) are rendered together, a frame at a time, so that
+    each statement is decoded once for the whole group. Each instance keeps its own state
+    layout, so this only shares the dispatch cost, and the arithmetic isn't vectorised.
+
+    A processor whose run() loop was vectorised by StreamLoopVectoriser isn't batched, and
+    is rendered a group of frames at a time by calling its vectorised function instead.
+*/
+class GraphRuntime  : private WorkStealingScheduler::Task
+{
+public:
+    GraphRuntime (Program& p, const BuildSettings& s, std::unique_ptr<ProcessorCompiler> c)
+        : program (p), settings (s), compiler (std::move (c))
+    {
+    }
+
+    ~GraphRuntime() override = default;
+
+    //==============================================================================
+    void build()
+    {
+        graph.build (program);
+
+        auto maxExponent = graph.getMaxClockExponent();
+        topLevelExponent = graph.nodes[graph.topLevelInputs.empty() ? graph.topLevelOutputs.front()
+                                                                     : graph.topLevelInputs.front()].clockExponent;
+        ticksPerTopLevelFrame = uint64_t (1) << (maxExponent - topLevelExponent);
+
+        for (auto& n : graph.nodes)
+            nodes.push_back (createNode (n, maxExponent));
+
+        compiler->finishedCompiling();
+
+        maxChunkTicks = ticksPerTopLevelFrame * settings.maxBlockSize;
+        uint64_t maxDelayTicks = 0, maxTicksPerFrame = 1;
+
+        for (auto& c : graph.connections)
+        {
+            if (c.delayLength > 0)
+            {
+                auto delayTicks = static_cast<uint64_t> (c.delayLength) * nodes[c.source.node].ticksPerFrame;
+                maxChunkTicks = std::min (maxChunkTicks, delayTicks);
+                maxDelayTicks = std::max (maxDelayTicks, delayTicks);
+            }
+        }
+
+        for (auto& n : nodes)
+            maxTicksPerFrame = std::max (maxTicksPerFrame, n.ticksPerFrame);
+
+        for (auto& n : nodes)
+            for (size_t i = 0; i < n.outputs.size(); ++i)
+                if (n.outputs[i]->isStreamEndpoint())
+                    n.outputBuffers[i] = std::make_unique<StreamBuffer> (n.outputFrameRanges[i].size,
+                                                                         (maxChunkTicks + maxDelayTicks + 2 * maxTicksPerFrame) / n.ticksPerFrame + 4);
+
+        for (auto& c : graph.connections)
+            addConnection (c);
+
+        for (auto& n : nodes)
+        {
+            uint32_t maxEventSize = 0;
+
+            for (auto& input : n.inputs)
+                if (input->isEventEndpoint())
+                    for (auto& type : input->dataTypes)
+                        maxEventSize = std::max (maxEventSize, static_cast<uint32_t> (type.getPackedSizeInBytes()));
+
+            n.eventQueue.initialise (eventQueueCapacity, maxEventSize);
+        }
+
+        for (auto index : graph.topLevelOutputs)
+        {
+            auto& n = nodes[index];
+
+            if (n.outputs.front()->isStreamEndpoint())
+                n.topLevelFrames.resize (static_cast<size_t> (settings.maxBlockSize) * n.outputFrameRanges.front().size);
+
+            if (n.outputs.front()->isEventEndpoint())
+            {
+                n.outputEvents.reserve (eventQueueCapacity);
+                n.outputEventData.resize (static_cast<size_t> (eventQueueCapacity) * n.eventQueue.slotSize);
+            }
+        }
+
+        for (auto index : graph.topLevelInputs)
+        {
+            auto& n = nodes[index];
+
+            if (n.inputs.front()->isStreamEndpoint())
+            {
+                n.topLevelFrames.resize (static_cast<size_t> (settings.maxBlockSize) * n.outputFrameRanges.front().size);
+                n.rampIncrement.resize (n.outputFrameRanges.front().numElements);
+            }
+        }
+
+        for (uint32_t i = 0; i < graph.renderOrder.size(); ++i)
+            nodes[graph.renderOrder[i]].renderRank = i + 1;
+
+        createWorkers ((compiler->getRequiredStackSize() + 7) / 8);
+    }
+
+    void reset() noexcept
+    {
+        currentTick = 0;
+        currentBlockStartFrame = 0;
+        xruns = 0;
+
+        for (auto& n : nodes)
+        {
+            std::fill (n.state.begin(), n.state.end(), (uint64_t) 0);
+            n.nextFrame = 0;
+            n.hasFinished = false;
+            n.eventQueue.clear();
+            n.outputEvents.clear();
+            n.rampFramesRemaining = 0;
+            n.hasTopLevelFrames = false;
+
+            for (auto& b : n.outputBuffers)
+                if (b != nullptr)
+                    b->clear();
+
+            if (auto code = n.code)
+            {
+                auto state = n.getState();
+                writeValue<double> (state + code->frequencyOffset, n.sampleRate);
+                writeValue<double> (state + code->periodOffset, 1.0 / n.sampleRate);
+                writeValue<int32_t> (state + code->idOffset, static_cast<int32_t> (n.node->instanceID));
+                writeValue<ResumePoint> (state + code->resumePointOffset, {});
+
+                auto& worker = workers.front();
+                worker.currentNode = std::addressof (n);
+                worker.currentSequence = getEventSequence (n.renderRank);
+                callInitFunction (worker, n, code->stateInitialiser);
+                callInitFunction (worker, n, code->systemInitFunction);
+                callInitFunction (worker, n, code->userInitFunction);
+                worker.currentNode = nullptr;
+            }
+        }
+    }
+
+    //==============================================================================
+    void prepare (uint32_t numFrames) noexcept
+    {
+        numFramesToRender = std::min (numFrames, settings.maxBlockSize);
+
+        for (auto index : graph.topLevelInputs)
+            nodes[index].hasTopLevelFrames = false;
+
+        for (auto index : graph.topLevelOutputs)
+            nodes[index].outputEvents.clear();
+    }
+
+    void render() noexcept
+    {
+        for (auto index : graph.topLevelOutputs)
+            nodes[index].outputEvents.clear();
+
+        auto endTick = currentTick + numFramesToRender * ticksPerTopLevelFrame;
+
+        if (scheduler != nullptr)
+            scheduler->startBlock();
+
+        while (currentTick < endTick)
+        {
+            auto chunkEnd = std::min (endTick, currentTick + maxChunkTicks);
+
+            if (scheduler != nullptr || lanesPerWorker > 1)
+                renderChunkByLevel (chunkEnd);
+            else
+                for (auto index : graph.renderOrder)
+                    renderNode (workers.front(), nodes[index], chunkEnd);
+
+            currentTick = chunkEnd;
+        }
+
+        if (scheduler != nullptr)
+            scheduler->finishBlock();
+
+        currentBlockStartFrame += numFramesToRender;
+        lastBlockSize = numFramesToRender;
+    }
+
+    //==============================================================================
+    void setTopLevelInputFrames (uint32_t inputIndex, const choc::value::ValueView& frames) noexcept
+    {
+        auto& n = nodes[graph.topLevelInputs[inputIndex]];
+        auto& range = n.outputFrameRanges.front();
+        auto numFrames = std::min (frames.size(), numFramesToRender);
+
+        if (frames.getType().isArray() && frames.getType().getElementType() == n.externalTypes.front())
+        {
+            std::memcpy (n.topLevelFrames.data(), frames.getRawData(), numFrames * range.size);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < numFrames; ++i)
+                copyExternalFrame (n.topLevelFrames.data() + i * range.size, range, frames[i]);
+        }
+
+        if (numFrames < numFramesToRender)
+        {
+            std::memset (n.topLevelFrames.data() + numFrames * range.size, 0, (numFramesToRender - numFrames) * range.size);
+            ++xruns;
+        }
+
+        n.hasTopLevelFrames = true;
+        n.rampFramesRemaining = 0;
+    }
+
+    void setTopLevelSparseTarget (uint32_t inputIndex, const choc::value::ValueView& target, uint32_t numFramesToReachValue) noexcept
+    {
+        auto& n = nodes[graph.topLevelInputs[inputIndex]];
+        auto& range = n.outputFrameRanges.front();
+        auto slot = n.getState();
+
+        if (numFramesToReachValue == 0 || range.primitiveType.isInteger() || range.primitiveType.isBool())
+        {
+            copyExternalFrame (slot, range, target);
+            n.rampFramesRemaining = 0;
+            return;
+        }
+
+        // Work out the target in the same format as the slot, then ramp towards it from the current value
+        auto targetFrame = workers.front().getStack();
+        copyExternalFrame (targetFrame, range, target);
+        auto elementSize = range.primitiveType.getPackedSizeInBytes();
+
+        for (uint32_t i = 0; i < range.numElements; ++i)
+        {
+            auto current = readElement (slot + i * elementSize, range.primitiveType);
+            auto end = readElement (targetFrame + i * elementSize, range.primitiveType);
+            n.rampIncrement[i] = (end - current) / numFramesToReachValue;
+        }
+
+        n.rampFramesRemaining = numFramesToReachValue;
+        n.hasTopLevelFrames = false;
+    }
+
+    void setTopLevelInputValue (uint32_t inputIndex, const choc::value::ValueView& value) noexcept
+    {
+        auto& n = nodes[graph.topLevelInputs[inputIndex]];
+        auto& range = n.outputFrameRanges.front();
+
+        if (value.getType() == n.externalTypes.front())
+            std::memcpy (n.getState(), value.getRawData(), range.size);
+        else if (range.isNumeric)
+            copyExternalFrame (n.getState(), range, value);
+    }
+
+    void addTopLevelInputEvent (uint32_t inputIndex, uint32_t frameOffset, const choc::value::ValueView& event) noexcept
+    {
+        auto nodeIndex = graph.topLevelInputs[inputIndex];
+        auto& n = nodes[nodeIndex];
+        auto& types = n.inputs.front()->dataTypes;
+
+        for (uint32_t i = 0; i < types.size(); ++i)
+        {
+            if (event.getType() == n.externalTypes[i])
+            {
+                dispatchEvent (n, 0, 0, i, event.getRawData(),
+                               currentTick + static_cast<uint64_t> (frameOffset) * ticksPerTopLevelFrame, getEventSequence (0));
+                return;
+            }
+        }
+
+        // No exact match, so try a primitive conversion
+        for (uint32_t i = 0; i < types.size(); ++i)
+        {
+            if (types[i].isPrimitive() && (event.isFloat() || event.isInt() || event.isBool()))
+            {
+                uint64_t converted = 0;
+                writeElement (reinterpret_cast<uint8_t*> (std::addressof (converted)), types[i].getPrimitiveType(), event.get<double>());
+                dispatchEvent (n, 0, 0, i, std::addressof (converted),
+                               currentTick + static_cast<uint64_t> (frameOffset) * ticksPerTopLevelFrame, getEventSequence (0));
+                return;
+            }
+        }
+
+        ++xruns;
+    }
+
+    choc::value::ValueView getTopLevelOutputFrames (uint32_t outputIndex) noexcept
+    {
+        auto& n = nodes[graph.topLevelOutputs[outputIndex]];
+        return choc::value::ValueView (choc::value::Type::createArray (n.externalTypes.front(), lastBlockSize),
+                                       n.topLevelFrames.data(), std::addressof (program.getStringDictionary()));
+    }
+
+    choc::value::ValueView getTopLevelOutputValue (uint32_t outputIndex) noexcept
+    {
+        auto& n = nodes[graph.topLevelOutputs[outputIndex]];
+        return choc::value::ValueView (n.externalTypes.front(), n.getState(), std::addressof (program.getStringDictionary()));
+    }
+
+    template <typename Callback>
+    void iterateTopLevelOutputEvents (uint32_t outputIndex, Callback&& callback) noexcept
+    {
+        auto& n = nodes[graph.topLevelOutputs[outputIndex]];
+
+        for (auto& e : n.outputEvents)
+            if (! callback (e.frame, choc::value::ValueView (n.externalTypes[e.typeIndex],
+                                                             n.outputEventData.data() + e.dataOffset,
+                                                             std::addressof (program.getStringDictionary()))))
+                break;
+    }
+
+    uint32_t getXRuns() const noexcept      { return xruns; }
+
+private:
+    //==============================================================================
+    struct StreamSource
+    {
+        const StreamBuffer* buffer;
+        ElementRange source, dest;
+        uint64_t ticksPerFrame, delayTicks;
+        InterpolationType interpolation;
+        bool canCopyDirectly;
+        std::vector<double> scratch;
+    };
+
+    struct ValueSource
+    {
+        const uint8_t* source;
+        ElementRange sourceRange, destRange;
+        bool canCopyDirectly;
+    };
+
+    struct InputSources
+    {
+        std::vector<StreamSource> streams;
+        std::vector<ValueSource> values;
+    };
+
+    struct TypeMapping
+    {
+        int32_t destType = -1;
+        bool needsConversion = false;
+        PrimitiveType sourcePrimitive, destPrimitive;
+    };
+
+    struct EventRoute
+    {
+        uint32_t destNode, destInput;
+        int32_t sourceElement, destElement; // -1 means "any" and "the same as the source"
+        uint64_t delayTicks;
+        std::vector<TypeMapping> typeMap;
+    };
+
+    struct OutputEvent
+    {
+        uint32_t frame, typeIndex;
+        size_t dataOffset;
+    };
+
+    struct NodeState
+    {
+        const FlattenedGraph::Node* node = nullptr;
+        const CompiledProcessor* code = nullptr;   // null for a junction
+        std::vector<pool_ref<heart::IODeclaration>> inputs, outputs;
+        std::vector<uint32_t> inputOffsets, outputOffsets;
+        std::vector<ElementRange> inputFrameRanges, outputFrameRanges;
+        std::vector<choc::value::Type> externalTypes; // only used for top-level junctions
+        std::vector<uint64_t> state;
+        uint64_t ticksPerFrame = 1, nextFrame = 0;
+        uint32_t renderRank = 0;   // the node's 1-based position in the render order
+        double sampleRate = 0;
+        bool hasFinished = false;
+
+        std::vector<InputSources> inputSources;
+        std::vector<std::unique_ptr<StreamBuffer>> outputBuffers;
+        std::vector<std::vector<EventRoute>> eventRoutes;
+        PendingEventQueue eventQueue;
+        choc::threading::SpinLock* queueLock = nullptr; // only used when rendering in parallel
+
+        // Used by top-level junctions
+        std::vector<uint8_t> topLevelFrames;
+        std::vector<double> rampIncrement;
+        uint32_t rampFramesRemaining = 0;
+        bool hasTopLevelFrames = false;
+        std::vector<OutputEvent> outputEvents;
+        std::vector<uint8_t> outputEventData;
+
+        uint8_t* getState() noexcept    { return reinterpret_cast<uint8_t*> (state.data()); }
+    };
+
+    /** Locks a node's event queue if other threads might be using it. */
+    struct ScopedQueueLock
+    {
+        ScopedQueueLock (NodeState& n) noexcept  : lock (n.queueLock)    { if (lock != nullptr) lock->lock(); }
+        ~ScopedQueueLock() noexcept                                      { if (lock != nullptr) lock->unlock(); }
+
+        choc::threading::SpinLock* lock;
+    };
+
+    /** The stack and current node for a thread which is rendering nodes. This is the
+        handler that the compiled code sends its events to.
+    */
+    struct alignas (64) Worker  : public EventOutputHandler
+    {
+        Worker (GraphRuntime& r, size_t stackSize)  : runtime (r), stack (stackSize) {}
+
+        void writeEvent (uint32_t outputIndex, uint32_t element, uint32_t typeIndex, const void* eventData) noexcept override
+        {
+            SOUL_ASSERT (currentNode != nullptr);
+            runtime.dispatchEvent (*currentNode, outputIndex, element, typeIndex, eventData, currentNodeTick, currentSequence);
+        }
+
+        uint8_t* getStack() noexcept    { return reinterpret_cast<uint8_t*> (stack.data()); }
+
+        GraphRuntime& runtime;
+        std::vector<uint64_t> stack;
+        NodeState* currentNode = nullptr;
+        uint64_t currentNodeTick = 0, currentSequence = 0;
+    };
+
+    struct RenderLevel
+    {
+        std::vector<uint32_t> batches; // indexes into GraphRuntime::batches
+        bool isParallel = false;
+    };
+
+    Program& program;
+    const BuildSettings& settings;
+    std::unique_ptr<ProcessorCompiler> compiler;
+    FlattenedGraph graph;
+    std::vector<NodeState> nodes;
+    std::vector<Worker> workers;
+    std::vector<RenderLevel> levels;
+    std::vector<std::vector<uint32_t>> batches; // groups of nodes which are rendered together
+    uint32_t lanesPerWorker = 1;                // the size of the largest batch
+    std::unique_ptr<WorkStealingScheduler> scheduler;
+    std::unique_ptr<choc::threading::SpinLock[]> queueLocks;
+
+    static constexpr uint32_t eventQueueCapacity = 1024;
+
+    // Below this, the time spent joining the threads at each level would outweigh the gains
+    static constexpr uint64_t minTicksPerParallelChunk = 16;
+
+    int topLevelExponent = 0;
+    uint64_t ticksPerTopLevelFrame = 1, maxChunkTicks = 1, currentTick = 0, currentChunkEnd = 0;
+    uint64_t currentBlockStartFrame = 0;
+    uint32_t numFramesToRender = 0, lastBlockSize = 0;
+    std::atomic<uint32_t> xruns { 0 };
+
+    //==============================================================================
+    void createWorkers (size_t stackSize)
+    {
+        uint32_t maxParallelBatches = 0;
+        auto maxBatchSize = compiler->canDispatchGroupedInstances() ? std::min (settings.processorBatchSize, EntryPoint::maxBatchSize)
+                                                                    : 1u;
+
+        for (auto& level : graph.renderLevels)
+        {
+            RenderLevel l;
+            uint32_t numProcessorBatches = 0;
+
+            for (auto index : level)
+            {
+                auto& n = nodes[index];
+
+                if (n.code != nullptr && n.code->vectorisedRunFunction == nullptr && maxBatchSize > 1)
+                {
+                    auto canJoin = [&] (uint32_t batchIndex)
+                    {
+                        auto& batch = batches[batchIndex];
+                        auto& first = nodes[batch.front()];
+                        return batch.size() < maxBatchSize && first.code == n.code && first.ticksPerFrame == n.ticksPerFrame;
+                    };
+
+                    auto existing = std::find_if (l.batches.begin(), l.batches.end(), canJoin);
+
+                    if (existing != l.batches.end())
+                    {
+                        batches[*existing].push_back (index);
+                        lanesPerWorker = std::max (lanesPerWorker, static_cast<uint32_t> (batches[*existing].size()));
+                        continue;
+                    }
+                }
+
+                l.batches.push_back (static_cast<uint32_t> (batches.size()));
+                batches.push_back ({ index });
+
+                if (n.code != nullptr)
+                    ++numProcessorBatches;
+            }
+
+            l.isParallel = numProcessorBatches > 1;
+            maxParallelBatches = std::max (maxParallelBatches, numProcessorBatches);
+            levels.push_back (std::move (l));
+        }
+
+        auto numThreads = std::min ({ settings.maxRenderThreads, maxParallelBatches,
+                                      std::max (1u, std::thread::hardware_concurrency()) });
+
+        if (numThreads < 2 || maxChunkTicks < minTicksPerParallelChunk)
+            numThreads = 1;
+
+        // Each thread needs a worker for every node in the batch that it's rendering
+        workers.reserve (numThreads * lanesPerWorker);
+
+        for (uint32_t i = 0; i < numThreads * lanesPerWorker; ++i)
+            workers.emplace_back (*this, stackSize);
+
+        if (numThreads > 1)
+        {
+            scheduler = std::make_unique<WorkStealingScheduler> (numThreads);
+            queueLocks = std::make_unique<choc::threading::SpinLock[]> (nodes.size());
+
+            for (size_t i = 0; i < nodes.size(); ++i)
+                nodes[i].queueLock = std::addressof (queueLocks[i]);
+        }
+    }
+
+    /** Events are ordered by the chunk in which they were sent, and then by the sender's
+        position in the render order (or 0 for events from the caller), which matches the
+        order they'd arrive in when rendering serially.
+    */
+    uint64_t getEventSequence (uint32_t senderRank) const noexcept
+    {
+        return currentTick * (nodes.size() + 1) + senderRank;
+    }
+
+    //==============================================================================
+    NodeState createNode (const FlattenedGraph::Node& node, int maxExponent)
+    {
+        NodeState n;
+        n.node = std::addressof (node);
+        n.ticksPerFrame = uint64_t (1) << (maxExponent - node.clockExponent);
+        n.sampleRate = settings.sampleRate * std::pow (2.0, node.clockExponent - topLevelExponent);
+        uint32_t stateSize = 0;
+
+        if (node.isJunction())
+        {
+            n.inputs.push_back (*node.endpoint);
+            n.outputs.push_back (*node.endpoint);
+            n.inputOffsets.push_back (0);
+            n.outputOffsets.push_back (0);
+
+            if (! node.endpoint->isEventEndpoint())
+                stateSize = static_cast<uint32_t> (node.endpoint->getFrameOrValueType().getPackedSizeInBytes());
+
+            if (node.isTopLevel)
+            {
+                if (node.endpoint->isEventEndpoint())
+                {
+                    for (auto& type : node.endpoint->dataTypes)
+                        n.externalTypes.push_back (type.getExternalType());
+                }
+                else
+                {
+                    n.externalTypes.push_back (node.endpoint->getFrameOrValueType().getExternalType());
+                }
+            }
+        }
+        else
+        {
+            auto& code = compiler->getProcessor (*node.processor);
+            n.code = std::addressof (code);
+
+            for (auto& i : node.processor->inputs)   n.inputs.push_back (i);
+            for (auto& o : node.processor->outputs)  n.outputs.push_back (o);
+
+            n.inputOffsets = code.inputOffsets;
+            n.outputOffsets = code.outputOffsets;
+            stateSize = code.stateSize;
+        }
+
+        for (auto& i : n.inputs)
+            n.inputFrameRanges.push_back (i->isEventEndpoint() ? ElementRange() : ElementRange (i->getFrameOrValueType(), {}));
+
+        for (auto& o : n.outputs)
+            n.outputFrameRanges.push_back (o->isEventEndpoint() ? ElementRange() : ElementRange (o->getFrameOrValueType(), {}));
+
+        n.state.resize ((stateSize + 7) / 8 + 1);
+        n.inputSources.resize (n.inputs.size());
+        n.outputBuffers.resize (n.outputs.size());
+        n.eventRoutes.resize (n.outputs.size());
+        return n;
+    }
+
+    static uint32_t findEndpointIndex (const std::vector<pool_ref<heart::IODeclaration>>& list, const heart::IODeclaration& endpoint)
+    {
+        for (size_t i = 0; i < list.size(); ++i)
+            if (list[i].getPointer() == std::addressof (endpoint))
+                return static_cast<uint32_t> (i);
+
+        SOUL_ASSERT_FALSE;
+        return 0;
+    }
+
+    void addConnection (const FlattenedGraph::Connection& c)
+    {
+        auto& source = nodes[c.source.node];
+        auto& dest = nodes[c.dest.node];
+        auto sourceOutput = findEndpointIndex (source.outputs, *c.source.endpoint);
+        auto destInput = findEndpointIndex (dest.inputs, *c.dest.endpoint);
+        auto& sourceEndpoint = source.outputs[sourceOutput].get();
+        auto& destEndpoint = dest.inputs[destInput].get();
+        auto delayTicks = static_cast<uint64_t> (c.delayLength) * source.ticksPerFrame;
+
+        if (sourceEndpoint.isEventEndpoint())
+        {
+            EventRoute route;
+            route.destNode = c.dest.node;
+            route.destInput = destInput;
+            route.sourceElement = c.source.element ? static_cast<int32_t> (*c.source.element) : -1;
+            route.destElement = c.dest.element ? static_cast<int32_t> (*c.dest.element)
+                                               : (destEndpoint.arraySize.has_value() ? -1 : 0);
+            route.delayTicks = delayTicks;
+
+            for (auto& sourceType : sourceEndpoint.dataTypes)
+            {
+                TypeMapping mapping;
+
+                for (uint32_t i = 0; i < destEndpoint.dataTypes.size(); ++i)
+                {
+                    if (destEndpoint.dataTypes[i].isEqual (sourceType, Type::ignoreConst | Type::ignoreReferences))
+                    {
+                        mapping.destType = static_cast<int32_t> (i);
+                        mapping.needsConversion = false;
+                        break;
+                    }
+
+                    if (mapping.destType < 0 && sourceType.isPrimitive() && destEndpoint.dataTypes[i].isPrimitive()
+                         && TypeRules::canSilentlyCastTo (destEndpoint.dataTypes[i], sourceType))
+                    {
+                        mapping.destType = static_cast<int32_t> (i);
+                        mapping.needsConversion = true;
+                        mapping.sourcePrimitive = sourceType.getPrimitiveType();
+                        mapping.destPrimitive = destEndpoint.dataTypes[i].getPrimitiveType();
+                    }
+                }
+
+                route.typeMap.push_back (mapping);
+            }
+
+            source.eventRoutes[sourceOutput].push_back (std::move (route));
+            return;
+        }
+
+        auto sourceRange = ElementRange (sourceEndpoint.getFrameOrValueType(), c.source.element);
+        auto destRange   = ElementRange (destEndpoint.getFrameOrValueType(), c.dest.element);
+
+        if (sourceEndpoint.isStreamEndpoint())
+        {
+            if (! sourceRange.canConvertTo (destRange))
+                c.location.throwError (Errors::notYetImplemented ("Stream connection between "
+                                                                     + sourceEndpoint.getFrameOrValueType().getDescription() + " and "
+                                                                     + destEndpoint.getFrameOrValueType().getDescription()));
+
+            dest.inputSources[destInput].streams.push_back ({ source.outputBuffers[sourceOutput].get(),
+                                                              sourceRange, destRange,
+                                                              source.ticksPerFrame, delayTicks,
+                                                              c.interpolation,
+                                                              sourceRange.canCopyDirectlyTo (destRange)
+                                                                && source.ticksPerFrame == dest.ticksPerFrame,
+                                                              std::vector<double> (sourceRange.numElements) });
+            return;
+        }
+
+        auto canCopy = sourceRange.size == destRange.size
+                        && sourceEndpoint.getFrameOrValueType().hasIdenticalLayout (destEndpoint.getFrameOrValueType());
+
+        if (! (canCopy || sourceRange.canConvertTo (destRange)))
+            c.location.throwError (Errors::notYetImplemented ("Value connection between "
+                                                                 + sourceEndpoint.getFrameOrValueType().getDescription() + " and "
+                                                                 + destEndpoint.getFrameOrValueType().getDescription()));
+
+        dest.inputSources[destInput].values.push_back ({ source.getState() + source.outputOffsets[sourceOutput],
+                                                         sourceRange, destRange, canCopy });
+    }
+
+    //==============================================================================
+    void callInitFunction (Worker& worker, NodeState& n, const EntryPoint* f) noexcept
+    {
+        if (f != nullptr)
+        {
+            auto stackStart = worker.getStack();
+            ExecutionContext context { n.getState(), stackStart, stackStart + f->frameSize, std::addressof (worker) };
+            ResumePoint start;
+            f->execute (context, start);
+        }
+    }
+
+    void renderChunkByLevel (uint64_t chunkEnd) noexcept
+    {
+        currentChunkEnd = chunkEnd;
+
+        for (auto& level : levels)
+        {
+            if (level.isParallel && scheduler != nullptr)
+                scheduler->runBatch (level.batches.data(), static_cast<uint32_t> (level.batches.size()), *this);
+            else
+                for (auto index : level.batches)
+                    renderBatch (workers.data(), batches[index], chunkEnd);
+        }
+    }
+
+    void performTask (uint32_t batchIndex, uint32_t workerIndex) noexcept override
+    {
+        renderBatch (workers.data() + workerIndex * lanesPerWorker, batches[batchIndex], currentChunkEnd);
+    }
+
+    /** Renders a group of instances of the same processor, using one worker for each. They
+        all run at the same rate, so they step through their frames together, and each frame's
+        run() calls are made with a single executeBatch().
+    */
+    void renderBatch (Worker* lanes, const std::vector<uint32_t>& batch, uint64_t endTick) noexcept
+    {
+        if (batch.size() == 1)
+            return renderNode (lanes[0], nodes[batch.front()], endTick);
+
+        auto numNodes = static_cast<uint32_t> (batch.size());
+        auto& first = nodes[batch.front()];
+        auto& code = *first.code;
+
+        ExecutionContext contexts[EntryPoint::maxBatchSize];
+        ResumePoint resumePoints[EntryPoint::maxBatchSize];
+        bool results[EntryPoint::maxBatchSize];
+        NodeState* running[EntryPoint::maxBatchSize];
+
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            auto& n = nodes[batch[i]];
+            lanes[i].currentNode = std::addressof (n);
+            lanes[i].currentSequence = getEventSequence (n.renderRank);
+        }
+
+        while (first.nextFrame * first.ticksPerFrame < endTick)
+        {
+            auto frame = first.nextFrame;
+            auto tick = frame * first.ticksPerFrame;
+            uint32_t numRunning = 0;
+
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                auto& n = nodes[batch[i]];
+                n.nextFrame = frame + 1;
+                lanes[i].currentNodeTick = tick;
+                prepareProcessorFrame (lanes[i], n, tick);
+
+                if (code.runFunction != nullptr && ! n.hasFinished)
+                {
+                    auto state = n.getState();
+                    contexts[numRunning] = { state, state + code.runFrameOffset, lanes[i].getStack(), std::addressof (lanes[i]) };
+                    resumePoints[numRunning] = readValue<ResumePoint> (state + code.resumePointOffset);
+                    running[numRunning++] = std::addressof (n);
+                }
+            }
+
+            if (numRunning != 0)
+                code.runFunction->executeBatch (contexts, resumePoints, results, numRunning);
+
+            for (uint32_t i = 0; i < numRunning; ++i)
+            {
+                if (! results[i])
+                    running[i]->hasFinished = true;
+
+                writeValue<ResumePoint> (running[i]->getState() + code.resumePointOffset, resumePoints[i]);
+            }
+
+            for (auto index : batch)
+                finishProcessorFrame (nodes[index], frame);
+        }
+
+        for (uint32_t i = 0; i < numNodes; ++i)
+            lanes[i].currentNode = nullptr;
+    }
+
+    void renderNode (Worker& worker, NodeState& n, uint64_t endTick) noexcept
+    {
+        worker.currentNode = std::addressof (n);
+        worker.currentSequence = getEventSequence (n.renderRank);
+
+        if (n.code != nullptr && n.code->vectorisedRunFunction != nullptr)
+            renderVectorisedFrames (worker, n, endTick);
+
+        while (n.nextFrame * n.ticksPerFrame < endTick)
+        {
+            auto frame = n.nextFrame++;
+            auto tick = frame * n.ticksPerFrame;
+            worker.currentNodeTick = tick;
+
+            if (n.code != nullptr)
+                renderProcessorFrame (worker, n, frame, tick);
+            else
+                renderJunctionFrame (n, frame, tick);
+        }
+
+        worker.currentNode = nullptr;
+    }
+
+    /** Renders a processor whose run() loop has a vectorised version, which processes a group of
+        frames in each call. A node's input frames for the whole chunk are ready before it gets
+        rendered, so each group of them is gathered into the function's parameters, and the frames
+        that it writes are then copied into the output buffers. Value inputs only change between
+        chunks, so they're read once for each group.
+
+        Events are delivered before each group, and a group ends before the next queued event,
+        so that the handler runs before the frame it was due on, just as it would for run().
+    */
+    void renderVectorisedFrames (Worker& worker, NodeState& n, uint64_t endTick) noexcept
+    {
+        auto& code = *n.code;
+        auto& f = *code.vectorisedRunFunction;
+        auto framesPerCall = code.vectorisedFramesPerCall;
+        auto numOutputs = n.outputs.size();
+        auto state = n.getState();
+        auto stack = worker.getStack();
+        auto endFrame = (endTick + n.ticksPerFrame - 1) / n.ticksPerFrame;
+
+        while (n.nextFrame < endFrame)
+        {
+            auto firstFrame = n.nextFrame;
+            auto tick = firstFrame * n.ticksPerFrame;
+            auto numFrames = static_cast<uint32_t> (std::min (endFrame - firstFrame, static_cast<uint64_t> (framesPerCall)));
+            worker.currentNodeTick = tick;
+            deliverPendingEvents (worker, n, tick);
+
+            {
+                ScopedQueueLock lock (n);
+
+                if (auto next = n.eventQueue.getNext (std::numeric_limits<uint64_t>::max()))
+                    numFrames = static_cast<uint32_t> (std::min (static_cast<uint64_t> (numFrames),
+                                                                 (next->tick - tick + n.ticksPerFrame - 1) / n.ticksPerFrame));
+            }
+
+            for (size_t i = 0; i < numOutputs; ++i)
+            {
+                auto frames = state + code.vectorisedOutputOffsets[i];
+                std::memset (frames, 0, framesPerCall * n.outputFrameRanges[i].size);
+                writeValue<uint8_t*> (stack + f.parameters[i].offset, frames);
+            }
+
+            for (size_t i = 0, parameter = numOutputs; i < n.inputs.size(); ++i)
+            {
+                if (n.inputs[i]->isEventEndpoint())
+                    continue;
+
+                auto frames = stack + f.parameters[parameter++].offset;
+
+                if (n.inputs[i]->isValueEndpoint())
+                {
+                    readInputs (n, i, frames, tick);
+                    continue;
+                }
+
+                auto frameSize = n.inputFrameRanges[i].size;
+
+                for (uint32_t j = 0; j < numFrames; ++j)
+                    readInputs (n, i, frames + j * frameSize, (firstFrame + j) * n.ticksPerFrame);
+
+                // A final partial group has its unused frames filled with copies of the last one
+                for (uint32_t j = numFrames; j < framesPerCall; ++j)
+                    std::memcpy (frames + j * frameSize, frames + (numFrames - 1) * frameSize, frameSize);
+            }
+
+            ExecutionContext context { state, stack, stack + f.frameSize, std::addressof (worker) };
+            ResumePoint start;
+            f.execute (context, start);
+
+            for (size_t i = 0; i < numOutputs; ++i)
+                if (auto buffer = n.outputBuffers[i].get())
+                    for (uint32_t j = 0; j < numFrames; ++j)
+                        std::memcpy (buffer->getFrame (static_cast<int64_t> (firstFrame + j)),
+                                     state + code.vectorisedOutputOffsets[i] + j * buffer->frameSize, buffer->frameSize);
+
+            n.nextFrame = firstFrame + numFrames;
+        }
+    }
+
+    void renderProcessorFrame (Worker& worker, NodeState& n, uint64_t frame, uint64_t tick) noexcept
+    {
+        auto& code = *n.code;
+        auto state = n.getState();
+
+        prepareProcessorFrame (worker, n, tick);
+
+        if (code.runFunction != nullptr && ! n.hasFinished)
+        {
+            ExecutionContext context { state, state + code.runFrameOffset, worker.getStack(), std::addressof (worker) };
+            auto resumePoint = readValue<ResumePoint> (state + code.resumePointOffset);
+
+            if (! code.runFunction->execute (context, resumePoint))
+                n.hasFinished = true;
+
+            writeValue<ResumePoint> (state + code.resumePointOffset, resumePoint);
+        }
+
+        finishProcessorFrame (n, frame);
+    }
+
+    /** Delivers a processor's events for this tick, then reads its inputs and clears its outputs. */
+    void prepareProcessorFrame (Worker& worker, NodeState& n, uint64_t tick) noexcept
+    {
+        auto state = n.getState();
+        deliverPendingEvents (worker, n, tick);
+
+        for (size_t i = 0; i < n.inputs.size(); ++i)
+            if (! n.inputs[i]->isEventEndpoint())
+                readInputs (n, i, state + n.inputOffsets[i], tick);
+
+        for (size_t i = 0; i < n.outputs.size(); ++i)
+            if (n.outputs[i]->isStreamEndpoint())
+                std::memset (state + n.outputOffsets[i], 0, n.outputFrameRanges[i].size);
+    }
+
+    void deliverPendingEvents (Worker& worker, NodeState& n, uint64_t tick) noexcept
+    {
+        // The queue is only locked while it's being looked at, because delivering an event
+        // may send others, and a node can be connected to itself with a delay
+        for (;;)
+        {
+            PendingEventQueue::Item e;
+
+            {
+                ScopedQueueLock lock (n);
+                auto next = n.eventQueue.getNext (tick);
+
+                if (next == nullptr)
+                    break;
+
+                e = *next;
+            }
+
+            deliverEventToProcessor (worker, n, e, n.eventQueue.getData (e));
+
+            ScopedQueueLock lock (n);
+            n.eventQueue.popNext();
+        }
+    }
+
+    /** Copies a processor's outputs for the frame into their buffers. */
+    void finishProcessorFrame (NodeState& n, uint64_t frame) noexcept
+    {
+        auto state = n.getState();
+
+        for (size_t i = 0; i < n.outputs.size(); ++i)
+            if (auto buffer = n.outputBuffers[i].get())
+                std::memcpy (buffer->getFrame (static_cast<int64_t> (frame)), state + n.outputOffsets[i], buffer->frameSize);
+    }
+
+    void renderJunctionFrame (NodeState& n, uint64_t frame, uint64_t tick) noexcept
+    {
+        auto& endpoint = n.inputs.front().get();
+        auto slot = n.getState();
+        auto blockFrame = static_cast<uint32_t> (frame - currentBlockStartFrame);
+
+        if (endpoint.isEventEndpoint())
+        {
+            // Only top-level outputs will have anything queued, because other junctions forward events as they arrive
+            ScopedQueueLock lock (n);
+
+            while (auto e = n.eventQueue.getNext (tick))
+            {
+                auto size = static_cast<uint32_t> (endpoint.dataTypes[e->typeIndex].getPackedSizeInBytes());
+                auto dataOffset = static_cast<size_t> (n.outputEvents.size()) * n.eventQueue.slotSize;
+
+                if (n.outputEvents.size() < n.outputEvents.capacity())
+                {
+                    std::memcpy (n.outputEventData.data() + dataOffset, n.eventQueue.getData (*e), size);
+                    n.outputEvents.push_back ({ blockFrame, e->typeIndex, dataOffset });
+                }
+                else
+                {
+                    ++xruns;
+                }
+
+                n.eventQueue.popNext();
+            }
+
+            return;
+        }
+
+        auto& range = n.outputFrameRanges.front();
+
+        if (n.node->isTopLevel && n.node->isInput)
+        {
+            if (endpoint.isStreamEndpoint())
+            {
+                if (n.hasTopLevelFrames)
+                {
+                    std::memcpy (slot, n.topLevelFrames.data() + blockFrame * range.size, range.size);
+                }
+                else if (n.rampFramesRemaining > 0)
+                {
+                    auto elementSize = range.primitiveType.getPackedSizeInBytes();
+
+                    for (uint32_t i = 0; i < range.numElements; ++i)
+                    {
+                        auto element = slot + i * elementSize;
+                        writeElement (element, range.primitiveType, readElement (element, range.primitiveType) + n.rampIncrement[i]);
+                    }
+
+                    --n.rampFramesRemaining;
+                }
+            }
+        }
+        else
+        {
+            readInputs (n, 0, slot, tick);
+        }
+
+        if (auto buffer = n.outputBuffers.front().get())
+            std::memcpy (buffer->getFrame (static_cast<int64_t> (frame)), slot, buffer->frameSize);
+
+        if (n.node->isTopLevel && ! n.node->isInput && endpoint.isStreamEndpoint())
+            std::memcpy (n.topLevelFrames.data() + blockFrame * range.size, slot, range.size);
+    }
+
+    //==============================================================================
+    void readInputs (NodeState& n, size_t inputIndex, uint8_t* slot, uint64_t tick) noexcept
+    {
+        auto& sources = n.inputSources[inputIndex];
+        auto& destFrame = n.inputFrameRanges[inputIndex];
+
+        if (! sources.streams.empty())
+        {
+            auto& first = sources.streams.front();
+
+            if (sources.streams.size() == 1 && first.canCopyDirectly)
+            {
+                if (first.dest.size != destFrame.size)
+                    std::memset (slot, 0, destFrame.size);
+
+                auto sourceFrame = floorDivide (static_cast<int64_t> (tick) - static_cast<int64_t> (first.delayTicks),
+                                                static_cast<int64_t> (first.ticksPerFrame));
+
+                std::memcpy (slot + first.dest.offset, first.buffer->getFrame (sourceFrame) + first.source.offset, first.dest.size);
+                return;
+            }
+
+            std::memset (slot, 0, destFrame.size);
+
+            for (auto& s : sources.streams)
+                addStreamSource (const_cast<StreamSource&> (s), slot, tick, n.ticksPerFrame);
+        }
+
+        for (auto& v : sources.values)
+        {
+            if (v.canCopyDirectly)
+                std::memcpy (slot + v.destRange.offset, v.source + v.sourceRange.offset, v.destRange.size);
+            else
+                convertElements (slot + v.destRange.offset, v.destRange, v.source + v.sourceRange.offset, v.sourceRange);
+        }
+    }
+
+    static void convertElements (uint8_t* dest, const ElementRange& destRange, const uint8_t* source, const ElementRange& sourceRange) noexcept
+    {
+        auto sourceSize = sourceRange.primitiveType.getPackedSizeInBytes();
+        auto destSize = destRange.primitiveType.getPackedSizeInBytes();
+
+        for (uint32_t i = 0; i < destRange.numElements; ++i)
+            writeElement (dest + i * destSize, destRange.primitiveType,
+                          readElement (source + (sourceRange.numElements == 1 ? 0 : i * sourceSize), sourceRange.primitiveType));
+    }
+
+    static void readFrameElements (std::vector<double>& result, const StreamSource& s, int64_t frame, double proportion) noexcept
+    {
+        auto data = s.buffer->getFrame (frame) + s.source.offset;
+        auto elementSize = s.source.primitiveType.getPackedSizeInBytes();
+
+        for (uint32_t i = 0; i < s.source.numElements; ++i)
+            result[i] += proportion * readElement (data + i * elementSize, s.source.primitiveType);
+    }
+
+    /** Reads a source stream at the given tick and adds it to the destination slot. When the
+        source runs at a lower rate, linear interpolation is done between its two most recent
+        frames (so this adds one source frame of latency). When the source is faster, the
+        non-latching interpolation types average all the frames in the period.
+    */
+    static void addStreamSource (StreamSource& s, uint8_t* slot, uint64_t tick, uint64_t destTicksPerFrame) noexcept
+    {
+        auto position = static_cast<int64_t> (tick) - static_cast<int64_t> (s.delayTicks);
+        auto sourceTicks = static_cast<int64_t> (s.ticksPerFrame);
+        auto latch = s.interpolation == InterpolationType::none || s.interpolation == InterpolationType::latch;
+        auto frame = floorDivide (position, sourceTicks);
+
+        std::fill (s.scratch.begin(), s.scratch.end(), 0.0);
+
+        if (s.ticksPerFrame == destTicksPerFrame || latch || s.source.primitiveType.isInteger())
+        {
+            readFrameElements (s.scratch, s, frame, 1.0);
+        }
+        else if (s.ticksPerFrame > destTicksPerFrame)
+        {
+            auto proportion = static_cast<double> (position - frame * sourceTicks) / static_cast<double> (sourceTicks);
+            readFrameElements (s.scratch, s, frame - 1, 1.0 - proportion);
+            readFrameElements (s.scratch, s, frame, proportion);
+        }
+        else
+        {
+            auto first = floorDivide (position - static_cast<int64_t> (destTicksPerFrame), sourceTicks) + 1;
+            auto proportion = 1.0 / static_cast<double> (frame - first + 1);
+
+            for (auto f = first; f <= frame; ++f)
+                readFrameElements (s.scratch, s, f, proportion);
+        }
+
+        auto dest = slot + s.dest.offset;
+        auto destSize = s.dest.primitiveType.getPackedSizeInBytes();
+
+        for (uint32_t i = 0; i < s.dest.numElements; ++i)
+        {
+            auto element = dest + i * destSize;
+            writeElement (element, s.dest.primitiveType, readElement (element, s.dest.primitiveType)
+                                                           + s.scratch[s.source.numElements == 1 ? 0 : i]);
+        }
+    }
+
+    static void copyExternalFrame (uint8_t* dest, const ElementRange& range, const choc::value::ValueView& source) noexcept
+    {
+        if (! range.isNumeric)
+            return;
+
+        auto elementSize = range.primitiveType.getPackedSizeInBytes();
+
+        try
+        {
+            if (source.isVector() || source.isArray())
+            {
+                auto num = std::min (range.numElements, source.size());
+
+                for (uint32_t i = 0; i < num; ++i)
+                    writeElement (dest + i * elementSize, range.primitiveType, source[i].get<double>());
+            }
+            else
+            {
+                auto v = source.get<double>();
+
+                for (uint32_t i = 0; i < range.numElements; ++i)
+                    writeElement (dest + i * elementSize, range.primitiveType, v);
+            }
+        }
+        catch (...) {}
+    }
+
+    //==============================================================================
+    void dispatchEvent (NodeState& source, uint32_t outputIndex, uint32_t element, uint32_t typeIndex,
+                        const void* eventData, uint64_t tick, uint64_t sequence) noexcept
+    {
+        for (auto& route : source.eventRoutes[outputIndex])
+        {
+            if (route.sourceElement >= 0 && static_cast<uint32_t> (route.sourceElement) != element)
+                continue;
+
+            auto& mapping = route.typeMap[typeIndex];
+
+            if (mapping.destType < 0)
+                continue;
+
+            auto destElement = route.destElement < 0 ? element : static_cast<uint32_t> (route.destElement);
+            auto destType = static_cast<uint32_t> (mapping.destType);
+            auto data = eventData;
+            uint64_t converted = 0;
+
+            if (mapping.needsConversion)
+            {
+                writeElement (reinterpret_cast<uint8_t*> (std::addressof (converted)), mapping.destPrimitive,
+                              readElement (static_cast<const uint8_t*> (eventData), mapping.sourcePrimitive));
+                data = std::addressof (converted);
+            }
+
+            auto& dest = nodes[route.destNode];
+
+            if (dest.code == nullptr && ! dest.node->isTopLevel)
+            {
+                dispatchEvent (dest, 0, destElement, destType, data, tick + route.delayTicks, sequence);
+            }
+            else
+            {
+                auto size = static_cast<uint32_t> (dest.inputs[route.destInput]->dataTypes[destType].getPackedSizeInBytes());
+                ScopedQueueLock lock (dest);
+
+                if (! dest.eventQueue.push (tick + route.delayTicks, sequence, route.destInput, destElement, destType, data, size))
+                    ++xruns;
+            }
+        }
+    }
+
+    void deliverEventToProcessor (Worker& worker, NodeState& n, const PendingEventQueue::Item& e, const uint8_t* eventData) noexcept
+    {
+        auto& handlers = n.code->eventHandlers[e.input];
+
+        if (e.typeIndex >= handlers.size())
+            return;
+
+        auto& handler = handlers[e.typeIndex];
+
+        if (handler.function == nullptr)
+            return;
+
+        auto& f = *handler.function;
+        auto stackStart = worker.getStack();
+        ExecutionContext context { n.getState(), stackStart, stackStart + f.frameSize, std::addressof (worker) };
+
+        if (handler.hasIndexParameter)
+        {
+            auto& indexParam = f.parameters.front();
+
+            if (indexParam.size == 8)
+                writeValue<int64_t> (stackStart + indexParam.offset, static_cast<int64_t> (e.element));
+            else
+                writeValue<int32_t> (stackStart + indexParam.offset, static_cast<int32_t> (e.element));
+        }
+
+        auto& valueParam = f.parameters.back();
+
+        if (valueParam.isReference)
+            writeValue<const uint8_t*> (stackStart + valueParam.offset, eventData);
+        else
+            std::memcpy (stackStart + valueParam.offset, eventData, valueParam.size);
+
+        ResumePoint start;
+        f.execute (context, start);
+    }
+};
+
+//==============================================================================
+/** Creates the ProcessorCompiler that a performer will use to turn its linked program into
+    code which a GraphRuntime can run.
+*/
+using CreateProcessorCompilerFn = std::function<std::unique_ptr<ProcessorCompiler> (Program&, const BuildSettings&,
+                                                                                       const std::unordered_map<const heart::Variable*, const Value*>& externals,
+                                                                                       UnsizedArraySizes&, LinkerCache*)>;
+
+//==============================================================================
+/**
+    A Performer which executes a program without a JIT compiler, by running the code
+    produced by a ProcessorCompiler.
+
+    With the default FunctionCompiler, this is a portable reference implementation rather
+    than a fast one: at link time every function is converted into a tree of nodes with
+    all its variables and blocks resolved, and the graph is flattened, so that advance()
+    doesn't need to look anything up or allocate any memory.
+*/
+class InterpreterPerformer  : public Performer
+{
+public:
+    InterpreterPerformer (CreateProcessorCompilerFn createCompilerFn)  : createCompiler (std::move (createCompilerFn)) {}
+    ~InterpreterPerformer() override    { unload(); }
+
+    bool load (CompileMessageList& messageList, const Program& programToLoad) noexcept override
+    {
+        unload();
+
+        if (programToLoad.isEmpty())
+            return false;
+
+        CompileMessageHandler handler (messageList);
+
+        try
+        {
+            program = programToLoad.clone();
+            auto& main = program.getMainProcessor();
+
+            for (auto& i : main.inputs)
+                inputEndpoints.push_back (i->getDetails());
+
+            for (auto& o : main.outputs)
+                outputEndpoints.push_back (o->getDetails());
+
+            for (auto& v : program.getExternalVariables())
+                externalVariables.push_back ({ program.getExternalVariableName (v), v->type.getExternalType(),
+                                               v->annotation.toExternalValue() });
+
+            isProgramLoaded = true;
+            return true;
+        }
+        catch (AbortCompilationException) {}
+
+        unload();
+        return false;
+    }
+
+    void unload() noexcept override
+    {
+        runtime.reset();
+        externalValues.clear();
+        externalVariableValues.clear();
+        unsizedArraySizes.clear();
+        linkedProgram = {};
+        program = {};
+        inputEndpoints.clear();
+        outputEndpoints.clear();
+        externalVariables.clear();
+        isProgramLoaded = false;
+        isProgramLinked = false;
+        hasPreparedBlock = false;
+        errorMessage.clear();
+    }
+
+    ArrayView<const EndpointDetails> getInputEndpoints() noexcept override         { return inputEndpoints; }
+    ArrayView<const EndpointDetails> getOutputEndpoints() noexcept override        { return outputEndpoints; }
+    ArrayView<const ExternalVariable> getExternalVariables() noexcept override     { return externalVariables; }
+
+    bool setExternalVariable (const char* name, const choc::value::ValueView& value) noexcept override
+    {
+        for (auto& e : externalVariables)
+        {
+            if (e.name == name)
+            {
+                externalVariableValues[e.name] = choc::value::Value (value);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool link (CompileMessageList& messageList, const BuildSettings& buildSettings, LinkerCache* cache) noexcept override
+    {
+        if (! isProgramLoaded || isProgramLinked)
+            return false;
+
+        SOUL_TRACE_SCOPE ("link", "Performer::link");
+        CompileMessageHandler handler (messageList);
+
+        try
+        {
+            settings = buildSettings;
+
+            if (settings.maxBlockSize == 0 || settings.maxBlockSize > 16384)
+                CodeLocation().throwError (Errors::unsupportedBlockSize());
+
+            if (! (settings.sampleRate > 0))
+                CodeLocation().throwError (Errors::unsupportedSampleRate());
+
+            linkedProgram = program.clone();
+            resolveExternals();
+
+            runtime = std::make_unique<GraphRuntime> (linkedProgram, settings,
+                                                      createCompiler (linkedProgram, settings, externalValues, unsizedArraySizes, cache));
+            runtime->build();
+            runtime->reset();
+            isProgramLinked = true;
+            return true;
+        }
+        catch (AbortCompilationException) {}
+        catch (...)
+        {
+            messageList.addError ("Failed to link the program", {});
+        }
+
+        runtime.reset();
+        return false;
+    }
+
+    bool isLoaded() noexcept override       { return isProgramLoaded; }
+    bool isLinked() noexcept override       { return isProgramLinked; }
+
+    void reset() noexcept override
+    {
+        if (runtime != nullptr)
+            runtime->reset();
+    }
+
+    EndpointHandle getEndpointHandle (const EndpointID& endpointID) noexcept override
+    {
+        for (uint32_t i = 0; i < inputEndpoints.size(); ++i)
+            if (inputEndpoints[i].endpointID == endpointID)
+                return EndpointHandle::create (inputEndpoints[i].endpointType, i + 1);
+
+        for (uint32_t i = 0; i < outputEndpoints.size(); ++i)
+            if (outputEndpoints[i].endpointID == endpointID)
+                return EndpointHandle::create (outputEndpoints[i].endpointType, outputHandleFlag | (i + 1));
+
+        return {};
+    }
+
+    void prepare (uint32_t numFramesToBeRendered) noexcept override
+    {
+        if (runtime != nullptr)
+        {
+            runtime->prepare (numFramesToBeRendered);
+            hasPreparedBlock = true;
+        }
+    }
+
+    void setNextInputStreamFrames (EndpointHandle handle, const choc::value::ValueView& frameArray) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::stream))
+            runtime->setTopLevelInputFrames (*index, frameArray);
+    }
+
+    void setSparseInputStreamTarget (EndpointHandle handle, const choc::value::ValueView& targetFrameValue,
+                                     uint32_t numFramesToReachValue) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::stream))
+            runtime->setTopLevelSparseTarget (*index, targetFrameValue, numFramesToReachValue);
+    }
+
+    void setInputValue (EndpointHandle handle, const choc::value::ValueView& newValue) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::value))
+            runtime->setTopLevelInputValue (*index, newValue);
+    }
+
+    void addInputEvent (EndpointHandle handle, const choc::value::ValueView& eventData) noexcept override
+    {
+        if (auto index = getInputIndex (handle, EndpointType::event))
+            runtime->addTopLevelInputEvent (*index, 0, eventData);
+    }
+
+    choc::value::ValueView getOutputStreamFrames (EndpointHandle handle) noexcept override
+    {
+        if (auto index = getOutputIndex (handle, EndpointType::stream))
+            return runtime->getTopLevelOutputFrames (*index);
+
+        return {};
+    }
+
+    choc::value::ValueView getOutputValue (EndpointHandle handle) noexcept override
+    {
+        if (auto index = getOutputIndex (handle, EndpointType::value))
+            return runtime->getTopLevelOutputValue (*index);
+
+        return {};
+    }
+
+    void iterateOutputEvents (EndpointHandle handle, HandleNextOutputEventFn fn) noexcept override
+    {
+        if (auto index = getOutputIndex (handle, EndpointType::event))
+            runtime->iterateTopLevelOutputEvents (*index, fn);
+    }
+
+    void advance() noexcept override
+    {
+        if (runtime != nullptr && hasPreparedBlock)
+        {
+            runtime->render();
+            hasPreparedBlock = false;
+        }
+    }
+
+    bool isEndpointActive (const EndpointID& endpointID) noexcept override
+    {
+        return static_cast<bool> (getEndpointHandle (endpointID));
+    }
+
+    uint32_t getLatency() noexcept override
+    {
+        return isProgramLoaded ? program.getMainProcessor().latency : 0;
+    }
+
+    uint32_t getXRuns() noexcept override           { return runtime != nullptr ? runtime->getXRuns() : 0; }
+    uint32_t getBlockSize() noexcept override       { return settings.maxBlockSize; }
+    bool hasError() noexcept override               { return ! errorMessage.empty(); }
+    const char* getError() noexcept override        { return errorMessage.empty() ? nullptr : errorMessage.c_str(); }
+
+private:
+    //==============================================================================
+    CreateProcessorCompilerFn createCompiler;
+    Program program, linkedProgram;
+    BuildSettings settings;
+    std::unique_ptr<GraphRuntime> runtime;
+
+    std::vector<EndpointDetails> inputEndpoints, outputEndpoints;
+    std::vector<ExternalVariable> externalVariables;
+    std::unordered_map<std::string, choc::value::Value> externalVariableValues;
+    std::vector<std::unique_ptr<Value>> externalValueStorage;
+    std::unordered_map<const heart::Variable*, const Value*> externalValues;
+    UnsizedArraySizes unsizedArraySizes;
+
+    bool isProgramLoaded = false, isProgramLinked = false, hasPreparedBlock = false;
+    std::string errorMessage;
+
+    static constexpr uint32_t outputHandleFlag = 0x10000;
+
+    void resolveExternals()
+    {
+        auto& constantTable = linkedProgram.getConstantTable();
+        externalValueStorage.clear();
+        externalValues.clear();
+        unsizedArraySizes.clear();
+
+        for (auto& v : linkedProgram.getExternalVariables())
+        {
+            auto name = linkedProgram.getExternalVariableName (v);
+            auto found = externalVariableValues.find (name);
+
+            if (found == externalVariableValues.end())
+                v->location.throwError (Errors::unresolvedExternal (name));
+
+            auto value = Value::fromExternalValue (v->type, found->second, constantTable, linkedProgram.getStringDictionary());
+
+            if (! value.getType().isIdentical (v->type))
+                v->location.throwError (Errors::cannotConvertExternalType (name, v->type.getDescription()));
+
+            externalValueStorage.push_back (std::make_unique<Value> (std::move (value)));
+            externalValues[v.getPointer()] = externalValueStorage.back().get();
+        }
+
+        // Now that all the constants are in the table, any handles that they contain can
+        // be replaced by pointers, and the array sizes recorded for get_array_size()
+        for (auto& item : constantTable)
+        {
+            auto& value = const_cast<Value&> (*item.value);
+            value.convertAllHandlesToPointers (constantTable);
+
+            if (value.getType().isFixedSizeArray())
+                unsizedArraySizes.add (value.getPackedData(), static_cast<int32_t> (value.getType().getArraySize()));
+        }
+
+        for (auto& v : externalValueStorage)
+            v->convertAllHandlesToPointers (constantTable);
+    }
+
+    std::optional<uint32_t> getInputIndex (EndpointHandle handle, EndpointType type) const noexcept
+    {
+        auto raw = handle.getRawHandle();
+
+        if (runtime != nullptr && handle.getType() == type && (raw & outputHandleFlag) == 0
+             && raw > 0 && raw <= inputEndpoints.size())
+            return raw - 1;
+
+        return {};
+    }
+
+    std::optional<uint32_t> getOutputIndex (EndpointHandle handle, EndpointType type) const noexcept
+    {
+        auto raw = handle.getRawHandle();
+
+        if (runtime != nullptr && handle.getType() == type && (raw & outputHandleFlag) != 0)
+        {
+            auto index = raw & ~outputHandleFlag;
+
+            if (index > 0 && index <= outputEndpoints.size())
+                return index - 1;
+        }
+
+        return {};
+    }
+};
+
+//==============================================================================
+struct InterpreterPerformerFactory  : public PerformerFactory
+{
+    std::unique_ptr<Performer> createPerformer() override
+    {
+        return std::make_unique<InterpreterPerformer> ([] (Program& program, const BuildSettings& settings,
+                                                           const std::unordered_map<const heart::Variable*, const Value*>& externals,
+                                                           UnsizedArraySizes& sizes, LinkerCache*)
+        {
+            return std::make_unique<FunctionCompiler> (program, settings, externals, sizes);
+        });
+    }
+};
+
+} // namespace soul::interpreter
+
+namespace soul
+{
+
+std::unique_ptr<PerformerFactory> createInterpreterPerformerFactory()
+{
+    return std::make_unique<interpreter::InterpreterPerformerFactory>();
+}
+
+} // namespace soul
@@ -0,0 +1,343 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul::interpreter
+{
+
+//==============================================================================
+/**
+    Runs batches of independent tasks on a fixed pool of worker threads, with the
+    thread that calls runBatch() joining in as worker 0.
+
+    Each batch is split into one contiguous run of tasks per worker. A worker takes
+    tasks from the front of its own run, and when that's empty it steals them from
+    the back of the other workers' runs, so a few expensive tasks can't leave the
+    rest of the pool idle. runBatch() only returns once every task has finished.
+
+    The threads are all created up-front, and are given a real-time priority where the
+    OS allows it. An idle worker spins for up to maxSpinMicroseconds waiting for a batch,
+    and then parks itself on a semaphore. The thread that posts a batch never takes a
+    lock: it only posts to the semaphore if a worker has actually parked, and posting
+    doesn't block. So when batches follow each other closely, as they do within a block,
+    the workers pick them up without any OS involvement, and between blocks they go to
+    sleep rather than burning their cores. The cost is that the first batch after a
+    worker has parked has to wait for the OS to wake it up, which is typically tens of
+    microseconds. startBlock() wakes any parked workers early to hide some of that, and
+    until they arrive, worker 0 and the workers that are still spinning steal their tasks.
+    No memory is allocated while a batch is running.
+*/
+class WorkStealingScheduler
+{
+public:
+    struct Task
+    {
+        virtual ~Task() = default;
+        virtual void performTask (uint32_t item, uint32_t workerIndex) noexcept = 0;
+    };
+
+    WorkStealingScheduler (uint32_t numWorkers)  : queues (numWorkers)
+    {
+        SOUL_ASSERT (numWorkers > 1);
+
+        try
+        {
+            for (uint32_t i = 1; i < numWorkers; ++i)
+            {
+                threads.emplace_back ([this, i] { runWorker (i); });
+                setRealtimePriority (threads.back());
+            }
+        }
+        catch (...)
+        {
+            stopThreads();
+            throw;
+        }
+    }
+
+    ~WorkStealingScheduler()
+    {
+        stopThreads();
+    }
+
+    uint32_t getNumWorkers() const noexcept     { return static_cast<uint32_t> (queues.size()); }
+
+    /** The longest time that an idle worker will spin for before it parks itself. */
+    static constexpr int64_t maxSpinMicroseconds = 50;
+
+    /** Wakes any parked workers, so that they're ready by the time the first batch of
+        a block is posted.
+    */
+    void startBlock() noexcept
+    {
+        wakeParkedWorkers();
+    }
+
+    /** Called once the block's last batch has finished. The workers will park themselves
+        once they've been idle for maxSpinMicroseconds.
+    */
+    void finishBlock() noexcept {}
+
+    /** Runs the task for each of the items, and waits for them all to complete.
+        This must be called between startBlock() and finishBlock().
+    */
+    void runBatch (const uint32_t* items, uint32_t numItems, Task& task) noexcept
+    {
+        // An odd batch number tells the workers to keep away while the queues are changed
+        batchNumber.fetch_add (1);
+
+        while (busyWorkers.load() != 0)
+            pause();
+
+        currentItems = items;
+        currentTask = std::addressof (task);
+        remainingTasks = numItems;
+
+        auto numWorkers = static_cast<uint64_t> (queues.size());
+
+        for (uint64_t i = 0; i < numWorkers; ++i)
+            queues[i].range = createRange (static_cast<uint32_t> (numItems * i / numWorkers),
+                                           static_cast<uint32_t> (numItems * (i + 1) / numWorkers));
+
+        batchNumber.fetch_add (1);
+        wakeParkedWorkers();
+        runTasks (0);
+
+        // Every task has been claimed by now, so this only waits for the ones still running
+        while (remainingTasks.load (std::memory_order_acquire) != 0)
+            pause();
+    }
+
+private:
+    //==============================================================================
+    /** A worker's run of tasks, packed as the indexes of the first and the one after
+        the last, so that the owner and thieves can both claim a task with one CAS.
+    */
+    struct alignas (64) Queue
+    {
+        std::atomic<uint64_t> range { 0 };
+    };
+
+    /** A counting semaphore. post() never blocks, and on Linux and macOS it doesn't
+        take a lock either. Elsewhere it falls back to a mutex, which is only ever
+        touched when a worker has parked.
+    */
+    struct Semaphore
+    {
+       #if defined (__APPLE__)
+        Semaphore()     : semaphore (dispatch_semaphore_create (0)) {}
+        ~Semaphore()    { dispatch_release (semaphore); }
+
+        void post (uint32_t count) noexcept     { while (count-- != 0) dispatch_semaphore_signal (semaphore); }
+        void wait() noexcept                    { dispatch_semaphore_wait (semaphore, DISPATCH_TIME_FOREVER); }
+
+        dispatch_semaphore_t semaphore;
+       #elif defined (__linux__)
+        Semaphore()     { sem_init (std::addressof (semaphore), 0, 0); }
+        ~Semaphore()    { sem_destroy (std::addressof (semaphore)); }
+
+        void post (uint32_t count) noexcept     { while (count-- != 0) sem_post (std::addressof (semaphore)); }
+        void wait() noexcept                    { while (sem_wait (std::addressof (semaphore)) != 0) {} }
+
+        sem_t semaphore;
+       #else
+        void post (uint32_t count) noexcept
+        {
+            {
+                std::lock_guard<std::mutex> l (lock);
+                available += count;
+            }
+
+            condition.notify_all();
+        }
+
+        void wait() noexcept
+        {
+            std::unique_lock<std::mutex> l (lock);
+            condition.wait (l, [this] { return available != 0; });
+            --available;
+        }
+
+        std::mutex lock;
+        std::condition_variable condition;
+        uint32_t available = 0;
+       #endif
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> threads;
+    Semaphore parkedWorkerSemaphore;
+    std::atomic<bool> shouldStop { false };
+    std::atomic<uint32_t> batchNumber { 0 }, busyWorkers { 0 }, remainingTasks { 0 }, numParkedWorkers { 0 };
+    const uint32_t* currentItems = nullptr;
+    Task* currentTask = nullptr;
+
+    static uint64_t createRange (uint32_t front, uint32_t back) noexcept    { return (static_cast<uint64_t> (back) << 32) | front; }
+
+    static void pause() noexcept
+    {
+       #if SOUL_INTEL
+        _mm_pause();
+       #elif SOUL_ARM64 || SOUL_ARM32
+        asm volatile ("yield");
+       #else
+        std::this_thread::yield();
+       #endif
+    }
+
+    static void setRealtimePriority (std::thread& t) noexcept
+    {
+       #if defined (__APPLE__) || defined (__linux__)
+        // This needs permission from the OS, and without it the thread just keeps its normal priority
+        sched_param param {};
+        param.sched_priority = sched_get_priority_min (SCHED_FIFO) + 1;
+        pthread_setschedparam (t.native_handle(), SCHED_FIFO, std::addressof (param));
+       #else
+        (void) t;
+       #endif
+    }
+
+    void wakeParkedWorkers() noexcept
+    {
+        if (numParkedWorkers.load() != 0)
+            if (auto numToWake = numParkedWorkers.exchange (0))
+                parkedWorkerSemaphore.post (numToWake);
+    }
+
+    static bool takeFromFront (Queue& q, uint32_t& item) noexcept
+    {
+        auto range = q.range.load();
+
+        for (;;)
+        {
+            auto front = static_cast<uint32_t> (range), back = static_cast<uint32_t> (range >> 32);
+
+            if (front >= back)
+                return false;
+
+            if (q.range.compare_exchange_weak (range, createRange (front + 1, back)))
+            {
+                item = front;
+                return true;
+            }
+        }
+    }
+
+    static bool takeFromBack (Queue& q, uint32_t& item) noexcept
+    {
+        auto range = q.range.load();
+
+        for (;;)
+        {
+            auto front = static_cast<uint32_t> (range), back = static_cast<uint32_t> (range >> 32);
+
+            if (front >= back)
+                return false;
+
+            if (q.range.compare_exchange_weak (range, createRange (front, back - 1)))
+            {
+                item = back - 1;
+                return true;
+            }
+        }
+    }
+
+    void runTasks (uint32_t workerIndex) noexcept
+    {
+        auto& task = *currentTask;
+        auto items = currentItems;
+        auto numWorkers = getNumWorkers();
+        uint32_t item;
+
+        while (takeFromFront (queues[workerIndex], item))
+        {
+            task.performTask (items[item], workerIndex);
+            remainingTasks.fetch_sub (1, std::memory_order_acq_rel);
+        }
+
+        for (uint32_t i = 1; i < numWorkers; ++i)
+        {
+            auto& victim = queues[(workerIndex + i) % numWorkers];
+
+            while (takeFromBack (victim, item))
+            {
+                task.performTask (items[item], workerIndex);
+                remainingTasks.fetch_sub (1, std::memory_order_acq_rel);
+            }
+        }
+    }
+
+    void runWorker (uint32_t workerIndex)
+    {
+        using Clock = std::chrono::steady_clock;
+        uint32_t lastBatch = 0;
+        auto idleSince = Clock::now();
+
+        while (! shouldStop)
+        {
+            auto batch = batchNumber.load();
+
+            if ((batch & 1) == 0 && batch != lastBatch)
+            {
+                // Having announced that it's busy, the worker must check that the
+                // queues weren't already being changed before it starts using them
+                ++busyWorkers;
+
+                if (batchNumber.load() == batch)
+                {
+                    lastBatch = batch;
+                    runTasks (workerIndex);
+                }
+
+                --busyWorkers;
+                idleSince = Clock::now();
+                continue;
+            }
+
+            for (int i = 0; i < 64; ++i)
+                pause();
+
+            if (Clock::now() - idleSince < std::chrono::microseconds (maxSpinMicroseconds))
+                continue;
+
+            // Once it's registered as parked, the worker must check again for anything that
+            // was posted before wakeParkedWorkers() could see it. If it then doesn't wait, its
+            // registration is left behind, and just causes one extra trip round this loop later.
+            ++numParkedWorkers;
+
+            if (batchNumber.load() == batch && ! shouldStop)
+                parkedWorkerSemaphore.wait();
+
+            idleSince = Clock::now();
+        }
+    }
+
+    void stopThreads()
+    {
+        shouldStop = true;
+        parkedWorkerSemaphore.post (static_cast<uint32_t> (threads.size()));
+
+        for (auto& t : threads)
+            t.join();
+
+        threads.clear();
+    }
+};
+
+} // namespace soul::interpreter
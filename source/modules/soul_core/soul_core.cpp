@@ -30,10 +30,12 @@
 #include <thread>
 #include <iomanip>
 #include <fstream>
+#include <unordered_set>
 
 #include "soul_core.h"
 
 #include "../../../include/soul/3rdParty/choc/text/choc_JSON.h"
+#include "../../../include/soul/3rdParty/choc/platform/choc_SpinLock.h"
 
 #if SOUL_INTEL
  #include <xmmintrin.h>
@@ -41,6 +43,16 @@
 
 #ifdef __APPLE__
  #include <AvailabilityMacros.h>
+ #include <dispatch/dispatch.h>
+#endif
+
+#if defined (__APPLE__) || defined (__linux__)
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+#ifdef __linux__
+ #include <semaphore.h>
 #endif
 
 #define SOUL_INSIDE_CORE_CPP 1
@@ -69,6 +81,7 @@
 #include "types/soul_EndpointType.cpp"
 #include "heart/soul_heart_Printer.h"
 #include "heart/soul_heart_Parser.h"
+#include "heart/soul_heart_BinaryFormat.h"
 #include "heart/soul_heart_Checker.h"
 #include "types/soul_Type.cpp"
 #include "compiler/soul_StandardLibrary.h"
@@ -85,10 +98,19 @@
 #include "heart/soul_Module.cpp"
 #include "heart/soul_Program.cpp"
 #include "venue/soul_ThreadedVenue.cpp"
+#include "interpreter/soul_InterpreterGraph.h"
+#include "interpreter/soul_InterpreterScheduler.h"
+#include "interpreter/soul_InterpreterFunctions.h"
+#include "interpreter/soul_InterpreterPerformer.cpp"
+#include "bytecode/soul_BytecodeInstructions.h"
+#include "bytecode/soul_BytecodeCompiler.h"
+#include "bytecode/soul_BytecodePerformer.cpp"
+#include "code_generation/soul_CPlusPlusGenerator.cpp"
 #include "diagnostics/soul_CodeLocation.cpp"
 #include "diagnostics/soul_Logging.cpp"
 #include "diagnostics/soul_CompileMessageList.cpp"
 #include "diagnostics/soul_Timing.cpp"
+#include "diagnostics/soul_Tracing.cpp"
 #include "venue/soul_Endpoints.cpp"
 
 #ifdef __clang__
@@ -49,6 +49,7 @@
 #include <sstream>
 #include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <functional>
 #include <mutex>
@@ -63,6 +64,7 @@
 #include <random>
 #include <optional>
 #include <complex>
+#include <thread>
 
 #include "utilities/soul_DebugUtilities.h"
 
@@ -76,6 +78,7 @@
 #include "../../../include/soul/3rdParty/choc/text/choc_CodePrinter.h"
 #include "../../../include/soul/3rdParty/choc/containers/choc_DirtyList.h"
 #include "../../../include/soul/3rdParty/choc/containers/choc_VariableSizeFIFO.h"
+#include "../../../include/soul/3rdParty/choc/containers/choc_SingleReaderSingleWriterFIFO.h"
 #include "../../../include/soul/common/soul_ProgramDefinitions.h"
 #include "../../../include/soul/common/soul_DumpConstant.h"
 
@@ -113,6 +116,7 @@ namespace soul
 #include "utilities/soul_AccessCount.h"
 
 #include "diagnostics/soul_Logging.h"
+#include "diagnostics/soul_Tracing.h"
 #include "diagnostics/soul_Timing.h"
 #include "diagnostics/soul_CodeLocation.h"
 #include "diagnostics/soul_CompileMessageList.h"
@@ -131,6 +135,7 @@ namespace soul
 
 #include "heart/soul_Operators.h"
 #include "heart/soul_Intrinsics.h"
+#include "heart/soul_FastIntrinsics.h"
 #include "heart/soul_heart_AST.h"
 #include "heart/soul_Program.h"
 #include "heart/soul_Module.h"
@@ -138,7 +143,9 @@ namespace soul
 #include "heart/soul_heart_FunctionBuilder.h"
 #include "heart/soul_heart_CallFlowGraph.h"
 #include "heart/soul_heart_Optimisations.h"
+#include "heart/soul_heart_DataflowOptimisations.h"
 #include "heart/soul_heart_DelayCompensation.h"
+#include "heart/soul_heart_StreamLoopVectoriser.h"
 
 #include "compiler/soul_AST.h"
 #include "compiler/soul_Compiler.h"
@@ -146,8 +153,11 @@ namespace soul
 #include "venue/soul_Endpoints.h"
 #include "venue/soul_Performer.h"
 #include "venue/soul_Venue.h"
+#include "code_generation/soul_CPlusPlusGenerator.h"
+#include "code_generation/soul_GeneratedCodePerformer.h"
 
 #include "utilities/soul_EventQueue.h"
+#include "utilities/soul_MultiProducerFIFO.h"
 #include "utilities/soul_MultiEndpointFIFO.h"
 #include "utilities/soul_AudioDataGeneration.h"
 #include "utilities/soul_AudioMIDIWrapper.h"
@@ -36,12 +36,15 @@ namespace soul
         if (! value.isValid())
             return 0;
 
-        for (auto& i : items)
-            if (value == *i.value)
-                return i.handle;
+        auto contentHash = getContentHash (value);
+        auto matches = itemIndexesByContentHash.equal_range (contentHash);
 
-        auto handle = nextIndex++;
-        items.push_back ({ handle, std::make_unique<Value> (std::move (value)) });
+        for (auto i = matches.first; i != matches.second; ++i)
+            if (value == *items[i->second].value)
+                return items[i->second].handle;
+
+        auto handle = nextIndex;
+        addItem ({ handle, std::make_unique<Value> (std::move (value)) }, contentHash);
         return handle;
     }
 
@@ -50,9 +53,10 @@ namespace soul
         if (handle == 0)
             return {};
 
-        for (auto& i : items)
-            if (handle == i.handle)
-                return i.value.get();
+        auto found = itemIndexesByHandle.find (handle);
+
+        if (found != itemIndexesByHandle.end())
+            return items[found->second].value.get();
 
         SOUL_ASSERT_FALSE;
         return {};
@@ -60,7 +64,22 @@ namespace soul
 
     void ConstantTable::addItem (Item i)
     {
+        auto contentHash = getContentHash (*i.value);
+        addItem (std::move (i), contentHash);
+    }
+
+    void ConstantTable::addItem (Item i, size_t contentHash)
+    {
+        SOUL_ASSERT (itemIndexesByHandle.find (i.handle) == itemIndexesByHandle.end());
         nextIndex = std::max (nextIndex, i.handle + 1);
+        itemIndexesByContentHash.insert ({ contentHash, items.size() });
+        itemIndexesByHandle[i.handle] = items.size();
         items.push_back (std::move (i));
     }
+
+    size_t ConstantTable::getContentHash (const Value& v)
+    {
+        return std::hash<std::string_view>() (std::string_view (static_cast<const char*> (v.getPackedData()),
+                                                                v.getPackedDataSize()));
+    }
 }
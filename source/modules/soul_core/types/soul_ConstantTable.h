@@ -22,7 +22,11 @@ namespace soul
 {
 
 //==============================================================================
-/** A set of constant Value objects which are mapped to numeric handles. */
+/** A set of constant Value objects which are mapped to numeric handles.
+
+    Values are indexed by a hash of their content and items by handle, so adding a
+    value that's already present, or finding one by handle, doesn't need a scan.
+*/
 class ConstantTable
 {
 public:
@@ -54,7 +58,12 @@ public:
 
 private:
     ArrayWithPreallocation<Item, 32> items;
+    std::unordered_multimap<size_t, size_t> itemIndexesByContentHash;
+    std::unordered_map<Handle, size_t> itemIndexesByHandle;
     Handle nextIndex = 1;
+
+    static size_t getContentHash (const Value&);
+    void addItem (Item, size_t contentHash);
 };
 
 
@@ -32,12 +32,15 @@ namespace soul
         if (text.empty())
             return {};
 
-        for (auto& s : strings)
-            if (s.text == text)
-                return s.handle;
+        if (hashIndex.empty())
+            rebuildIndex();
+
+        if (auto itemIndex = findSlot (text))
+            return strings[itemIndex - 1].handle;
 
         auto handle = StringDictionary::Handle { nextIndex++ };
         strings.push_back ({ handle, std::string (text) });
+        addToIndex (static_cast<uint32_t> (strings.size() - 1));
         return handle;
     }
 
@@ -46,11 +49,77 @@ namespace soul
         if (handle == Handle())
             return {};
 
-        for (auto& s : strings)
-            if (s.handle == handle)
-                return s.text;
+        if (auto item = findItem (handle))
+            return item->text;
 
         SOUL_ASSERT_FALSE;
         return {};
     }
+
+    void StringDictionary::addItem (Handle handle, std::string text)
+    {
+        SOUL_ASSERT (handle.handle >= nextIndex && ! text.empty());
+        nextIndex = handle.handle + 1;
+        strings.push_back ({ handle, std::move (text) });
+        addToIndex (static_cast<uint32_t> (strings.size() - 1));
+    }
+
+    void StringDictionary::clear()
+    {
+        strings.clear();
+        hashIndex.clear();
+        nextIndex = 1;
+    }
+
+    const StringDictionary::Item* StringDictionary::findItem (Handle handle) const
+    {
+        // Unless some items have been removed, a handle's position is just its value - 1
+        auto index = static_cast<size_t> (handle.handle - 1);
+
+        if (index < strings.size() && strings[index].handle == handle)
+            return std::addressof (strings[index]);
+
+        auto found = std::lower_bound (strings.begin(), strings.end(), handle,
+                                       [] (const Item& item, Handle h) { return item.handle.handle < h.handle; });
+
+        if (found != strings.end() && found->handle == handle)
+            return std::addressof (*found);
+
+        return nullptr;
+    }
+
+    uint32_t& StringDictionary::findSlot (std::string_view text)
+    {
+        auto mask = hashIndex.size() - 1;
+
+        for (auto i = std::hash<std::string_view>() (text) & mask;; i = (i + 1) & mask)
+        {
+            auto& slot = hashIndex[i];
+
+            if (slot == 0 || strings[slot - 1].text == text)
+                return slot;
+        }
+    }
+
+    void StringDictionary::addToIndex (uint32_t itemIndex)
+    {
+        if (strings.size() * 2 > hashIndex.size())
+            rebuildIndex();
+        else
+            findSlot (strings[itemIndex].text) = itemIndex + 1;
+    }
+
+    void StringDictionary::rebuildIndex()
+    {
+        size_t size = 16;
+
+        while (size < strings.size() * 4)
+            size *= 2;
+
+        hashIndex.clear();
+        hashIndex.resize (size);
+
+        for (uint32_t i = 0; i < strings.size(); ++i)
+            findSlot (strings[i].text) = i + 1;
+    }
 }
@@ -22,13 +22,23 @@ namespace soul
 {
 
 //==============================================================================
-/** Holds a map of strings to integer handles. */
+/** Holds a map of strings to integer handles.
+
+    Handles are allocated sequentially and never re-used, so the items are always sorted
+    by handle. A handle can usually be found directly from its position, and strings are
+    found using an open-addressed hash index, so both kinds of lookup are O(1).
+*/
 class StringDictionary  : public choc::value::StringDictionary
 {
 public:
     StringDictionary();
     ~StringDictionary() override;
 
+    StringDictionary (const StringDictionary&) = default;
+    StringDictionary (StringDictionary&&) = default;
+    StringDictionary& operator= (const StringDictionary&) = default;
+    StringDictionary& operator= (StringDictionary&&) = default;
+
     Handle getHandleForString (std::string_view) override;
     std::string_view getStringForHandle (Handle) const override;
 
@@ -38,10 +48,35 @@ public:
         std::string text;
     };
 
-    std::vector<Item> strings;
+    /** Returns the items, in ascending order of handle. */
+    const std::vector<Item>& getItems() const       { return strings; }
+
+    /** Adds a string with a known handle, e.g. when restoring a dictionary that was
+        created elsewhere. The handle must be higher than any that are already in use.
+    */
+    void addItem (Handle, std::string text);
+
+    template <typename Predicate>
+    bool removeIf (Predicate&& pred)
+    {
+        if (! soul::removeIf (strings, std::move (pred)))
+            return false;
+
+        rebuildIndex();
+        return true;
+    }
+
+    void clear();
 
 private:
+    std::vector<Item> strings;
+    std::vector<uint32_t> hashIndex; // each slot holds an index into strings + 1, or 0 if empty
     uint32_t nextIndex = 1;
+
+    const Item* findItem (Handle) const;
+    uint32_t& findSlot (std::string_view);
+    void addToIndex (uint32_t itemIndex);
+    void rebuildIndex();
 };
 
 
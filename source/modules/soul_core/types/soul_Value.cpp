@@ -361,9 +361,17 @@ struct Value::PackedData
     {
         if (type.isUnsizedArray())
         {
-            auto source = constantTable.getValueForHandle (getAs<ConstantTable::Handle>());
-            SOUL_ASSERT (source != nullptr);
-            setAs<void*> (source->getPackedData());
+            // a null handle is an empty (e.g. zero-initialised) array, so has no data
+            if (auto handle = getAs<ConstantTable::Handle>())
+            {
+                auto source = constantTable.getValueForHandle (handle);
+                SOUL_ASSERT (source != nullptr);
+                setAs<void*> (source->getPackedData());
+            }
+            else
+            {
+                setAs<void*> (nullptr);
+            }
         }
         else if (type.isArrayOrVector())
         {
@@ -88,29 +88,43 @@ struct AudioInputList
     {
         inputs.clear();
         totalNumChannels = 0;
+        currentInputChannels = {};
     }
 
-    void addToFIFO (MultiEndpointFIFO& fifo, uint64_t time, choc::buffer::ChannelArrayView<const float> inputChannels)
+    /** Sets the host's input channels for the next block. Mono inputs are read directly from
+        these channels, but a multi-channel input needs its frames interleaved, so that's done
+        here, once for the whole block.
+    */
+    void setInputChannels (choc::buffer::ChannelArrayView<const float> inputChannels)
     {
+        currentInputChannels = inputChannels;
         auto numFrames = inputChannels.getNumFrames();
 
+        for (auto& input : inputs)
+            if (input.numChannels != 1)
+                copy (input.interleaved.getStart (numFrames),
+                      inputChannels.getChannelRange ({ input.startChannelIndex, input.startChannelIndex + input.numChannels }));
+    }
+
+    /** Gives the performer views of a range of frames from the current block, without
+        copying them.
+    */
+    void setPerformerInputFrames (Performer& p, uint32_t startFrame, uint32_t numFrames)
+    {
         for (auto& input : inputs)
         {
             if (input.numChannels == 1)
             {
-                auto channel = inputChannels.getChannel (input.startChannelIndex);
+                auto channel = currentInputChannels.getChannel (input.startChannelIndex);
 
-                fifo.addInputData (input.endpoint, time,
-                                   choc::value::createArrayView (const_cast<float*> (channel.data.data), numFrames));
+                p.setNextInputStreamFrames (input.endpoint,
+                                            choc::value::createArrayView (const_cast<float*> (channel.data.data + startFrame), numFrames));
             }
             else
             {
-                copy (input.interleaved.getStart (numFrames),
-                      inputChannels.getChannelRange ({ input.startChannelIndex, input.startChannelIndex + input.numChannels }));
-
-                fifo.addInputData (input.endpoint, time,
-                                   choc::value::create2DArrayView (input.interleaved.getView().data.data,
-                                                                   numFrames, input.numChannels));
+                p.setNextInputStreamFrames (input.endpoint,
+                                            choc::value::create2DArrayView (input.interleaved.getView().data.data + startFrame * input.numChannels,
+                                                                            numFrames, input.numChannels));
             }
         }
     }
@@ -124,6 +138,7 @@ struct AudioInputList
 
     std::vector<AudioInput> inputs;
     uint32_t totalNumChannels = 0;
+    choc::buffer::ChannelArrayView<const float> currentInputChannels;
 };
 
 //==============================================================================
@@ -189,7 +204,7 @@ struct MIDIInputList
         inputs.clear();
     }
 
-    void addToFIFO (MultiEndpointFIFO& fifo, uint64_t time, MIDIEventInputList midiEvents)
+    void addToFIFO (MultiProducerEndpointFIFO& fifo, uint64_t time, MIDIEventInputList midiEvents)
     {
         if (inputs.empty())
             return;
@@ -271,6 +286,7 @@ struct EventOutputList
                 auto handle = p.getEndpointHandle (e.endpointID);
                 outputs.push_back (handle);
                 endpointNames[handle.getRawHandle()] = e.name;
+                fifo.registerEndpointTypes (handle, e.dataTypes);
             }
         }
     }
@@ -361,6 +377,10 @@ struct ParameterStateList
 
         for (size_t i = 0; i < parameters.size(); ++i)
             parameters[i].dirtyListHandle = dirtyHandles[i];
+
+        incomingAutomationPoints.reset (maxNumAutomationPoints);
+        automationPoints.clear();
+        automationPoints.reserve (maxNumAutomationPoints);
     }
 
     /** Sets the current value for a parameter, and if the value has changed, marks it as
@@ -385,25 +405,45 @@ struct ParameterStateList
         dirtyList.markAsDirty (parameters[parameterIndex].dirtyListHandle);
     }
 
-    /** Pushes events for any endpoints which have had their value
-        modified by setParameter() or markAsChanged().
+    /** Adds a breakpoint to a parameter's automation, at an absolute frame position in the
+        timeline that's passed to addToFIFO(), which for an AudioMIDIWrapper is the number of
+        frames it has rendered since it was prepared.
+        A parameter that's a stream ramps linearly from its value at its previous breakpoint (or
+        from the start of the block, if that point was in an earlier block) to reach newValue
+        at the given frame, and any other parameter jumps to newValue at that frame. A point
+        whose frame has already been rendered by the time it's read is applied at the start
+        of the block that reads it.
+        Each parameter's points must be added in time order.
+        The points go through a single-writer FIFO, so this doesn't lock or allocate, and can
+        be called by a host thread as well as by the rendering thread, but only one thread may
+        add points. It returns false if the FIFO is full.
+    */
+    bool addAutomationPoint (uint32_t parameterIndex, uint64_t frame, float newValue)
+    {
+        SOUL_ASSERT (parameterIndex < parameters.size());
+        return incomingAutomationPoints.push ({ parameterIndex, frame, newValue });
+    }
+
+    /** Pushes events for any endpoints which have had their value modified by setParameter()
+        or markAsChanged(), and for any automation points which affect the next numFrames.
     */
-    void addToFIFO (MultiEndpointFIFO& fifo, uint64_t time)
+    void addToFIFO (MultiProducerEndpointFIFO& fifo, uint64_t time, uint32_t numFrames)
     {
         while (auto p = dirtyList.popNextDirtyObject())
-        {
-            if (p->rampFrames == 0)
-            {
-                valueHolder.getViewReference().set (p->currentValue);
-                fifo.addInputData (p->endpoint, time, valueHolder);
-            }
-            else
-            {
-                rampFramesMember.set (static_cast<int32_t> (p->rampFrames));
-                rampTargetMember.set (p->currentValue);
-                fifo.addInputData (p->endpoint, time, rampedValueHolder);
-            }
-        }
+            addValueToFIFO (fifo, *p, time, p->currentValue, p->rampFrames);
+
+        readIncomingAutomationPoints();
+
+        if (! automationPoints.empty())
+            addAutomationToFIFO (fifo, time, numFrames);
+    }
+
+    /** Registers the types that addToFIFO() will send with the FIFO. */
+    void registerTypes (MultiProducerEndpointFIFO& fifo) const
+    {
+        for (auto& p : parameters)
+            fifo.registerEndpointType (p.endpoint, p.rampFrames == 0 ? valueHolder.getType()
+                                                                      : rampedValueHolder.getType());
     }
 
     static constexpr std::string_view rampHolderName { "_RampHolder" };
@@ -420,6 +460,8 @@ struct ParameterStateList
         return false;
     }
 
+    static constexpr size_t maxNumAutomationPoints = 1024;
+
 private:
     struct Parameter
     {
@@ -427,12 +469,83 @@ private:
         soul::EndpointHandle endpoint;
         float currentValue = 0;
         uint32_t rampFrames = 0;
+        uint64_t nextRampStartFrame = 0;
+        uint64_t lastAutomationFrame = 0;
+    };
+
+    struct AutomationPoint
+    {
+        uint32_t parameterIndex;
+        uint64_t frame;
+        float value;
     };
 
     std::vector<Parameter> parameters;
     choc::fifo::DirtyList<Parameter> dirtyList;
+    choc::fifo::SingleReaderSingleWriterFIFO<AutomationPoint> incomingAutomationPoints;
+    std::vector<AutomationPoint> automationPoints;
     choc::value::Value valueHolder, rampedValueHolder;
     choc::value::ValueView rampFramesMember, rampTargetMember;
+
+    void addValueToFIFO (MultiProducerEndpointFIFO& fifo, const Parameter& param, uint64_t time, float value, uint32_t rampFrames)
+    {
+        if (param.rampFrames == 0)
+        {
+            valueHolder.getViewReference().set (value);
+            fifo.addInputData (param.endpoint, time, valueHolder);
+        }
+        else
+        {
+            rampFramesMember.set (static_cast<int32_t> (rampFrames));
+            rampTargetMember.set (value);
+            fifo.addInputData (param.endpoint, time, rampedValueHolder);
+        }
+    }
+
+    // Moves the points that have arrived since the last block into the list of pending ones.
+    // If that list is full, the rest stay in the FIFO until there's room for them.
+    void readIncomingAutomationPoints()
+    {
+        AutomationPoint point;
+
+        while (automationPoints.size() < maxNumAutomationPoints && incomingAutomationPoints.pop (point))
+        {
+            auto& param = parameters[point.parameterIndex];
+            SOUL_ASSERT (point.frame >= param.lastAutomationFrame); // each parameter's points must be in time order
+            param.lastAutomationFrame = point.frame;
+            automationPoints.push_back (point);
+        }
+    }
+
+    // Each segment of a stream's automation is sent as a ramp that starts on the frame after the
+    // previous point and lands on the new one, so a point is sent in the block where its segment
+    // starts, and anything later is kept for a later block. Because the frames are absolute,
+    // points that are kept, or are still waiting in the FIFO, never need adjusting.
+    void addAutomationToFIFO (MultiProducerEndpointFIFO& fifo, uint64_t time, uint32_t numFrames)
+    {
+        auto blockEnd = time + numFrames;
+        size_t numPointsKept = 0;
+
+        for (auto& point : automationPoints)
+        {
+            auto& param = parameters[point.parameterIndex];
+            auto frame = std::max (point.frame, time);
+            auto startFrame = param.rampFrames != 0 ? std::max (time, std::min (param.nextRampStartFrame, frame))
+                                                    : frame;
+
+            if (startFrame >= blockEnd)
+            {
+                automationPoints[numPointsKept++] = point;
+                continue;
+            }
+
+            addValueToFIFO (fifo, param, startFrame, point.value, static_cast<uint32_t> (frame + 1 - startFrame));
+            param.currentValue = point.value;
+            param.nextRampStartFrame = frame + 1;
+        }
+
+        automationPoints.resize (numPointsKept);
+    }
 };
 
 
@@ -519,7 +632,7 @@ struct TimelineEventEndpointList
         }
     }
 
-    void addToFIFO (MultiEndpointFIFO& fifo, uint64_t time)
+    void addToFIFO (MultiProducerEndpointFIFO& fifo, uint64_t time)
     {
         if (anyChanges)
         {
@@ -584,7 +697,9 @@ struct AudioMIDIWrapper
         midiOutputList.clear();
         timelineEventEndpointList.clear();
         eventOutputList.clear();
-        inputFIFO.reset (256 * maxInternalBlockSize, maxInternalBlockSize * 2);
+        // Each thread that sends input gets an equal share of the FIFO's space, which leaves room
+        // for a full block of MIDI and parameter changes from the rendering thread
+        inputFIFO.reset (1024 * maxInternalBlockSize, maxInternalBlockSize * 2);
         maxBlockSize = 0;
     }
 
@@ -610,6 +725,12 @@ struct AudioMIDIWrapper
         parameterList.initialise (perf, std::move (getRampLengthForSparseStreamFn));
         timelineEventEndpointList.initialise (perf);
         eventOutputList.initialise (perf);
+
+        for (auto& e : perf.getInputEndpoints())
+            if (getInputEndpointType (e) != InputEndpointType::audio)
+                inputFIFO.registerEndpointTypes (perf.getEndpointHandle (e.endpointID), e.dataTypes);
+
+        parameterList.registerTypes (inputFIFO);
     }
 
     void render (choc::buffer::ChannelArrayView<const float> input,
@@ -623,18 +744,23 @@ struct AudioMIDIWrapper
             return renderInChunks (input, output, midiIn, midiOut);
 
         SOUL_ASSERT (input.getNumFrames() == numFrames && maxBlockSize != 0);
+        SOUL_TRACE_SCOPE ("render", "AudioMIDIWrapper::render");
 
-        audioInputList.addToFIFO (inputFIFO, totalFramesRendered, input);
-        midiInputList.addToFIFO (inputFIFO, totalFramesRendered, midiIn);
-        parameterList.addToFIFO (inputFIFO, totalFramesRendered);
-        timelineEventEndpointList.addToFIFO (inputFIFO, totalFramesRendered);
+        auto blockStartFrame = totalFramesRendered.load (std::memory_order_relaxed);
+        audioInputList.setInputChannels (input);
+        midiInputList.addToFIFO (inputFIFO, blockStartFrame, midiIn);
+        parameterList.addToFIFO (inputFIFO, blockStartFrame, numFrames);
+        timelineEventEndpointList.addToFIFO (inputFIFO, blockStartFrame);
         uint32_t framesDone = 0;
+        std::optional<TraceRecorder::ScopedEvent> chunkEvent;
 
-        inputFIFO.iterateChunks (totalFramesRendered,
+        inputFIFO.iterateChunks (blockStartFrame,
                                  numFrames, maxBlockSize,
                                  [&] (uint32_t numFramesToDo)
                                  {
+                                     chunkEvent.emplace ("render", "chunk", numFramesToDo);
                                      performer.prepare (numFramesToDo);
+                                     audioInputList.setPerformerInputFrames (performer, framesDone, numFramesToDo);
                                  },
                                  [&] (EndpointHandle endpoint, uint64_t /*itemStart*/, const choc::value::ValueView& value)
                                  {
@@ -645,11 +771,12 @@ struct AudioMIDIWrapper
                                      performer.advance();
                                      audioOutputList.handleOutputData (performer, output.getFrameRange ({ framesDone, output.size.numFrames }));
                                      midiOutputList.handleOutputData (performer, framesDone, midiOut);
-                                     eventOutputList.postOutputEvents (performer, totalFramesRendered + framesDone);
+                                     eventOutputList.postOutputEvents (performer, blockStartFrame + framesDone);
                                      framesDone += numFramesDone;
+                                     chunkEvent.reset();
                                  });
 
-        totalFramesRendered += framesDone;
+        totalFramesRendered.store (blockStartFrame + framesDone, std::memory_order_relaxed);
     }
 
     void renderInChunks (choc::buffer::ChannelArrayView<const float> input,
@@ -700,12 +827,29 @@ struct AudioMIDIWrapper
         }
     }
 
+    /** By default, each event is delivered at exactly its own frame, so the block gets split into
+        a separate prepare() and advance() at every distinct event time. Under heavy controller
+        traffic, this lets the timing be relaxed to keep the number of chunks down: event times
+        can be rounded down to a grid of quantisationFrames, and chunks can be made at least
+        minimumChunkFrames long, with any events inside a chunk being delivered at its start.
+        Stream data, including ramped parameter changes, still starts at its exact frame.
+        Passing 1 for both restores the sample-accurate default.
+    */
+    void setEventTiming (uint32_t quantisationFrames, uint32_t minimumChunkFrames)
+    {
+        inputFIFO.setChunkTiming (quantisationFrames, minimumChunkFrames);
+    }
+
     uint32_t getExpectedNumInputChannels() const     { return audioInputList.totalNumChannels; }
     uint32_t getExpectedNumOutputChannels() const    { return audioOutputList.totalNumChannels; }
 
+    /** Queues an event to be delivered at the start of the next block, or at the start of
+        the block being rendered if that hasn't reached its events yet. This can be called
+        by any thread.
+    */
     bool postInputEvent (EndpointHandle endpoint, const choc::value::ValueView& value)
     {
-        return inputFIFO.addInputData (endpoint, totalFramesRendered, value);
+        return inputFIFO.addInputData (endpoint, totalFramesRendered.load (std::memory_order_relaxed), value);
     }
 
     template <typename HandleEventFn>
@@ -714,7 +858,7 @@ struct AudioMIDIWrapper
         eventOutputList.deliverPendingEvents (handleEvent);
     }
 
-    MultiEndpointFIFO inputFIFO;
+    MultiProducerEndpointFIFO inputFIFO;
 
     ParameterStateList parameterList;
     TimelineEventEndpointList timelineEventEndpointList;
@@ -729,7 +873,7 @@ private:
     MIDIOutputList   midiOutputList;
     EventOutputList  eventOutputList;
 
-    uint64_t totalFramesRendered = 0;
+    std::atomic<uint64_t> totalFramesRendered { 0 };
     uint32_t maxBlockSize = 0;
 
     static constexpr uint32_t maxInternalBlockSize = 512;
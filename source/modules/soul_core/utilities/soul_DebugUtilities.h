@@ -65,3 +65,7 @@ namespace soul
 #else
  #define SOUL_NO_SIGNED_INTEGER_OVERFLOW_WARNING
 #endif
+
+// Joins two tokens after expanding them, e.g. to make a unique name from __LINE__
+#define SOUL_CONCAT_INNER(a, b)  a ## b
+#define SOUL_CONCAT(a, b)        SOUL_CONCAT_INNER (a, b)
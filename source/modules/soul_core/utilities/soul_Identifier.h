@@ -41,6 +41,10 @@ struct Identifier  final
     bool operator!= (std::string_view other) const                  { SOUL_ASSERT (isValid()); return *name != other; }
 
     //==============================================================================
+    /** Interns strings so that each one is only stored once.
+        The strings live in fixed-size chunks so that their addresses never change,
+        and are found with an open-addressed hash index.
+    */
     struct Pool  final
     {
         Pool() = default;
@@ -51,36 +55,18 @@ struct Identifier  final
         {
             SOUL_ASSERT (! newString.empty());
 
-            size_t s = 0;
-            size_t e = strings.size();
+            if (numStrings * 2 >= slots.size())
+                growIndex();
 
-            while (s < e)
-            {
-                auto* elem = strings[s].get();
-
-                if (*elem == newString)
-                    return Identifier (elem);
-
-                auto halfway = (s + e) / 2;
-                bool isBeforeHalfway = (newString < *strings[halfway]);
+            auto& slot = findSlot (newString);
 
-                if (halfway == s)
-                {
-                    if (! isBeforeHalfway)
-                        ++s;
-
-                    break;
-                }
-
-                if (isBeforeHalfway)
-                    e = halfway;
-                else
-                    s = halfway;
+            if (slot == nullptr)
+            {
+                slot = allocateString (newString);
+                ++numStrings;
             }
 
-            auto* sharedString = new std::string (newString);
-            strings.insert (strings.begin() + (int) s, std::unique_ptr<std::string> (sharedString));
-            return Identifier (sharedString);
+            return Identifier (slot);
         }
 
         Identifier get (const Identifier& i)
@@ -93,11 +79,55 @@ struct Identifier  final
 
         void clear()
         {
-            strings.clear();
+            chunks.clear();
+            slots.clear();
+            numStrings = 0;
+            numUsedInLastChunk = chunkSize;
         }
 
     private:
-        std::vector<std::unique_ptr<std::string>> strings;
+        static constexpr size_t chunkSize = 256;
+
+        std::vector<std::unique_ptr<std::string[]>> chunks;
+        std::vector<const std::string*> slots;
+        size_t numStrings = 0, numUsedInLastChunk = chunkSize;
+
+        const std::string*& findSlot (std::string_view s)
+        {
+            auto mask = slots.size() - 1;
+
+            for (auto i = std::hash<std::string_view>() (s) & mask;; i = (i + 1) & mask)
+            {
+                auto& slot = slots[i];
+
+                if (slot == nullptr || *slot == s)
+                    return slot;
+            }
+        }
+
+        void growIndex()
+        {
+            auto oldSlots = std::move (slots);
+            slots.clear();
+            slots.resize (std::max (static_cast<size_t> (64), oldSlots.size() * 2));
+
+            for (auto s : oldSlots)
+                if (s != nullptr)
+                    findSlot (*s) = s;
+        }
+
+        const std::string* allocateString (std::string_view s)
+        {
+            if (numUsedInLastChunk == chunkSize)
+            {
+                chunks.push_back (std::make_unique<std::string[]> (chunkSize));
+                numUsedInLastChunk = 0;
+            }
+
+            auto& newString = chunks.back()[numUsedInLastChunk++];
+            newString = s;
+            return std::addressof (newString);
+        }
     };
 
 private:
@@ -27,33 +27,75 @@ namespace soul
 //==============================================================================
 /**
     Manages a FIFO containing a set of data chunks being sent to or from endpoints.
+
+    The FIFOType is the underlying queue of variable-sized items, which decides how many
+    threads can add data at once - see MultiEndpointFIFO and MultiProducerEndpointFIFO.
+    No space is allocated until reset() is called.
 */
-struct MultiEndpointFIFO
+template <typename FIFOType>
+struct MultiEndpointFIFOImpl
 {
-    MultiEndpointFIFO()
+    MultiEndpointFIFOImpl()
     {
         incomingItemAllocator = std::make_unique<LocalAllocator<incomingItemAllocationSpace>>();
-        reset (256 * 1024, 2048);
     }
 
-    ~MultiEndpointFIFO() = default;
+    ~MultiEndpointFIFOImpl() = default;
 
+    /** Empties the FIFO and also clears any types that were registered. */
     void reset (uint32_t fifoSize, uint32_t maxNumIncomingItems)
     {
         fifo.reset (fifoSize);
         incomingItems.resize (maxNumIncomingItems);
+        registeredTypes.clear();
+    }
+
+    /** Registers a type that will be sent to an endpoint.
+        Items of a registered type are stored as just their time, endpoint and data, and are read
+        back as views using the registered type, which saves serialising and deserialising the
+        type for every item. Items of any other type can still be added, but will take the slower
+        path, as will types containing strings or arrays of objects. This must be called before
+        any other thread starts using the FIFO.
+    */
+    void registerEndpointType (soul::EndpointHandle endpoint, const choc::value::Type& type)
+    {
+        if (canBeRegistered (type) && findRegisteredType (endpoint, type) == unregisteredType)
+            registeredTypes.insert (findFirstTypeForEndpoint (endpoint), { endpoint, type, choc::value::Value (type) });
+    }
+
+    void registerEndpointTypes (soul::EndpointHandle endpoint, ArrayView<const choc::value::Type> types)
+    {
+        for (auto& type : types)
+            registerEndpointType (endpoint, type);
+    }
+
+    /** Lets iterateChunks() trade some timing accuracy for fewer, longer chunks.
+        Event and value item times are rounded down to a multiple of quantisationFrames, and a block
+        is never split less than minimumChunkFrames after the start of the previous chunk, so one of
+        those items which falls inside a chunk is delivered at its start. Stream items are frames of
+        audio that get written from the start of a chunk, so they always start a new chunk at their
+        exact frame. The default of 1 for both keeps every item sample-accurate.
+    */
+    void setChunkTiming (uint32_t quantisationFrames, uint32_t minimumChunkFrames)
+    {
+        chunkQuantisation = std::max (1u, quantisationFrames);
+        minimumChunkLength = std::max (1u, minimumChunkFrames);
     }
 
     bool addInputData (soul::EndpointHandle endpoint, uint64_t time,
                        const choc::value::ValueView& value)
     {
         ScratchWriter scratch;
+        auto& type = value.getType();
+        auto typeIndex = findRegisteredType (endpoint, type);
 
         scratch.write (std::addressof (time), sizeof (time));
         scratch.write (std::addressof (endpoint), sizeof (endpoint));
+        scratch.write (std::addressof (typeIndex), sizeof (typeIndex));
+
+        if (typeIndex == unregisteredType)
+            type.serialise (scratch);
 
-        auto& type = value.getType();
-        type.serialise (scratch);
         auto startOfValueData = scratch.dest;
 
         if (! type.isVoid())
@@ -83,6 +125,7 @@ struct MultiEndpointFIFO
                         HandleItem&& handleItem,
                         HandleEndOfChunk&& handleEndOfChunk)
     {
+        SOUL_TRACE_SCOPE ("render", "MultiEndpointFIFO::iterateChunks");
         uint32_t numItems = 0;
         bool success = true;
         incomingItemAllocator->reset();
@@ -126,7 +169,7 @@ struct MultiEndpointFIFO
                                   uint64_t absoluteTime = 0;
 
                                   if (readIncomingItem (item, { d, d + size }, 0, absoluteTime))
-                                      handleItem (item.endpoint, absoluteTime, item.value);
+                                      handleItem (item.endpoint, absoluteTime, getItemValue (item));
                                   else
                                       success = false;
                               },
@@ -147,12 +190,21 @@ private:
         const char* start = {};
     };
 
+    struct RegisteredType
+    {
+        soul::EndpointHandle endpoint;
+        choc::value::Type type;
+        choc::value::Value objectHolder;
+    };
+
     struct Item
     {
         uint32_t startFrame, numFrames;
         soul::EndpointHandle endpoint;
         choc::value::ValueView value;
         IncomingStringDictionary dictionary;
+        RegisteredType* registeredObject = nullptr;
+        const void* objectData = nullptr;
     };
 
     struct ScratchWriter
@@ -213,9 +265,56 @@ private:
         std::array<char, totalSize> pool;
     };
 
-    choc::fifo::VariableSizeFIFO fifo;
+    static constexpr uint32_t unregisteredType = 0xffffffffu;
+
+    FIFOType fifo;
     std::unique_ptr<LocalAllocator<incomingItemAllocationSpace>> incomingItemAllocator;
     std::vector<Item> incomingItems;
+    std::vector<RegisteredType> registeredTypes;
+    uint32_t chunkQuantisation = 1, minimumChunkLength = 1;
+
+    // Copying an object type needs an allocation, so views of registered objects are made by
+    // copying their data into a holder at the point they're delivered. Types with strings need
+    // a dictionary for each item, and arrays of objects can't be held like that, so neither of
+    // those are registered.
+    static bool canBeRegistered (const choc::value::Type& type)
+    {
+        if (type.usesStrings())
+            return false;
+
+        if (type.isArray())
+            return type.isUniformArray() && (type.getElementType().isPrimitive() || type.getElementType().isVector());
+
+        return ! type.isVoid();
+    }
+
+    static const choc::value::ValueView& getItemValue (Item& item)
+    {
+        if (auto registered = item.registeredObject)
+        {
+            std::memcpy (registered->objectHolder.getRawData(), item.objectData, registered->objectHolder.getRawDataSize());
+            return registered->objectHolder.getView();
+        }
+
+        return item.value;
+    }
+
+    // The table is kept sorted by endpoint, so that a lookup only has to compare the types
+    // registered for that endpoint
+    typename std::vector<RegisteredType>::const_iterator findFirstTypeForEndpoint (soul::EndpointHandle endpoint) const
+    {
+        return std::lower_bound (registeredTypes.begin(), registeredTypes.end(), endpoint,
+                                 [] (const RegisteredType& r, soul::EndpointHandle e) { return r.endpoint.getRawHandle() < e.getRawHandle(); });
+    }
+
+    uint32_t findRegisteredType (soul::EndpointHandle endpoint, const choc::value::Type& type) const
+    {
+        for (auto i = findFirstTypeForEndpoint (endpoint); i != registeredTypes.end() && i->endpoint.getRawHandle() == endpoint.getRawHandle(); ++i)
+            if (i->endpoint == endpoint && i->type == type)
+                return static_cast<uint32_t> (i - registeredTypes.begin());
+
+        return unregisteredType;
+    }
 
     struct DictionaryBuilder
     {
@@ -299,27 +398,56 @@ private:
             uint64_t time;
             read (reader, time);
 
-            if (time >= startFrameNumber)
+            // An item that was timed for a block which has already been rendered (e.g. an event
+            // posted by another thread while that block was running) is delivered at the start
+            // of this block rather than being lost
+            absoluteTime = std::max (time, startFrameNumber);
+            item.startFrame = static_cast<uint32_t> (absoluteTime - startFrameNumber);
+            read (reader, item.endpoint);
+
+            uint32_t typeIndex;
+            read (reader, typeIndex);
+            item.registeredObject = nullptr;
+
+            if (typeIndex != unregisteredType)
             {
-                absoluteTime = time;
-                item.startFrame = static_cast<uint32_t> (time - startFrameNumber);
-                read (reader, item.endpoint);
+                if (typeIndex >= registeredTypes.size())
+                    return false;
+
+                auto& registered = registeredTypes[typeIndex];
 
-                auto type = choc::value::Type::deserialise (reader, incomingItemAllocator.get());
-                auto dataSize = type.getValueDataSize();
+                if (reader.start + registered.type.getValueDataSize() > reader.end)
+                    return false;
 
-                if (reader.start + dataSize <= reader.end)
+                if (registered.type.isObject())
                 {
-                    item.dictionary.start = reinterpret_cast<const char*> (reader.start + dataSize);
-                    item.value = choc::value::ValueView (std::move (type), const_cast<uint8_t*> (reader.start), std::addressof (item.dictionary));
+                    item.registeredObject = std::addressof (registered);
+                    item.objectData = reader.start;
+                    item.numFrames = 1;
+                }
+                else
+                {
+                    item.value = choc::value::ValueView (registered.type, const_cast<uint8_t*> (reader.start), nullptr);
+                    item.numFrames = item.value.isArray() ? item.value.getType().getNumElements() : 1;
+                }
 
-                    if (item.value.isArray())
-                        item.numFrames = item.value.getType().getNumElements();
-                    else
-                        item.numFrames = 1;
+                return true;
+            }
 
-                    return true;
-                }
+            auto type = choc::value::Type::deserialise (reader, incomingItemAllocator.get());
+            auto dataSize = type.getValueDataSize();
+
+            if (reader.start + dataSize <= reader.end)
+            {
+                item.dictionary.start = reinterpret_cast<const char*> (reader.start + dataSize);
+                item.value = choc::value::ValueView (std::move (type), const_cast<uint8_t*> (reader.start), std::addressof (item.dictionary));
+
+                if (item.value.isArray())
+                    item.numFrames = item.value.getType().getNumElements();
+                else
+                    item.numFrames = 1;
+
+                return true;
             }
         }
         catch (const choc::value::Error&) {}
@@ -330,12 +458,23 @@ private:
     uint32_t findOffsetOfNextItemAfter (const Item* items, uint32_t numItems, uint32_t startFrame, uint32_t endFrame)
     {
         auto lowest = endFrame;
+        auto earliest = startFrame + minimumChunkLength;
 
         for (uint32_t i = 0; i < numItems; ++i)
         {
             auto frame = items[i].startFrame;
 
-            if (frame < lowest && frame > startFrame)
+            if (items[i].endpoint.isStream())
+            {
+                if (frame < lowest && frame > startFrame)
+                    lowest = frame;
+
+                continue;
+            }
+
+            frame -= frame % chunkQuantisation;
+
+            if (frame < lowest && frame >= earliest)
                 lowest = frame;
         }
 
@@ -382,7 +521,7 @@ private:
                     }
                     else
                     {
-                        handleItem (item.endpoint, itemStart, static_cast<const choc::value::ValueView&> (item.value));
+                        handleItem (item.endpoint, itemStart, getItemValue (item));
                     }
                 }
             }
@@ -393,4 +532,13 @@ private:
     }
 };
 
+/** A MultiEndpointFIFO which only one thread at a time may add data to. */
+using MultiEndpointFIFO = MultiEndpointFIFOImpl<choc::fifo::VariableSizeFIFO>;
+
+/** A MultiEndpointFIFO which any number of threads can add data to without locking. Items
+    added by different threads aren't kept in order relative to each other, so this is
+    for data that carries its own timestamps.
+*/
+using MultiProducerEndpointFIFO = MultiEndpointFIFOImpl<MultiProducerFIFO>;
+
 } // namespace soul
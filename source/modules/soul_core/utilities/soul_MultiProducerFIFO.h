@@ -0,0 +1,285 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    A FIFO of variable-sized items which many threads can write to at once without
+    blocking each other, and which a single thread reads.
+
+    Each writing thread claims its own single-writer ring the first time it pushes, so
+    writers never contend for a lock or a shared write position, and the reader merges
+    the items from all the rings. Items from one thread stay in order, but there's no
+    ordering between items from different threads.
+
+    The space given to reset() is allocated in one block and shared out equally between
+    maxNumProducers rings plus one fallback ring, each getting at least minRingSize bytes,
+    so a single thread can only have its share of the space in use at once. Pushing
+    never allocates.
+
+    A thread gives its rings back when it exits, so threads that come and go don't use
+    up the rings. Any thread that can't have its own ring pushes to the fallback ring
+    instead, taking a spin lock to do so: either because more than maxNumProducers
+    threads are writing to the same FIFO at once, or because the thread is already
+    writing to more than maxFIFOsPerThread of these FIFOs.
+
+    It has the same interface as choc::fifo::VariableSizeFIFO, and the same caveat that
+    an item can't be split across the end of a ring, so an item that's more than about
+    half a ring's size may not fit even when the ring is empty. Nothing can be pushed
+    until reset() is called.
+*/
+struct MultiProducerFIFO
+{
+    MultiProducerFIFO()  : claimFlags (std::make_shared<ClaimFlags>()) {}
+    ~MultiProducerFIFO()  { claimFlags->isRetired.store (true, std::memory_order_release); }
+
+    static constexpr uint32_t maxNumProducers = 16;
+    static constexpr uint32_t maxFIFOsPerThread = 16;
+
+    /** The smallest size that a ring will be given, which is enough for four of the largest
+        items that MultiEndpointFIFO can send.
+    */
+    static constexpr uint32_t minRingSize = 16384;
+
+    /** Resets the FIFO, sharing out the given number of bytes between its rings.
+        This must only be called when nothing else is pushing or popping. Threads keep
+        the rings they've already claimed.
+    */
+    void reset (uint32_t totalSizeBytes)
+    {
+        auto ringSize = std::max (totalSizeBytes / numRings, minRingSize);
+        ringStorage.reset (new char[static_cast<size_t> (ringSize + Ring::headerSize) * numRings]);
+
+        for (uint32_t i = 0; i < numRings; ++i)
+            rings[i].setBuffer (ringStorage.get() + static_cast<size_t> (ringSize + Ring::headerSize) * i, ringSize);
+    }
+
+    /** Pushes a chunk of data onto the calling thread's ring.
+        Returns false if the item didn't fit, or if numBytes is 0.
+    */
+    bool push (const void* sourceData, uint32_t numBytes)
+    {
+        if (numBytes == 0)
+            return false;
+
+        if (auto ring = getRingForThisThread())
+            return ring->push (sourceData, numBytes);
+
+        std::lock_guard<decltype (sharedRingLock)> l (sharedRingLock);
+        return rings[sharedRingIndex].push (sourceData, numBytes);
+    }
+
+    /** Calls handleItem (const void* data, uint32_t size) for every item that is currently
+        available, and then calls itemsComplete() before the space is freed up for re-use.
+        This must only be called by the single reader thread.
+    */
+    template <typename HandleItem, typename ItemsComplete>
+    void popAllAvailable (HandleItem&& handleItem, ItemsComplete&& itemsComplete)
+    {
+        uint32_t newReadPositions[numRings];
+
+        for (uint32_t i = 0; i < numRings; ++i)
+            newReadPositions[i] = rings[i].readAll (handleItem);
+
+        itemsComplete();
+
+        for (uint32_t i = 0; i < numRings; ++i)
+            rings[i].readPos.store (newReadPositions[i], std::memory_order_release);
+    }
+
+private:
+    //==============================================================================
+    struct Ring
+    {
+        using ItemHeader = uint32_t; // 0 = skip to the start of the buffer
+        static constexpr uint32_t headerSize = static_cast<uint32_t> (sizeof (ItemHeader));
+
+        char* buffer = nullptr;
+        uint32_t capacity = 0;
+        std::atomic<uint32_t> readPos { 0 }, writePos { 0 };
+
+        // An item never ends exactly at the capacity, so that a full ring can't look empty,
+        // and the buffer has an extra header's worth of space to leave room for a skip
+        // marker written by an item that has to wrap.
+        void setBuffer (char* newBuffer, uint32_t size)
+        {
+            buffer = newBuffer;
+            capacity = size;
+            readPos = 0;
+            writePos = 0;
+        }
+
+        // Only ever called by the thread which has claimed the ring
+        bool push (const void* sourceData, uint32_t numBytes)
+        {
+            auto bytesNeeded = numBytes + headerSize;
+            auto destOffset = writePos.load (std::memory_order_relaxed);
+            auto currentReadPos = readPos.load (std::memory_order_acquire);
+
+            if (destOffset >= currentReadPos)
+            {
+                if (destOffset + bytesNeeded >= capacity)
+                {
+                    if (bytesNeeded >= currentReadPos)
+                        return false;
+
+                    std::fill (buffer + destOffset, buffer + destOffset + headerSize, 0);
+                    destOffset = 0;
+                }
+            }
+            else if (destOffset + bytesNeeded >= currentReadPos)
+            {
+                return false;
+            }
+
+            auto dest = buffer + destOffset;
+            auto header = static_cast<ItemHeader> (numBytes);
+            std::memcpy (dest, std::addressof (header), headerSize);
+            std::memcpy (dest + headerSize, sourceData, numBytes);
+            writePos.store (destOffset + bytesNeeded, std::memory_order_release);
+            return true;
+        }
+
+        // Passes every available item to the handler, and returns the read position that
+        // should be stored once the caller has finished with their data
+        template <typename HandleItem>
+        uint32_t readAll (HandleItem& handleItem)
+        {
+            auto newReadPos = readPos.load (std::memory_order_relaxed);
+            auto endPos = writePos.load (std::memory_order_acquire);
+
+            while (newReadPos != endPos)
+            {
+                auto itemData = buffer + newReadPos;
+                ItemHeader itemSize;
+                std::memcpy (std::addressof (itemSize), itemData, headerSize);
+
+                if (itemSize != 0)
+                {
+                    handleItem (static_cast<const void*> (itemData + headerSize), itemSize);
+                    newReadPos += itemSize + headerSize;
+                }
+                else
+                {
+                    newReadPos = 0;
+                }
+            }
+
+            return newReadPos;
+        }
+    };
+
+    // The last ring is shared by any threads which don't have one of their own
+    static constexpr uint32_t sharedRingIndex = maxNumProducers;
+    static constexpr uint32_t numRings = maxNumProducers + 1;
+
+    // Only these flags are shared with the threads that have claimed rings, so that a thread
+    // which outlives the FIFO can still safely give its ring back. The ring buffers belong to
+    // the FIFO alone.
+    struct ClaimFlags
+    {
+        ClaimFlags()
+        {
+            for (auto& c : isClaimed)
+                c.store (false);
+        }
+
+        std::atomic<bool> isClaimed[maxNumProducers];
+        std::atomic<bool> isRetired { false };
+    };
+
+    struct ThreadClaims
+    {
+        ~ThreadClaims()
+        {
+            for (auto& c : claims)
+                c.release();
+        }
+
+        struct Claim
+        {
+            void release()
+            {
+                if (flags != nullptr)
+                {
+                    flags->isClaimed[ringIndex].store (false, std::memory_order_release);
+                    flags.reset();
+                }
+            }
+
+            std::shared_ptr<ClaimFlags> flags;
+            uint32_t ringIndex = 0;
+        };
+
+        std::array<Claim, maxFIFOsPerThread> claims;
+    };
+
+    static ThreadClaims& getClaimsForThisThread()
+    {
+        thread_local ThreadClaims claims;
+        return claims;
+    }
+
+    Ring* getRingForThisThread()
+    {
+        auto& threadClaims = getClaimsForThisThread();
+        ThreadClaims::Claim* freeClaim = nullptr;
+
+        for (auto& c : threadClaims.claims)
+        {
+            if (c.flags == claimFlags)
+                return std::addressof (rings[c.ringIndex]);
+
+            // Claims on FIFOs that have been deleted are dropped as soon as the thread
+            // next pushes anything, rather than waiting for the thread to exit
+            if (c.flags != nullptr && c.flags->isRetired.load (std::memory_order_acquire))
+                c.release();
+
+            if (freeClaim == nullptr && c.flags == nullptr)
+                freeClaim = std::addressof (c);
+        }
+
+        if (freeClaim == nullptr)
+            return {};
+
+        for (uint32_t i = 0; i < maxNumProducers; ++i)
+        {
+            bool wasClaimed = false;
+
+            if (claimFlags->isClaimed[i].compare_exchange_strong (wasClaimed, true, std::memory_order_acquire))
+            {
+                freeClaim->flags = claimFlags;
+                freeClaim->ringIndex = i;
+                return std::addressof (rings[i]);
+            }
+        }
+
+        return {};
+    }
+
+    std::array<Ring, numRings> rings;
+    std::unique_ptr<char[]> ringStorage;
+    std::shared_ptr<ClaimFlags> claimFlags;
+    choc::threading::SpinLock sharedRingLock;
+};
+
+} // namespace soul
@@ -249,7 +249,23 @@ public:
         return *newObject;
     }
 
+    /** Running totals for all the allocations made by any PoolAllocator on the calling
+        thread. Compare the values before and after a task to see how much it allocated.
+    */
+    struct ThreadStatistics
+    {
+        uint64_t numAllocations = 0, numBytes = 0;
+    };
+
+    static ThreadStatistics getThreadStatistics() noexcept    { return getStatisticsForThisThread(); }
+
 private:
+    static ThreadStatistics& getStatisticsForThisThread() noexcept
+    {
+        static thread_local ThreadStatistics statistics;
+        return statistics;
+    }
+
     using DestructorFn = void(void*);
 
     static constexpr const size_t poolSize = 1024 * 64 - 32;
@@ -331,7 +347,11 @@ private:
             SOUL_ASSERT (currentPool->hasSpaceFor (size));
         }
 
-        return currentPool->createItem (size);
+        auto& item = currentPool->createItem (size);
+        auto& statistics = getStatisticsForThisThread();
+        statistics.numAllocations++;
+        statistics.numBytes += item.size;
+        return item;
     }
 };
 
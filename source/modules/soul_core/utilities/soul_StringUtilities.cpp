@@ -333,6 +333,87 @@ std::string HashBuilder::toString() const
     return std::string (result, result + 32);
 }
 
+static constexpr uint64_t murmurC1 = 0x87c37b91114253d5ull, murmurC2 = 0x4cf5ad432745937full;
+
+static inline uint64_t rotateLeft (uint64_t n, int bits) noexcept    { return (n << bits) | (n >> (64 - bits)); }
+
+static inline uint64_t murmurMix (uint64_t k) noexcept
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+void HashBuilder128::processBlock (const uint8_t* block) noexcept
+{
+    auto k1 = readUnaligned<uint64_t> (block);
+    auto k2 = readUnaligned<uint64_t> (block + 8);
+
+    h1 ^= rotateLeft (k1 * murmurC1, 31) * murmurC2;
+    h1 = (rotateLeft (h1, 27) + h2) * 5 + 0x52dce729;
+    h2 ^= rotateLeft (k2 * murmurC2, 33) * murmurC1;
+    h2 = (rotateLeft (h2, 31) + h1) * 5 + 0x38495ab5;
+}
+
+void HashBuilder128::addBytes (const void* data, size_t size) noexcept
+{
+    auto source = static_cast<const uint8_t*> (data);
+    totalSize += size;
+
+    if (numPending != 0)
+    {
+        auto numToCopy = std::min (size, static_cast<size_t> (16 - numPending));
+        memcpy (pending + numPending, source, numToCopy);
+        numPending += static_cast<uint32_t> (numToCopy);
+        source += numToCopy;
+        size -= numToCopy;
+
+        if (numPending < 16)
+            return;
+
+        processBlock (pending);
+        numPending = 0;
+    }
+
+    for (; size >= 16; size -= 16, source += 16)
+        processBlock (source);
+
+    memcpy (pending, source, size);
+    numPending = static_cast<uint32_t> (size);
+}
+
+std::string HashBuilder128::toString() const
+{
+    uint64_t k1 = 0, k2 = 0, a = h1, b = h2;
+
+    for (uint32_t i = numPending; i > 8; --i)  k2 = (k2 << 8) | pending[i - 1];
+    for (uint32_t i = std::min (numPending, 8u); i > 0; --i)  k1 = (k1 << 8) | pending[i - 1];
+
+    if (numPending > 8)  b ^= rotateLeft (k2 * murmurC2, 33) * murmurC1;
+    if (numPending > 0)  a ^= rotateLeft (k1 * murmurC1, 31) * murmurC2;
+
+    a ^= totalSize;
+    b ^= totalSize;
+    a += b;
+    b += a;
+    a = murmurMix (a);
+    b = murmurMix (b);
+    a += b;
+    b += a;
+
+    std::string result;
+    result.reserve (32);
+
+    for (auto n : { a, b })
+        for (int shift = 60; shift >= 0; shift -= 4)
+            result += "0123456789abcdef"[(n >> shift) & 15];
+
+    return result;
+}
+
 std::string toCppStringLiteral (const std::string& text,
                                 int maxCharsOnLine, bool breakAtNewLines,
                                 bool replaceSingleQuotes, bool allowStringBreaks)
@@ -165,5 +165,32 @@ private:
     uint32_t index = 0;
 };
 
+//==============================================================================
+/** A streaming 128-bit hash of arbitrary binary data (MurmurHash3, x64 variant).
+    The result only depends on the sequence of bytes added, not on how they were
+    split across calls, so it's stable enough to use as a persistent cache key.
+*/
+struct HashBuilder128
+{
+    void addBytes (const void* data, size_t size) noexcept;
+
+    template <typename Type>
+    void add (Type value) noexcept
+    {
+        static_assert (std::is_trivially_copyable<Type>::value);
+        addBytes (std::addressof (value), sizeof (Type));
+    }
+
+    /** Returns the hash as a 32-character hex string. */
+    std::string toString() const;
+
+private:
+    uint64_t h1 = 0, h2 = 0, totalSize = 0;
+    uint8_t pending[16] = {};
+    uint32_t numPending = 0;
+
+    void processBlock (const uint8_t*) noexcept;
+};
+
 
 } // namespace soul
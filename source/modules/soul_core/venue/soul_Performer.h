@@ -255,4 +255,17 @@ public:
     virtual std::unique_ptr<Performer> createPerformer() = 0;
 };
 
+//==============================================================================
+/** Creates a factory for performers which run programs by interpreting their HEART code.
+    This is portable and needs no JIT compiler, but is much slower than native code.
+*/
+std::unique_ptr<PerformerFactory> createInterpreterPerformerFactory();
+
+/** Creates a factory for performers which compile the HEART code into a register bytecode
+    for a fast threaded interpreter. Like the plain interpreter, this needs no JIT compiler.
+    If a LinkerCache is passed to link(), the compiled bytecode is stored in it and reused
+    when the same program is linked again.
+*/
+std::unique_ptr<PerformerFactory> createBytecodePerformerFactory();
+
 } // namespace soul
@@ -247,6 +247,7 @@ struct ThreadedVenue  : public soul::Venue
             {
                 while (! shouldStop.load())
                 {
+                    SOUL_TRACE_SCOPE ("render", "ThreadedVenueSession::run");
                     loadMeasurer.startMeasurement();
                     performer->prepare (blockSize);
 
@@ -494,6 +494,11 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
             paramList.setParameter (paramIndex, value);
         }
 
+        bool addAutomationPoint (uint64_t frameIndex, float newValue) override
+        {
+            return paramList.addAutomationPoint (paramIndex, frameIndex, snapToLegalValue (newValue));
+        }
+
         void markAsDirty()
         {
             paramList.markAsChanged (paramIndex);
@@ -0,0 +1,198 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Builds programs with a soul::CompileProfile, and prints the average time spent in each
+    stage of the build. It's used to see how much of a link could be shared between
+    threads: the last lines show the time taken by each stage which works on one module or
+    one function at a time, and how much an ideal split of all that work over 8 threads
+    would save. That's an upper bound, because the cost-based inliner visits functions
+    callees-first, so it can't be split up completely.
+
+    With no arguments, it builds synthetic graphs of 16 and 64 distinct processors. Any
+    arguments are taken as the .soul files of a single program to build instead.
+
+    Build and run from the root of the repository with:
+
+        g++ -std=c++17 -O2 -DNDEBUG -pthread -Iinclude tools/benchmarks/CompileProfile_Benchmark.cpp source/modules/soul_core/soul_core.cpp -ldl -o compile_benchmark
+        ./compile_benchmark
+        ./compile_benchmark examples/patches/PadSynth/PadSynth.soul
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../source/modules/soul_core/soul_core.h"
+
+static constexpr int numRepeats = 10;
+static constexpr int optimisationLevel = 3;
+static constexpr double numThreads = 8;
+
+// The link stages which loop over the program's modules or functions, doing the same work
+// on each of them
+static const char* const perModuleOrFunctionStages[] =
+{
+    "HEARTGenerator",
+    "inlineFunctionsByCost",
+    "optimiseFunctionBlocks",
+    "DataflowOptimisations",
+    "StreamLoopVectoriser",
+    "removeUnusedVariables"
+};
+
+// Each processor is a little different, so that none of them can be shared between instances
+static std::string createSyntheticGraph (int numProcessors)
+{
+    std::ostringstream code;
+
+    for (int i = 0; i < numProcessors; ++i)
+        code << "processor Stage" << i << R"(
+{
+    input stream float in;
+    input event float cutoff [[ name: "Cutoff )" << i << R"(", min: 20, max: 20000, init: 1000 ]];
+    output stream float out;
+
+    float coeff = 0.1f, state1, state2;
+
+    event cutoff (float f)    { coeff = clamp (f / float (processor.frequency), 0.0f, 0.49f) * )" << (i + 1) << R"(.0f; }
+
+    float shape (float x)     { return x + )" << (i % 7) << R"(.0f * x * x * x / (1.0f + abs (x)); }
+
+    void run()
+    {
+        loop
+        {
+            state1 += coeff * (in - state1);
+            state2 += coeff * (state1 - state2);
+            out << shape (state2 * )" << (i % 5 + 1) << R"(.0f);
+            advance();
+        }
+    }
+}
+)";
+
+    code << "graph Chain [[ main ]]\n{\n    input stream float in;\n    output stream float out;\n\n    let\n    {\n";
+
+    for (int i = 0; i < numProcessors; ++i)
+        code << "        s" << i << " = Stage" << i << ";\n";
+
+    code << "    }\n\n    connection\n    {\n        in -> s0.in;\n";
+
+    for (int i = 1; i < numProcessors; ++i)
+        code << "        s" << (i - 1) << ".out -> s" << i << ".in;\n";
+
+    code << "        s" << (numProcessors - 1) << ".out -> out;\n    }\n}\n";
+    return code.str();
+}
+
+static std::string loadFile (const std::string& filename)
+{
+    std::ifstream stream (filename);
+    std::ostringstream content;
+    content << stream.rdbuf();
+    return content.str();
+}
+
+static bool isLinkStage (const std::string& path, const std::string& name)
+{
+    return path == "build/link/" + name;
+}
+
+static void profileBuild (const std::string& description, const soul::SourceFiles& files)
+{
+    soul::BuildBundle bundle;
+    bundle.sourceFiles = files;
+    bundle.settings.sampleRate = 44100;
+    bundle.settings.maxBlockSize = 512;
+    bundle.settings.optimisationLevel = optimisationLevel;
+
+    soul::CompileProfile profile;
+
+    for (int i = 0; i < numRepeats; ++i)
+    {
+        soul::CompileMessageList messages;
+        soul::Compiler::build (messages, bundle, profile);
+
+        if (messages.hasErrors())
+        {
+            std::printf ("%s failed to compile:\n%s\n", description.c_str(), messages.toString().c_str());
+            return;
+        }
+    }
+
+    std::printf ("%s, average of %d builds at -O%d\n\n", description.c_str(), numRepeats, optimisationLevel);
+    std::printf ("%10s %8s   %s\n", "ms", "calls", "stage");
+
+    for (auto& stage : profile.stages)
+        std::printf ("%10.3f %8u   %s\n", stage.totalSeconds * 1000.0 / numRepeats, stage.numCalls / numRepeats, stage.path.c_str());
+
+    auto toMilliseconds = [] (double seconds) { return seconds * 1000.0 / numRepeats; };
+    auto getSeconds = [&] (const char* path) { auto stage = profile.findStage (path); return stage != nullptr ? stage->totalSeconds : 0.0; };
+    auto buildSeconds = getSeconds ("build");
+    auto linkSeconds = getSeconds ("build/link");
+    double parallelisable = 0;
+
+    std::printf ("\n    whole build:                   %8.3f ms\n", toMilliseconds (buildSeconds));
+    std::printf ("    link:                          %8.3f ms\n", toMilliseconds (linkSeconds));
+
+    for (auto name : perModuleOrFunctionStages)
+    {
+        double seconds = 0;
+
+        for (auto& stage : profile.stages)
+            if (isLinkStage (stage.path, name))
+                seconds += stage.totalSeconds;
+
+        std::printf ("      %-28s %8.3f ms\n", name, toMilliseconds (seconds));
+        parallelisable += seconds;
+    }
+
+    auto saving = parallelisable * (1.0 - 1.0 / numThreads);
+
+    std::printf ("    all of those stages:           %8.3f ms (%.1f%% of the link)\n", toMilliseconds (parallelisable),
+                 linkSeconds > 0 ? 100.0 * parallelisable / linkSeconds : 0.0);
+    std::printf ("    ideal saving over %.0f threads:   %8.3f ms (%.1f%% of the link, %.1f%% of the build)\n\n", numThreads,
+                 toMilliseconds (saving),
+                 linkSeconds > 0 ? 100.0 * saving / linkSeconds : 0.0,
+                 buildSeconds > 0 ? 100.0 * saving / buildSeconds : 0.0);
+}
+
+int main (int argc, char** argv)
+{
+    if (argc > 1)
+    {
+        soul::SourceFiles files;
+
+        for (int i = 1; i < argc; ++i)
+            files.push_back ({ argv[i], loadFile (argv[i]) });
+
+        profileBuild (argv[1], files);
+        return 0;
+    }
+
+    for (int numProcessors : { 16, 64 })
+        profileBuild ("A graph of " + std::to_string (numProcessors) + " distinct processors",
+                      { { "synthetic.soul", createSyntheticGraph (numProcessors) } });
+
+    return 0;
+}
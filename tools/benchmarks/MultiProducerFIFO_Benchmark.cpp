@@ -0,0 +1,164 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Measures push contention in the input FIFO used by AudioMIDIWrapper, comparing the
+    spin-locked choc::fifo::VariableSizeFIFO with soul::MultiProducerFIFO for 1 to 16
+    producer threads, while one consumer thread drains the FIFO continuously.
+
+    Each call to push() is timed on its own. A producer which finds the FIFO full yields
+    and tries again, and those retries are counted separately, because they depend on how
+    much space each producer gets rather than on contention between the producers.
+
+    Build and run from the root of the repository with:
+
+        g++ -std=c++17 -O2 -pthread -Iinclude tools/benchmarks/MultiProducerFIFO_Benchmark.cpp -o fifo_benchmark
+        ./fifo_benchmark
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "soul/3rdParty/choc/containers/choc_VariableSizeFIFO.h"
+#include "../../source/modules/soul_core/utilities/soul_MultiProducerFIFO.h"
+
+static constexpr uint32_t itemSize = 32;
+static constexpr uint32_t itemsPerProducer = 200000;
+static constexpr uint32_t fifoSize = 512 * 512;
+
+struct Result
+{
+    double averageNanosecondsPerPush = 0;
+    double worstPushMicroseconds = 0;
+    double percentagePushesFull = 0;
+};
+
+template <typename FIFOType>
+static Result runBenchmark (uint32_t numProducers)
+{
+    using Clock = std::chrono::steady_clock;
+
+    FIFOType fifo;
+    fifo.reset (fifoSize);
+
+    std::atomic<uint32_t> numProducersFinished { 0 };
+    std::atomic<bool> startFlag { false };
+    std::vector<double> totalNanoseconds (numProducers), worstNanoseconds (numProducers);
+    std::vector<uint64_t> numCalls (numProducers);
+    std::vector<std::thread> producers;
+
+    std::thread consumer ([&]
+    {
+        while (numProducersFinished.load() < numProducers)
+            fifo.popAllAvailable ([] (const void*, uint32_t) {}, [] {});
+
+        fifo.popAllAvailable ([] (const void*, uint32_t) {}, [] {});
+    });
+
+    for (uint32_t p = 0; p < numProducers; ++p)
+    {
+        producers.emplace_back ([&, p]
+        {
+            char item[itemSize] = {};
+            double total = 0, worst = 0;
+            uint64_t calls = 0;
+
+            while (! startFlag.load())
+                std::this_thread::yield();
+
+            for (uint32_t i = 0; i < itemsPerProducer; ++i)
+            {
+                std::memcpy (item, std::addressof (i), sizeof (i));
+
+                for (;;)
+                {
+                    auto start = Clock::now();
+                    auto succeeded = fifo.push (item, itemSize);
+                    auto elapsed = std::chrono::duration<double, std::nano> (Clock::now() - start).count();
+
+                    total += elapsed;
+                    worst = std::max (worst, elapsed);
+                    ++calls;
+
+                    if (succeeded)
+                        break;
+
+                    std::this_thread::yield();
+                }
+            }
+
+            totalNanoseconds[p] = total;
+            worstNanoseconds[p] = worst;
+            numCalls[p] = calls;
+            ++numProducersFinished;
+        });
+    }
+
+    startFlag = true;
+
+    for (auto& t : producers)
+        t.join();
+
+    consumer.join();
+
+    Result result;
+    uint64_t totalCalls = 0;
+
+    for (uint32_t p = 0; p < numProducers; ++p)
+        totalCalls += numCalls[p];
+
+    for (uint32_t p = 0; p < numProducers; ++p)
+    {
+        result.averageNanosecondsPerPush += totalNanoseconds[p] / static_cast<double> (totalCalls);
+        result.worstPushMicroseconds = std::max (result.worstPushMicroseconds, worstNanoseconds[p] / 1000.0);
+    }
+
+    auto numItems = static_cast<double> (itemsPerProducer) * numProducers;
+    result.percentagePushesFull = 100.0 * (static_cast<double> (totalCalls) - numItems) / static_cast<double> (totalCalls);
+
+    return result;
+}
+
+int main()
+{
+    std::printf ("%u-byte items, %u per producer, %u hardware threads\n\n",
+                 itemSize, itemsPerProducer, std::thread::hardware_concurrency());
+    std::printf ("             spin-locked                      per-thread rings\n");
+    std::printf ("producers    ns/push  worst us  %% full         ns/push  worst us  %% full\n");
+
+    for (uint32_t numProducers : { 1u, 2u, 4u, 8u, 16u })
+    {
+        auto locked = runBenchmark<choc::fifo::VariableSizeFIFO> (numProducers);
+        auto rings  = runBenchmark<soul::MultiProducerFIFO> (numProducers);
+
+        std::printf ("%9u  %9.0f %9.1f %7.1f       %9.0f %9.1f %7.1f\n", numProducers,
+                     locked.averageNanosecondsPerPush, locked.worstPushMicroseconds, locked.percentagePushesFull,
+                     rings.averageNanosecondsPerPush, rings.worstPushMicroseconds, rings.percentagePushesFull);
+    }
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Compares the hash-indexed soul::StringDictionary with the linear scan that it replaced,
+    for dictionaries of 16 to 16384 strings. For each size it times adding every string,
+    looking each one up again by its text, and looking each one up by its handle.
+
+    The strings look like the names that programs put in a dictionary, with a shared prefix
+    and a numbered suffix, so that the linear scan's comparisons can't fail on the first
+    character. Lookups are made in a shuffled order.
+
+    Build and run from the root of the repository with:
+
+        g++ -std=c++17 -O2 -pthread -Iinclude tools/benchmarks/StringDictionary_Benchmark.cpp source/modules/soul_core/soul_core.cpp -ldl -o dictionary_benchmark
+        ./dictionary_benchmark
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../source/modules/soul_core/soul_core.h"
+
+/** The dictionary as it was before it was indexed: every lookup scans all the items. */
+struct LinearScanDictionary  : public choc::value::StringDictionary
+{
+    Handle getHandleForString (std::string_view text) override
+    {
+        if (text.empty())
+            return {};
+
+        for (auto& s : strings)
+            if (s.text == text)
+                return s.handle;
+
+        auto handle = Handle { nextIndex++ };
+        strings.push_back ({ handle, std::string (text) });
+        return handle;
+    }
+
+    std::string_view getStringForHandle (Handle handle) const override
+    {
+        if (handle == Handle())
+            return {};
+
+        for (auto& s : strings)
+            if (s.handle == handle)
+                return s.text;
+
+        return {};
+    }
+
+    struct Item
+    {
+        Handle handle;
+        std::string text;
+    };
+
+    std::vector<Item> strings;
+    uint32_t nextIndex = 1;
+};
+
+struct Result
+{
+    double addNanoseconds = 0, findByTextNanoseconds = 0, findByHandleNanoseconds = 0;
+};
+
+template <typename DictionaryType>
+static Result runBenchmark (const std::vector<std::string>& strings, const std::vector<uint32_t>& lookupOrder, int numRepeats)
+{
+    using Clock = std::chrono::steady_clock;
+    auto numStrings = static_cast<double> (strings.size());
+    auto nanosecondsPerItem = [&] (Clock::time_point start, int numPasses)
+    {
+        return std::chrono::duration<double, std::nano> (Clock::now() - start).count() / (numStrings * numPasses);
+    };
+
+    Result result;
+    uint64_t checksum = 0;
+
+    for (int repeat = 0; repeat < numRepeats; ++repeat)
+    {
+        DictionaryType dictionary;
+        std::vector<choc::value::StringDictionary::Handle> handles;
+        handles.reserve (strings.size());
+
+        auto start = Clock::now();
+
+        for (auto& s : strings)
+            handles.push_back (dictionary.getHandleForString (s));
+
+        result.addNanoseconds += nanosecondsPerItem (start, numRepeats);
+
+        start = Clock::now();
+
+        for (auto i : lookupOrder)
+            checksum += dictionary.getHandleForString (strings[i]).handle;
+
+        result.findByTextNanoseconds += nanosecondsPerItem (start, numRepeats);
+
+        start = Clock::now();
+
+        for (auto i : lookupOrder)
+            checksum += dictionary.getStringForHandle (handles[i]).length();
+
+        result.findByHandleNanoseconds += nanosecondsPerItem (start, numRepeats);
+    }
+
+    if (checksum == 0)
+        std::printf ("(unexpected checksum)\n");
+
+    return result;
+}
+
+int main()
+{
+    std::printf ("Average ns per operation\n\n");
+    std::printf ("             ------ linear scan ------       -------- hashed ---------\n");
+    std::printf ("   strings      add   by text  by handle        add   by text  by handle\n");
+
+    std::mt19937 random (1234);
+
+    for (uint32_t numStrings : { 16u, 64u, 256u, 1024u, 4096u, 16384u })
+    {
+        std::vector<std::string> strings;
+        std::vector<uint32_t> lookupOrder;
+
+        for (uint32_t i = 0; i < numStrings; ++i)
+        {
+            strings.push_back ("soul::midi::noteEventParameter_" + std::to_string (i));
+            lookupOrder.push_back (i);
+        }
+
+        std::shuffle (lookupOrder.begin(), lookupOrder.end(), random);
+
+        // Keep the total work for each size roughly the same for the hashed version
+        auto numRepeats = static_cast<int> (std::max (1u, 65536u / numStrings));
+        auto linear = runBenchmark<LinearScanDictionary> (strings, lookupOrder, std::max (1, numRepeats / 16));
+        auto hashed = runBenchmark<soul::StringDictionary> (strings, lookupOrder, numRepeats);
+
+        std::printf ("%10u %8.0f %9.0f %10.0f   %8.0f %9.0f %10.0f\n", numStrings,
+                     linear.addNanoseconds, linear.findByTextNanoseconds, linear.findByHandleNanoseconds,
+                     hashed.addNanoseconds, hashed.findByTextNanoseconds, hashed.findByHandleNanoseconds);
+    }
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Checks that the loop-invariant code motion in soul::DataflowOptimisations moves a call
+    such as sin (freq * twoPi / sampleRate) out of a run() loop when its arguments can't
+    change, including when they read state that only the init() function writes. When an
+    event handler also writes that state, the call has to stay in the loop, because the
+    handler can run during any advance(). Each processor's output is compared with the same
+    processor built at optimisation level 0.
+
+    It's built and run by the CTest project in tools/tests/CMakeLists.txt.
+*/
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../../source/modules/soul_core/soul_core.h"
+#include "TestUtilities.h"
+
+using soul_tests::expect;
+
+static constexpr const char* initialisedFrequency = R"(
+processor FixedTone
+{
+    output stream float out;
+
+    float freq;
+
+    void init()
+    {
+        freq = 220.0f * float (processor.id + 1);
+    }
+
+    void run()
+    {
+        float phase = 0;
+
+        loop
+        {
+            phase += float (sin (freq * twoPi / processor.frequency));
+            out << phase;
+            advance();
+        }
+    }
+}
+)";
+
+static constexpr const char* eventFrequency = R"(
+processor ChangingTone
+{
+    input event float frequencyIn [[ name: "Frequency", init: 220.0f ]];
+    output stream float out;
+
+    float freq = 220.0f;
+
+    event frequencyIn (float f)    { freq = f; }
+
+    void run()
+    {
+        float phase = 0;
+
+        loop
+        {
+            phase += float (sin (freq * twoPi / processor.frequency));
+            out << phase;
+            advance();
+        }
+    }
+}
+)";
+
+static constexpr uint32_t blockSize = 64;
+
+static soul::BuildSettings getBuildSettings (int optimisationLevel)
+{
+    soul::BuildSettings settings;
+    settings.sampleRate = 44100;
+    settings.maxBlockSize = blockSize;
+    settings.optimisationLevel = optimisationLevel;
+    return settings;
+}
+
+static soul::Program compile (const char* code, int optimisationLevel)
+{
+    soul::BuildBundle bundle;
+    bundle.sourceFiles.push_back ({ "test.soul", code });
+    bundle.settings = getBuildSettings (optimisationLevel);
+
+    soul::CompileMessageList messages;
+    auto program = soul::Compiler::build (messages, bundle);
+    expect (! messages.hasErrors(), "the test processor compiles: " + messages.toString());
+    return program;
+}
+
+// Returns true if the block of run() which contains the advance() also calls sin()
+static bool loopCallsSin (const soul::Program& program)
+{
+    auto run = program.getMainProcessor().functions.findRunFunction();
+
+    for (auto& b : run->blocks)
+    {
+        bool hasAdvance = false, callsSin = false;
+
+        for (auto s : b->statements)
+        {
+            if (soul::is_type<soul::heart::AdvanceClock> (*s))
+                hasAdvance = true;
+
+            if (auto fc = soul::cast<soul::heart::FunctionCall> (*s))
+                if (fc->getFunction().intrinsicType == soul::IntrinsicType::sin)
+                    callsSin = true;
+        }
+
+        if (hasAdvance)
+            return callsSin;
+    }
+
+    return false;
+}
+
+// Renders a few blocks, changing the parameter (if there is one) part-way through the second
+static std::vector<float> render (const soul::Program& program, int optimisationLevel)
+{
+    soul::CompileMessageList messages;
+    auto performer = soul::createInterpreterPerformerFactory()->createPerformer();
+    performer->load (messages, program);
+    performer->link (messages, getBuildSettings (optimisationLevel), nullptr);
+    expect (! messages.hasErrors(), "the program links: " + messages.toString());
+
+    soul::AudioMIDIWrapper wrapper (*performer);
+    wrapper.prepare (blockSize, [] (const soul::EndpointDetails&) -> uint32_t { return 1000; });
+
+    if (! wrapper.getParameterEndpoints().empty())
+        wrapper.parameterList.addAutomationPoint (0, blockSize + 21, 880.0f);
+
+    choc::buffer::ChannelArrayBuffer<float> input (0, blockSize), output (1, blockSize);
+    soul::MIDIEvent midiOut[16];
+    std::vector<float> result;
+
+    for (int block = 0; block < 4; ++block)
+    {
+        soul::MIDIEventOutputList midiOutList { midiOut, 16 };
+        wrapper.render (input.getView(), output.getView(), {}, midiOutList);
+
+        for (uint32_t i = 0; i < blockSize; ++i)
+            result.push_back (output.getSample (0, i));
+    }
+
+    return result;
+}
+
+static bool isNear (const std::vector<float>& a, const std::vector<float>& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::abs (a[i] - b[i]) > 1.0e-4f)
+            return false;
+
+    return true;
+}
+
+int main()
+{
+    {
+        auto optimised = compile (initialisedFrequency, 3);
+        expect (! loopCallsSin (optimised), "sin (freq * twoPi / processor.frequency) is hoisted when only init() writes freq");
+        expect (isNear (render (optimised, 3), render (compile (initialisedFrequency, 0), 0)), "the hoisted version renders the same output");
+    }
+
+    {
+        auto optimised = compile (eventFrequency, 3);
+        expect (loopCallsSin (optimised), "the sin() call stays in the loop when an event handler writes freq");
+        expect (isNear (render (optimised, 3), render (compile (eventFrequency, 0), 0)), "the event-driven version renders the same output");
+    }
+
+    return soul_tests::getTestResult();
+}
@@ -0,0 +1,124 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Checks how soul::MultiEndpointFIFO splits a block into chunks when its chunk timing has
+    been relaxed: event times are moved back to the grid or the start of a chunk, but a stream
+    item which doesn't start on the grid still starts a chunk at its own frame, because its
+    frames are written from the start of the chunk that delivers it.
+
+    It's built and run by the CTest project in tools/tests/CMakeLists.txt.
+*/
+
+#include <vector>
+
+#include "../../source/modules/soul_core/soul_core.h"
+#include "TestUtilities.h"
+
+using soul_tests::expect;
+
+struct DeliveredItem
+{
+    soul::EndpointHandle endpoint;
+    uint32_t chunkStart;
+    float firstValue;
+};
+
+struct ChunkList
+{
+    std::vector<uint32_t> chunkStarts;
+    std::vector<DeliveredItem> items;
+
+    // Returns the start of the chunk which delivered the nth item sent to an endpoint
+    uint32_t getChunkStart (soul::EndpointHandle endpoint, size_t index = 0) const
+    {
+        for (auto& item : items)
+            if (item.endpoint == endpoint && index-- == 0)
+                return item.chunkStart;
+
+        return 0xffffffffu;
+    }
+};
+
+static const auto eventEndpoint  = soul::EndpointHandle::create (soul::EndpointType::event, 1);
+static const auto streamEndpoint = soul::EndpointHandle::create (soul::EndpointType::stream, 2);
+
+// Sends events at frames 10 and 70, and a stream item covering frames 37 to 56
+static ChunkList splitIntoChunks (uint32_t quantisationFrames, uint32_t minimumChunkFrames)
+{
+    constexpr uint32_t blockSize = 128;
+    soul::MultiEndpointFIFO fifo;
+    fifo.reset (8192, 16);
+    fifo.setChunkTiming (quantisationFrames, minimumChunkFrames);
+
+    fifo.addInputData (eventEndpoint, 10, choc::value::createFloat32 (1.0f));
+    fifo.addInputData (streamEndpoint, 37, choc::value::createArray (20, [] (uint32_t i) { return static_cast<float> (i); }));
+    fifo.addInputData (eventEndpoint, 70, choc::value::createFloat32 (2.0f));
+
+    ChunkList result;
+    uint32_t chunkStart = 0;
+
+    fifo.iterateChunks (0, blockSize, blockSize,
+                        [&] (uint32_t)  { result.chunkStarts.push_back (chunkStart); },
+                        [&] (soul::EndpointHandle endpoint, uint64_t, const choc::value::ValueView& value)
+                        {
+                            auto firstValue = value.isArray() ? value[0].getFloat32() : value.getFloat32();
+                            result.items.push_back ({ endpoint, chunkStart, firstValue });
+                        },
+                        [&] (uint32_t numFrames)  { chunkStart += numFrames; });
+
+    return result;
+}
+
+static void testQuantisedEventsWithAStreamItemOffTheGrid()
+{
+    auto chunks = splitIntoChunks (32, 1);
+
+    expect (chunks.chunkStarts == std::vector<uint32_t> { 0, 37, 64 }, "chunks start at 0, at the stream item, and at the second event's grid line");
+    expect (chunks.getChunkStart (eventEndpoint, 0) == 0, "an event is moved back to its grid line");
+    expect (chunks.getChunkStart (eventEndpoint, 1) == 64, "a later event is moved back to its grid line");
+    expect (chunks.getChunkStart (streamEndpoint) == 37, "a stream item that isn't on the grid starts on its own frame");
+}
+
+static void testMinimumChunkLengthWithAStreamItem()
+{
+    auto chunks = splitIntoChunks (1, 64);
+
+    expect (chunks.chunkStarts == std::vector<uint32_t> { 0, 37 }, "the minimum length doesn't delay a stream item");
+    expect (chunks.getChunkStart (streamEndpoint) == 37, "a stream item starts on its own frame despite the minimum length");
+    expect (chunks.getChunkStart (eventEndpoint, 1) == 37, "an event inside a chunk is delivered at its start");
+}
+
+static void testSampleAccurateDefault()
+{
+    auto chunks = splitIntoChunks (1, 1);
+
+    expect (chunks.chunkStarts == std::vector<uint32_t> { 0, 10, 37, 70 }, "by default, every item starts a chunk");
+    expect (chunks.getChunkStart (streamEndpoint) == 37 && chunks.items[1].firstValue == 0.0f, "the stream item is delivered from its first frame");
+}
+
+int main()
+{
+    testQuantisedEventsWithAStreamItemOffTheGrid();
+    testMinimumChunkLengthWithAStreamItem();
+    testSampleAccurateDefault();
+
+    return soul_tests::getTestResult();
+}
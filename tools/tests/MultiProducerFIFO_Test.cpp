@@ -0,0 +1,152 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Checks that soul::MultiProducerFIFO delivers every item, in order for each producer,
+    when more threads are pushing than it has rings for, and that items of the largest
+    size that MultiEndpointFIFO sends can always be pushed once a ring has been drained.
+
+    It's built and run by the CTest project in tools/tests/CMakeLists.txt.
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "soul/3rdParty/choc/containers/choc_VariableSizeFIFO.h"
+#include "../../source/modules/soul_core/utilities/soul_MultiProducerFIFO.h"
+#include "TestUtilities.h"
+
+using soul_tests::expect;
+
+struct TestItem
+{
+    uint32_t producer, sequence;
+    char padding[20];
+};
+
+static void testMoreProducersThanRings()
+{
+    constexpr uint32_t numProducers = soul::MultiProducerFIFO::maxNumProducers + 4;
+    constexpr uint32_t itemsPerProducer = 100000;
+
+    soul::MultiProducerFIFO fifo;
+    fifo.reset (262144);
+
+    std::vector<uint32_t> nextExpected (numProducers, 0);
+    std::atomic<uint32_t> numProducersFinished { 0 };
+    uint64_t numReceived = 0;
+    bool anyOutOfOrder = false, anyWrongSize = false;
+
+    auto handleItem = [&] (const void* data, uint32_t size)
+    {
+        if (size != sizeof (TestItem))
+        {
+            anyWrongSize = true;
+            return;
+        }
+
+        TestItem item;
+        std::memcpy (std::addressof (item), data, sizeof (item));
+
+        if (item.producer >= numProducers || item.sequence != nextExpected[item.producer])
+            anyOutOfOrder = true;
+        else
+            ++nextExpected[item.producer];
+
+        ++numReceived;
+    };
+
+    std::thread consumer ([&]
+    {
+        while (numProducersFinished.load() < numProducers)
+            fifo.popAllAvailable (handleItem, [] {});
+
+        fifo.popAllAvailable (handleItem, [] {});
+    });
+
+    std::vector<std::thread> producers;
+
+    for (uint32_t p = 0; p < numProducers; ++p)
+    {
+        producers.emplace_back ([&, p]
+        {
+            TestItem item = {};
+            item.producer = p;
+
+            for (uint32_t i = 0; i < itemsPerProducer; ++i)
+            {
+                item.sequence = i;
+
+                while (! fifo.push (std::addressof (item), sizeof (item)))
+                    std::this_thread::yield();
+            }
+
+            ++numProducersFinished;
+        });
+    }
+
+    for (auto& t : producers)
+        t.join();
+
+    consumer.join();
+
+    expect (! anyWrongSize, "items have the size they were pushed with");
+    expect (! anyOutOfOrder, "items from each producer arrive in order, with none missing");
+    expect (numReceived == static_cast<uint64_t> (numProducers) * itemsPerProducer, "every item is received");
+}
+
+static void testLargestItemsAlwaysFit()
+{
+    constexpr uint32_t largestItemSize = 4096;
+
+    soul::MultiProducerFIFO fifo;
+    fifo.reset (0);
+
+    std::vector<char> item (largestItemSize, 1);
+    bool allPushed = true;
+
+    // Items of a few different sizes move the write position around the ring, and after each
+    // one has been drained, the largest size must still fit
+    for (uint32_t size : { 2068u, 3000u, 1000u, largestItemSize, 37u, 2500u, 4000u })
+    {
+        for (int repeat = 0; repeat < 20; ++repeat)
+        {
+            allPushed = fifo.push (item.data(), size) && allPushed;
+            fifo.popAllAvailable ([] (const void*, uint32_t) {}, [] {});
+            allPushed = fifo.push (item.data(), largestItemSize) && allPushed;
+            fifo.popAllAvailable ([] (const void*, uint32_t) {}, [] {});
+        }
+    }
+
+    expect (allPushed, "an item of the largest size can always be pushed into a drained ring");
+}
+
+int main()
+{
+    testMoreProducersThanRings();
+    testLargestItemsAlwaysFit();
+
+    return soul_tests::getTestResult();
+}
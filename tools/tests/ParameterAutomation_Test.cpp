@@ -0,0 +1,206 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Checks the sample-accurate automation in soul::ParameterStateList, by rendering a
+    processor that copies a ramped stream parameter and a stepped value parameter to its
+    outputs through an AudioMIDIWrapper, and comparing the output with the points that
+    were added. It covers ramps and steps, ramps whose segments cross a block boundary,
+    points that arrive after their frame has been rendered, and more points than the
+    pending list can hold, so that some of them have to wait in the FIFO.
+
+    It's built and run by the CTest project in tools/tests/CMakeLists.txt.
+*/
+
+#include <cmath>
+#include <vector>
+
+#include "../../source/modules/soul_core/soul_core.h"
+#include "TestUtilities.h"
+
+using soul_tests::expect;
+
+static constexpr const char* testProcessor = R"(
+processor AutomationEcho
+{
+    input stream float ramped [[ name: "Ramped" ]];
+    input value float stepped [[ name: "Stepped" ]];
+    output stream float rampedOut, steppedOut;
+
+    void run()
+    {
+        loop
+        {
+            rampedOut << ramped;
+            steppedOut << stepped;
+            advance();
+        }
+    }
+}
+)";
+
+struct AutomationTestPlayer
+{
+    AutomationTestPlayer()
+    {
+        soul::BuildBundle bundle;
+        bundle.sourceFiles.push_back ({ "automation.soul", testProcessor });
+        bundle.settings.sampleRate = 44100;
+        bundle.settings.maxBlockSize = blockSize;
+
+        soul::CompileMessageList messages;
+        auto program = soul::Compiler::build (messages, bundle);
+
+        performer = soul::createInterpreterPerformerFactory()->createPerformer();
+        performer->load (messages, program);
+        performer->link (messages, bundle.settings, nullptr);
+        expect (! messages.hasErrors(), "the test processor compiles");
+
+        wrapper = std::make_unique<soul::AudioMIDIWrapper> (*performer);
+        wrapper->prepare (blockSize, [] (const soul::EndpointDetails&) -> uint32_t { return 1000; });
+
+        for (auto& p : wrapper->getParameterEndpoints())
+            (p.name == "ramped" ? rampedIndex : steppedIndex) = index++;
+    }
+
+    // Renders the given number of blocks, appending the output of each parameter
+    void render (int numBlocks)
+    {
+        choc::buffer::ChannelArrayBuffer<float> input (0, blockSize), output (2, blockSize);
+        soul::MIDIEvent midiOut[16];
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            soul::MIDIEventOutputList midiOutList { midiOut, 16 };
+            wrapper->render (input.getView(), output.getView(), {}, midiOutList);
+
+            for (uint32_t frame = 0; frame < blockSize; ++frame)
+            {
+                rampedOutput.push_back (output.getSample (0, frame));
+                steppedOutput.push_back (output.getSample (1, frame));
+            }
+        }
+    }
+
+    bool addPoint (uint32_t parameterIndex, uint64_t frame, float value)
+    {
+        return wrapper->parameterList.addAutomationPoint (parameterIndex, frame, value);
+    }
+
+    static constexpr uint32_t blockSize = 64;
+
+    std::unique_ptr<soul::Performer> performer;
+    std::unique_ptr<soul::AudioMIDIWrapper> wrapper;
+    uint32_t index = 0, rampedIndex = 0, steppedIndex = 0;
+    std::vector<float> rampedOutput, steppedOutput;
+};
+
+static bool isNear (float a, float b)
+{
+    return std::abs (a - b) < 1.0e-4f;
+}
+
+static bool isRamp (const std::vector<float>& samples, size_t start, size_t end, float startValue, float endValue)
+{
+    for (auto i = start; i <= end; ++i)
+    {
+        auto expected = startValue + (endValue - startValue) * static_cast<float> (i + 1 - start) / static_cast<float> (end + 1 - start);
+
+        if (! isNear (samples[i], expected))
+            return false;
+    }
+
+    return true;
+}
+
+static void testRampedAndSteppedPoints()
+{
+    AutomationTestPlayer player;
+
+    // The ramp to frame 9 is inside the first block, and the ramp from there to frame 99
+    // crosses into the second one
+    player.addPoint (player.rampedIndex, 9, 1.0f);
+    player.addPoint (player.rampedIndex, 99, 4.0f);
+    player.addPoint (player.steppedIndex, 20, 5.0f);
+    player.addPoint (player.steppedIndex, 70, 7.0f);
+    player.render (3);
+
+    auto& ramped = player.rampedOutput;
+    auto& stepped = player.steppedOutput;
+
+    expect (isRamp (ramped, 0, 9, 0.0f, 1.0f), "a stream ramps to its first point from the start of the block");
+    expect (isRamp (ramped, 10, 99, 1.0f, 4.0f), "a stream ramp that crosses a block boundary lands on its point");
+    expect (isNear (ramped[150], 4.0f), "a stream holds its last point's value");
+
+    expect (isNear (stepped[19], 0.0f) && isNear (stepped[20], 5.0f), "a value steps on its point's frame");
+    expect (isNear (stepped[69], 5.0f) && isNear (stepped[70], 7.0f), "a value steps on a point in a later block");
+}
+
+static void testLatePoints()
+{
+    AutomationTestPlayer player;
+    player.render (2);
+
+    // This frame has already been rendered, so the point should apply at the start of the next block
+    player.addPoint (player.steppedIndex, 10, 3.0f);
+    player.render (1);
+
+    auto& stepped = player.steppedOutput;
+    expect (isNear (stepped[127], 0.0f) && isNear (stepped[128], 3.0f), "a late point applies at the start of the next block");
+}
+
+static void testMorePointsThanThePendingListHolds()
+{
+    constexpr auto maxPoints = soul::ParameterStateList::maxNumAutomationPoints;
+    constexpr uint64_t firstFrame = 1000;
+
+    AutomationTestPlayer player;
+    bool allAdded = true;
+
+    // The first batch fills the pending list, so the second batch has to wait in the FIFO,
+    // and is only read once enough of the first batch has been sent
+    for (uint64_t i = 0; i < maxPoints; ++i)
+        allAdded = player.addPoint (player.steppedIndex, firstFrame + i, static_cast<float> (i)) && allAdded;
+
+    player.render (1);
+
+    for (uint64_t i = maxPoints; i < maxPoints + 200; ++i)
+        allAdded = player.addPoint (player.steppedIndex, firstFrame + i, static_cast<float> (i)) && allAdded;
+
+    expect (allAdded, "every point fits in the FIFO");
+
+    player.render (static_cast<int> ((firstFrame + maxPoints + 300) / AutomationTestPlayer::blockSize));
+
+    bool allOnTime = true;
+
+    for (uint64_t i = 0; i < maxPoints + 200; ++i)
+        allOnTime = isNear (player.steppedOutput[firstFrame + i], static_cast<float> (i)) && allOnTime;
+
+    expect (allOnTime, "points that waited in the FIFO still apply on their own frames");
+}
+
+int main()
+{
+    testRampedAndSteppedPoints();
+    testLatePoints();
+    testMorePointsThanThePendingListHolds();
+
+    return soul_tests::getTestResult();
+}
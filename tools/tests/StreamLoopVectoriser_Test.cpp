@@ -0,0 +1,242 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    Checks that soul::StreamLoopVectoriser emits a vectorised run function for processors
+    with a value or event input, and for loops which call intrinsics such as tanh(), clamp(),
+    min() and max(). Each processor is then rendered through an AudioMIDIWrapper by both
+    engines, with its gain changed in the middle of a block, and the output is compared with
+    the same processor built at optimisation level 0, where nothing is vectorised.
+
+    It's built and run by the CTest project in tools/tests/CMakeLists.txt.
+*/
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../../source/modules/soul_core/soul_core.h"
+#include "TestUtilities.h"
+
+using soul_tests::expect;
+
+struct TestProcessor
+{
+    const char* name;
+    const char* code;
+};
+
+static const TestProcessor testProcessors[] =
+{
+    { "a gain stage with a value input", R"(
+processor ValueGain
+{
+    input stream float in;
+    input value float gain [[ name: "Gain", init: 1.0f ]];
+    output stream float out;
+
+    void run()
+    {
+        loop
+        {
+            out << in * gain;
+            advance();
+        }
+    }
+}
+)" },
+
+    { "a gain stage with an event input", R"(
+processor EventGain
+{
+    input stream float in;
+    input event float gain [[ name: "Gain", init: 1.0f ]];
+    output stream float out;
+
+    float currentGain = 1.0f;
+
+    event gain (float newGain)    { currentGain = newGain; }
+
+    void run()
+    {
+        loop
+        {
+            out << in * currentGain;
+            advance();
+        }
+    }
+}
+)" },
+
+    { "a tanh waveshaper", R"(
+processor TanhShaper
+{
+    input stream float in;
+    input value float gain [[ name: "Gain", init: 1.0f ]];
+    output stream float out;
+
+    void run()
+    {
+        let drive = 3.0f;
+
+        loop
+        {
+            out << tanh (in * gain * drive);
+            advance();
+        }
+    }
+}
+)" },
+
+    { "a clamp() limiter", R"(
+processor ClampLimiter
+{
+    input stream float in;
+    input value float gain [[ name: "Gain", init: 1.0f ]];
+    output stream float out;
+
+    void run()
+    {
+        loop
+        {
+            out << clamp (in * gain, -0.5f, 0.5f);
+            advance();
+        }
+    }
+}
+)" },
+
+    { "a min() and max() limiter", R"(
+processor MinMaxLimiter
+{
+    input stream float in;
+    input event float gain [[ name: "Gain", init: 1.0f ]];
+    output stream float out;
+
+    float currentGain = 1.0f;
+
+    event gain (float newGain)    { currentGain = newGain; }
+
+    void run()
+    {
+        loop
+        {
+            out << max (min (in * currentGain, 0.5f), -0.25f);
+            advance();
+        }
+    }
+}
+)" }
+};
+
+static constexpr uint32_t blockSize = 64;
+static constexpr int numBlocks = 4;
+
+static soul::BuildSettings getBuildSettings (int optimisationLevel)
+{
+    soul::BuildSettings settings;
+    settings.sampleRate = 44100;
+    settings.maxBlockSize = blockSize;
+    settings.optimisationLevel = optimisationLevel;
+    return settings;
+}
+
+static soul::Program compile (const TestProcessor& processor, int optimisationLevel)
+{
+    soul::BuildBundle bundle;
+    bundle.sourceFiles.push_back ({ "test.soul", processor.code });
+    bundle.settings = getBuildSettings (optimisationLevel);
+
+    soul::CompileMessageList messages;
+    auto program = soul::Compiler::build (messages, bundle);
+    expect (! messages.hasErrors(), std::string (processor.name) + " compiles: " + messages.toString());
+    return program;
+}
+
+static bool hasVectorisedRunFunction (const soul::Program& program)
+{
+    return ! program.isEmpty()
+            && program.getMainProcessor().functions.find (soul::heart::getVectorisedRunFunctionName()) != nullptr;
+}
+
+// Renders a ramp through the processor, changing its gain part-way through the second block
+static std::vector<float> render (soul::PerformerFactory& factory, const soul::Program& program, int optimisationLevel)
+{
+    soul::CompileMessageList messages;
+    auto performer = factory.createPerformer();
+    performer->load (messages, program);
+    performer->link (messages, getBuildSettings (optimisationLevel), nullptr);
+    expect (! messages.hasErrors(), "the program links: " + messages.toString());
+
+    soul::AudioMIDIWrapper wrapper (*performer);
+    wrapper.prepare (blockSize, [] (const soul::EndpointDetails&) -> uint32_t { return 1000; });
+    wrapper.parameterList.addAutomationPoint (0, blockSize + 21, 2.5f);
+
+    choc::buffer::ChannelArrayBuffer<float> input (1, blockSize), output (1, blockSize);
+    soul::MIDIEvent midiOut[16];
+    std::vector<float> result;
+
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        for (uint32_t i = 0; i < blockSize; ++i)
+            input.getSample (0, i) = static_cast<float> (block * static_cast<int> (blockSize) + static_cast<int> (i)) / 200.0f - 0.6f;
+
+        soul::MIDIEventOutputList midiOutList { midiOut, 16 };
+        wrapper.render (input.getView(), output.getView(), {}, midiOutList);
+
+        for (uint32_t i = 0; i < blockSize; ++i)
+            result.push_back (output.getSample (0, i));
+    }
+
+    return result;
+}
+
+static bool isNear (const std::vector<float>& a, const std::vector<float>& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::abs (a[i] - b[i]) > 1.0e-5f)
+            return false;
+
+    return true;
+}
+
+int main()
+{
+    auto interpreter = soul::createInterpreterPerformerFactory();
+    auto bytecode = soul::createBytecodePerformerFactory();
+
+    for (auto& processor : testProcessors)
+    {
+        auto vectorised = compile (processor, 3);
+        auto reference = compile (processor, 0);
+
+        expect (hasVectorisedRunFunction (vectorised), std::string ("the run() loop is vectorised for ") + processor.name);
+        expect (! hasVectorisedRunFunction (reference), std::string ("nothing is vectorised at level 0 for ") + processor.name);
+
+        auto expected = render (*interpreter, reference, 0);
+        expect (isNear (render (*interpreter, vectorised, 3), expected), std::string ("the interpreter's vectorised output matches for ") + processor.name);
+        expect (isNear (render (*bytecode, vectorised, 3), expected), std::string ("the bytecode engine's vectorised output matches for ") + processor.name);
+    }
+
+    return soul_tests::getTestResult();
+}
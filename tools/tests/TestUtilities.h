@@ -0,0 +1,60 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    The checks shared by the test programs in this folder. Each test calls expect() for
+    everything it checks, and returns getTestResult() from main(), so that CTest sees a
+    non-zero exit code if anything failed.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+namespace soul_tests
+{
+
+inline int& getNumFailures()
+{
+    static int numFailures = 0;
+    return numFailures;
+}
+
+/** Prints the description and counts a failure if the condition is false. */
+inline void expect (bool condition, const std::string& description)
+{
+    if (! condition)
+    {
+        std::printf ("FAILED: %s\n", description.c_str());
+        ++getNumFailures();
+    }
+}
+
+/** Prints a summary if nothing failed, and returns the exit code for main(). */
+inline int getTestResult()
+{
+    if (getNumFailures() == 0)
+        std::printf ("All tests passed\n");
+
+    return getNumFailures() == 0 ? 0 : 1;
+}
+
+} // namespace soul_tests